@@ -0,0 +1,92 @@
+//***************************************************************************************
+// Arena.cpp
+//***************************************************************************************
+
+#include "Arena.h"
+#include <algorithm>
+#include <new>
+
+const std::size_t Arena::DefaultBlockSize;
+
+Arena::Arena(std::size_t blockSize)
+	: mBlockSize(std::max<std::size_t>(blockSize, 1))
+{
+}
+
+Arena::~Arena()
+{
+	FreeBlocks();
+}
+
+void* Arena::Allocate(std::size_t bytes, std::size_t alignment)
+{
+	assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+
+	std::size_t start = 0;
+	if (!mBlocks.empty())
+	{
+		const std::uintptr_t base = reinterpret_cast<std::uintptr_t>(mBlocks.back().Data);
+		start = (std::size_t)(((base + mOffset + alignment - 1) & ~(std::uintptr_t)(alignment - 1)) - base);
+	}
+
+	// What does not fit starts a new block; the rest of the old one goes unused.
+	if (mBlocks.empty() || start > mBlocks.back().Size || bytes > mBlocks.back().Size - start)
+	{
+		if (bytes > ~std::size_t(0) - alignment)
+			throw std::bad_alloc();
+		AddBlock(std::max(mBlockSize, bytes + alignment - 1));
+
+		const std::uintptr_t base = reinterpret_cast<std::uintptr_t>(mBlocks.back().Data);
+		start = (std::size_t)(((base + alignment - 1) & ~(std::uintptr_t)(alignment - 1)) - base);
+	}
+
+	mBytesUsed += bytes + (start - std::min(start, mOffset));
+	mOffset = start + bytes;
+	mPeakBytesUsed = std::max(mPeakBytesUsed, mBytesUsed);
+	++mAllocations;
+	++mTotalAllocations;
+	return mBlocks.back().Data + start;
+}
+
+void Arena::Reset()
+{
+	// Next time everything fits in one block.
+	if (mBlocks.size() > 1)
+	{
+		const std::size_t size = mCapacity;
+		FreeBlocks();
+		AddBlock(size);
+	}
+
+	mOffset = 0;
+	mAllocations = 0;
+	mBytesUsed = 0;
+}
+
+void Arena::Release()
+{
+	FreeBlocks();
+	mBlocks.shrink_to_fit();
+	mOffset = 0;
+	mAllocations = 0;
+	mBytesUsed = 0;
+}
+
+void Arena::AddBlock(std::size_t size)
+{
+	// Reserve first so a failed push_back cannot leak the block.
+	mBlocks.reserve(mBlocks.size() + 1);
+	Block block = { static_cast<unsigned char*>(::operator new(size)), size };
+	mBlocks.push_back(block);
+	mOffset = 0;
+	mCapacity += size;
+	++mHeapAllocations;
+}
+
+void Arena::FreeBlocks()
+{
+	for (const Block& block : mBlocks)
+		::operator delete(block.Data);
+	mBlocks.clear();
+	mCapacity = 0;
+}
@@ -0,0 +1,125 @@
+//***************************************************************************************
+// Arena.h
+//
+// Bump allocation from large blocks.  Allocate hands out the next bytes of the current
+// block, and Reset makes every block free again at once; nothing is freed on its own.
+// That suits memory whose lifetime is a phase of the program: the scratch lists of one
+// frame, or the temporaries of building a scene.
+//
+// A Reset after a phase that spilled into several blocks replaces them with a single
+// block as large as all of them together, so once an arena has seen its largest phase
+// it takes no more memory from the heap.  Release gives the blocks back.
+//
+// ArenaAllocator lets standard containers allocate from an arena.  Freeing through it
+// does nothing, so a container that grows leaves its old storage behind until the
+// Reset; reserve what is known up front.  A container must not be used after its
+// arena is Reset.
+//***************************************************************************************
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+class Arena
+{
+public:
+	static const std::size_t DefaultBlockSize = 64 * 1024;
+
+	explicit Arena(std::size_t blockSize = DefaultBlockSize);
+	~Arena();
+	Arena(const Arena& rhs) = delete;
+	Arena& operator=(const Arena& rhs) = delete;
+
+	// Uninitialized memory, aligned to alignment, which must be a power of two.  Throws
+	// std::bad_alloc when a new block cannot be had, like operator new.
+	void* Allocate(std::size_t bytes, std::size_t alignment = alignof(std::max_align_t));
+
+	// Uninitialized room for count objects of type T.
+	template<typename T>
+	T* AllocateArray(std::size_t count);
+
+	// Everything allocated so far is free again.  Keeps the memory.
+	void Reset();
+	// Reset and frees every block.
+	void Release();
+
+	// Since the last Reset.
+	std::size_t Allocations()const { return mAllocations; }
+	std::size_t BytesUsed()const { return mBytesUsed; }
+
+	// Over the arena's life.  HeapAllocations counts the blocks taken from the heap,
+	// which is what a steady state keeps at its current value.
+	std::uint64_t TotalAllocations()const { return mTotalAllocations; }
+	std::uint64_t HeapAllocations()const { return mHeapAllocations; }
+	std::size_t PeakBytesUsed()const { return mPeakBytesUsed; }
+
+	// Bytes in the blocks held.
+	std::size_t Capacity()const { return mCapacity; }
+
+private:
+	struct Block
+	{
+		unsigned char* Data;
+		std::size_t Size;
+	};
+
+	void AddBlock(std::size_t size);
+	void FreeBlocks();
+
+	std::size_t mBlockSize;
+
+	// Allocations come from the last block; the others are full.
+	std::vector<Block> mBlocks;
+	std::size_t mOffset = 0;
+	std::size_t mCapacity = 0;
+
+	std::size_t mAllocations = 0;
+	std::size_t mBytesUsed = 0;
+	std::uint64_t mTotalAllocations = 0;
+	std::uint64_t mHeapAllocations = 0;
+	std::size_t mPeakBytesUsed = 0;
+};
+
+template<typename T>
+T* Arena::AllocateArray(std::size_t count)
+{
+	assert(count <= ~std::size_t(0) / sizeof(T));
+	return static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+}
+
+// A standard allocator drawing from an arena.  Containers sharing one arena can be
+// swapped and assigned; the arena goes along with the contents.
+template<typename T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+	typedef std::true_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+	ArenaAllocator(Arena& arena) : mArena(&arena) { }
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U>& rhs) : mArena(rhs.mArena) { }
+
+	T* allocate(std::size_t count) { return mArena->AllocateArray<T>(count); }
+	void deallocate(T*, std::size_t) { }
+
+	template<typename U>
+	bool operator==(const ArenaAllocator<U>& rhs)const { return mArena == rhs.mArena; }
+	template<typename U>
+	bool operator!=(const ArenaAllocator<U>& rhs)const { return mArena != rhs.mArena; }
+
+private:
+	template<typename U>
+	friend class ArenaAllocator;
+
+	Arena* mArena;
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
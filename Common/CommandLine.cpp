@@ -0,0 +1,54 @@
+//***************************************************************************************
+// CommandLine.cpp
+//***************************************************************************************
+
+#include "CommandLine.h"
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+const char* FindCommandLineOption(const char* cmdLine, const char* name)
+{
+	if (cmdLine == nullptr || name == nullptr || *name == '\0')
+		return nullptr;
+
+	const std::size_t length = std::strlen(name);
+	for (const char* arg = std::strstr(cmdLine, name); arg != nullptr; arg = std::strstr(arg + 1, name))
+	{
+		const bool wordStart = arg == cmdLine || std::isspace((unsigned char)arg[-1]);
+		const bool wordEnd = arg[length] == '\0' || std::isspace((unsigned char)arg[length]);
+		if (wordStart && wordEnd)
+			return arg + length;
+	}
+	return nullptr;
+}
+
+int GetCommandLineInt(const char* cmdLine, const char* name, int defaultValue)
+{
+	const char* arg = FindCommandLineOption(cmdLine, name);
+	if (arg == nullptr)
+		return defaultValue;
+
+	char* end = nullptr;
+	const long value = std::strtol(arg, &end, 10);
+	if (end == arg)
+		return defaultValue;
+
+	return value < INT_MIN ? INT_MIN : value > INT_MAX ? INT_MAX : (int)value;
+}
+
+std::string GetCommandLineString(const char* cmdLine, const char* name, const std::string& defaultValue)
+{
+	const char* arg = FindCommandLineOption(cmdLine, name);
+	if (arg == nullptr)
+		return defaultValue;
+
+	std::istringstream stream(arg);
+	std::string value;
+	if (!(stream >> value))
+		return defaultValue;
+
+	return value;
+}
@@ -0,0 +1,21 @@
+//***************************************************************************************
+// CommandLine.h
+//
+// Options on the single command line string WinMain receives, each a word starting
+// with '-' followed by its value: "-maze 200 -mazeseed 7".  Options match as whole
+// words, so -maze does not find -mazeseed, and the order they are given in does not
+// matter.
+//***************************************************************************************
+
+#pragma once
+
+#include <string>
+
+// The text after option name on the command line, or nullptr if it is not there.
+const char* FindCommandLineOption(const char* cmdLine, const char* name);
+
+// Returns the integer that follows name on the command line, or defaultValue.
+int GetCommandLineInt(const char* cmdLine, const char* name, int defaultValue);
+
+// Returns the word that follows name on the command line, or defaultValue.
+std::string GetCommandLineString(const char* cmdLine, const char* name, const std::string& defaultValue);
@@ -0,0 +1,179 @@
+//***************************************************************************************
+// CpuProfiler.cpp
+//***************************************************************************************
+
+#include "CpuProfiler.h"
+#include "GameTimer.h"
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+	struct ProfileEvent
+	{
+		const char* Name;
+		long long Start;
+		long long End;
+	};
+
+	// Events recorded by one thread.  Only the owning thread writes; it publishes
+	// each event by bumping Count, so the exporter can read without locking.
+	struct ThreadBuffer
+	{
+		static const size_t Capacity = 1 << 16;
+
+		std::vector<ProfileEvent> Events = std::vector<ProfileEvent>(Capacity);
+		std::atomic<size_t> Count{ 0 };
+		std::atomic<size_t> Dropped{ 0 };
+		const char* Name = nullptr;
+		int ThreadId = 0;
+	};
+
+	std::atomic<bool> gCapturing{ false };
+
+	// Buffers are owned here rather than by the thread so they outlive worker
+	// threads that exit before the trace is written.
+	std::mutex gBuffersMutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> gBuffers;
+
+	thread_local ThreadBuffer* tBuffer = nullptr;
+
+	ThreadBuffer& GetThreadBuffer()
+	{
+		if (tBuffer == nullptr)
+		{
+			// Once per thread; the only lock on the recording path.
+			std::lock_guard<std::mutex> lock(gBuffersMutex);
+			gBuffers.push_back(std::make_unique<ThreadBuffer>());
+			tBuffer = gBuffers.back().get();
+			tBuffer->ThreadId = (int)gBuffers.size();
+		}
+		return *tBuffer;
+	}
+
+	void WriteJsonString(std::ofstream& fout, const char* s)
+	{
+		fout << '"';
+		for (; *s != '\0'; ++s)
+		{
+			if (*s == '"' || *s == '\\')
+				fout << '\\';
+			fout << *s;
+		}
+		fout << '"';
+	}
+}
+
+void CpuProfiler::BeginCapture()
+{
+	std::lock_guard<std::mutex> lock(gBuffersMutex);
+	for (auto& buffer : gBuffers)
+	{
+		buffer->Count.store(0, std::memory_order_relaxed);
+		buffer->Dropped.store(0, std::memory_order_relaxed);
+	}
+
+	gCapturing.store(true, std::memory_order_release);
+}
+
+void CpuProfiler::EndCapture()
+{
+	gCapturing.store(false, std::memory_order_release);
+}
+
+bool CpuProfiler::IsCapturing()
+{
+	return gCapturing.load(std::memory_order_relaxed);
+}
+
+void CpuProfiler::SetThreadName(const char* name)
+{
+	GetThreadBuffer().Name = name;
+}
+
+void CpuProfiler::Record(const char* name, long long startTicks, long long endTicks)
+{
+	ThreadBuffer& buffer = GetThreadBuffer();
+
+	size_t index = buffer.Count.load(std::memory_order_relaxed);
+	if (index >= ThreadBuffer::Capacity)
+	{
+		buffer.Dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	buffer.Events[index] = { name, startTicks, endTicks };
+	buffer.Count.store(index + 1, std::memory_order_release);
+}
+
+bool CpuProfiler::WriteChromeTrace(const std::string& filename)
+{
+	std::ofstream fout(filename);
+	if (!fout)
+		return false;
+
+	std::lock_guard<std::mutex> lock(gBuffersMutex);
+
+	// Make timestamps relative to the first event so the numbers stay readable.
+	long long origin = 0;
+	bool haveOrigin = false;
+	for (auto& buffer : gBuffers)
+	{
+		size_t count = buffer->Count.load(std::memory_order_acquire);
+		for (size_t i = 0; i < count; ++i)
+		{
+			if (!haveOrigin || buffer->Events[i].Start < origin)
+				origin = buffer->Events[i].Start;
+			haveOrigin = true;
+		}
+	}
+
+	fout << "{\"traceEvents\":[\n";
+	bool first = true;
+	for (auto& buffer : gBuffers)
+	{
+		size_t count = buffer->Count.load(std::memory_order_acquire);
+		if (count == 0)
+			continue;
+
+		if (buffer->Name != nullptr)
+		{
+			fout << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+				<< buffer->ThreadId << ",\"args\":{\"name\":";
+			WriteJsonString(fout, buffer->Name);
+			fout << "}}";
+			first = false;
+		}
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			const ProfileEvent& e = buffer->Events[i];
+
+			fout << (first ? "" : ",\n") << "{\"name\":";
+			WriteJsonString(fout, e.Name);
+			fout << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->ThreadId
+				<< ",\"ts\":" << GameTimer::TicksToMs(e.Start - origin) * 1000.0
+				<< ",\"dur\":" << GameTimer::TicksToMs(e.End - e.Start) * 1000.0 << "}";
+			first = false;
+		}
+	}
+	fout << "\n]}\n";
+
+	return (bool)fout;
+}
+
+ProfileScope::ProfileScope(const char* name)
+	: mName(name)
+{
+	if (CpuProfiler::IsCapturing())
+		mStart = GameTimer::Ticks();
+}
+
+ProfileScope::~ProfileScope()
+{
+	if (mStart != 0)
+		CpuProfiler::Record(mName, mStart, GameTimer::Ticks());
+}
@@ -0,0 +1,61 @@
+//***************************************************************************************
+// CpuProfiler.h
+//
+// Lightweight scoped CPU profiler.  PROFILE_SCOPE("name") records the time spent in
+// the enclosing scope on the calling thread.  Each thread appends to its own buffer,
+// so recording takes no locks; the capture is written out in Chrome trace_event JSON
+// (load it in chrome://tracing or https://ui.perfetto.dev).
+//
+// Timestamps come from GameTimer::Ticks so traces line up with frame timings.  Each
+// thread keeps a fixed number of events; once full, further events are dropped.
+// Build with CPU_PROFILER_ENABLED=0 to compile every scope out completely.
+//***************************************************************************************
+
+#pragma once
+
+#include <string>
+
+#ifndef CPU_PROFILER_ENABLED
+#define CPU_PROFILER_ENABLED 1
+#endif
+
+class CpuProfiler
+{
+public:
+	// Scopes are only recorded between BeginCapture and EndCapture.
+	static void BeginCapture();
+	static void EndCapture();
+	static bool IsCapturing();
+
+	// Names the calling thread in the trace.  The string must outlive the capture.
+	static void SetThreadName(const char* name);
+
+	// Writes every recorded event as Chrome trace_event JSON.  Call while no
+	// thread is recording, e.g. after EndCapture.
+	static bool WriteChromeTrace(const std::string& filename);
+
+	// Records one complete event on the calling thread's buffer.
+	static void Record(const char* name, long long startTicks, long long endTicks);
+};
+
+class ProfileScope
+{
+public:
+	explicit ProfileScope(const char* name);
+	~ProfileScope();
+
+	ProfileScope(const ProfileScope& rhs) = delete;
+	ProfileScope& operator=(const ProfileScope& rhs) = delete;
+
+private:
+	const char* mName;
+	long long mStart = 0;
+};
+
+#if CPU_PROFILER_ENABLED
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#endif
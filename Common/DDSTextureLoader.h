@@ -24,7 +24,9 @@
 
 #include <wrl.h>
 #include <d3d11_1.h>
+#include <vector>
 #include "d3dx12.h"
+#include "MappedFile.h"
 
 #pragma warning(push)
 #pragma warning(disable : 4005)
@@ -92,6 +94,18 @@ namespace DirectX
 		                               _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr
 		                               );
 
+	// Maps and parses a DDS file without creating any D3D objects, so it can run on a
+	// worker thread.  subresources point into the ddsData mapping, so the texel data
+	// is only copied once, straight into the upload heap.  Only 2D textures and
+	// texture arrays are supported.
+	HRESULT LoadDDSTextureFromFile12(_In_z_ const wchar_t* szFileName,
+		                             _Out_ MappedFile& ddsData,
+		                             _Out_ D3D12_RESOURCE_DESC& texDesc,
+		                             _Out_ std::vector<D3D12_SUBRESOURCE_DATA>& subresources,
+		                             _In_ size_t maxsize = 0,
+		                             _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr
+		                             );
+
     // Standard version with optional auto-gen mipmap support
     HRESULT CreateDDSTextureFromMemory( _In_ ID3D11Device* d3dDevice,
                                         _In_opt_ ID3D11DeviceContext* d3dContext,
@@ -0,0 +1,686 @@
+//***************************************************************************************
+// DdsImage.cpp
+//
+// The validation rules and format tables follow DDSTextureLoader, which previously did
+// this work itself.
+//***************************************************************************************
+
+#include "DdsImage.h"
+#include <algorithm>
+#include <cstring>
+
+static_assert(sizeof(DdsPixelFormat) == 32, "DDS pixel format size mismatch");
+static_assert(sizeof(DdsHeader) == 124, "DDS header size mismatch");
+static_assert(sizeof(DdsHeaderDxt10) == 20, "DDS DX10 header size mismatch");
+
+namespace
+{
+	const std::uint32_t DdsMagic = 0x20534444; // "DDS "
+
+	// DDS_PIXELFORMAT flags.
+	const std::uint32_t DdsFourCC = 0x00000004;
+	const std::uint32_t DdsRgb = 0x00000040;
+	const std::uint32_t DdsLuminance = 0x00020000;
+	const std::uint32_t DdsAlpha = 0x00000002;
+
+	// DDS_HEADER flags and caps2.
+	const std::uint32_t DdsHeaderFlagsVolume = 0x00800000;
+	const std::uint32_t DdsHeight = 0x00000002;
+	const std::uint32_t DdsCubemap = 0x00000200;
+	const std::uint32_t DdsCubemapAllFaces = 0x0000fe00;
+
+	// DDS_HEADER_DXT10 miscFlag and miscFlags2.
+	const std::uint32_t DdsResourceMiscTextureCube = 0x4;
+	const std::uint32_t DdsMiscFlags2AlphaModeMask = 0x7;
+
+	// D3D12_REQ_* limits.  Headers asking for more than the hardware supports are
+	// rejected rather than trusted.
+	const std::uint64_t MaxMipLevels = 15;
+	const std::uint64_t MaxTexture1DWidth = 16384;
+	const std::uint64_t MaxTexture1DArraySize = 2048;
+	const std::uint64_t MaxTexture2DDimension = 16384;
+	const std::uint64_t MaxTexture2DArraySize = 2048;
+	const std::uint64_t MaxTextureCubeDimension = 16384;
+	const std::uint64_t MaxTexture3DDimension = 2048;
+
+	constexpr std::uint32_t MakeFourCC(char ch0, char ch1, char ch2, char ch3)
+	{
+		return (std::uint32_t)(std::uint8_t)ch0 | ((std::uint32_t)(std::uint8_t)ch1 << 8) |
+			((std::uint32_t)(std::uint8_t)ch2 << 16) | ((std::uint32_t)(std::uint8_t)ch3 << 24);
+	}
+
+	bool IsBitMask(const DdsPixelFormat& ddpf, std::uint32_t r, std::uint32_t g, std::uint32_t b, std::uint32_t a)
+	{
+		return ddpf.RBitMask == r && ddpf.GBitMask == g && ddpf.BBitMask == b && ddpf.ABitMask == a;
+	}
+
+	// GetSurfaceInfo in 64-bit arithmetic, so the largest legal surfaces cannot
+	// overflow in a 32-bit build.
+	void SurfaceInfo(std::uint64_t width, std::uint64_t height, DdsFormat format,
+		std::uint64_t& numBytes, std::uint64_t& rowBytes, std::uint64_t& numRows)
+	{
+		bool bc = false;
+		bool packed = false;
+		bool planar = false;
+		std::uint64_t bpe = 0;
+
+		switch (format)
+		{
+		case DdsFormat::BC1_TYPELESS:
+		case DdsFormat::BC1_UNORM:
+		case DdsFormat::BC1_UNORM_SRGB:
+		case DdsFormat::BC4_TYPELESS:
+		case DdsFormat::BC4_UNORM:
+		case DdsFormat::BC4_SNORM:
+			bc = true;
+			bpe = 8;
+			break;
+
+		case DdsFormat::BC2_TYPELESS:
+		case DdsFormat::BC2_UNORM:
+		case DdsFormat::BC2_UNORM_SRGB:
+		case DdsFormat::BC3_TYPELESS:
+		case DdsFormat::BC3_UNORM:
+		case DdsFormat::BC3_UNORM_SRGB:
+		case DdsFormat::BC5_TYPELESS:
+		case DdsFormat::BC5_UNORM:
+		case DdsFormat::BC5_SNORM:
+		case DdsFormat::BC6H_TYPELESS:
+		case DdsFormat::BC6H_UF16:
+		case DdsFormat::BC6H_SF16:
+		case DdsFormat::BC7_TYPELESS:
+		case DdsFormat::BC7_UNORM:
+		case DdsFormat::BC7_UNORM_SRGB:
+			bc = true;
+			bpe = 16;
+			break;
+
+		case DdsFormat::R8G8_B8G8_UNORM:
+		case DdsFormat::G8R8_G8B8_UNORM:
+		case DdsFormat::YUY2:
+			packed = true;
+			bpe = 4;
+			break;
+
+		case DdsFormat::Y210:
+		case DdsFormat::Y216:
+			packed = true;
+			bpe = 8;
+			break;
+
+		case DdsFormat::NV12:
+		case DdsFormat::OPAQUE_420:
+			planar = true;
+			bpe = 2;
+			break;
+
+		case DdsFormat::P010:
+		case DdsFormat::P016:
+			planar = true;
+			bpe = 4;
+			break;
+
+		default:
+			break;
+		}
+
+		if (bc)
+		{
+			std::uint64_t numBlocksWide = (width > 0) ? std::max<std::uint64_t>(1, (width + 3) / 4) : 0;
+			std::uint64_t numBlocksHigh = (height > 0) ? std::max<std::uint64_t>(1, (height + 3) / 4) : 0;
+			rowBytes = numBlocksWide * bpe;
+			numRows = numBlocksHigh;
+			numBytes = rowBytes * numBlocksHigh;
+		}
+		else if (packed)
+		{
+			rowBytes = ((width + 1) >> 1) * bpe;
+			numRows = height;
+			numBytes = rowBytes * height;
+		}
+		else if (format == DdsFormat::NV11)
+		{
+			rowBytes = ((width + 3) >> 2) * 4;
+			numRows = height * 2; // Direct3D makes this simplifying assumption, although it is larger than the 4:1:1 data
+			numBytes = rowBytes * numRows;
+		}
+		else if (planar)
+		{
+			rowBytes = ((width + 1) >> 1) * bpe;
+			numBytes = (rowBytes * height) + ((rowBytes * height + 1) >> 1);
+			numRows = height + ((height + 1) >> 1);
+		}
+		else
+		{
+			std::uint64_t bpp = DdsImage::BitsPerPixel(format);
+			rowBytes = (width * bpp + 7) / 8; // round up to nearest byte
+			numRows = height;
+			numBytes = rowBytes * height;
+		}
+	}
+}
+
+const char* DdsResultName(DdsResult result)
+{
+	switch (result)
+	{
+	case DdsResult::Ok:          return "ok";
+	case DdsResult::TooSmall:    return "too small";
+	case DdsResult::BadMagic:    return "bad magic number";
+	case DdsResult::BadHeader:   return "bad header";
+	case DdsResult::InvalidData: return "invalid data";
+	case DdsResult::Unsupported: return "unsupported";
+	case DdsResult::Truncated:   return "truncated";
+	}
+
+	return "unknown";
+}
+
+void DdsImage::Clear()
+{
+	// Keep the capacity; batch parsers reuse one image for many files.
+	mData = nullptr;
+	mSubresources.clear();
+	mDimension = DdsDimension::Unknown;
+	mFormat = DdsFormat::UNKNOWN;
+	mAlphaMode = DdsAlphaMode::Unknown;
+	mWidth = 0;
+	mHeight = 0;
+	mDepth = 0;
+	mMipLevels = 0;
+	mArraySize = 0;
+	mIsCubeMap = false;
+}
+
+DdsResult DdsImage::Parse(const std::uint8_t* data, std::uint64_t size, std::uint32_t maxSize)
+{
+	Clear();
+
+	// Need at least enough data to fill the header and magic number to be a valid DDS.
+	if (data == nullptr || size < sizeof(std::uint32_t) + sizeof(DdsHeader))
+		return DdsResult::TooSmall;
+
+	// The headers are copied out because a byte span has no alignment guarantee.
+	std::uint32_t magic = 0;
+	std::memcpy(&magic, data, sizeof(magic));
+	if (magic != DdsMagic)
+		return DdsResult::BadMagic;
+
+	DdsHeader header;
+	std::memcpy(&header, data + sizeof(std::uint32_t), sizeof(header));
+	if (header.size != sizeof(DdsHeader) || header.ddspf.size != sizeof(DdsPixelFormat))
+		return DdsResult::BadHeader;
+
+	std::uint64_t offset = sizeof(std::uint32_t) + sizeof(DdsHeader);
+
+	std::uint64_t width = header.width;
+	std::uint64_t height = header.height;
+	std::uint64_t depth = header.depth;
+	std::uint64_t arraySize = 1;
+	std::uint64_t mipCount = (header.mipMapCount == 0) ? 1 : header.mipMapCount;
+
+	DdsDimension dimension = DdsDimension::Unknown;
+	DdsFormat format = DdsFormat::UNKNOWN;
+	DdsAlphaMode alphaMode = DdsAlphaMode::Unknown;
+	bool isCubeMap = false;
+
+	if ((header.ddspf.flags & DdsFourCC) && header.ddspf.fourCC == MakeFourCC('D', 'X', '1', '0'))
+	{
+		if (size < offset + sizeof(DdsHeaderDxt10))
+			return DdsResult::TooSmall;
+
+		DdsHeaderDxt10 ext;
+		std::memcpy(&ext, data + offset, sizeof(ext));
+		offset += sizeof(DdsHeaderDxt10);
+
+		arraySize = ext.arraySize;
+		if (arraySize == 0)
+			return DdsResult::InvalidData;
+
+		format = static_cast<DdsFormat>(ext.dxgiFormat);
+		switch (format)
+		{
+		case DdsFormat::AI44:
+		case DdsFormat::IA44:
+		case DdsFormat::P8:
+		case DdsFormat::A8P8:
+			return DdsResult::Unsupported;
+
+		default:
+			if (BitsPerPixel(format) == 0)
+				return DdsResult::Unsupported;
+		}
+
+		switch (static_cast<DdsDimension>(ext.resourceDimension))
+		{
+		case DdsDimension::Texture1D:
+			if ((header.flags & DdsHeight) && height != 1)
+				return DdsResult::InvalidData;
+			height = depth = 1;
+			dimension = DdsDimension::Texture1D;
+			break;
+
+		case DdsDimension::Texture2D:
+			if (ext.miscFlag & DdsResourceMiscTextureCube)
+			{
+				arraySize *= 6;
+				isCubeMap = true;
+			}
+			depth = 1;
+			dimension = DdsDimension::Texture2D;
+			break;
+
+		case DdsDimension::Texture3D:
+			if (!(header.flags & DdsHeaderFlagsVolume))
+				return DdsResult::InvalidData;
+			if (arraySize > 1)
+				return DdsResult::Unsupported;
+			dimension = DdsDimension::Texture3D;
+			break;
+
+		default:
+			return DdsResult::Unsupported;
+		}
+
+		std::uint32_t mode = ext.miscFlags2 & DdsMiscFlags2AlphaModeMask;
+		if (mode >= (std::uint32_t)DdsAlphaMode::Straight && mode <= (std::uint32_t)DdsAlphaMode::Custom)
+			alphaMode = static_cast<DdsAlphaMode>(mode);
+	}
+	else
+	{
+		format = FormatFromPixelFormat(header.ddspf);
+		if (format == DdsFormat::UNKNOWN)
+			return DdsResult::Unsupported;
+
+		if (header.flags & DdsHeaderFlagsVolume)
+		{
+			dimension = DdsDimension::Texture3D;
+		}
+		else
+		{
+			if (header.caps2 & DdsCubemap)
+			{
+				// Partial cube maps are not supported.
+				if ((header.caps2 & DdsCubemapAllFaces) != DdsCubemapAllFaces)
+					return DdsResult::Unsupported;
+				arraySize = 6;
+				isCubeMap = true;
+			}
+
+			depth = 1;
+			dimension = DdsDimension::Texture2D;
+		}
+
+		// Premultiplied alpha has no DXGI format, but these are BC2/BC3 otherwise.
+		if ((header.ddspf.flags & DdsFourCC) &&
+			(header.ddspf.fourCC == MakeFourCC('D', 'X', 'T', '2') || header.ddspf.fourCC == MakeFourCC('D', 'X', 'T', '4')))
+		{
+			alphaMode = DdsAlphaMode::Premultiplied;
+		}
+	}
+
+	if (width == 0 || height == 0 || depth == 0)
+		return DdsResult::InvalidData;
+
+	if (mipCount > MaxMipLevels)
+		return DdsResult::Unsupported;
+
+	switch (dimension)
+	{
+	case DdsDimension::Texture1D:
+		if (arraySize > MaxTexture1DArraySize || width > MaxTexture1DWidth)
+			return DdsResult::Unsupported;
+		break;
+
+	case DdsDimension::Texture2D:
+		if (isCubeMap)
+		{
+			// arraySize already counts six faces per cube.
+			if (arraySize > MaxTexture2DArraySize || width > MaxTextureCubeDimension || height > MaxTextureCubeDimension)
+				return DdsResult::Unsupported;
+		}
+		else if (arraySize > MaxTexture2DArraySize || width > MaxTexture2DDimension || height > MaxTexture2DDimension)
+		{
+			return DdsResult::Unsupported;
+		}
+		break;
+
+	case DdsDimension::Texture3D:
+		if (arraySize > 1 || width > MaxTexture3DDimension || height > MaxTexture3DDimension || depth > MaxTexture3DDimension)
+			return DdsResult::Unsupported;
+		break;
+
+	default:
+		return DdsResult::Unsupported;
+	}
+
+	// Walk the mip chain of every array slice.  Everything is bounded above, so none
+	// of the 64-bit sizes can overflow; only the file length needs checking.
+	mSubresources.reserve((std::size_t)(mipCount * arraySize));
+
+	std::uint64_t skipMip = 0;
+	for (std::uint64_t slice = 0; slice < arraySize; ++slice)
+	{
+		std::uint64_t w = width;
+		std::uint64_t h = height;
+		std::uint64_t d = depth;
+
+		for (std::uint64_t mip = 0; mip < mipCount; ++mip)
+		{
+			std::uint64_t numBytes = 0;
+			std::uint64_t rowBytes = 0;
+			std::uint64_t numRows = 0;
+			SurfaceInfo(w, h, format, numBytes, rowBytes, numRows);
+
+			const std::uint64_t mipBytes = numBytes * d;
+			if (mipBytes > size - offset)
+			{
+				mSubresources.clear();
+				return DdsResult::Truncated;
+			}
+
+			if (mipCount <= 1 || maxSize == 0 || (w <= maxSize && h <= maxSize && d <= maxSize))
+			{
+				DdsSubresource sub;
+				sub.Offset = offset;
+				sub.RowPitch = rowBytes;
+				sub.SlicePitch = numBytes;
+				sub.RowCount = (std::uint32_t)numRows;
+				sub.Width = (std::uint32_t)w;
+				sub.Height = (std::uint32_t)h;
+				sub.Depth = (std::uint32_t)d;
+				mSubresources.push_back(sub);
+			}
+			else if (slice == 0)
+			{
+				// Mips skipped for maxSize are counted on the first slice only.
+				++skipMip;
+			}
+
+			offset += mipBytes;
+
+			w = std::max<std::uint64_t>(1, w >> 1);
+			h = std::max<std::uint64_t>(1, h >> 1);
+			d = std::max<std::uint64_t>(1, d >> 1);
+		}
+	}
+
+	// Every mip was larger than maxSize.
+	if (mSubresources.empty())
+		return DdsResult::Unsupported;
+
+	mData = data;
+	mDimension = dimension;
+	mFormat = format;
+	mAlphaMode = alphaMode;
+	mWidth = mSubresources[0].Width;
+	mHeight = mSubresources[0].Height;
+	mDepth = mSubresources[0].Depth;
+	mMipLevels = (std::uint32_t)(mipCount - skipMip);
+	mArraySize = (std::uint32_t)arraySize;
+	mIsCubeMap = isCubeMap;
+
+	return DdsResult::Ok;
+}
+
+void DdsImage::GetSurfaceInfo(std::size_t width, std::size_t height, DdsFormat format,
+	std::size_t* outNumBytes, std::size_t* outRowBytes, std::size_t* outNumRows)
+{
+	std::uint64_t numBytes = 0;
+	std::uint64_t rowBytes = 0;
+	std::uint64_t numRows = 0;
+	SurfaceInfo(width, height, format, numBytes, rowBytes, numRows);
+
+	if (outNumBytes)
+		*outNumBytes = (std::size_t)numBytes;
+	if (outRowBytes)
+		*outRowBytes = (std::size_t)rowBytes;
+	if (outNumRows)
+		*outNumRows = (std::size_t)numRows;
+}
+
+std::size_t DdsImage::BitsPerPixel(DdsFormat format)
+{
+	switch (format)
+	{
+	case DdsFormat::R32G32B32A32_TYPELESS:
+	case DdsFormat::R32G32B32A32_FLOAT:
+	case DdsFormat::R32G32B32A32_UINT:
+	case DdsFormat::R32G32B32A32_SINT:
+		return 128;
+
+	case DdsFormat::R32G32B32_TYPELESS:
+	case DdsFormat::R32G32B32_FLOAT:
+	case DdsFormat::R32G32B32_UINT:
+	case DdsFormat::R32G32B32_SINT:
+		return 96;
+
+	case DdsFormat::R16G16B16A16_TYPELESS:
+	case DdsFormat::R16G16B16A16_FLOAT:
+	case DdsFormat::R16G16B16A16_UNORM:
+	case DdsFormat::R16G16B16A16_UINT:
+	case DdsFormat::R16G16B16A16_SNORM:
+	case DdsFormat::R16G16B16A16_SINT:
+	case DdsFormat::R32G32_TYPELESS:
+	case DdsFormat::R32G32_FLOAT:
+	case DdsFormat::R32G32_UINT:
+	case DdsFormat::R32G32_SINT:
+	case DdsFormat::R32G8X24_TYPELESS:
+	case DdsFormat::D32_FLOAT_S8X24_UINT:
+	case DdsFormat::R32_FLOAT_X8X24_TYPELESS:
+	case DdsFormat::X32_TYPELESS_G8X24_UINT:
+	case DdsFormat::Y416:
+	case DdsFormat::Y210:
+	case DdsFormat::Y216:
+		return 64;
+
+	case DdsFormat::R10G10B10A2_TYPELESS:
+	case DdsFormat::R10G10B10A2_UNORM:
+	case DdsFormat::R10G10B10A2_UINT:
+	case DdsFormat::R11G11B10_FLOAT:
+	case DdsFormat::R8G8B8A8_TYPELESS:
+	case DdsFormat::R8G8B8A8_UNORM:
+	case DdsFormat::R8G8B8A8_UNORM_SRGB:
+	case DdsFormat::R8G8B8A8_UINT:
+	case DdsFormat::R8G8B8A8_SNORM:
+	case DdsFormat::R8G8B8A8_SINT:
+	case DdsFormat::R16G16_TYPELESS:
+	case DdsFormat::R16G16_FLOAT:
+	case DdsFormat::R16G16_UNORM:
+	case DdsFormat::R16G16_UINT:
+	case DdsFormat::R16G16_SNORM:
+	case DdsFormat::R16G16_SINT:
+	case DdsFormat::R32_TYPELESS:
+	case DdsFormat::D32_FLOAT:
+	case DdsFormat::R32_FLOAT:
+	case DdsFormat::R32_UINT:
+	case DdsFormat::R32_SINT:
+	case DdsFormat::R24G8_TYPELESS:
+	case DdsFormat::D24_UNORM_S8_UINT:
+	case DdsFormat::R24_UNORM_X8_TYPELESS:
+	case DdsFormat::X24_TYPELESS_G8_UINT:
+	case DdsFormat::R9G9B9E5_SHAREDEXP:
+	case DdsFormat::R8G8_B8G8_UNORM:
+	case DdsFormat::G8R8_G8B8_UNORM:
+	case DdsFormat::B8G8R8A8_UNORM:
+	case DdsFormat::B8G8R8X8_UNORM:
+	case DdsFormat::R10G10B10_XR_BIAS_A2_UNORM:
+	case DdsFormat::B8G8R8A8_TYPELESS:
+	case DdsFormat::B8G8R8A8_UNORM_SRGB:
+	case DdsFormat::B8G8R8X8_TYPELESS:
+	case DdsFormat::B8G8R8X8_UNORM_SRGB:
+	case DdsFormat::AYUV:
+	case DdsFormat::Y410:
+	case DdsFormat::YUY2:
+		return 32;
+
+	case DdsFormat::P010:
+	case DdsFormat::P016:
+		return 24;
+
+	case DdsFormat::R8G8_TYPELESS:
+	case DdsFormat::R8G8_UNORM:
+	case DdsFormat::R8G8_UINT:
+	case DdsFormat::R8G8_SNORM:
+	case DdsFormat::R8G8_SINT:
+	case DdsFormat::R16_TYPELESS:
+	case DdsFormat::R16_FLOAT:
+	case DdsFormat::D16_UNORM:
+	case DdsFormat::R16_UNORM:
+	case DdsFormat::R16_UINT:
+	case DdsFormat::R16_SNORM:
+	case DdsFormat::R16_SINT:
+	case DdsFormat::B5G6R5_UNORM:
+	case DdsFormat::B5G5R5A1_UNORM:
+	case DdsFormat::A8P8:
+	case DdsFormat::B4G4R4A4_UNORM:
+		return 16;
+
+	case DdsFormat::NV12:
+	case DdsFormat::OPAQUE_420:
+	case DdsFormat::NV11:
+		return 12;
+
+	case DdsFormat::R8_TYPELESS:
+	case DdsFormat::R8_UNORM:
+	case DdsFormat::R8_UINT:
+	case DdsFormat::R8_SNORM:
+	case DdsFormat::R8_SINT:
+	case DdsFormat::A8_UNORM:
+	case DdsFormat::AI44:
+	case DdsFormat::IA44:
+	case DdsFormat::P8:
+		return 8;
+
+	case DdsFormat::R1_UNORM:
+		return 1;
+
+	case DdsFormat::BC1_TYPELESS:
+	case DdsFormat::BC1_UNORM:
+	case DdsFormat::BC1_UNORM_SRGB:
+	case DdsFormat::BC4_TYPELESS:
+	case DdsFormat::BC4_UNORM:
+	case DdsFormat::BC4_SNORM:
+		return 4;
+
+	case DdsFormat::BC2_TYPELESS:
+	case DdsFormat::BC2_UNORM:
+	case DdsFormat::BC2_UNORM_SRGB:
+	case DdsFormat::BC3_TYPELESS:
+	case DdsFormat::BC3_UNORM:
+	case DdsFormat::BC3_UNORM_SRGB:
+	case DdsFormat::BC5_TYPELESS:
+	case DdsFormat::BC5_UNORM:
+	case DdsFormat::BC5_SNORM:
+	case DdsFormat::BC6H_TYPELESS:
+	case DdsFormat::BC6H_UF16:
+	case DdsFormat::BC6H_SF16:
+	case DdsFormat::BC7_TYPELESS:
+	case DdsFormat::BC7_UNORM:
+	case DdsFormat::BC7_UNORM_SRGB:
+		return 8;
+
+	default:
+		return 0;
+	}
+}
+
+DdsFormat DdsImage::FormatFromPixelFormat(const DdsPixelFormat& ddpf)
+{
+	if (ddpf.flags & DdsRgb)
+	{
+		// Note that sRGB formats are written using the "DX10" extended header.
+		switch (ddpf.RGBBitCount)
+		{
+		case 32:
+			if (IsBitMask(ddpf, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000))
+				return DdsFormat::R8G8B8A8_UNORM;
+			if (IsBitMask(ddpf, 0x00ff0000, 0x0000ff00, 0x000000ff, 0xff000000))
+				return DdsFormat::B8G8R8A8_UNORM;
+			if (IsBitMask(ddpf, 0x00ff0000, 0x0000ff00, 0x000000ff, 0x00000000))
+				return DdsFormat::B8G8R8X8_UNORM;
+
+			// Many writers (including D3DX) swap the red and blue masks for 10:10:10:2,
+			// so the 'backwards' masks are assumed here.
+			if (IsBitMask(ddpf, 0x3ff00000, 0x000ffc00, 0x000003ff, 0xc0000000))
+				return DdsFormat::R10G10B10A2_UNORM;
+
+			if (IsBitMask(ddpf, 0x0000ffff, 0xffff0000, 0x00000000, 0x00000000))
+				return DdsFormat::R16G16_UNORM;
+
+			// Only 32-bit color channel format in D3D9 was R32F.
+			if (IsBitMask(ddpf, 0xffffffff, 0x00000000, 0x00000000, 0x00000000))
+				return DdsFormat::R32_FLOAT;
+			break;
+
+		case 16:
+			if (IsBitMask(ddpf, 0x7c00, 0x03e0, 0x001f, 0x8000))
+				return DdsFormat::B5G5R5A1_UNORM;
+			if (IsBitMask(ddpf, 0xf800, 0x07e0, 0x001f, 0x0000))
+				return DdsFormat::B5G6R5_UNORM;
+			if (IsBitMask(ddpf, 0x0f00, 0x00f0, 0x000f, 0xf000))
+				return DdsFormat::B4G4R4A4_UNORM;
+			break;
+		}
+	}
+	else if (ddpf.flags & DdsLuminance)
+	{
+		if (ddpf.RGBBitCount == 8)
+		{
+			if (IsBitMask(ddpf, 0x000000ff, 0x00000000, 0x00000000, 0x00000000))
+				return DdsFormat::R8_UNORM;
+		}
+
+		if (ddpf.RGBBitCount == 16)
+		{
+			if (IsBitMask(ddpf, 0x0000ffff, 0x00000000, 0x00000000, 0x00000000))
+				return DdsFormat::R16_UNORM;
+			if (IsBitMask(ddpf, 0x000000ff, 0x00000000, 0x00000000, 0x0000ff00))
+				return DdsFormat::R8G8_UNORM;
+		}
+	}
+	else if (ddpf.flags & DdsAlpha)
+	{
+		if (ddpf.RGBBitCount == 8)
+			return DdsFormat::A8_UNORM;
+	}
+	else if (ddpf.flags & DdsFourCC)
+	{
+		switch (ddpf.fourCC)
+		{
+		case MakeFourCC('D', 'X', 'T', '1'): return DdsFormat::BC1_UNORM;
+		case MakeFourCC('D', 'X', 'T', '3'): return DdsFormat::BC2_UNORM;
+		case MakeFourCC('D', 'X', 'T', '5'): return DdsFormat::BC3_UNORM;
+
+		// Premultiplied alpha has no DXGI format, but the blocks are BC2/BC3.
+		case MakeFourCC('D', 'X', 'T', '2'): return DdsFormat::BC2_UNORM;
+		case MakeFourCC('D', 'X', 'T', '4'): return DdsFormat::BC3_UNORM;
+
+		case MakeFourCC('A', 'T', 'I', '1'): return DdsFormat::BC4_UNORM;
+		case MakeFourCC('B', 'C', '4', 'U'): return DdsFormat::BC4_UNORM;
+		case MakeFourCC('B', 'C', '4', 'S'): return DdsFormat::BC4_SNORM;
+
+		case MakeFourCC('A', 'T', 'I', '2'): return DdsFormat::BC5_UNORM;
+		case MakeFourCC('B', 'C', '5', 'U'): return DdsFormat::BC5_UNORM;
+		case MakeFourCC('B', 'C', '5', 'S'): return DdsFormat::BC5_SNORM;
+
+		// BC6H and BC7 are written using the "DX10" extended header.
+
+		case MakeFourCC('R', 'G', 'B', 'G'): return DdsFormat::R8G8_B8G8_UNORM;
+		case MakeFourCC('G', 'R', 'G', 'B'): return DdsFormat::G8R8_G8B8_UNORM;
+		case MakeFourCC('Y', 'U', 'Y', '2'): return DdsFormat::YUY2;
+
+		// D3DFORMAT enums stored in the FourCC.
+		case 36:  return DdsFormat::R16G16B16A16_UNORM; // D3DFMT_A16B16G16R16
+		case 110: return DdsFormat::R16G16B16A16_SNORM; // D3DFMT_Q16W16V16U16
+		case 111: return DdsFormat::R16_FLOAT;          // D3DFMT_R16F
+		case 112: return DdsFormat::R16G16_FLOAT;       // D3DFMT_G16R16F
+		case 113: return DdsFormat::R16G16B16A16_FLOAT; // D3DFMT_A16B16G16R16F
+		case 114: return DdsFormat::R32_FLOAT;          // D3DFMT_R32F
+		case 115: return DdsFormat::R32G32_FLOAT;       // D3DFMT_G32R32F
+		case 116: return DdsFormat::R32G32B32A32_FLOAT; // D3DFMT_A32B32G32R32F
+		}
+	}
+
+	return DdsFormat::UNKNOWN;
+}
@@ -0,0 +1,281 @@
+//***************************************************************************************
+// DdsImage.h
+//
+// Device-independent DDS parser.  DdsImage::Parse validates a DDS file held in memory
+// and describes it as a table of subresources: the offset, pitch and size of every mip
+// of every array slice, in D3D subresource order.  Nothing here depends on Windows or
+// Direct3D, so the parser builds anywhere and can be tested, fuzzed and benchmarked on
+// its own.  DDSTextureLoader turns the table into D3D12_SUBRESOURCE_DATA.
+//
+// Formats are DXGI_FORMAT values; DdsFormat only names them without the DXGI headers.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Numerically identical to DXGI_FORMAT.
+enum class DdsFormat : std::uint32_t
+{
+	UNKNOWN = 0,
+	R32G32B32A32_TYPELESS = 1,
+	R32G32B32A32_FLOAT = 2,
+	R32G32B32A32_UINT = 3,
+	R32G32B32A32_SINT = 4,
+	R32G32B32_TYPELESS = 5,
+	R32G32B32_FLOAT = 6,
+	R32G32B32_UINT = 7,
+	R32G32B32_SINT = 8,
+	R16G16B16A16_TYPELESS = 9,
+	R16G16B16A16_FLOAT = 10,
+	R16G16B16A16_UNORM = 11,
+	R16G16B16A16_UINT = 12,
+	R16G16B16A16_SNORM = 13,
+	R16G16B16A16_SINT = 14,
+	R32G32_TYPELESS = 15,
+	R32G32_FLOAT = 16,
+	R32G32_UINT = 17,
+	R32G32_SINT = 18,
+	R32G8X24_TYPELESS = 19,
+	D32_FLOAT_S8X24_UINT = 20,
+	R32_FLOAT_X8X24_TYPELESS = 21,
+	X32_TYPELESS_G8X24_UINT = 22,
+	R10G10B10A2_TYPELESS = 23,
+	R10G10B10A2_UNORM = 24,
+	R10G10B10A2_UINT = 25,
+	R11G11B10_FLOAT = 26,
+	R8G8B8A8_TYPELESS = 27,
+	R8G8B8A8_UNORM = 28,
+	R8G8B8A8_UNORM_SRGB = 29,
+	R8G8B8A8_UINT = 30,
+	R8G8B8A8_SNORM = 31,
+	R8G8B8A8_SINT = 32,
+	R16G16_TYPELESS = 33,
+	R16G16_FLOAT = 34,
+	R16G16_UNORM = 35,
+	R16G16_UINT = 36,
+	R16G16_SNORM = 37,
+	R16G16_SINT = 38,
+	R32_TYPELESS = 39,
+	D32_FLOAT = 40,
+	R32_FLOAT = 41,
+	R32_UINT = 42,
+	R32_SINT = 43,
+	R24G8_TYPELESS = 44,
+	D24_UNORM_S8_UINT = 45,
+	R24_UNORM_X8_TYPELESS = 46,
+	X24_TYPELESS_G8_UINT = 47,
+	R8G8_TYPELESS = 48,
+	R8G8_UNORM = 49,
+	R8G8_UINT = 50,
+	R8G8_SNORM = 51,
+	R8G8_SINT = 52,
+	R16_TYPELESS = 53,
+	R16_FLOAT = 54,
+	D16_UNORM = 55,
+	R16_UNORM = 56,
+	R16_UINT = 57,
+	R16_SNORM = 58,
+	R16_SINT = 59,
+	R8_TYPELESS = 60,
+	R8_UNORM = 61,
+	R8_UINT = 62,
+	R8_SNORM = 63,
+	R8_SINT = 64,
+	A8_UNORM = 65,
+	R1_UNORM = 66,
+	R9G9B9E5_SHAREDEXP = 67,
+	R8G8_B8G8_UNORM = 68,
+	G8R8_G8B8_UNORM = 69,
+	BC1_TYPELESS = 70,
+	BC1_UNORM = 71,
+	BC1_UNORM_SRGB = 72,
+	BC2_TYPELESS = 73,
+	BC2_UNORM = 74,
+	BC2_UNORM_SRGB = 75,
+	BC3_TYPELESS = 76,
+	BC3_UNORM = 77,
+	BC3_UNORM_SRGB = 78,
+	BC4_TYPELESS = 79,
+	BC4_UNORM = 80,
+	BC4_SNORM = 81,
+	BC5_TYPELESS = 82,
+	BC5_UNORM = 83,
+	BC5_SNORM = 84,
+	B5G6R5_UNORM = 85,
+	B5G5R5A1_UNORM = 86,
+	B8G8R8A8_UNORM = 87,
+	B8G8R8X8_UNORM = 88,
+	R10G10B10_XR_BIAS_A2_UNORM = 89,
+	B8G8R8A8_TYPELESS = 90,
+	B8G8R8A8_UNORM_SRGB = 91,
+	B8G8R8X8_TYPELESS = 92,
+	B8G8R8X8_UNORM_SRGB = 93,
+	BC6H_TYPELESS = 94,
+	BC6H_UF16 = 95,
+	BC6H_SF16 = 96,
+	BC7_TYPELESS = 97,
+	BC7_UNORM = 98,
+	BC7_UNORM_SRGB = 99,
+	AYUV = 100,
+	Y410 = 101,
+	Y416 = 102,
+	NV12 = 103,
+	P010 = 104,
+	P016 = 105,
+	OPAQUE_420 = 106,
+	YUY2 = 107,
+	Y210 = 108,
+	Y216 = 109,
+	NV11 = 110,
+	AI44 = 111,
+	IA44 = 112,
+	P8 = 113,
+	A8P8 = 114,
+	B4G4R4A4_UNORM = 115,
+};
+
+// Numerically identical to D3D12_RESOURCE_DIMENSION.
+enum class DdsDimension : std::uint32_t
+{
+	Unknown = 0,
+	Texture1D = 2,
+	Texture2D = 3,
+	Texture3D = 4
+};
+
+// Numerically identical to DirectX::DDS_ALPHA_MODE.
+enum class DdsAlphaMode : std::uint32_t
+{
+	Unknown = 0,
+	Straight = 1,
+	Premultiplied = 2,
+	Opaque = 3,
+	Custom = 4
+};
+
+enum class DdsResult
+{
+	Ok,
+	TooSmall,         // shorter than the magic number and headers
+	BadMagic,
+	BadHeader,        // header or pixel format size fields are wrong
+	InvalidData,      // header fields contradict each other
+	Unsupported,      // format, dimension or size the loaders do not handle
+	Truncated         // texel data ends before the last subresource
+};
+
+const char* DdsResultName(DdsResult result);
+
+//--------------------------------------------------------------------------------------
+// On-disk structures.  See DDS.h in the DirectXTex library.
+//--------------------------------------------------------------------------------------
+#pragma pack(push,1)
+
+struct DdsPixelFormat
+{
+	std::uint32_t size;
+	std::uint32_t flags;
+	std::uint32_t fourCC;
+	std::uint32_t RGBBitCount;
+	std::uint32_t RBitMask;
+	std::uint32_t GBitMask;
+	std::uint32_t BBitMask;
+	std::uint32_t ABitMask;
+};
+
+struct DdsHeader
+{
+	std::uint32_t size;
+	std::uint32_t flags;
+	std::uint32_t height;
+	std::uint32_t width;
+	std::uint32_t pitchOrLinearSize;
+	std::uint32_t depth; // only if the volume flag is set in flags
+	std::uint32_t mipMapCount;
+	std::uint32_t reserved1[11];
+	DdsPixelFormat ddspf;
+	std::uint32_t caps;
+	std::uint32_t caps2;
+	std::uint32_t caps3;
+	std::uint32_t caps4;
+	std::uint32_t reserved2;
+};
+
+struct DdsHeaderDxt10
+{
+	std::uint32_t dxgiFormat;
+	std::uint32_t resourceDimension;
+	std::uint32_t miscFlag;
+	std::uint32_t arraySize;
+	std::uint32_t miscFlags2;
+};
+
+#pragma pack(pop)
+
+struct DdsSubresource
+{
+	std::uint64_t Offset = 0;     // from the start of the file
+	std::uint64_t RowPitch = 0;   // bytes per row of pixels or blocks
+	std::uint64_t SlicePitch = 0; // bytes per depth slice
+	std::uint32_t RowCount = 0;   // rows of pixels or blocks per slice
+	std::uint32_t Width = 0;
+	std::uint32_t Height = 0;
+	std::uint32_t Depth = 0;
+};
+
+class DdsImage
+{
+public:
+	// Parses size bytes at data.  The image describes data but does not copy it, so
+	// data must outlive any use of SubresourceData.  When maxSize is non-zero, leading
+	// mips larger than maxSize in any dimension are skipped.
+	DdsResult Parse(const std::uint8_t* data, std::uint64_t size, std::uint32_t maxSize = 0);
+
+	DdsDimension Dimension()const { return mDimension; }
+	DdsFormat Format()const { return mFormat; }
+	DdsAlphaMode AlphaMode()const { return mAlphaMode; }
+
+	// Size of the largest mip that was kept.
+	std::uint32_t Width()const { return mWidth; }
+	std::uint32_t Height()const { return mHeight; }
+	std::uint32_t Depth()const { return mDepth; }
+
+	// Mips kept per array slice.  Cube maps count six slices per cube.
+	std::uint32_t MipLevels()const { return mMipLevels; }
+	std::uint32_t ArraySize()const { return mArraySize; }
+	bool IsCubeMap()const { return mIsCubeMap; }
+
+	// Subresource i is mip (i % MipLevels) of array slice (i / MipLevels).
+	const std::vector<DdsSubresource>& Subresources()const { return mSubresources; }
+	const std::uint8_t* SubresourceData(std::size_t i)const { return mData + mSubresources[i].Offset; }
+
+	// Bits per pixel of an uncompressed format, or per texel of a block-compressed
+	// one.  0 for unknown formats.
+	static std::size_t BitsPerPixel(DdsFormat format);
+
+	// Byte size, row pitch and row count of one width x height surface.
+	static void GetSurfaceInfo(std::size_t width, std::size_t height, DdsFormat format,
+		std::size_t* outNumBytes, std::size_t* outRowBytes, std::size_t* outNumRows);
+
+	// Format described by a legacy (non-DX10) pixel format, or UNKNOWN.
+	static DdsFormat FormatFromPixelFormat(const DdsPixelFormat& ddpf);
+
+private:
+	void Clear();
+
+	const std::uint8_t* mData = nullptr;
+	std::vector<DdsSubresource> mSubresources;
+
+	DdsDimension mDimension = DdsDimension::Unknown;
+	DdsFormat mFormat = DdsFormat::UNKNOWN;
+	DdsAlphaMode mAlphaMode = DdsAlphaMode::Unknown;
+	std::uint32_t mWidth = 0;
+	std::uint32_t mHeight = 0;
+	std::uint32_t mDepth = 0;
+	std::uint32_t mMipLevels = 0;
+	std::uint32_t mArraySize = 0;
+	bool mIsCubeMap = false;
+};
@@ -0,0 +1,89 @@
+//***************************************************************************************
+// DescriptorAllocator.cpp
+//***************************************************************************************
+
+#include "DescriptorAllocator.h"
+#include <functional>
+
+using Microsoft::WRL::ComPtr;
+
+DescriptorAllocator::DescriptorAllocator(ID3D12Device* device, UINT persistentCount, UINT transientCountPerFrame, UINT frameCount)
+	: mPersistentCount(persistentCount), mTransientCountPerFrame(transientCountPerFrame), mFrameCount(frameCount)
+{
+	D3D12_DESCRIPTOR_HEAP_DESC heapDesc = {};
+	heapDesc.NumDescriptors = persistentCount + transientCountPerFrame * frameCount;
+	heapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+	heapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+	ThrowIfFailed(device->CreateDescriptorHeap(&heapDesc, IID_PPV_ARGS(&mHeap)));
+
+	mDescriptorSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+	mFreeList.reserve(persistentCount);
+	for (UINT i = persistentCount; i-- > 0;)
+		mFreeList.push_back(i);
+
+	mTransientBase = persistentCount;
+}
+
+UINT DescriptorAllocator::Allocate()
+{
+	if (mFreeList.empty())
+		throw DxException(E_OUTOFMEMORY, L"DescriptorAllocator::Allocate", AnsiToWString(__FILE__), __LINE__);
+
+	UINT index = mFreeList.back();
+	mFreeList.pop_back();
+	return index;
+}
+
+void DescriptorAllocator::Free(UINT index)
+{
+	// Frames begun so far may all still read it; the frame that reuses the last of
+	// their frame resources has waited for them.
+	mPendingFrees.push_back({ index, mFrame + mFrameCount });
+}
+
+void DescriptorAllocator::BeginFrame(UINT frameIndex)
+{
+	++mFrame;
+
+	bool recycled = false;
+	for (auto it = mPendingFrees.begin(); it != mPendingFrees.end();)
+	{
+		if (it->ReusableFrame > mFrame)
+		{
+			++it;
+			continue;
+		}
+
+		mFreeList.push_back(it->Index);
+		it = mPendingFrees.erase(it);
+		recycled = true;
+	}
+
+	// Keep handing out the lowest indices first.
+	if (recycled)
+		std::sort(mFreeList.begin(), mFreeList.end(), std::greater<UINT>());
+
+	mTransientBase = mPersistentCount + frameIndex * mTransientCountPerFrame;
+	mTransientUsed = 0;
+}
+
+UINT DescriptorAllocator::AllocateTransient(UINT count)
+{
+	if (mTransientUsed + count > mTransientCountPerFrame)
+		throw DxException(E_OUTOFMEMORY, L"DescriptorAllocator::AllocateTransient", AnsiToWString(__FILE__), __LINE__);
+
+	UINT index = mTransientBase + mTransientUsed;
+	mTransientUsed += count;
+	return index;
+}
+
+CD3DX12_CPU_DESCRIPTOR_HANDLE DescriptorAllocator::CpuHandle(UINT index)const
+{
+	return CD3DX12_CPU_DESCRIPTOR_HANDLE(mHeap->GetCPUDescriptorHandleForHeapStart(), index, mDescriptorSize);
+}
+
+CD3DX12_GPU_DESCRIPTOR_HANDLE DescriptorAllocator::GpuHandle(UINT index)const
+{
+	return CD3DX12_GPU_DESCRIPTOR_HANDLE(mHeap->GetGPUDescriptorHandleForHeapStart(), index, mDescriptorSize);
+}
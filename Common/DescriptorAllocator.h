@@ -0,0 +1,73 @@
+//***************************************************************************************
+// DescriptorAllocator.h
+//
+// One large shader-visible CBV/SRV/UAV heap shared by everything the app binds.  The
+// front of the heap holds persistent descriptors, handed out from a free list and kept
+// until freed.  Behind it, each frame resource has its own linear region for transient
+// descriptors.  That region is emptied when the frame resource comes round again.
+//
+// Freed persistent descriptors are not reused straight away.  Frames already recorded
+// may still read them, so Free parks them until as many frames have begun as there
+// are frame resources.
+//
+// With the whole heap bound as an unbounded descriptor table, a shader can index any
+// descriptor in it directly ("bindless"), so the index returned by Allocate is all a
+// material needs to carry.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+class DescriptorAllocator
+{
+public:
+	DescriptorAllocator(ID3D12Device* device, UINT persistentCount, UINT transientCountPerFrame, UINT frameCount);
+	DescriptorAllocator(const DescriptorAllocator& rhs) = delete;
+	DescriptorAllocator& operator=(const DescriptorAllocator& rhs) = delete;
+
+	ID3D12DescriptorHeap* Heap()const { return mHeap.Get(); }
+
+	// Returns the heap index of a persistent descriptor.  Throws DxException when the
+	// persistent region is full.
+	UINT Allocate();
+
+	// Returns index to the free list once no frame in flight can still read it.
+	void Free(UINT index);
+
+	// Call once a frame, once frame resource frameIndex may be reused.  Recycles the
+	// descriptors freed long enough ago and empties that frame's transient region.
+	void BeginFrame(UINT frameIndex);
+
+	// Returns the first of count contiguous descriptors that stay valid until this
+	// frame resource is reused.  Throws DxException when the region is full.
+	UINT AllocateTransient(UINT count);
+
+	CD3DX12_CPU_DESCRIPTOR_HANDLE CpuHandle(UINT index)const;
+	CD3DX12_GPU_DESCRIPTOR_HANDLE GpuHandle(UINT index)const;
+
+	UINT PersistentCount()const { return mPersistentCount; }
+	UINT PersistentInUse()const { return mPersistentCount - (UINT)mFreeList.size(); }
+
+private:
+	struct PendingFree
+	{
+		UINT Index;
+		UINT64 ReusableFrame;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> mHeap;
+	UINT mDescriptorSize = 0;
+
+	UINT mPersistentCount = 0;
+	UINT mTransientCountPerFrame = 0;
+	UINT mFrameCount = 0;
+
+	// Free persistent indices, lowest on top so the heap fills from the front.
+	std::vector<UINT> mFreeList;
+	std::vector<PendingFree> mPendingFrees;
+
+	UINT64 mFrame = 0;
+	UINT mTransientBase = 0;
+	UINT mTransientUsed = 0;
+};
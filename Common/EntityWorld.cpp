@@ -0,0 +1,154 @@
+//***************************************************************************************
+// EntityWorld.cpp
+//***************************************************************************************
+
+#include "EntityWorld.h"
+#include <mutex>
+
+namespace
+{
+	// Component sizes by type, shared by every world.
+	std::mutex gComponentTypesMutex;
+	std::vector<std::uint32_t> gComponentSizes;
+}
+
+const std::uint32_t EntityWorld::MaxComponentTypes;
+const std::uint32_t EntityWorld::ParallelBatch;
+
+std::uint32_t EntityWorld::RegisterComponentType(std::uint32_t size)
+{
+	std::lock_guard<std::mutex> lock(gComponentTypesMutex);
+	assert(gComponentSizes.size() < MaxComponentTypes);
+	gComponentSizes.push_back(size);
+	return (std::uint32_t)gComponentSizes.size() - 1;
+}
+
+std::uint32_t EntityWorld::ComponentSize(std::uint32_t type)
+{
+	std::lock_guard<std::mutex> lock(gComponentTypesMutex);
+	return gComponentSizes[type];
+}
+
+std::uint32_t EntityWorld::BitCount(Mask mask)
+{
+	std::uint32_t count = 0;
+	for (; mask != 0; mask &= mask - 1)
+		++count;
+	return count;
+}
+
+void EntityWorld::Destroy(Entity entity)
+{
+	assert(mIterating == 0 && Alive(entity));
+	Record& record = mRecords[entity.Index];
+	RemoveRow(record.Archetype, record.Row);
+	++record.Generation;
+	mFreeIndices.push_back(entity.Index);
+}
+
+bool EntityWorld::Alive(Entity entity)const
+{
+	// Destroy moves the slot's generation past every handle given out for it.
+	return entity.Index < mRecords.size() && mRecords[entity.Index].Generation == entity.Generation;
+}
+
+std::uint32_t EntityWorld::FindArchetype(Mask components)
+{
+	auto found = mArchetypeIndices.find(components);
+	if (found != mArchetypeIndices.end())
+		return found->second;
+
+	Archetype archetype;
+	archetype.Components = components;
+	std::fill(std::begin(archetype.ColumnOf), std::end(archetype.ColumnOf), std::int8_t(-1));
+	for (std::uint32_t type = 0; type < MaxComponentTypes; ++type)
+	{
+		if (components & (Mask(1) << type))
+		{
+			archetype.ColumnOf[type] = (std::int8_t)archetype.Columns.size();
+			archetype.Columns.push_back(Column{ type, ComponentSize(type), {} });
+		}
+	}
+
+	const std::uint32_t index = (std::uint32_t)mArchetypes.size();
+	mArchetypes.push_back(std::move(archetype));
+	mArchetypeIndices.emplace(components, index);
+	return index;
+}
+
+std::uint32_t EntityWorld::AddRow(std::uint32_t archetype, Entity entity)
+{
+	Archetype& a = mArchetypes[archetype];
+	const std::uint32_t row = (std::uint32_t)a.Entities.size();
+	a.Entities.push_back(entity);
+	for (Column& column : a.Columns)
+		column.Data.resize(column.Data.size() + column.Size);
+	return row;
+}
+
+void EntityWorld::RemoveRow(std::uint32_t archetype, std::uint32_t row)
+{
+	// The last row fills the gap.
+	Archetype& a = mArchetypes[archetype];
+	const std::uint32_t last = (std::uint32_t)a.Entities.size() - 1;
+	if (row != last)
+	{
+		a.Entities[row] = a.Entities[last];
+		for (Column& column : a.Columns)
+			std::memcpy(column.Data.data() + (std::size_t)row * column.Size, column.Data.data() + (std::size_t)last * column.Size, column.Size);
+		mRecords[a.Entities[row].Index].Row = row;
+	}
+	a.Entities.pop_back();
+	for (Column& column : a.Columns)
+		column.Data.resize(column.Data.size() - column.Size);
+}
+
+void EntityWorld::MoveEntity(Entity entity, Mask components)
+{
+	assert(mIterating == 0);
+	Record& record = mRecords[entity.Index];
+	const std::uint32_t from = record.Archetype;
+	const std::uint32_t fromRow = record.Row;
+	const std::uint32_t to = FindArchetype(components);
+	const std::uint32_t toRow = AddRow(to, entity);
+
+	// FindArchetype may have moved the archetypes, so look them up after it.
+	const Archetype& source = mArchetypes[from];
+	for (Column& column : mArchetypes[to].Columns)
+	{
+		const int sourceColumn = source.ColumnOf[column.Type];
+		if (sourceColumn >= 0)
+			std::memcpy(column.Data.data() + (std::size_t)toRow * column.Size,
+				source.Columns[sourceColumn].Data.data() + (std::size_t)fromRow * column.Size, column.Size);
+	}
+
+	RemoveRow(from, fromRow);
+	record.Archetype = to;
+	record.Row = toRow;
+}
+
+void* EntityWorld::Component(std::uint32_t archetype, std::uint32_t row, std::uint32_t type)
+{
+	Column& column = mArchetypes[archetype].Columns[mArchetypes[archetype].ColumnOf[type]];
+	return column.Data.data() + (std::size_t)row * column.Size;
+}
+
+const void* EntityWorld::Component(std::uint32_t archetype, std::uint32_t row, std::uint32_t type)const
+{
+	const Column& column = mArchetypes[archetype].Columns[mArchetypes[archetype].ColumnOf[type]];
+	return column.Data.data() + (std::size_t)row * column.Size;
+}
+
+std::size_t EntityWorld::MemoryBytes()const
+{
+	std::size_t bytes = mArchetypes.capacity() * sizeof(Archetype) + mRecords.capacity() * sizeof(Record) +
+		mFreeIndices.capacity() * sizeof(std::uint32_t) + mBatches.capacity() * sizeof(mBatches[0]) +
+		mArchetypeIndices.size() * (sizeof(Mask) + sizeof(std::uint32_t));
+	for (const Archetype& archetype : mArchetypes)
+	{
+		bytes += archetype.Entities.capacity() * sizeof(Entity) + archetype.Columns.capacity() * sizeof(Column);
+		for (const Column& column : archetype.Columns)
+			bytes += column.Data.capacity();
+	}
+	return bytes;
+}
@@ -0,0 +1,307 @@
+//***************************************************************************************
+// EntityWorld.h
+//
+// Entities and their components, stored by archetype.  An entity is a handle; what it
+// is made of is the set of component types it has.  Entities with the same set share
+// an archetype, which keeps one array per component type with a row per entity, so
+// every Transform of an archetype is next to the others and a system reading only
+// transforms and bounds walks two dense arrays instead of whole objects.
+//
+// Components are plain data: trivially copyable and moved between arrays with memcpy.
+// Adding or removing a component moves the entity's row to another archetype, and
+// destroying it fills its row with the archetype's last one, so rows (and pointers
+// into them) only stay put between structural changes.  Handles stay valid until
+// the entity is destroyed; a stale handle is told apart by its generation.
+//
+// ForEach visits the entities having every listed component, archetype by archetype;
+// ParallelForEach splits them into blocks of ParallelBatch rows spread over threads.
+// Neither may create, destroy or change the components of an entity while it runs.
+//***************************************************************************************
+
+#pragma once
+
+#include "ParallelFor.h"
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// Index is the entity's slot; Generation counts the entities that held the slot
+// before it.
+struct Entity
+{
+	std::uint32_t Index = 0xffffffff;
+	std::uint32_t Generation = 0;
+
+	bool operator==(const Entity& rhs)const { return Index == rhs.Index && Generation == rhs.Generation; }
+	bool operator!=(const Entity& rhs)const { return !(*this == rhs); }
+};
+
+class EntityWorld
+{
+public:
+	// Component types are numbered as first used, for the whole process.
+	static const std::uint32_t MaxComponentTypes = 64;
+
+	// Rows per task in ParallelForEach; fewer matching entities stay on one thread.
+	static const std::uint32_t ParallelBatch = 256;
+
+	EntityWorld() = default;
+	EntityWorld(const EntityWorld& rhs) = delete;
+	EntityWorld& operator=(const EntityWorld& rhs) = delete;
+
+	template<typename T>
+	static std::uint32_t ComponentType();
+
+	// Creates an entity with the given components, at most one of each type.
+	template<typename... Ts>
+	Entity Create(const Ts&... components);
+	void Destroy(Entity entity);
+	bool Alive(Entity entity)const;
+
+	template<typename T>
+	bool Has(Entity entity)const;
+	// The entity must have the component.
+	template<typename T>
+	T& Get(Entity entity);
+	template<typename T>
+	const T& Get(Entity entity)const;
+	// Sets the component, adding it if the entity does not have one.
+	template<typename T>
+	void Add(Entity entity, const T& component);
+	// Does nothing if the entity does not have the component.
+	template<typename T>
+	void Remove(Entity entity);
+
+	// Calls func(Entity, Ts&...) for every entity with all of Ts.
+	template<typename... Ts, typename Func>
+	void ForEach(const Func& func);
+	// The same from several threads at once, in no particular order.  func may only
+	// write the components it is passed.
+	template<typename... Ts, typename Func>
+	void ParallelForEach(const Func& func);
+
+	// Entities with all of Ts.
+	template<typename... Ts>
+	std::uint32_t Count()const;
+
+	std::uint32_t EntityCount()const { return (std::uint32_t)(mRecords.size() - mFreeIndices.size()); }
+	std::uint32_t ArchetypeCount()const { return (std::uint32_t)mArchetypes.size(); }
+
+	// Bytes held by the component arrays and the bookkeeping.
+	std::size_t MemoryBytes()const;
+
+private:
+	typedef std::uint64_t Mask;
+
+	struct Column
+	{
+		std::uint32_t Type;
+		std::uint32_t Size;
+		std::vector<unsigned char> Data;
+	};
+
+	// Columns are in component type order; ColumnOf maps a type to its column, or -1.
+	struct Archetype
+	{
+		Mask Components = 0;
+		std::vector<Entity> Entities;
+		std::vector<Column> Columns;
+		std::int8_t ColumnOf[MaxComponentTypes];
+	};
+
+	// Where each entity slot's row is, and the slot's current generation.
+	struct Record
+	{
+		std::uint32_t Archetype;
+		std::uint32_t Row;
+		std::uint32_t Generation;
+	};
+
+	static std::uint32_t RegisterComponentType(std::uint32_t size);
+	static std::uint32_t ComponentSize(std::uint32_t type);
+	static std::uint32_t BitCount(Mask mask);
+
+	template<typename... Ts>
+	static Mask MaskOf();
+
+	template<typename... Ts, typename Func>
+	static void ForEachRow(Archetype& archetype, std::uint32_t begin, std::uint32_t end, const Func& func);
+
+	std::uint32_t FindArchetype(Mask components);
+	// Appends a row to an archetype with its components left zeroed.
+	std::uint32_t AddRow(std::uint32_t archetype, Entity entity);
+	void RemoveRow(std::uint32_t archetype, std::uint32_t row);
+	// Moves the entity to the archetype with these components, keeping those it has.
+	void MoveEntity(Entity entity, Mask components);
+	void* Component(std::uint32_t archetype, std::uint32_t row, std::uint32_t type);
+	const void* Component(std::uint32_t archetype, std::uint32_t row, std::uint32_t type)const;
+
+	std::vector<Archetype> mArchetypes;
+	std::unordered_map<Mask, std::uint32_t> mArchetypeIndices;
+
+	std::vector<Record> mRecords;
+	std::vector<std::uint32_t> mFreeIndices;
+
+	// Set while ForEach runs, which structural changes assert against.
+	int mIterating = 0;
+	std::vector<std::pair<std::uint32_t, std::uint32_t>> mBatches;
+};
+
+template<typename T>
+std::uint32_t EntityWorld::ComponentType()
+{
+	static_assert(std::is_trivially_copyable<T>::value, "components are moved with memcpy");
+	static_assert(alignof(T) <= alignof(std::max_align_t), "component arrays are only aligned for fundamental types");
+
+	static const std::uint32_t type = RegisterComponentType((std::uint32_t)sizeof(T));
+	return type;
+}
+
+template<typename... Ts>
+EntityWorld::Mask EntityWorld::MaskOf()
+{
+	// types[0] only keeps the array from being empty.
+	const std::uint32_t types[] = { 0, ComponentType<Ts>()... };
+	Mask mask = 0;
+	for (std::size_t i = 1; i < sizeof(types) / sizeof(types[0]); ++i)
+		mask |= Mask(1) << types[i];
+	return mask;
+}
+
+template<typename... Ts>
+Entity EntityWorld::Create(const Ts&... components)
+{
+	assert(mIterating == 0);
+	const Mask mask = MaskOf<Ts...>();
+	assert(BitCount(mask) == sizeof...(Ts));
+
+	Entity entity;
+	if (mFreeIndices.empty())
+	{
+		entity.Index = (std::uint32_t)mRecords.size();
+		mRecords.push_back(Record{ 0, 0, 0 });
+	}
+	else
+	{
+		entity.Index = mFreeIndices.back();
+		mFreeIndices.pop_back();
+	}
+	entity.Generation = mRecords[entity.Index].Generation;
+
+	const std::uint32_t archetype = FindArchetype(mask);
+	const std::uint32_t row = AddRow(archetype, entity);
+	mRecords[entity.Index].Archetype = archetype;
+	mRecords[entity.Index].Row = row;
+
+	const int copies[] = { 0, (std::memcpy(Component(archetype, row, ComponentType<Ts>()), &components, sizeof(Ts)), 0)... };
+	(void)copies;
+	return entity;
+}
+
+template<typename T>
+bool EntityWorld::Has(Entity entity)const
+{
+	assert(Alive(entity));
+	return (mArchetypes[mRecords[entity.Index].Archetype].Components & (Mask(1) << ComponentType<T>())) != 0;
+}
+
+template<typename T>
+T& EntityWorld::Get(Entity entity)
+{
+	assert(Has<T>(entity));
+	const Record& record = mRecords[entity.Index];
+	return *static_cast<T*>(Component(record.Archetype, record.Row, ComponentType<T>()));
+}
+
+template<typename T>
+const T& EntityWorld::Get(Entity entity)const
+{
+	assert(Has<T>(entity));
+	const Record& record = mRecords[entity.Index];
+	return *static_cast<const T*>(Component(record.Archetype, record.Row, ComponentType<T>()));
+}
+
+template<typename T>
+void EntityWorld::Add(Entity entity, const T& component)
+{
+	if (!Has<T>(entity))
+		MoveEntity(entity, mArchetypes[mRecords[entity.Index].Archetype].Components | (Mask(1) << ComponentType<T>()));
+	Get<T>(entity) = component;
+}
+
+template<typename T>
+void EntityWorld::Remove(Entity entity)
+{
+	if (Has<T>(entity))
+		MoveEntity(entity, mArchetypes[mRecords[entity.Index].Archetype].Components & ~(Mask(1) << ComponentType<T>()));
+}
+
+template<typename... Ts, typename Func>
+void EntityWorld::ForEachRow(Archetype& archetype, std::uint32_t begin, std::uint32_t end, const Func& func)
+{
+	const std::tuple<Ts*...> columns(reinterpret_cast<Ts*>(archetype.Columns[archetype.ColumnOf[ComponentType<Ts>()]].Data.data())...);
+	const Entity* entities = archetype.Entities.data();
+	for (std::uint32_t row = begin; row < end; ++row)
+		func(entities[row], std::get<Ts*>(columns)[row]...);
+}
+
+template<typename... Ts, typename Func>
+void EntityWorld::ForEach(const Func& func)
+{
+	const Mask mask = MaskOf<Ts...>();
+	++mIterating;
+	for (Archetype& archetype : mArchetypes)
+	{
+		if ((archetype.Components & mask) == mask)
+			ForEachRow<Ts...>(archetype, 0, (std::uint32_t)archetype.Entities.size(), func);
+	}
+	--mIterating;
+}
+
+template<typename... Ts, typename Func>
+void EntityWorld::ParallelForEach(const Func& func)
+{
+	// Blocks of rows as (archetype, first row).
+	const Mask mask = MaskOf<Ts...>();
+	mBatches.clear();
+	for (std::uint32_t a = 0; a < mArchetypes.size(); ++a)
+	{
+		if ((mArchetypes[a].Components & mask) != mask)
+			continue;
+		for (std::uint32_t row = 0; row < mArchetypes[a].Entities.size(); row += ParallelBatch)
+			mBatches.push_back(std::make_pair(a, row));
+	}
+
+	++mIterating;
+	auto batch = [&](std::uint32_t b)
+	{
+		Archetype& archetype = mArchetypes[mBatches[b].first];
+		const std::uint32_t begin = mBatches[b].second;
+		const std::uint32_t end = std::min<std::uint32_t>(begin + ParallelBatch, (std::uint32_t)archetype.Entities.size());
+		ForEachRow<Ts...>(archetype, begin, end, func);
+	};
+	if (mBatches.size() == 1)
+		batch(0);
+	else if (mBatches.size() > 1)
+		ParallelFor((std::uint32_t)mBatches.size(), batch);
+	--mIterating;
+}
+
+template<typename... Ts>
+std::uint32_t EntityWorld::Count()const
+{
+	const Mask mask = MaskOf<Ts...>();
+	std::uint32_t count = 0;
+	for (const Archetype& archetype : mArchetypes)
+	{
+		if ((archetype.Components & mask) == mask)
+			count += (std::uint32_t)archetype.Entities.size();
+	}
+	return count;
+}
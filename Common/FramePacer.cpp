@@ -0,0 +1,197 @@
+//***************************************************************************************
+// FramePacer.cpp
+//***************************************************************************************
+
+#include "FramePacer.h"
+#include <algorithm>
+#include <cassert>
+
+#ifdef _WIN32
+#include "d3dUtil.h"
+#endif
+
+std::uint64_t ThroughputPacingPolicy::WaitValue(std::uint64_t resourceFence, std::uint64_t /*lastSubmittedFence*/)const
+{
+	return resourceFence;
+}
+
+LatencyPacingPolicy::LatencyPacingPolicy(int maxFramesInFlight)
+	: mMaxFramesInFlight((std::max)(1, maxFramesInFlight))
+{
+}
+
+std::uint64_t LatencyPacingPolicy::WaitValue(std::uint64_t resourceFence, std::uint64_t lastSubmittedFence)const
+{
+	// With k frames in flight at most k-1 submitted frames may still be pending
+	// once we start recording, so the GPU must have reached lastSubmitted-(k-1).
+	const std::uint64_t pendingAllowed = (std::uint64_t)(mMaxFramesInFlight - 1);
+	std::uint64_t latencyFence = lastSubmittedFence > pendingAllowed ? lastSubmittedFence - pendingAllowed : 0;
+
+	return (std::max)(resourceFence, latencyFence);
+}
+
+FramePacer::FramePacer(GpuTimeline& timeline, std::unique_ptr<FramePacingPolicy> policy, int frameResourceCount)
+	: mTimeline(timeline),
+	mPolicy(std::move(policy)),
+	mFrameFences((std::max)(1, frameResourceCount), 0),
+	mCurrIndex(0)
+{
+	assert(mPolicy != nullptr);
+}
+
+int FramePacer::BeginFrame()
+{
+	// Cycle through the circular frame resource array.
+	mCurrIndex = (mCurrIndex + 1) % FrameResourceCount();
+
+	// Let the swap chain throttle us first; it is the cheaper wait and usually
+	// already covers the fence wait below.
+	mTimeline.WaitForPresentSlot();
+
+	// Has the GPU finished processing the commands the policy cares about?
+	// If not, wait until the GPU has completed commands up to that fence point.
+	std::uint64_t waitValue = mPolicy->WaitValue(mFrameFences[mCurrIndex], mLastSubmittedFence);
+	if (waitValue != 0 && mTimeline.CompletedValue() < waitValue)
+	{
+		mTimeline.WaitForValue(waitValue);
+		++mStallCount;
+	}
+
+	return mCurrIndex;
+}
+
+void FramePacer::EndFrame(std::uint64_t fenceValue)
+{
+	mFrameFences[mCurrIndex] = fenceValue;
+	mLastSubmittedFence = fenceValue;
+}
+
+SimulatedGpuTimeline::SimulatedGpuTimeline(int maxFrameLatency)
+	: mMaxFrameLatency((std::max)(0, maxFrameLatency))
+{
+}
+
+std::uint64_t SimulatedGpuTimeline::CompletedValue()const
+{
+	// The GPU runs in order, so completion times only grow.
+	auto it = std::upper_bound(mSignals.begin(), mSignals.end(), mCpuTimeMs,
+		[](double t, const Signal& s) { return t < s.CompletionMs; });
+
+	return it != mSignals.begin() ? (it - 1)->Value : 0;
+}
+
+double SimulatedGpuTimeline::CompletionTime(std::uint64_t fenceValue)const
+{
+	// Signals are submitted in increasing order, so the first signal at or past
+	// the value is the one that releases a waiter.
+	auto it = std::lower_bound(mSignals.begin(), mSignals.end(), fenceValue,
+		[](const Signal& s, std::uint64_t v) { return s.Value < v; });
+
+	assert(it != mSignals.end() && "Waiting on a fence value that was never submitted.");
+	return it != mSignals.end() ? it->CompletionMs : mCpuTimeMs;
+}
+
+void SimulatedGpuTimeline::WaitForValue(std::uint64_t value)
+{
+	mCpuTimeMs = (std::max)(mCpuTimeMs, CompletionTime(value));
+}
+
+void SimulatedGpuTimeline::WaitForPresentSlot()
+{
+	// DXGI releases the waitable object when a queued frame is presented, so at most
+	// mMaxFrameLatency frames can be queued ahead of the display.
+	if (mMaxFrameLatency == 0 || (int)mSignals.size() < mMaxFrameLatency)
+		return;
+
+	const Signal& oldest = mSignals[mSignals.size() - mMaxFrameLatency];
+	mCpuTimeMs = (std::max)(mCpuTimeMs, oldest.CompletionMs);
+}
+
+void SimulatedGpuTimeline::Submit(std::uint64_t fenceValue, double gpuMs)
+{
+	assert(mSignals.empty() || mSignals.back().Value < fenceValue);
+
+	double start = (std::max)(mCpuTimeMs, mGpuFreeMs);
+	mGpuFreeMs = start + gpuMs;
+	mSignals.push_back({ fenceValue, mGpuFreeMs });
+}
+
+FramePacingSimResult SimulateFramePacing(std::unique_ptr<FramePacingPolicy> policy,
+	int frameResourceCount, int maxFrameLatency, double cpuMs, double gpuMs, int frameCount)
+{
+	SimulatedGpuTimeline timeline(maxFrameLatency);
+	FramePacer pacer(timeline, std::move(policy), frameResourceCount);
+
+	FramePacingSimResult result;
+	if (frameCount <= 0)
+		return result;
+
+	double totalLatencyMs = 0.0;
+	std::uint64_t fence = 0;
+	for (int i = 0; i < frameCount; ++i)
+	{
+		pacer.BeginFrame();
+		double frameStartMs = timeline.CpuTime();
+
+		timeline.AdvanceCpu(cpuMs);
+		timeline.Submit(++fence, gpuMs);
+		pacer.EndFrame(fence);
+
+		totalLatencyMs += timeline.CompletionTime(fence) - frameStartMs;
+	}
+
+	double totalMs = timeline.CompletionTime(fence);
+	result.AverageLatencyMs = totalLatencyMs / frameCount;
+	result.FramesPerSecond = totalMs > 0.0 ? 1000.0 * frameCount / totalMs : 0.0;
+	result.Stalls = pacer.StallCount();
+
+	return result;
+}
+
+#ifdef _WIN32
+D3D12FenceTimeline::D3D12FenceTimeline(ID3D12Fence* fence)
+	: mFence(fence)
+{
+	mFenceEvent = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+	if (mFenceEvent == nullptr)
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+}
+
+D3D12FenceTimeline::~D3D12FenceTimeline()
+{
+	SetFrameLatencyWaitableObject(nullptr);
+
+	if (mFenceEvent != nullptr)
+		CloseHandle(mFenceEvent);
+}
+
+std::uint64_t D3D12FenceTimeline::CompletedValue()const
+{
+	return mFence->GetCompletedValue();
+}
+
+void D3D12FenceTimeline::WaitForValue(std::uint64_t value)
+{
+	if (mFence->GetCompletedValue() >= value)
+		return;
+
+	// Fire event when GPU hits the fence value, then wait on it.  The event is
+	// auto-reset, so it is ready for the next wait as soon as this one returns.
+	ThrowIfFailed(mFence->SetEventOnCompletion(value, mFenceEvent));
+	WaitForSingleObject(mFenceEvent, INFINITE);
+}
+
+void D3D12FenceTimeline::WaitForPresentSlot()
+{
+	if (mFrameLatencyWaitableObject != nullptr)
+		WaitForSingleObjectEx(mFrameLatencyWaitableObject, 1000, true);
+}
+
+void D3D12FenceTimeline::SetFrameLatencyWaitableObject(HANDLE waitableObject)
+{
+	if (mFrameLatencyWaitableObject != nullptr)
+		CloseHandle(mFrameLatencyWaitableObject);
+
+	mFrameLatencyWaitableObject = waitableObject;
+}
+#endif
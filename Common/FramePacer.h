@@ -0,0 +1,186 @@
+//***************************************************************************************
+// FramePacer.h
+//
+// Decides when the CPU may start recording the next frame.  The app cycles through a
+// ring of frame resources; before one can be reused the GPU must have finished the
+// commands that last referenced it.  How far ahead the CPU is allowed to run is a
+// FramePacingPolicy, and the GPU side is hidden behind a GpuTimeline so the same
+// pacing code runs against a real ID3D12Fence or against SimulatedGpuTimeline, which
+// needs no device or window.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <wrl.h>
+#include <d3d12.h>
+#endif
+
+// The GPU side of frame pacing: fence progress plus the swap chain's present queue.
+class GpuTimeline
+{
+public:
+	virtual ~GpuTimeline() = default;
+
+	// Largest fence value the GPU has reached.
+	virtual std::uint64_t CompletedValue()const = 0;
+
+	// Blocks the calling thread until the GPU reaches the given fence value.
+	virtual void WaitForValue(std::uint64_t value) = 0;
+
+	// Blocks until the swap chain can accept another frame.  No-op when the
+	// timeline has no latency waitable object.
+	virtual void WaitForPresentSlot() = 0;
+};
+
+// Chooses the fence value the CPU waits on before starting a frame.
+class FramePacingPolicy
+{
+public:
+	virtual ~FramePacingPolicy() = default;
+
+	// resourceFence is the fence of the last frame that used the frame resource about
+	// to be reused; lastSubmittedFence is the fence of the most recently submitted frame.
+	virtual std::uint64_t WaitValue(std::uint64_t resourceFence, std::uint64_t lastSubmittedFence)const = 0;
+
+	virtual const char* Name()const = 0;
+};
+
+// Only waits when the frame resource is still in use, so the CPU may run up to
+// FrameResourceCount-1 frames ahead.  Best throughput, highest input latency.
+class ThroughputPacingPolicy : public FramePacingPolicy
+{
+public:
+	std::uint64_t WaitValue(std::uint64_t resourceFence, std::uint64_t lastSubmittedFence)const override;
+	const char* Name()const override { return "throughput"; }
+};
+
+// Caps the number of frames in flight (including the one being recorded) at
+// maxFramesInFlight, independent of how many frame resources exist.  A value of 1
+// serializes CPU and GPU for the lowest latency.
+class LatencyPacingPolicy : public FramePacingPolicy
+{
+public:
+	explicit LatencyPacingPolicy(int maxFramesInFlight);
+
+	std::uint64_t WaitValue(std::uint64_t resourceFence, std::uint64_t lastSubmittedFence)const override;
+	const char* Name()const override { return "latency"; }
+
+private:
+	int mMaxFramesInFlight = 1;
+};
+
+class FramePacer
+{
+public:
+	FramePacer(GpuTimeline& timeline, std::unique_ptr<FramePacingPolicy> policy, int frameResourceCount);
+	FramePacer(const FramePacer& rhs) = delete;
+	FramePacer& operator=(const FramePacer& rhs) = delete;
+
+	int FrameResourceCount()const { return (int)mFrameFences.size(); }
+	int CurrentFrameResourceIndex()const { return mCurrIndex; }
+	const FramePacingPolicy& Policy()const { return *mPolicy; }
+
+	// Number of BeginFrame calls that had to block on the GPU.
+	std::uint64_t StallCount()const { return mStallCount; }
+
+	// Advances to the next frame resource and blocks until the policy lets the CPU
+	// write to it.  Returns the index of the frame resource to use.
+	int BeginFrame();
+
+	// Marks the commands recorded with the current frame resource as ending at
+	// fenceValue.  The value must already have been signaled on the queue.
+	void EndFrame(std::uint64_t fenceValue);
+
+private:
+	GpuTimeline& mTimeline;
+	std::unique_ptr<FramePacingPolicy> mPolicy;
+
+	// Fence value to mark commands up to this fence point, one per frame resource.
+	// This lets us check if a frame resource is still in use by the GPU.
+	std::vector<std::uint64_t> mFrameFences;
+	int mCurrIndex = 0;
+
+	std::uint64_t mLastSubmittedFence = 0;
+	std::uint64_t mStallCount = 0;
+};
+
+// Deterministic GPU model: every submitted frame costs a fixed amount of GPU time and
+// executes in order once the CPU has submitted it.  The CPU clock only moves when the
+// caller advances it or blocks in a wait, so pacing policies can be compared headless.
+class SimulatedGpuTimeline : public GpuTimeline
+{
+public:
+	// maxFrameLatency emulates a DXGI frame latency waitable object; 0 disables it.
+	explicit SimulatedGpuTimeline(int maxFrameLatency = 0);
+
+	std::uint64_t CompletedValue()const override;
+	void WaitForValue(std::uint64_t value) override;
+	void WaitForPresentSlot() override;
+
+	// Spends CPU time on the simulated clock.
+	void AdvanceCpu(double ms) { mCpuTimeMs += ms; }
+
+	// Queues gpuMs worth of GPU work followed by a signal of fenceValue.
+	void Submit(std::uint64_t fenceValue, double gpuMs);
+
+	double CpuTime()const { return mCpuTimeMs; }
+
+	// Time at which fenceValue completes (or will complete) on the GPU.
+	double CompletionTime(std::uint64_t fenceValue)const;
+
+private:
+	struct Signal
+	{
+		std::uint64_t Value;
+		double CompletionMs;
+	};
+
+	std::vector<Signal> mSignals;
+	double mCpuTimeMs = 0.0;
+	double mGpuFreeMs = 0.0;
+	int mMaxFrameLatency = 0;
+};
+
+struct FramePacingSimResult
+{
+	double AverageLatencyMs = 0.0; // CPU frame start to GPU completion.
+	double FramesPerSecond = 0.0;
+	std::uint64_t Stalls = 0;
+};
+
+// Runs frameCount frames with fixed CPU and GPU cost through a FramePacer backed by
+// SimulatedGpuTimeline and reports the resulting latency and throughput.
+FramePacingSimResult SimulateFramePacing(std::unique_ptr<FramePacingPolicy> policy,
+	int frameResourceCount, int maxFrameLatency, double cpuMs, double gpuMs, int frameCount);
+
+#ifdef _WIN32
+// GpuTimeline over an ID3D12Fence.  Owns one auto-reset event that is reused for
+// every wait instead of creating and closing an event per wait.
+class D3D12FenceTimeline : public GpuTimeline
+{
+public:
+	explicit D3D12FenceTimeline(ID3D12Fence* fence);
+	D3D12FenceTimeline(const D3D12FenceTimeline& rhs) = delete;
+	D3D12FenceTimeline& operator=(const D3D12FenceTimeline& rhs) = delete;
+	~D3D12FenceTimeline();
+
+	std::uint64_t CompletedValue()const override;
+	void WaitForValue(std::uint64_t value) override;
+	void WaitForPresentSlot() override;
+
+	// Takes ownership of a handle from IDXGISwapChain2::GetFrameLatencyWaitableObject.
+	// Pass nullptr to stop waiting on the swap chain.
+	void SetFrameLatencyWaitableObject(HANDLE waitableObject);
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
+	HANDLE mFenceEvent = nullptr;
+	HANDLE mFrameLatencyWaitableObject = nullptr;
+};
+#endif
@@ -0,0 +1,176 @@
+//***************************************************************************************
+// FrameStats.cpp
+//***************************************************************************************
+
+#include "FrameStats.h"
+#include <algorithm>
+#include <fstream>
+
+const char* FramePhaseName(FramePhase phase)
+{
+	static const char* names[(int)FramePhase::Count] =
+	{
+		"input", "collision", "wave_sim", "cb_upload", "record", "submit",
+		"gpu_frame", "gpu_opaque", "gpu_alpha_tested", "gpu_tree_sprites", "gpu_transparent"
+	};
+
+	return names[(int)phase];
+}
+
+static std::size_t RoundUpToPowerOfTwo(std::size_t n)
+{
+	std::size_t p = 1;
+	while (p < n)
+		p <<= 1;
+	return p;
+}
+
+FrameStats::FrameStats(std::size_t ringCapacity)
+	: mRing(RoundUpToPowerOfTwo(std::max<std::size_t>(ringCapacity, 1))),
+	mHistogram(BucketCount, 0)
+{
+	mRingMask = mRing.size() - 1;
+}
+
+void FrameStats::EndFrame(double frameMs)
+{
+	mCurrent.FrameIndex = mFrameCount;
+	mCurrent.FrameMs = (float)frameMs;
+
+	// Compare against the average before this frame so one long frame cannot hide itself.
+	mCurrent.Hitch = mFrameCount > 0 && frameMs > HitchFactor * mAverageMs;
+	mAverageMs = mFrameCount == 0 ? frameMs : 0.9 * mAverageMs + 0.1 * frameMs;
+
+	int bucket = std::min((int)(frameMs / BucketMs), BucketCount - 1);
+	mHistogram[std::max(bucket, 0)]++;
+
+	mFrameCount++;
+	mHitchCount += mCurrent.Hitch ? 1 : 0;
+	mTotalFrameMs += frameMs;
+	mMaxFrameMs = std::max(mMaxFrameMs, frameMs);
+	for (int i = 0; i < (int)FramePhase::Count; ++i)
+		mTotalPhaseMs[i] += mCurrent.PhaseMs[i];
+
+	// Write the slot, then publish it.  Readers never look at an unpublished slot.
+	std::uint64_t index = mPublished.load(std::memory_order_relaxed);
+	mRing[index & mRingMask] = mCurrent;
+	mPublished.store(index + 1, std::memory_order_release);
+
+	mCurrent = FrameSample();
+}
+
+void FrameStats::Reset()
+{
+	mPublished.store(0, std::memory_order_release);
+	mCurrent = FrameSample();
+
+	std::fill(mHistogram.begin(), mHistogram.end(), 0);
+	mFrameCount = 0;
+	mHitchCount = 0;
+	mTotalFrameMs = 0.0;
+	mMaxFrameMs = 0.0;
+	mAverageMs = 0.0;
+	std::fill(std::begin(mTotalPhaseMs), std::end(mTotalPhaseMs), 0.0);
+}
+
+double FrameStats::PercentileMs(double percentile)const
+{
+	if (mFrameCount == 0)
+		return 0.0;
+
+	// Smallest bucket whose cumulative count reaches the requested rank.
+	std::uint64_t rank = (std::uint64_t)(percentile / 100.0 * (double)(mFrameCount - 1)) + 1;
+	std::uint64_t cumulative = 0;
+	for (int i = 0; i < BucketCount; ++i)
+	{
+		cumulative += mHistogram[i];
+		if (cumulative >= rank)
+			return std::min((i + 1) * BucketMs, mMaxFrameMs);
+	}
+
+	return mMaxFrameMs;
+}
+
+double FrameStats::AverageFrameMs()const
+{
+	return mFrameCount > 0 ? mTotalFrameMs / (double)mFrameCount : 0.0;
+}
+
+double FrameStats::AveragePhaseMs(FramePhase phase)const
+{
+	return mFrameCount > 0 ? mTotalPhaseMs[(int)phase] / (double)mFrameCount : 0.0;
+}
+
+std::size_t FrameStats::ReadRecent(FrameSample* out, std::size_t maxCount)const
+{
+	std::uint64_t published = mPublished.load(std::memory_order_acquire);
+	std::uint64_t available = std::min<std::uint64_t>(published, mRing.size());
+	std::uint64_t count = std::min<std::uint64_t>(available, maxCount);
+	std::uint64_t first = published - count;
+
+	for (std::uint64_t i = 0; i < count; ++i)
+		out[i] = mRing[(first + i) & mRingMask];
+
+	// The producer may have lapped us while copying.  Drop the samples whose slots
+	// were overwritten (or are being overwritten) by frames published since.
+	std::uint64_t latest = mPublished.load(std::memory_order_acquire);
+	std::uint64_t oldestValid = latest + 1 > mRing.size() ? latest + 1 - mRing.size() : 0;
+	if (first >= oldestValid)
+		return (std::size_t)count;
+
+	std::uint64_t skip = std::min(oldestValid - first, count);
+	std::copy(out + skip, out + count, out);
+	return (std::size_t)(count - skip);
+}
+
+bool FrameStats::WriteCsv(const std::string& filename)const
+{
+	std::ofstream fout(filename);
+	if (!fout)
+		return false;
+
+	fout << "frame,frame_ms";
+	for (int i = 0; i < (int)FramePhase::Count; ++i)
+		fout << "," << FramePhaseName((FramePhase)i) << "_ms";
+	fout << ",hitch\n";
+
+	std::vector<FrameSample> samples(mRing.size());
+	samples.resize(ReadRecent(samples.data(), samples.size()));
+
+	for (const auto& s : samples)
+	{
+		fout << s.FrameIndex << "," << s.FrameMs;
+		for (int i = 0; i < (int)FramePhase::Count; ++i)
+			fout << "," << s.PhaseMs[i];
+		fout << "," << (s.Hitch ? 1 : 0) << "\n";
+	}
+
+	return (bool)fout;
+}
+
+bool FrameStats::WriteJson(const std::string& filename)const
+{
+	std::ofstream fout(filename);
+	if (!fout)
+		return false;
+
+	fout << "{\n";
+	fout << "  \"frames\": " << mFrameCount << ",\n";
+	fout << "  \"hitches\": " << mHitchCount << ",\n";
+	fout << "  \"frame_ms\": { "
+		<< "\"avg\": " << AverageFrameMs() << ", "
+		<< "\"p50\": " << PercentileMs(50.0) << ", "
+		<< "\"p95\": " << PercentileMs(95.0) << ", "
+		<< "\"p99\": " << PercentileMs(99.0) << ", "
+		<< "\"max\": " << mMaxFrameMs << " },\n";
+	fout << "  \"phase_avg_ms\": { ";
+	for (int i = 0; i < (int)FramePhase::Count; ++i)
+	{
+		fout << (i > 0 ? ", " : "") << "\"" << FramePhaseName((FramePhase)i) << "\": "
+			<< AveragePhaseMs((FramePhase)i);
+	}
+	fout << " }\n";
+	fout << "}\n";
+
+	return (bool)fout;
+}
@@ -0,0 +1,118 @@
+//***************************************************************************************
+// FrameStats.h
+//
+// Per-frame timing statistics: frame time percentiles, hitch counts and CPU/GPU time
+// per frame phase.  The producer (the game loop) writes one FrameSample per frame into a
+// single-producer ring buffer; other threads can read recent samples without locks.
+// A fixed-bucket histogram covers the whole run so percentiles do not depend on the
+// ring size.
+//***************************************************************************************
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "GameTimer.h"
+
+enum class FramePhase : int
+{
+	Input = 0,
+	Collision,
+	WaveSim,
+	CBUpload,
+	Record,
+	Submit,
+
+	// GPU phases come from timestamp queries (see GpuProfiler.h) and are added to
+	// the frame in which they are read back, a few frames after they ran.
+	GpuFrame,
+	GpuOpaque,
+	GpuAlphaTested,
+	GpuTreeSprites,
+	GpuTransparent,
+	Count
+};
+
+const char* FramePhaseName(FramePhase phase);
+
+struct FrameSample
+{
+	std::uint64_t FrameIndex = 0;
+	float FrameMs = 0.0f;
+	float PhaseMs[(int)FramePhase::Count] = {};
+	bool Hitch = false;
+};
+
+class FrameStats
+{
+public:
+	// ringCapacity is rounded up to a power of two.
+	explicit FrameStats(std::size_t ringCapacity = 4096);
+	FrameStats(const FrameStats& rhs) = delete;
+	FrameStats& operator=(const FrameStats& rhs) = delete;
+
+	// Producer side.  Phase times accumulate into the frame in progress until
+	// EndFrame publishes it.
+	void AddPhaseTime(FramePhase phase, double ms) { mCurrent.PhaseMs[(int)phase] += (float)ms; }
+	void EndFrame(double frameMs);
+	void Reset();
+
+	// Whole-run summary.  Producer thread only.
+	std::uint64_t FrameCount()const { return mFrameCount; }
+	std::uint64_t HitchCount()const { return mHitchCount; }
+	double PercentileMs(double percentile)const;
+	double AverageFrameMs()const;
+	double MaxFrameMs()const { return mMaxFrameMs; }
+	double AveragePhaseMs(FramePhase phase)const;
+
+	// Copies up to maxCount of the most recent samples, oldest first, and returns how
+	// many were copied.  Safe to call from any thread while the producer runs.
+	std::size_t ReadRecent(FrameSample* out, std::size_t maxCount)const;
+
+	// Frame-by-frame CSV of the samples still in the ring.
+	bool WriteCsv(const std::string& filename)const;
+	// Whole-run summary as JSON.
+	bool WriteJson(const std::string& filename)const;
+
+	// A frame is a hitch when it takes longer than HitchFactor times the recent average.
+	static constexpr double HitchFactor = 2.0;
+
+private:
+	// Histogram covers [0, BucketCount*BucketMs); longer frames land in the last bucket.
+	static constexpr int BucketCount = 1000;
+	static constexpr double BucketMs = 0.1;
+
+	std::vector<FrameSample> mRing;
+	std::size_t mRingMask = 0;
+	std::atomic<std::uint64_t> mPublished{ 0 };
+
+	FrameSample mCurrent;
+
+	std::vector<std::uint32_t> mHistogram;
+	std::uint64_t mFrameCount = 0;
+	std::uint64_t mHitchCount = 0;
+	double mTotalFrameMs = 0.0;
+	double mMaxFrameMs = 0.0;
+	double mAverageMs = 0.0; // exponential moving average used for hitch detection
+	double mTotalPhaseMs[(int)FramePhase::Count] = {};
+};
+
+// Adds the time spent in its scope to one phase of the current frame.
+class ScopedFramePhase
+{
+public:
+	ScopedFramePhase(FrameStats& stats, FramePhase phase)
+		: mStats(stats), mPhase(phase), mStart(GameTimer::Ticks()) { }
+	~ScopedFramePhase() { mStats.AddPhaseTime(mPhase, GameTimer::TicksToMs(GameTimer::Ticks() - mStart)); }
+
+	ScopedFramePhase(const ScopedFramePhase& rhs) = delete;
+	ScopedFramePhase& operator=(const ScopedFramePhase& rhs) = delete;
+
+private:
+	FrameStats& mStats;
+	FramePhase mPhase;
+	long long mStart;
+};
@@ -125,8 +125,21 @@ void GameTimer::Tick()
 	}
 }
 
+long long GameTimer::Ticks()
+{
+	__int64 currTime;
+	QueryPerformanceCounter((LARGE_INTEGER*)&currTime);
+	return currTime;
+}
 
+double GameTimer::TicksToMs(long long ticks)
+{
+	static const double msPerCount = []()
+	{
+		__int64 countsPerSec;
+		QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
+		return 1000.0 / (double)countsPerSec;
+	}();
 
-
-
-
+	return (double)ticks * msPerCount;
+}
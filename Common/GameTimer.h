@@ -18,15 +18,20 @@ public:
 	void Stop();  // Call when paused.
 	void Tick();  // Call every frame.
 
+	// Raw high-resolution clock the timer is built on, for code that needs to time
+	// intervals shorter than a frame.
+	static long long Ticks();
+	static double TicksToMs(long long ticks);
+
 private:
 	double mSecondsPerCount;
 	double mDeltaTime;
 
-	__int64 mBaseTime;
-	__int64 mPausedTime;
-	__int64 mStopTime;
-	__int64 mPrevTime;
-	__int64 mCurrTime;
+	long long mBaseTime;
+	long long mPausedTime;
+	long long mStopTime;
+	long long mPrevTime;
+	long long mCurrTime;
 
 	bool mStopped;
 };
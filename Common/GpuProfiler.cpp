@@ -0,0 +1,188 @@
+//***************************************************************************************
+// GpuProfiler.cpp
+//***************************************************************************************
+
+#include "GpuProfiler.h"
+#include <algorithm>
+#include <cassert>
+
+#ifdef _WIN32
+#include "d3dUtil.h"
+#endif
+
+GpuProfiler::GpuProfiler(GpuTimestampBackend& backend, const GpuTimeline& timeline,
+	int frameResourceCount, int maxScopesPerFrame)
+	: mBackend(backend),
+	mTimeline(timeline),
+	mFrames(std::max(1, frameResourceCount)),
+	mTimestamps(2 * std::max(1, maxScopesPerFrame)),
+	mMaxScopesPerFrame(std::max(1, maxScopesPerFrame))
+{
+	for (auto& frame : mFrames)
+		frame.Scopes.reserve(mMaxScopesPerFrame);
+}
+
+void GpuProfiler::BeginFrame(int frameResourceIndex, FrameStats& stats)
+{
+	assert(frameResourceIndex >= 0 && frameResourceIndex < (int)mFrames.size());
+
+	// Frame resources are used round-robin, so starting at the one about to be reused
+	// visits the pending frames oldest first.
+	const int count = (int)mFrames.size();
+	for (int k = 0; k < count; ++k)
+	{
+		int index = (frameResourceIndex + k) % count;
+		if (mFrames[index].Pending && mTimeline.CompletedValue() >= mFrames[index].Fence)
+			ReadFrame(index, stats);
+	}
+
+	PendingFrame& frame = mFrames[frameResourceIndex];
+	if (frame.Pending)
+	{
+		// Its queries are about to be overwritten.
+		frame.Pending = false;
+		++mDroppedFrames;
+	}
+
+	frame.Scopes.clear();
+	frame.QueryCount = 0;
+	frame.FrameNumber = mFrameNumber++;
+	frame.Fence = 0;
+	mCurrIndex = frameResourceIndex;
+}
+
+int GpuProfiler::BeginScope(FramePhase phase)
+{
+	PendingFrame& frame = mFrames[mCurrIndex];
+	if ((int)frame.Scopes.size() >= mMaxScopesPerFrame)
+		return -1;
+
+	Scope scope = { phase, frame.QueryCount++, -1 };
+	mBackend.WriteTimestamp(mCurrIndex, scope.BeginQuery);
+	frame.Scopes.push_back(scope);
+
+	return (int)frame.Scopes.size() - 1;
+}
+
+void GpuProfiler::EndScope(int scope)
+{
+	PendingFrame& frame = mFrames[mCurrIndex];
+	if (scope < 0 || scope >= (int)frame.Scopes.size())
+		return;
+
+	frame.Scopes[scope].EndQuery = frame.QueryCount++;
+	mBackend.WriteTimestamp(mCurrIndex, frame.Scopes[scope].EndQuery);
+}
+
+void GpuProfiler::ResolveFrame()
+{
+	PendingFrame& frame = mFrames[mCurrIndex];
+	if (frame.QueryCount > 0)
+		mBackend.ResolveTimestamps(mCurrIndex, frame.QueryCount);
+}
+
+void GpuProfiler::EndFrame(std::uint64_t fenceValue)
+{
+	PendingFrame& frame = mFrames[mCurrIndex];
+	frame.Fence = fenceValue;
+	frame.Pending = frame.QueryCount > 0;
+}
+
+void GpuProfiler::ReadFrame(int frameResourceIndex, FrameStats& stats)
+{
+	PendingFrame& frame = mFrames[frameResourceIndex];
+	mBackend.ReadTimestamps(frameResourceIndex, frame.QueryCount, mTimestamps.data());
+
+	const double ticksToMs = 1000.0 / (double)mBackend.Frequency();
+	for (const auto& scope : frame.Scopes)
+	{
+		// A scope left open has no end timestamp.
+		if (scope.EndQuery < 0)
+			continue;
+
+		std::uint64_t begin = mTimestamps[scope.BeginQuery];
+		std::uint64_t end = mTimestamps[scope.EndQuery];
+		stats.AddPhaseTime(scope.Phase, end > begin ? (double)(end - begin) * ticksToMs : 0.0);
+	}
+
+	frame.Pending = false;
+	mResolveLatency = mFrameNumber - frame.FrameNumber;
+	++mResolvedFrames;
+}
+
+SimulatedTimestampBackend::SimulatedTimestampBackend(int frameResourceCount, int maxQueriesPerFrame,
+	std::uint64_t frequency)
+	: mQueries(std::max(1, frameResourceCount), std::vector<std::uint64_t>(std::max(1, maxQueriesPerFrame), 0)),
+	mReadback(mQueries),
+	mFrequency(std::max<std::uint64_t>(frequency, 1))
+{
+}
+
+void SimulatedTimestampBackend::WriteTimestamp(int frameResourceIndex, int queryIndex)
+{
+	mQueries[frameResourceIndex][queryIndex] = mNow;
+}
+
+void SimulatedTimestampBackend::ResolveTimestamps(int frameResourceIndex, int queryCount)
+{
+	std::copy_n(mQueries[frameResourceIndex].begin(), queryCount, mReadback[frameResourceIndex].begin());
+}
+
+void SimulatedTimestampBackend::ReadTimestamps(int frameResourceIndex, int queryCount, std::uint64_t* out)
+{
+	std::copy_n(mReadback[frameResourceIndex].begin(), queryCount, out);
+}
+
+#ifdef _WIN32
+D3D12TimestampBackend::D3D12TimestampBackend(ID3D12Device* device, ID3D12CommandQueue* queue,
+	ID3D12GraphicsCommandList* cmdList, int frameResourceCount, int maxQueriesPerFrame)
+	: mCommandList(cmdList)
+{
+	ThrowIfFailed(queue->GetTimestampFrequency(&mFrequency));
+
+	D3D12_QUERY_HEAP_DESC queryHeapDesc = {};
+	queryHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+	queryHeapDesc.Count = (UINT)maxQueriesPerFrame;
+	queryHeapDesc.NodeMask = 0;
+
+	for (int i = 0; i < frameResourceCount; ++i)
+	{
+		Microsoft::WRL::ComPtr<ID3D12QueryHeap> queryHeap;
+		ThrowIfFailed(device->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&queryHeap)));
+
+		Microsoft::WRL::ComPtr<ID3D12Resource> readback;
+		ThrowIfFailed(device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(sizeof(std::uint64_t) * maxQueriesPerFrame),
+			D3D12_RESOURCE_STATE_COPY_DEST,
+			nullptr,
+			IID_PPV_ARGS(&readback)));
+
+		mQueryHeaps.push_back(queryHeap);
+		mReadbackBuffers.push_back(readback);
+	}
+}
+
+void D3D12TimestampBackend::WriteTimestamp(int frameResourceIndex, int queryIndex)
+{
+	mCommandList->EndQuery(mQueryHeaps[frameResourceIndex].Get(), D3D12_QUERY_TYPE_TIMESTAMP, (UINT)queryIndex);
+}
+
+void D3D12TimestampBackend::ResolveTimestamps(int frameResourceIndex, int queryCount)
+{
+	mCommandList->ResolveQueryData(mQueryHeaps[frameResourceIndex].Get(), D3D12_QUERY_TYPE_TIMESTAMP,
+		0, (UINT)queryCount, mReadbackBuffers[frameResourceIndex].Get(), 0);
+}
+
+void D3D12TimestampBackend::ReadTimestamps(int frameResourceIndex, int queryCount, std::uint64_t* out)
+{
+	D3D12_RANGE readRange = { 0, sizeof(std::uint64_t) * queryCount };
+	D3D12_RANGE writeRange = { 0, 0 };
+
+	void* data = nullptr;
+	ThrowIfFailed(mReadbackBuffers[frameResourceIndex]->Map(0, &readRange, &data));
+	memcpy(out, data, sizeof(std::uint64_t) * queryCount);
+	mReadbackBuffers[frameResourceIndex]->Unmap(0, &writeRange);
+}
+#endif
@@ -0,0 +1,169 @@
+//***************************************************************************************
+// GpuProfiler.h
+//
+// GPU timings per render layer from timestamp queries.  Each frame resource owns its
+// own block of queries and readback memory; the queries written while recording a frame
+// are resolved on the GPU at the end of that frame and read back on the CPU a few frames
+// later, once its fence has completed, so reading never stalls.  Results go into the
+// same FrameStats as the CPU phase times.
+//
+// The device side is a GpuTimestampBackend.  D3D12TimestampBackend drives a real query
+// heap; SimulatedTimestampBackend returns synthetic timestamps so the resolve and
+// latency bookkeeping can run without a device.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "FramePacer.h"
+#include "FrameStats.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <wrl.h>
+#include <d3d12.h>
+#endif
+
+class GpuTimestampBackend
+{
+public:
+	virtual ~GpuTimestampBackend() = default;
+
+	// Timestamp ticks per second.
+	virtual std::uint64_t Frequency()const = 0;
+
+	// Records a write of the GPU clock into query queryIndex of the frame resource.
+	virtual void WriteTimestamp(int frameResourceIndex, int queryIndex) = 0;
+
+	// Records copying the first queryCount queries of the frame resource to its readback memory.
+	virtual void ResolveTimestamps(int frameResourceIndex, int queryCount) = 0;
+
+	// Copies resolved timestamps back to the CPU.  Only valid once the GPU has
+	// finished the frame that resolved them.
+	virtual void ReadTimestamps(int frameResourceIndex, int queryCount, std::uint64_t* out) = 0;
+};
+
+class GpuProfiler
+{
+public:
+	GpuProfiler(GpuTimestampBackend& backend, const GpuTimeline& timeline,
+		int frameResourceCount, int maxScopesPerFrame);
+	GpuProfiler(const GpuProfiler& rhs) = delete;
+	GpuProfiler& operator=(const GpuProfiler& rhs) = delete;
+
+	// Reads back every earlier frame whose fence has completed, adding its scope times
+	// to stats, then starts recording into frameResourceIndex.  A frame that has not
+	// completed by the time its frame resource comes round again is dropped.
+	void BeginFrame(int frameResourceIndex, FrameStats& stats);
+
+	// Brackets GPU work with timestamps.  Scopes may nest; scopes beyond
+	// maxScopesPerFrame are ignored.  BeginScope returns the handle for EndScope.
+	int BeginScope(FramePhase phase);
+	void EndScope(int scope);
+
+	// Records the resolve of this frame's queries.  Call before closing the command list.
+	void ResolveFrame();
+
+	// Marks this frame's commands as ending at fenceValue, once it has been signaled.
+	void EndFrame(std::uint64_t fenceValue);
+
+	// Frames between recording the most recently read frame and reading it back.
+	std::uint64_t ResolveLatency()const { return mResolveLatency; }
+	std::uint64_t ResolvedFrameCount()const { return mResolvedFrames; }
+	std::uint64_t DroppedFrameCount()const { return mDroppedFrames; }
+
+private:
+	struct Scope
+	{
+		FramePhase Phase;
+		int BeginQuery;
+		int EndQuery;
+	};
+
+	struct PendingFrame
+	{
+		std::vector<Scope> Scopes;
+		int QueryCount = 0;
+		std::uint64_t FrameNumber = 0;
+		std::uint64_t Fence = 0;
+		bool Pending = false;
+	};
+
+	void ReadFrame(int frameResourceIndex, FrameStats& stats);
+
+	GpuTimestampBackend& mBackend;
+	const GpuTimeline& mTimeline;
+	std::vector<PendingFrame> mFrames;
+	std::vector<std::uint64_t> mTimestamps;
+	int mMaxScopesPerFrame = 0;
+	int mCurrIndex = 0;
+
+	std::uint64_t mFrameNumber = 0;
+	std::uint64_t mResolveLatency = 0;
+	std::uint64_t mResolvedFrames = 0;
+	std::uint64_t mDroppedFrames = 0;
+};
+
+// Adds the GPU time of the work recorded in its scope to one phase.
+class ScopedGpuPhase
+{
+public:
+	ScopedGpuPhase(GpuProfiler& profiler, FramePhase phase)
+		: mProfiler(profiler), mScope(profiler.BeginScope(phase)) { }
+	~ScopedGpuPhase() { mProfiler.EndScope(mScope); }
+
+	ScopedGpuPhase(const ScopedGpuPhase& rhs) = delete;
+	ScopedGpuPhase& operator=(const ScopedGpuPhase& rhs) = delete;
+
+private:
+	GpuProfiler& mProfiler;
+	int mScope;
+};
+
+// Synthetic GPU clock.  The caller advances it to stand in for GPU work; a timestamp
+// takes the clock value when it is written and becomes readable once resolved.
+class SimulatedTimestampBackend : public GpuTimestampBackend
+{
+public:
+	SimulatedTimestampBackend(int frameResourceCount, int maxQueriesPerFrame,
+		std::uint64_t frequency = 1000000);
+
+	std::uint64_t Frequency()const override { return mFrequency; }
+	void WriteTimestamp(int frameResourceIndex, int queryIndex) override;
+	void ResolveTimestamps(int frameResourceIndex, int queryCount) override;
+	void ReadTimestamps(int frameResourceIndex, int queryCount, std::uint64_t* out) override;
+
+	void Advance(std::uint64_t ticks) { mNow += ticks; }
+
+private:
+	std::vector<std::vector<std::uint64_t>> mQueries;
+	std::vector<std::vector<std::uint64_t>> mReadback;
+	std::uint64_t mFrequency;
+	std::uint64_t mNow = 0;
+};
+
+#ifdef _WIN32
+// Timestamp queries recorded on the app's command list.  Each frame resource gets its
+// own query heap and readback buffer.
+class D3D12TimestampBackend : public GpuTimestampBackend
+{
+public:
+	D3D12TimestampBackend(ID3D12Device* device, ID3D12CommandQueue* queue,
+		ID3D12GraphicsCommandList* cmdList, int frameResourceCount, int maxQueriesPerFrame);
+	D3D12TimestampBackend(const D3D12TimestampBackend& rhs) = delete;
+	D3D12TimestampBackend& operator=(const D3D12TimestampBackend& rhs) = delete;
+
+	std::uint64_t Frequency()const override { return mFrequency; }
+	void WriteTimestamp(int frameResourceIndex, int queryIndex) override;
+	void ResolveTimestamps(int frameResourceIndex, int queryCount) override;
+	void ReadTimestamps(int frameResourceIndex, int queryCount, std::uint64_t* out) override;
+
+private:
+	Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> mCommandList;
+	std::vector<Microsoft::WRL::ComPtr<ID3D12QueryHeap>> mQueryHeaps;
+	std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> mReadbackBuffers;
+	std::uint64_t mFrequency = 1;
+};
+#endif
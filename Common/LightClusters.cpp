@@ -0,0 +1,346 @@
+//***************************************************************************************
+// LightClusters.cpp
+//***************************************************************************************
+
+#include "LightClusters.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define LIGHTCLUSTERS_SSE2 1
+#else
+#define LIGHTCLUSTERS_SSE2 0
+#endif
+
+namespace
+{
+	// Lowest and highest set bit of a four-bit column mask.
+	const std::uint32_t LowestBit[16] = { 0, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0 };
+	const std::uint32_t HighestBit[16] = { 0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3 };
+
+	// Distance from value to [lo, hi] along one axis; zero inside.
+	float AxisDistance(float value, float lo, float hi)
+	{
+		return std::max(lo - value, 0.0f) + std::max(value - hi, 0.0f);
+	}
+}
+
+LightClusters::LightClusters(std::uint32_t tilesX, std::uint32_t tilesY, std::uint32_t slices)
+	: mTilesX(tilesX), mTilesY(tilesY), mSlices(slices), mPaddedTilesX((tilesX + 3) & ~3u)
+{
+	mSliceMinZ.resize(mSlices);
+	mSliceMaxZ.resize(mSlices);
+	mColumnMinX.resize(mSlices * mPaddedTilesX);
+	mColumnMaxX.resize(mSlices * mPaddedTilesX);
+	mRowMinY.resize(mSlices * mTilesY);
+	mRowMaxY.resize(mSlices * mTilesY);
+
+	mSliceLightOffsets.resize(mSlices + 1);
+	mSliceBins.resize(mSlices);
+	mRanges.resize(ClusterCount());
+
+	SetProjection(0.25f * 3.1415926535f, 1.0f, mNearZ, mFarZ);
+}
+
+void LightClusters::SetProjection(float fovY, float aspect, float nearZ, float farZ)
+{
+	mNearZ = nearZ;
+	mFarZ = farZ;
+
+	const float logDepthRange = std::log(farZ / nearZ);
+	mSliceScale = mSlices / logDepthRange;
+	mSliceBias = -(float)mSlices * std::log(nearZ) / logDepthRange;
+
+	const float tanY = std::tan(0.5f * fovY);
+	const float tanX = aspect * tanY;
+	const float unreachable = std::numeric_limits<float>::max();
+
+	for (std::uint32_t slice = 0; slice < mSlices; ++slice)
+	{
+		const float z0 = nearZ * std::pow(farZ / nearZ, (float)slice / mSlices);
+		const float z1 = nearZ * std::pow(farZ / nearZ, (float)(slice + 1) / mSlices);
+		mSliceMinZ[slice] = z0;
+		mSliceMaxZ[slice] = z1;
+
+		// A tile's edges fan out with depth, so its box spans the edges at both ends.
+		for (std::uint32_t x = 0; x < mPaddedTilesX; ++x)
+		{
+			float& minX = mColumnMinX[slice * mPaddedTilesX + x];
+			float& maxX = mColumnMaxX[slice * mPaddedTilesX + x];
+			if (x >= mTilesX)
+			{
+				minX = unreachable;
+				maxX = unreachable;
+				continue;
+			}
+
+			const float left = tanX * (-1.0f + 2.0f * x / mTilesX);
+			const float right = tanX * (-1.0f + 2.0f * (x + 1) / mTilesX);
+			minX = std::min(left * z0, left * z1);
+			maxX = std::max(right * z0, right * z1);
+		}
+
+		for (std::uint32_t y = 0; y < mTilesY; ++y)
+		{
+			const float top = tanY * (1.0f - 2.0f * y / mTilesY);
+			const float bottom = tanY * (1.0f - 2.0f * (y + 1) / mTilesY);
+			mRowMinY[slice * mTilesY + y] = std::min(bottom * z0, bottom * z1);
+			mRowMaxY[slice * mTilesY + y] = std::max(top * z0, top * z1);
+		}
+	}
+}
+
+std::uint32_t LightClusters::Slice(float z)const
+{
+	const float slice = std::floor(std::log(z) * mSliceScale + mSliceBias);
+	return (std::uint32_t)std::min(std::max(slice, 0.0f), (float)(mSlices - 1));
+}
+
+void LightClusters::Build(const ClusterLight* lights, std::uint32_t count)
+{
+	// Bucket the lights by the slices their depth range covers, keeping them in
+	// order so every cluster's list comes out sorted.
+	std::fill(mSliceLightOffsets.begin(), mSliceLightOffsets.end(), 0);
+
+	auto sliceRange = [this](const ClusterLight& light, std::uint32_t& first, std::uint32_t& last)
+	{
+		if (!(light.Radius > 0.0f) || light.Z + light.Radius < mNearZ || light.Z - light.Radius > mFarZ)
+			return false;
+		first = Slice(std::max(light.Z - light.Radius, mNearZ));
+		last = Slice(std::min(light.Z + light.Radius, mFarZ));
+		return true;
+	};
+
+	std::uint32_t first, last;
+	for (std::uint32_t i = 0; i < count; ++i)
+	{
+		if (sliceRange(lights[i], first, last))
+		{
+			for (std::uint32_t slice = first; slice <= last; ++slice)
+				++mSliceLightOffsets[slice + 1];
+		}
+	}
+
+	for (std::uint32_t slice = 0; slice < mSlices; ++slice)
+		mSliceLightOffsets[slice + 1] += mSliceLightOffsets[slice];
+
+	mSliceLights.resize(mSliceLightOffsets[mSlices]);
+	mSliceLightCursors.assign(mSliceLightOffsets.begin(), mSliceLightOffsets.end() - 1);
+	for (std::uint32_t i = 0; i < count; ++i)
+	{
+		if (sliceRange(lights[i], first, last))
+		{
+			for (std::uint32_t slice = first; slice <= last; ++slice)
+				mSliceLights[mSliceLightCursors[slice]++] = i;
+		}
+	}
+
+	// Slices share nothing, so each bins on its own thread.  Once every slice has
+	// counted its lists, each writes them straight into its part of mIndices.
+	ParallelFor(mSlices, [this, lights](std::uint32_t slice)
+	{
+		BinSlice(slice, lights);
+	});
+
+	std::uint32_t total = 0;
+	for (SliceBins& bins : mSliceBins)
+	{
+		bins.Base = total;
+		total += bins.Total;
+	}
+	mIndices.resize(total);
+
+	ParallelFor(mSlices, [this](std::uint32_t slice)
+	{
+		ScatterSlice(slice);
+	});
+}
+
+void LightClusters::BinSlice(std::uint32_t slice, const ClusterLight* lights)
+{
+	SliceBins& bins = mSliceBins[slice];
+	bins.Runs.clear();
+
+	const float minZ = mSliceMinZ[slice];
+	const float maxZ = mSliceMaxZ[slice];
+	const float* columnMinX = &mColumnMinX[slice * mPaddedTilesX];
+	const float* columnMaxX = &mColumnMaxX[slice * mPaddedTilesX];
+	const float* rowMinY = &mRowMinY[slice * mTilesY];
+	const float* rowMaxY = &mRowMaxY[slice * mTilesY];
+
+	float columnDistance[64];
+	float* dx2 = columnDistance;
+	if (mPaddedTilesX > 64)
+	{
+		bins.ColumnDistance.resize(mPaddedTilesX);
+		dx2 = bins.ColumnDistance.data();
+	}
+
+	for (std::uint32_t i = mSliceLightOffsets[slice]; i < mSliceLightOffsets[slice + 1]; ++i)
+	{
+		const std::uint32_t lightIndex = mSliceLights[i];
+		const ClusterLight& light = lights[lightIndex];
+		const float r2 = light.Radius * light.Radius;
+
+		const float dz = AxisDistance(light.Z, minZ, maxZ);
+		const float yzBudget = r2 - dz * dz;
+		if (yzBudget < 0.0f)
+			continue;
+
+		// Squared x distance to every column at once; the rows below reuse it.
+#if LIGHTCLUSTERS_SSE2
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 x = _mm_set1_ps(light.X);
+		for (std::uint32_t c = 0; c < mPaddedTilesX; c += 4)
+		{
+			__m128 below = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(columnMinX + c), x), zero);
+			__m128 above = _mm_max_ps(_mm_sub_ps(x, _mm_loadu_ps(columnMaxX + c)), zero);
+			__m128 d = _mm_add_ps(below, above);
+			_mm_storeu_ps(dx2 + c, _mm_mul_ps(d, d));
+		}
+#else
+		for (std::uint32_t c = 0; c < mPaddedTilesX; ++c)
+		{
+			const float d = AxisDistance(light.X, columnMinX[c], columnMaxX[c]);
+			dx2[c] = d * d;
+		}
+#endif
+
+		// Columns a sphere touches in one row are contiguous, so each row gets one run.
+		for (std::uint32_t y = 0; y < mTilesY; ++y)
+		{
+			const float dy = AxisDistance(light.Y, rowMinY[y], rowMaxY[y]);
+			const float xBudget = yzBudget - dy * dy;
+			if (xBudget < 0.0f)
+				continue;
+
+			std::uint32_t first = mTilesX;
+			std::uint32_t last = 0;
+
+#if LIGHTCLUSTERS_SSE2
+			const __m128 budget = _mm_set1_ps(xBudget);
+			for (std::uint32_t c = 0; c < mPaddedTilesX; c += 4)
+			{
+				const int mask = _mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(dx2 + c), budget));
+				if (mask != 0)
+				{
+					first = std::min(first, c + LowestBit[mask]);
+					last = c + HighestBit[mask];
+				}
+			}
+#else
+			for (std::uint32_t c = 0; c < mTilesX; ++c)
+			{
+				if (dx2[c] <= xBudget)
+				{
+					first = std::min(first, c);
+					last = c;
+				}
+			}
+#endif
+
+			if (first <= last)
+				bins.Runs.push_back({ lightIndex, y * mTilesX + first, last - first + 1 });
+		}
+	}
+
+	// Counting sort by cluster.  Runs are in light order, and the sort is stable.
+	const std::uint32_t clustersPerSlice = mTilesX * mTilesY;
+	ClusterRange* ranges = &mRanges[slice * clustersPerSlice];
+	for (std::uint32_t c = 0; c < clustersPerSlice; ++c)
+		ranges[c] = { 0, 0 };
+
+	for (const Run& run : bins.Runs)
+	{
+		for (std::uint32_t c = run.First; c < run.First + run.Count; ++c)
+			++ranges[c].Count;
+	}
+
+	std::uint32_t offset = 0;
+	for (std::uint32_t c = 0; c < clustersPerSlice; ++c)
+	{
+		ranges[c].Offset = offset;
+		offset += ranges[c].Count;
+	}
+	bins.Total = offset;
+}
+
+void LightClusters::ScatterSlice(std::uint32_t slice)
+{
+	SliceBins& bins = mSliceBins[slice];
+	const std::uint32_t clustersPerSlice = mTilesX * mTilesY;
+	ClusterRange* ranges = &mRanges[slice * clustersPerSlice];
+
+	bins.Cursor.resize(clustersPerSlice);
+	for (std::uint32_t c = 0; c < clustersPerSlice; ++c)
+	{
+		ranges[c].Offset += bins.Base;
+		bins.Cursor[c] = ranges[c].Offset;
+	}
+
+	std::uint32_t* indices = mIndices.data();
+	for (const Run& run : bins.Runs)
+	{
+		for (std::uint32_t c = run.First; c < run.First + run.Count; ++c)
+			indices[bins.Cursor[c]++] = run.Light;
+	}
+}
+
+std::size_t LightClusters::CapacityBytes()const
+{
+	std::size_t bytes = mSliceLights.capacity() * sizeof(std::uint32_t) +
+		mSliceLightCursors.capacity() * sizeof(std::uint32_t) +
+		mIndices.capacity() * sizeof(std::uint32_t);
+	for (const SliceBins& bins : mSliceBins)
+	{
+		bytes += bins.Runs.capacity() * sizeof(Run) +
+			bins.Cursor.capacity() * sizeof(std::uint32_t) +
+			bins.ColumnDistance.capacity() * sizeof(float);
+	}
+	return bytes;
+}
+
+bool LightClusters::Touches(std::uint32_t cluster, const ClusterLight& light)const
+{
+	if (!(light.Radius > 0.0f))
+		return false;
+
+	const std::uint32_t x = cluster % mTilesX;
+	const std::uint32_t y = (cluster / mTilesX) % mTilesY;
+	const std::uint32_t slice = cluster / (mTilesX * mTilesY);
+
+	const float dx = AxisDistance(light.X, mColumnMinX[slice * mPaddedTilesX + x], mColumnMaxX[slice * mPaddedTilesX + x]);
+	const float dy = AxisDistance(light.Y, mRowMinY[slice * mTilesY + y], mRowMaxY[slice * mTilesY + y]);
+	const float dz = AxisDistance(light.Z, mSliceMinZ[slice], mSliceMaxZ[slice]);
+	return dx * dx + dy * dy + dz * dz <= light.Radius * light.Radius;
+}
+
+ClusterLight LightClusters::ConeBounds(const float apex[3], const float direction[3], float range, float cosHalfAngle)
+{
+	// Past 45 degrees the cone's base circle bounds it; below, a sphere through the
+	// apex and the base circle is smaller.
+	cosHalfAngle = std::max(cosHalfAngle, 0.0f);
+
+	float offset;
+	float radius;
+	if (cosHalfAngle < 0.70710678f)
+	{
+		offset = range * cosHalfAngle;
+		radius = range * std::sqrt(std::max(0.0f, 1.0f - cosHalfAngle * cosHalfAngle));
+	}
+	else
+	{
+		offset = range / (2.0f * cosHalfAngle);
+		radius = offset;
+	}
+
+	ClusterLight bounds;
+	bounds.X = apex[0] + direction[0] * offset;
+	bounds.Y = apex[1] + direction[1] * offset;
+	bounds.Z = apex[2] + direction[2] * offset;
+	bounds.Radius = radius;
+	return bounds;
+}
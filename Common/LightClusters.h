@@ -0,0 +1,136 @@
+//***************************************************************************************
+// LightClusters.h
+//
+// Clustered forward light assignment.  The view frustum is cut into a grid of clusters:
+// TilesX by TilesY screen tiles, each split into Slices depth slices spaced
+// exponentially between the near and far planes.  Build bins the bounding spheres of
+// a frame's point and spot lights into the clusters they touch and writes one compact
+// index list, so a pixel shader only loops over the lights of its own cluster.
+//
+// Cluster bounds are view-space boxes.  A box is the product of a column's x range,
+// a row's y range and a slice's z range, so the sphere test splits into per-column,
+// per-row and per-slice distances.  Build tests four columns at a time with SSE2 and
+// bins slices in parallel.
+//
+// Everything here is plain data, so the binning can be checked and timed without a
+// device; see Tools/ClusterBench.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A light's bounding sphere in view space (left-handed, +z into the screen).
+struct ClusterLight
+{
+	float X;
+	float Y;
+	float Z;
+	float Radius;
+};
+
+// The lights of one cluster: Indices()[Offset, Offset + Count).
+struct ClusterRange
+{
+	std::uint32_t Offset;
+	std::uint32_t Count;
+};
+
+class LightClusters
+{
+public:
+	LightClusters(std::uint32_t tilesX, std::uint32_t tilesY, std::uint32_t slices);
+	LightClusters(const LightClusters& rhs) = delete;
+	LightClusters& operator=(const LightClusters& rhs) = delete;
+
+	// Recomputes the cluster bounds for a symmetric perspective projection.
+	void SetProjection(float fovY, float aspect, float nearZ, float farZ);
+
+	// Bins lights[0, count) into the clusters.  Each cluster lists the lights that
+	// touch it by their index in lights, in increasing order.
+	void Build(const ClusterLight* lights, std::uint32_t count);
+
+	// Bounding sphere of a spot light's cone: apex, unit direction, range and the
+	// cosine of the angle past which the light is treated as dark.
+	static ClusterLight ConeBounds(const float apex[3], const float direction[3], float range, float cosHalfAngle);
+
+	// True if the light's sphere touches the cluster's box.  Build gives the same
+	// answer for every pair; this is the slow reference it is checked against.
+	bool Touches(std::uint32_t cluster, const ClusterLight& light)const;
+
+	std::uint32_t TilesX()const { return mTilesX; }
+	std::uint32_t TilesY()const { return mTilesY; }
+	std::uint32_t Slices()const { return mSlices; }
+	std::uint32_t ClusterCount()const { return mTilesX * mTilesY * mSlices; }
+
+	// Tile (0, 0) is the top-left of the screen; slice 0 is nearest the camera.
+	std::uint32_t ClusterIndex(std::uint32_t x, std::uint32_t y, std::uint32_t slice)const
+	{
+		return (slice * mTilesY + y) * mTilesX + x;
+	}
+
+	// A view depth z falls in slice floor(log(z) * SliceScale() + SliceBias()).
+	float SliceScale()const { return mSliceScale; }
+	float SliceBias()const { return mSliceBias; }
+
+	const std::vector<ClusterRange>& Ranges()const { return mRanges; }
+	const std::vector<std::uint32_t>& Indices()const { return mIndices; }
+
+	// Bytes reserved by the lists Build keeps between calls.  Build only allocates
+	// when lights touch more clusters than in any earlier call, and then this grows.
+	std::size_t CapacityBytes()const;
+
+private:
+	std::uint32_t Slice(float z)const;
+	void BinSlice(std::uint32_t slice, const ClusterLight* lights);
+	void ScatterSlice(std::uint32_t slice);
+
+	std::uint32_t mTilesX;
+	std::uint32_t mTilesY;
+	std::uint32_t mSlices;
+
+	// Columns are padded to a multiple of four with boxes nothing touches.
+	std::uint32_t mPaddedTilesX;
+
+	float mNearZ = 1.0f;
+	float mFarZ = 1000.0f;
+	float mSliceScale = 0.0f;
+	float mSliceBias = 0.0f;
+
+	// Per slice: its depth range, its columns' x ranges and its rows' y ranges.
+	std::vector<float> mSliceMinZ;
+	std::vector<float> mSliceMaxZ;
+	std::vector<float> mColumnMinX; // [slice * mPaddedTilesX + x]
+	std::vector<float> mColumnMaxX;
+	std::vector<float> mRowMinY;    // [slice * mTilesY + y]
+	std::vector<float> mRowMaxY;
+
+	// Lights whose depth range reaches each slice, bucketed before binning.
+	std::vector<std::uint32_t> mSliceLightOffsets;
+	std::vector<std::uint32_t> mSliceLights;
+	std::vector<std::uint32_t> mSliceLightCursors;
+
+	// A light touching clusters [First, First + Count) of one row of a slice.
+	struct Run
+	{
+		std::uint32_t Light;
+		std::uint32_t First;
+		std::uint32_t Count;
+	};
+
+	// Each slice's runs and where its lists start in mIndices.
+	struct SliceBins
+	{
+		std::vector<Run> Runs; // in light order
+		std::vector<std::uint32_t> Cursor;
+		std::vector<float> ColumnDistance; // only when there are more than 64 columns
+		std::uint32_t Total = 0;
+		std::uint32_t Base = 0;
+	};
+	std::vector<SliceBins> mSliceBins;
+
+	std::vector<ClusterRange> mRanges;
+	std::vector<std::uint32_t> mIndices;
+};
@@ -0,0 +1,111 @@
+//***************************************************************************************
+// LightManager.cpp
+//***************************************************************************************
+
+#include "LightManager.h"
+
+UINT LightManager::First(LightType type)const
+{
+	UINT first = 0;
+	for (int t = 0; t < (int)type; ++t)
+		first += mCount[t];
+	return first;
+}
+
+LightManager::Handle LightManager::Add(LightType type, const Light& light)
+{
+	UINT slot;
+	if (!mFreeSlots.empty())
+	{
+		slot = mFreeSlots.back();
+		mFreeSlots.pop_back();
+	}
+	else
+	{
+		slot = (UINT)mSlots.size();
+		assert(slot < SlotMask);
+		mSlots.push_back(Slot());
+	}
+
+	// The new light goes at the end of its type's run; the lights after it move up.
+	const UINT index = First(type) + mCount[(int)type];
+	mLights.insert(mLights.begin() + index, light);
+	mChanged.insert(mChanged.begin() + index, 0);
+	mSlotOf.insert(mSlotOf.begin() + index, slot);
+	++mCount[(int)type];
+
+	mSlots[slot].Type = type;
+	mSlots[slot].InUse = true;
+	++mVersion;
+	Restamp(index);
+
+	return ((mSlots[slot].Generation & (~0u >> SlotBits)) << SlotBits) | (slot + 1);
+}
+
+void LightManager::Remove(Handle handle)
+{
+	const Slot* found = Find(handle);
+	assert(found != nullptr);
+	if (found == nullptr)
+		return;
+
+	const UINT slot = (handle & SlotMask) - 1;
+	const UINT index = found->Index;
+
+	mLights.erase(mLights.begin() + index);
+	mChanged.erase(mChanged.begin() + index);
+	mSlotOf.erase(mSlotOf.begin() + index);
+	--mCount[(int)found->Type];
+
+	mSlots[slot].InUse = false;
+	++mSlots[slot].Generation;
+	mFreeSlots.push_back(slot);
+
+	++mVersion;
+	Restamp(index);
+}
+
+void LightManager::Update(Handle handle, const Light& light)
+{
+	const Slot* found = Find(handle);
+	assert(found != nullptr);
+	if (found == nullptr)
+		return;
+
+	mLights[found->Index] = light;
+	mChanged[found->Index] = ++mVersion;
+}
+
+bool LightManager::Contains(Handle handle)const
+{
+	return Find(handle) != nullptr;
+}
+
+const Light& LightManager::Get(Handle handle)const
+{
+	const Slot* found = Find(handle);
+	assert(found != nullptr);
+	return mLights[found->Index];
+}
+
+const LightManager::Slot* LightManager::Find(Handle handle)const
+{
+	const UINT slot = (handle & SlotMask) - 1;
+	if ((handle & SlotMask) == 0 || slot >= mSlots.size())
+		return nullptr;
+
+	const Slot& s = mSlots[slot];
+	if (!s.InUse || (s.Generation & (~0u >> SlotBits)) != (handle >> SlotBits))
+		return nullptr;
+	return &s;
+}
+
+void LightManager::Restamp(UINT firstIndex)
+{
+	// Everything from firstIndex on has a new index, so every copy must rewrite it.
+	for (UINT i = firstIndex; i < (UINT)mLights.size(); ++i)
+	{
+		mSlots[mSlotOf[i]].Index = i;
+		mChanged[i] = mVersion;
+	}
+}
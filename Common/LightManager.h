@@ -0,0 +1,91 @@
+//***************************************************************************************
+// LightManager.h
+//
+// Owns the scene's lights.  Lights are added, changed and removed through handles, and
+// kept packed by type: directional lights first, then point lights, then spot lights.
+// That packed array is what the shaders see as one structured buffer, so a light's
+// index in it can change when lights of its type or an earlier type come and go.
+//
+// Every change bumps Version and stamps the packed entries it touched.  A frame
+// resource remembers the version its copy of the buffer was written at and uploads
+// only the entries changed since, so a scene whose lights stand still uploads nothing.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+enum class LightType : int
+{
+	Directional = 0,
+	Point,
+	Spot,
+	Count
+};
+
+class LightManager
+{
+public:
+	// Zero is never a valid handle.  A removed light's handle stays invalid even
+	// after its slot is reused.
+	typedef std::uint32_t Handle;
+	static const Handle InvalidHandle = 0;
+
+	LightManager() = default;
+	LightManager(const LightManager& rhs) = delete;
+	LightManager& operator=(const LightManager& rhs) = delete;
+
+	Handle Add(LightType type, const Light& light);
+	void Remove(Handle handle);
+	void Update(Handle handle, const Light& light);
+
+	bool Contains(Handle handle)const;
+	const Light& Get(Handle handle)const;
+
+	// The packed lights, and where each type's run of them starts.
+	const std::vector<Light>& Lights()const { return mLights; }
+	UINT Count()const { return (UINT)mLights.size(); }
+	UINT Count(LightType type)const { return mCount[(int)type]; }
+	UINT First(LightType type)const;
+
+	std::uint64_t Version()const { return mVersion; }
+
+	// Calls func(index, light) for every packed light changed after version.
+	template<typename Func>
+	void ForEachChangedSince(std::uint64_t version, Func func)const
+	{
+		if (version >= mVersion)
+			return;
+		for (UINT i = 0; i < (UINT)mLights.size(); ++i)
+		{
+			if (mChanged[i] > version)
+				func(i, mLights[i]);
+		}
+	}
+
+private:
+	struct Slot
+	{
+		UINT Index = 0;
+		LightType Type = LightType::Point;
+		std::uint32_t Generation = 0;
+		bool InUse = false;
+	};
+
+	// The slot is the low bits of a handle, plus one; the generation is the rest.
+	static const std::uint32_t SlotBits = 20;
+	static const std::uint32_t SlotMask = (1u << SlotBits) - 1;
+
+	const Slot* Find(Handle handle)const;
+	void Restamp(UINT firstIndex);
+
+	std::vector<Light> mLights;
+	std::vector<std::uint64_t> mChanged; // version each packed light last changed at
+	std::vector<UINT> mSlotOf;           // slot of each packed light
+
+	std::vector<Slot> mSlots;
+	std::vector<UINT> mFreeSlots;
+
+	UINT mCount[(int)LightType::Count] = {};
+	std::uint64_t mVersion = 0;
+};
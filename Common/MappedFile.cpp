@@ -0,0 +1,188 @@
+//***************************************************************************************
+// MappedFile.cpp
+//***************************************************************************************
+
+#include "MappedFile.h"
+#include <algorithm>
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(MappedFile&& rhs)
+{
+	*this = std::move(rhs);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& rhs)
+{
+	if (this != &rhs)
+	{
+		Close();
+		std::swap(mData, rhs.mData);
+		std::swap(mSize, rhs.mSize);
+		std::swap(mError, rhs.mError);
+		std::swap(mFile, rhs.mFile);
+#ifdef _WIN32
+		std::swap(mMapping, rhs.mMapping);
+#endif
+	}
+	return *this;
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#ifdef _WIN32
+bool MappedFile::Open(const char* filename)
+{
+	Close();
+
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	mFile = (file == INVALID_HANDLE_VALUE) ? nullptr : file;
+
+	return Map();
+}
+
+bool MappedFile::Open(const wchar_t* filename)
+{
+	Close();
+
+	HANDLE file = CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	mFile = (file == INVALID_HANDLE_VALUE) ? nullptr : file;
+
+	return Map();
+}
+
+bool MappedFile::Map()
+{
+	LARGE_INTEGER fileSize = {};
+	if (mFile == nullptr || !GetFileSizeEx(mFile, &fileSize))
+	{
+		mError = GetLastError();
+		Close();
+		return false;
+	}
+
+	// Empty files cannot be mapped, and a 32-bit process cannot map more than its
+	// address space.
+	if (fileSize.QuadPart == 0 || (std::uint64_t)fileSize.QuadPart > (std::uint64_t)SIZE_MAX)
+	{
+		mError = (fileSize.QuadPart == 0) ? ERROR_HANDLE_EOF : ERROR_FILE_TOO_LARGE;
+		Close();
+		return false;
+	}
+
+	mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mMapping != nullptr)
+		mData = static_cast<const std::uint8_t*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+
+	if (mData == nullptr)
+	{
+		mError = GetLastError();
+		Close();
+		return false;
+	}
+
+	mSize = (std::uint64_t)fileSize.QuadPart;
+	mError = 0;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (mData != nullptr)
+		UnmapViewOfFile(mData);
+	if (mMapping != nullptr)
+		CloseHandle(mMapping);
+	if (mFile != nullptr)
+		CloseHandle(mFile);
+
+	mData = nullptr;
+	mMapping = nullptr;
+	mFile = nullptr;
+	mSize = 0;
+}
+#else
+bool MappedFile::Open(const char* filename)
+{
+	Close();
+
+	mFile = open(filename, O_RDONLY);
+	return Map();
+}
+
+bool MappedFile::Map()
+{
+	struct stat fileInfo;
+	if (mFile < 0 || fstat(mFile, &fileInfo) != 0)
+	{
+		mError = (std::uint32_t)errno;
+		Close();
+		return false;
+	}
+
+	// Empty files cannot be mapped, and a 32-bit process cannot map more than its
+	// address space.
+	if (fileInfo.st_size <= 0 || (std::uint64_t)fileInfo.st_size > (std::uint64_t)SIZE_MAX)
+	{
+		mError = (fileInfo.st_size <= 0) ? EINVAL : EFBIG;
+		Close();
+		return false;
+	}
+
+	void* data = mmap(nullptr, (size_t)fileInfo.st_size, PROT_READ, MAP_PRIVATE, mFile, 0);
+	if (data == MAP_FAILED)
+	{
+		mError = (std::uint32_t)errno;
+		Close();
+		return false;
+	}
+
+	// The file is read front to back once.
+	madvise(data, (size_t)fileInfo.st_size, MADV_SEQUENTIAL);
+
+	mData = static_cast<const std::uint8_t*>(data);
+	mSize = (std::uint64_t)fileInfo.st_size;
+	mError = 0;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (mData != nullptr)
+		munmap(const_cast<std::uint8_t*>(mData), (size_t)mSize);
+	if (mFile >= 0)
+		close(mFile);
+
+	mData = nullptr;
+	mFile = -1;
+	mSize = 0;
+}
+#endif
+
+void MappedFile::Prefetch(std::uint64_t offset, std::uint64_t size)const
+{
+	if (mData == nullptr || offset >= mSize)
+		return;
+
+	const std::uint64_t end = std::min(mSize, offset + size);
+	const std::uint64_t pageSize = 4096;
+
+	// One read per page is enough to fault it in.
+	volatile std::uint8_t sink = 0;
+	for (std::uint64_t i = offset; i < end; i += pageSize)
+		sink += mData[i];
+	sink += mData[end - 1];
+}
@@ -0,0 +1,57 @@
+//***************************************************************************************
+// MappedFile.h
+//
+// Read-only memory mapping of a whole file (MapViewOfFile on Windows, mmap elsewhere).
+// Data() points straight at the page cache, so loaders can parse a file and copy
+// from it into staging memory without first reading it into a heap buffer.  Sizes
+// are 64-bit; files over 4 GB map fine in a 64-bit process.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile& rhs) = delete;
+	MappedFile& operator=(const MappedFile& rhs) = delete;
+	MappedFile(MappedFile&& rhs);
+	MappedFile& operator=(MappedFile&& rhs);
+	~MappedFile();
+
+	// Maps filename, unmapping any previous file.  On failure returns false and
+	// Error() holds the GetLastError/errno value.
+	bool Open(const char* filename);
+#ifdef _WIN32
+	bool Open(const wchar_t* filename);
+#endif
+	void Close();
+
+	bool IsOpen()const { return mData != nullptr; }
+	const std::uint8_t* Data()const { return mData; }
+	std::uint64_t Size()const { return mSize; }
+	std::uint32_t Error()const { return mError; }
+
+	// Touches every page of [offset, offset+size) so later reads do not block on
+	// disk.  Call it on a worker thread before handing the data to one that must not
+	// stall.  TextureLoader has no need to: hashing the file on its worker already
+	// reads every page.
+	void Prefetch(std::uint64_t offset, std::uint64_t size)const;
+
+private:
+	bool Map();
+
+	const std::uint8_t* mData = nullptr;
+	std::uint64_t mSize = 0;
+	std::uint32_t mError = 0;
+
+#ifdef _WIN32
+	void* mFile = nullptr;
+	void* mMapping = nullptr;
+#else
+	int mFile = -1;
+#endif
+};
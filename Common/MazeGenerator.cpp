@@ -0,0 +1,216 @@
+//***************************************************************************************
+// MazeGenerator.cpp
+//***************************************************************************************
+
+#include "MazeGenerator.h"
+
+namespace
+{
+	// Directions: +x, -x, +z, -z.
+	const std::uint32_t DirectionCount = 4;
+
+	// SplitMix64: small, fast, and the same everywhere.
+	std::uint64_t NextRandom(std::uint64_t& state)
+	{
+		std::uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+
+	// Uniform in [0, n) by multiply-shift; the bias is below 2^-32 for any n used here.
+	std::uint32_t RandomBelow(std::uint64_t& state, std::uint32_t n)
+	{
+		return (std::uint32_t)(((NextRandom(state) >> 32) * n) >> 32);
+	}
+}
+
+const std::uint64_t MazeGenerator::MaxCells;
+
+bool MazeGenerator::Generate(std::uint32_t width, std::uint32_t height, std::uint64_t seed, MazeAlgorithm algorithm)
+{
+	if ((std::uint64_t)width * height > MaxCells)
+	{
+		mWidth = 0;
+		mHeight = 0;
+		mCells.clear();
+		return false;
+	}
+
+	mWidth = width;
+	mHeight = height;
+	mCells.assign((std::size_t)width * height, CellWallX | CellWallZ);
+	if (mCells.empty())
+		return true;
+
+	std::uint64_t state = seed;
+	if (algorithm == MazeAlgorithm::Wilson)
+		Wilson(state);
+	else
+		Backtrack(state);
+
+	// The exit; the entrance is left out of the -z border by PlaceWalls.
+	mCells.back() &= ~CellWallZ;
+	for (std::uint8_t& cell : mCells)
+		cell &= ~CellVisited;
+	return true;
+}
+
+bool MazeGenerator::Neighbor(std::uint32_t cell, std::uint32_t direction, std::uint32_t& neighbor)const
+{
+	const std::uint32_t x = cell % mWidth;
+	const std::uint32_t y = cell / mWidth;
+	switch (direction)
+	{
+	case 0: neighbor = cell + 1; return x + 1 < mWidth;
+	case 1: neighbor = cell - 1; return x > 0;
+	case 2: neighbor = cell + mWidth; return y + 1 < mHeight;
+	default: neighbor = cell - mWidth; return y > 0;
+	}
+}
+
+void MazeGenerator::Carve(std::uint32_t cell, std::uint32_t direction)
+{
+	// A wall belongs to the cell on its -x or -z side.
+	switch (direction)
+	{
+	case 0: mCells[cell] &= ~CellWallX; break;
+	case 1: mCells[cell - 1] &= ~CellWallX; break;
+	case 2: mCells[cell] &= ~CellWallZ; break;
+	default: mCells[cell - mWidth] &= ~CellWallZ; break;
+	}
+}
+
+void MazeGenerator::Backtrack(std::uint64_t& state)
+{
+	mStack.clear();
+	const std::uint32_t start = RandomBelow(state, (std::uint32_t)mCells.size());
+	mCells[start] |= CellVisited;
+	mStack.push_back(start);
+
+	while (!mStack.empty())
+	{
+		const std::uint32_t cell = mStack.back();
+
+		std::uint32_t choices[DirectionCount];
+		std::uint32_t choiceCount = 0;
+		for (std::uint32_t direction = 0; direction < DirectionCount; ++direction)
+		{
+			std::uint32_t neighbor;
+			if (Neighbor(cell, direction, neighbor) && (mCells[neighbor] & CellVisited) == 0)
+				choices[choiceCount++] = direction;
+		}
+
+		if (choiceCount == 0)
+		{
+			mStack.pop_back();
+			continue;
+		}
+
+		const std::uint32_t direction = choices[RandomBelow(state, choiceCount)];
+		std::uint32_t neighbor;
+		Neighbor(cell, direction, neighbor);
+		Carve(cell, direction);
+		mCells[neighbor] |= CellVisited;
+		mStack.push_back(neighbor);
+	}
+}
+
+void MazeGenerator::Wilson(std::uint64_t& state)
+{
+	// Visited marks cells in the tree.  A walk records the direction it last left each
+	// cell by in mStack; following those from the start is the walk with its loops
+	// erased, since a revisit overwrites the direction taken before.
+	mStack.assign(mCells.size(), 0);
+	mCells[RandomBelow(state, (std::uint32_t)mCells.size())] |= CellVisited;
+
+	for (std::uint32_t start = 0; start < mCells.size(); ++start)
+	{
+		if (mCells[start] & CellVisited)
+			continue;
+
+		for (std::uint32_t cell = start; (mCells[cell] & CellVisited) == 0; )
+		{
+			std::uint32_t direction, neighbor;
+			do
+			{
+				direction = RandomBelow(state, DirectionCount);
+			} while (!Neighbor(cell, direction, neighbor));
+			mStack[cell] = direction;
+			cell = neighbor;
+		}
+
+		for (std::uint32_t cell = start; (mCells[cell] & CellVisited) == 0; )
+		{
+			std::uint32_t neighbor;
+			Neighbor(cell, mStack[cell], neighbor);
+			Carve(cell, mStack[cell]);
+			mCells[cell] |= CellVisited;
+			cell = neighbor;
+		}
+	}
+}
+
+std::uint32_t MazeGenerator::PlaceWalls(SceneWriter& writer, const MazeLayout& layout)const
+{
+	const std::uint32_t mesh = writer.Name(layout.Mesh);
+	const std::uint32_t material = writer.Name(layout.Material);
+	const std::uint32_t first = writer.PlacementCount();
+
+	// A wall along x covering cells [begin, end) on the line z = Origin.z + line * CellSize,
+	// or along z with the axes swapped.  Walls overlap by their thickness at corners.
+	auto place = [&](bool alongX, std::uint32_t line, std::uint32_t begin, std::uint32_t end)
+	{
+		const float length = (end - begin) * layout.CellSize + layout.WallThickness;
+		const float along = 0.5f * (begin + end) * layout.CellSize;
+		const float across = line * layout.CellSize;
+
+		ScenePlacement placement = {};
+		placement.Mesh = mesh;
+		placement.Material = material;
+		placement.Flags = ScenePlacementCollide;
+		placement.Node = SceneNoNode;
+		placement.Scale[0] = alongX ? length : layout.WallThickness;
+		placement.Scale[1] = layout.WallHeight;
+		placement.Scale[2] = alongX ? layout.WallThickness : length;
+		placement.Translation[0] = layout.Origin[0] + (alongX ? along : across);
+		placement.Translation[1] = layout.Origin[1] + 0.5f * layout.WallHeight;
+		placement.Translation[2] = layout.Origin[2] + (alongX ? across : along);
+		writer.AddPlacement(placement);
+	};
+
+	// Scans a line of cell sides, placing each run of walls (or each wall).
+	auto placeLine = [&](bool alongX, std::uint32_t line, std::uint32_t count, auto hasWall)
+	{
+		for (std::uint32_t i = 0; i < count; )
+		{
+			if (!hasWall(i))
+			{
+				++i;
+				continue;
+			}
+			std::uint32_t end = i + 1;
+			while (layout.MergeRuns && end < count && hasWall(end))
+				++end;
+			place(alongX, line, i, end);
+			i = end;
+		}
+	};
+
+	// Lines along x: the -z border (open at the entrance), then each row's +z sides.
+	placeLine(true, 0, mWidth, [&](std::uint32_t x) { return x != 0; });
+	for (std::uint32_t y = 0; y < mHeight; ++y)
+		placeLine(true, y + 1, mWidth, [&](std::uint32_t x) { return WallPositiveZ(x, y); });
+
+	// Lines along z: the -x border, then each column's +x sides.
+	placeLine(false, 0, mHeight, [&](std::uint32_t) { return true; });
+	for (std::uint32_t x = 0; x < mWidth; ++x)
+		placeLine(false, x + 1, mHeight, [&](std::uint32_t y) { return WallPositiveX(x, y); });
+
+	return writer.PlacementCount() - first;
+}
+
+std::size_t MazeGenerator::MemoryBytes()const
+{
+	return mCells.capacity() * sizeof(std::uint8_t) + mStack.capacity() * sizeof(std::uint32_t);
+}
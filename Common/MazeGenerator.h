@@ -0,0 +1,91 @@
+//***************************************************************************************
+// MazeGenerator.h
+//
+// Generates perfect mazes (exactly one path between any two cells) on a grid of any
+// size, and places their walls into a scene as colliding boxes.
+//
+// Two algorithms are offered.  The recursive backtracker (run with an explicit stack)
+// is fast and makes long winding corridors.  Wilson's algorithm builds the tree from
+// loop-erased random walks, which picks uniformly among all spanning trees; it has no
+// bias in its corridors but is several times slower on large grids.
+//
+// Everything is seeded from one 64-bit value with a generator defined here, so a seed
+// makes the same maze with any compiler and standard library.
+//***************************************************************************************
+
+#pragma once
+
+#include "SceneFile.h"
+
+#include <cstdint>
+#include <vector>
+
+enum class MazeAlgorithm
+{
+	Backtracker,
+	Wilson
+};
+
+// Where and how a maze's walls are placed.  Cell (x, y) covers
+// [Origin.x + x * CellSize, +CellSize] on x and [Origin.z + y * CellSize, +CellSize]
+// on z; walls stand on Origin.y.
+struct MazeLayout
+{
+	float Origin[3] = { 0.0f, 0.0f, 0.0f };
+	float CellSize = 8.0f;
+	float WallHeight = 10.0f;
+	float WallThickness = 1.0f;
+
+	// Merge each straight run of walls into one placement.  Without it every cell
+	// side is its own placement, which is what a stress test may want.
+	bool MergeRuns = true;
+
+	const char* Mesh = "box";
+	const char* Material = "wall";
+};
+
+class MazeGenerator
+{
+public:
+	// Cells are indexed with 32 bits.
+	static const std::uint64_t MaxCells = 0xffffffffull;
+
+	// Carves a width x height maze.  The entrance is the -z side of cell (0, 0) and the
+	// exit the +z side of the last cell.  Returns false, leaving an empty maze, when
+	// width x height is more than MaxCells.
+	bool Generate(std::uint32_t width, std::uint32_t height, std::uint64_t seed, MazeAlgorithm algorithm);
+
+	std::uint32_t Width()const { return mWidth; }
+	std::uint32_t Height()const { return mHeight; }
+
+	// Whether a wall closes the +x or +z side of a cell.
+	bool WallPositiveX(std::uint32_t x, std::uint32_t y)const { return (mCells[y * mWidth + x] & CellWallX) != 0; }
+	bool WallPositiveZ(std::uint32_t x, std::uint32_t y)const { return (mCells[y * mWidth + x] & CellWallZ) != 0; }
+
+	// Adds a colliding box per wall (or run of walls) and returns how many.
+	std::uint32_t PlaceWalls(SceneWriter& writer, const MazeLayout& layout)const;
+
+	// Bytes the generator holds, including the scratch space kept for the next maze.
+	std::size_t MemoryBytes()const;
+
+private:
+	enum : std::uint8_t
+	{
+		CellWallX = 1,
+		CellWallZ = 2,
+		CellVisited = 4,
+	};
+
+	void Backtrack(std::uint64_t& state);
+	void Wilson(std::uint64_t& state);
+	void Carve(std::uint32_t cell, std::uint32_t direction);
+	bool Neighbor(std::uint32_t cell, std::uint32_t direction, std::uint32_t& neighbor)const;
+
+	std::uint32_t mWidth = 0;
+	std::uint32_t mHeight = 0;
+
+	// Per cell: its +x and +z walls and scratch flags.  The -x and -z borders of the
+	// grid are always closed, except for the entrance.
+	std::vector<std::uint8_t> mCells;
+	std::vector<std::uint32_t> mStack;
+};
@@ -0,0 +1,44 @@
+//***************************************************************************************
+// ParallelFor.h
+//
+// Calls func(i) for every i in [0, count) spread over the machine's cores, returning
+// once all have run.  On Windows this is PPL's parallel_for; elsewhere (the portable
+// benches) a thread per core pulls indices off a shared counter.  func is taken as a
+// template rather than a std::function so a per-frame call allocates nothing.
+//***************************************************************************************
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#ifdef _WIN32
+#include <ppl.h>
+#else
+#include <atomic>
+#include <thread>
+#include <vector>
+#endif
+
+template<typename Func>
+void ParallelFor(std::uint32_t count, const Func& func)
+{
+#ifdef _WIN32
+	concurrency::parallel_for(std::uint32_t(0), count, func);
+#else
+	std::atomic<std::uint32_t> next(0);
+	auto worker = [&]()
+	{
+		for (std::uint32_t i = next++; i < count; i = next++)
+			func(i);
+	};
+
+	std::vector<std::thread> threads;
+	const std::uint32_t threadCount = (std::max)(1u, std::thread::hardware_concurrency());
+	for (std::uint32_t i = 1; i < (std::min)(threadCount, count); ++i)
+		threads.emplace_back(worker);
+	worker();
+	for (std::thread& thread : threads)
+		thread.join();
+#endif
+}
@@ -0,0 +1,317 @@
+//***************************************************************************************
+// PipelineCache.cpp
+//***************************************************************************************
+
+#include "PipelineCache.h"
+#include <iterator>
+
+using Microsoft::WRL::ComPtr;
+
+namespace
+{
+	// FNV-1a, fed field by field so padding bytes never reach the hash.
+	struct Hasher
+	{
+		std::uint64_t Hash = 14695981039346656037ull;
+
+		void Bytes(const void* data, std::size_t size)
+		{
+			const std::uint8_t* bytes = static_cast<const std::uint8_t*>(data);
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				Hash ^= bytes[i];
+				Hash *= 1099511628211ull;
+			}
+		}
+
+		template<typename T>
+		void Value(const T& value)
+		{
+			Bytes(&value, sizeof(T));
+		}
+
+		void String(const char* text)
+		{
+			const std::size_t length = text != nullptr ? strlen(text) : 0;
+			Value(length);
+			Bytes(text, length);
+		}
+
+		void Shader(const D3D12_SHADER_BYTECODE& code)
+		{
+			Value(code.BytecodeLength);
+			Bytes(code.pShaderBytecode, code.BytecodeLength);
+		}
+
+		void StencilOp(const D3D12_DEPTH_STENCILOP_DESC& op)
+		{
+			Value(op.StencilFailOp);
+			Value(op.StencilDepthFailOp);
+			Value(op.StencilPassOp);
+			Value(op.StencilFunc);
+		}
+	};
+
+	std::wstring LibraryName(PipelineCache::Key key)
+	{
+		static const wchar_t digits[] = L"0123456789abcdef";
+
+		std::wstring name(16, L'0');
+		for (int i = 15; i >= 0; --i)
+		{
+			name[i] = digits[key & 0xf];
+			key >>= 4;
+		}
+		return name;
+	}
+}
+
+PipelineCache::PipelineCache(ID3D12Device* device, const std::wstring& libraryFilename)
+	: mDevice(device), mLibraryFilename(libraryFilename)
+{
+	ComPtr<ID3D12Device1> device1;
+	if (FAILED(device->QueryInterface(IID_PPV_ARGS(&device1))))
+		return;
+
+	std::ifstream fin(libraryFilename, std::ios::binary);
+	if (fin)
+		mLibraryData.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+
+	HRESULT hr = E_FAIL;
+	if (!mLibraryData.empty())
+		hr = device1->CreatePipelineLibrary(mLibraryData.data(), mLibraryData.size(), IID_PPV_ARGS(&mLibrary));
+
+	// Missing, damaged, or written by another driver: start over with an empty one.
+	if (FAILED(hr))
+	{
+		mLibraryData.clear();
+		if (FAILED(device1->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&mLibrary))))
+			mLibrary = nullptr;
+	}
+}
+
+PipelineCache::~PipelineCache()
+{
+	// Workers hold pointers into mEntries.
+	mTasks.wait();
+}
+
+void PipelineCache::AddRootSignature(ID3D12RootSignature* rootSignature, const void* serialized, std::size_t size)
+{
+	Hasher hasher;
+	hasher.Bytes(serialized, size);
+	mRootSignatureHashes[rootSignature] = hasher.Hash;
+}
+
+PipelineCache::Key PipelineCache::Add(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+{
+	auto rootSignature = mRootSignatureHashes.find(desc.pRootSignature);
+	if (rootSignature == mRootSignatureHashes.end())
+		throw DxException(E_INVALIDARG, L"PipelineCache::Add (unregistered root signature)", AnsiToWString(__FILE__), __LINE__);
+	if (desc.StreamOutput.NumEntries > 0)
+		throw DxException(E_NOTIMPL, L"PipelineCache::Add (stream output)", AnsiToWString(__FILE__), __LINE__);
+
+	Hasher hasher;
+	hasher.Value(rootSignature->second);
+	hasher.Shader(desc.VS);
+	hasher.Shader(desc.PS);
+	hasher.Shader(desc.DS);
+	hasher.Shader(desc.HS);
+	hasher.Shader(desc.GS);
+
+	// Without independent blending only the first render target's blend is used.
+	hasher.Value(desc.BlendState.AlphaToCoverageEnable);
+	hasher.Value(desc.BlendState.IndependentBlendEnable);
+	const UINT blendCount = desc.BlendState.IndependentBlendEnable ? std::max(1u, desc.NumRenderTargets) : 1;
+	for (UINT i = 0; i < blendCount; ++i)
+	{
+		const D3D12_RENDER_TARGET_BLEND_DESC& rt = desc.BlendState.RenderTarget[i];
+		hasher.Value(rt.BlendEnable);
+		hasher.Value(rt.LogicOpEnable);
+		hasher.Value(rt.SrcBlend);
+		hasher.Value(rt.DestBlend);
+		hasher.Value(rt.BlendOp);
+		hasher.Value(rt.SrcBlendAlpha);
+		hasher.Value(rt.DestBlendAlpha);
+		hasher.Value(rt.BlendOpAlpha);
+		hasher.Value(rt.LogicOp);
+		hasher.Value(rt.RenderTargetWriteMask);
+	}
+	hasher.Value(desc.SampleMask);
+
+	const D3D12_RASTERIZER_DESC& rs = desc.RasterizerState;
+	hasher.Value(rs.FillMode);
+	hasher.Value(rs.CullMode);
+	hasher.Value(rs.FrontCounterClockwise);
+	hasher.Value(rs.DepthBias);
+	hasher.Value(rs.DepthBiasClamp);
+	hasher.Value(rs.SlopeScaledDepthBias);
+	hasher.Value(rs.DepthClipEnable);
+	hasher.Value(rs.MultisampleEnable);
+	hasher.Value(rs.AntialiasedLineEnable);
+	hasher.Value(rs.ForcedSampleCount);
+	hasher.Value(rs.ConservativeRaster);
+
+	const D3D12_DEPTH_STENCIL_DESC& ds = desc.DepthStencilState;
+	hasher.Value(ds.DepthEnable);
+	hasher.Value(ds.DepthWriteMask);
+	hasher.Value(ds.DepthFunc);
+	hasher.Value(ds.StencilEnable);
+	hasher.Value(ds.StencilReadMask);
+	hasher.Value(ds.StencilWriteMask);
+	hasher.StencilOp(ds.FrontFace);
+	hasher.StencilOp(ds.BackFace);
+
+	hasher.Value(desc.InputLayout.NumElements);
+	for (UINT i = 0; i < desc.InputLayout.NumElements; ++i)
+	{
+		const D3D12_INPUT_ELEMENT_DESC& element = desc.InputLayout.pInputElementDescs[i];
+		hasher.String(element.SemanticName);
+		hasher.Value(element.SemanticIndex);
+		hasher.Value(element.Format);
+		hasher.Value(element.InputSlot);
+		hasher.Value(element.AlignedByteOffset);
+		hasher.Value(element.InputSlotClass);
+		hasher.Value(element.InstanceDataStepRate);
+	}
+
+	hasher.Value(desc.IBStripCutValue);
+	hasher.Value(desc.PrimitiveTopologyType);
+	hasher.Value(desc.NumRenderTargets);
+	for (UINT i = 0; i < desc.NumRenderTargets; ++i)
+		hasher.Value(desc.RTVFormats[i]);
+	hasher.Value(desc.DSVFormat);
+	hasher.Value(desc.SampleDesc.Count);
+	hasher.Value(desc.SampleDesc.Quality);
+	hasher.Value(desc.NodeMask);
+	hasher.Value(desc.Flags);
+
+	const Key key = hasher.Hash;
+
+	std::lock_guard<std::mutex> lock(mEntriesLock);
+	auto& slot = mEntries[key];
+	if (slot != nullptr)
+		return key;
+
+	auto entry = std::make_unique<Entry>();
+	entry->PipelineKey = key;
+	entry->Desc = desc;
+	entry->Desc.CachedPSO = {};
+
+	D3D12_SHADER_BYTECODE* shaders[] = { &entry->Desc.VS, &entry->Desc.PS, &entry->Desc.DS, &entry->Desc.HS, &entry->Desc.GS };
+	for (size_t i = 0; i < _countof(shaders); ++i)
+	{
+		const std::uint8_t* code = static_cast<const std::uint8_t*>(shaders[i]->pShaderBytecode);
+		entry->Shaders[i].assign(code, code + shaders[i]->BytecodeLength);
+		shaders[i]->pShaderBytecode = entry->Shaders[i].empty() ? nullptr : entry->Shaders[i].data();
+	}
+
+	entry->InputElements.assign(desc.InputLayout.pInputElementDescs,
+		desc.InputLayout.pInputElementDescs + desc.InputLayout.NumElements);
+	for (const D3D12_INPUT_ELEMENT_DESC& element : entry->InputElements)
+		entry->SemanticNames.push_back(element.SemanticName);
+	for (size_t i = 0; i < entry->InputElements.size(); ++i)
+		entry->InputElements[i].SemanticName = entry->SemanticNames[i].c_str();
+	entry->Desc.InputLayout = { entry->InputElements.data(), (UINT)entry->InputElements.size() };
+
+	slot = std::move(entry);
+	return key;
+}
+
+void PipelineCache::CreateAllAsync()
+{
+	std::lock_guard<std::mutex> lock(mEntriesLock);
+	for (auto& e : mEntries)
+	{
+		Entry* entry = e.second.get();
+		mTasks.run([this, entry]()
+		{
+			std::lock_guard<std::mutex> entryLock(entry->Lock);
+			if (entry->Pipeline == nullptr && SUCCEEDED(entry->Result))
+				entry->Result = Create(*entry);
+		});
+	}
+}
+
+ID3D12PipelineState* PipelineCache::Get(Key key)
+{
+	Entry* entry = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(mEntriesLock);
+		auto it = mEntries.find(key);
+		if (it == mEntries.end())
+			throw DxException(E_INVALIDARG, L"PipelineCache::Get (unknown key)", AnsiToWString(__FILE__), __LINE__);
+		entry = it->second.get();
+	}
+
+	std::lock_guard<std::mutex> lock(entry->Lock);
+	if (entry->Pipeline == nullptr && SUCCEEDED(entry->Result))
+		entry->Result = Create(*entry);
+
+	ThrowIfFailed(entry->Result);
+	return entry->Pipeline.Get();
+}
+
+HRESULT PipelineCache::Create(Entry& entry)
+{
+	// The library synchronises itself, except that one pipeline must not be loaded
+	// from two threads at once; the caller holds entry.Lock.
+	const std::wstring name = LibraryName(entry.PipelineKey);
+	if (mLibrary != nullptr &&
+		SUCCEEDED(mLibrary->LoadGraphicsPipeline(name.c_str(), &entry.Desc, IID_PPV_ARGS(&entry.Pipeline))))
+	{
+		++mLoaded;
+		return S_OK;
+	}
+
+	HRESULT hr = mDevice->CreateGraphicsPipelineState(&entry.Desc, IID_PPV_ARGS(&entry.Pipeline));
+	if (FAILED(hr))
+		return hr;
+	++mCompiled;
+
+	if (mLibrary != nullptr && SUCCEEDED(mLibrary->StorePipeline(name.c_str(), entry.Pipeline.Get())))
+	{
+		std::lock_guard<std::mutex> lock(mLibraryLock);
+		mLibraryChanged = true;
+	}
+
+	return S_OK;
+}
+
+void PipelineCache::Save()
+{
+	mTasks.wait();
+
+	std::lock_guard<std::mutex> lock(mLibraryLock);
+	if (mLibrary == nullptr || !mLibraryChanged)
+		return;
+
+	std::vector<char> data(mLibrary->GetSerializedSize());
+	bool written = SUCCEEDED(mLibrary->Serialize(data.data(), data.size()));
+
+	// Write beside the old file and move over it, so a crash never leaves half a
+	// library behind.
+	if (written)
+	{
+		const std::wstring temp = mLibraryFilename + L".tmp";
+		std::ofstream fout(temp, std::ios::binary | std::ios::trunc);
+		fout.write(data.data(), (std::streamsize)data.size());
+		fout.close();
+		written = fout && MoveFileExW(temp.c_str(), mLibraryFilename.c_str(), MOVEFILE_REPLACE_EXISTING);
+		if (!written)
+			DeleteFileW(temp.c_str());
+	}
+
+	if (written)
+		mLibraryChanged = false;
+	else
+		OutputDebugString((L"PipelineCache: could not write " + mLibraryFilename + L"\n").c_str());
+}
+
+PipelineCache::Stats PipelineCache::GetStats()const
+{
+	Stats stats;
+	stats.Loaded = mLoaded;
+	stats.Compiled = mCompiled;
+	return stats;
+}
@@ -0,0 +1,100 @@
+//***************************************************************************************
+// PipelineCache.h
+//
+// Owns the app's graphics pipeline state objects.  Each pipeline is registered once by
+// its full description and identified from then on by a 64-bit key hashed from that
+// description, so draw code keeps keys rather than looking PSOs up by name.
+//
+// Pipelines are created when first asked for, or ahead of time on worker threads with
+// CreateAllAsync.  Created pipelines are stored in an ID3D12PipelineLibrary that Save
+// writes to disk.  On the next run, a pipeline whose description has not changed loads
+// from the library instead of being compiled again by the driver.  A library written
+// by another driver or adapter is discarded and rebuilt.
+//
+// Keys must be the same from one run to the next, so they hash shader bytecode and
+// input layouts by content rather than by address.  Root signatures have no content
+// to read back, so each must be registered with its serialized blob before use.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include <atomic>
+#include <mutex>
+#include <ppl.h>
+
+class PipelineCache
+{
+public:
+	typedef std::uint64_t Key;
+
+	// libraryFilename is read if it exists and written by Save.
+	PipelineCache(ID3D12Device* device, const std::wstring& libraryFilename);
+	PipelineCache(const PipelineCache& rhs) = delete;
+	PipelineCache& operator=(const PipelineCache& rhs) = delete;
+	~PipelineCache();
+
+	void AddRootSignature(ID3D12RootSignature* rootSignature, const void* serialized, std::size_t size);
+
+	// Registers desc and returns its key; registering the same description again
+	// returns the same key.  Everything desc points to is copied.  Throws DxException
+	// if its root signature was not registered or it uses stream output.
+	Key Add(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc);
+
+	// Starts creating every registered pipeline not yet created on worker threads.
+	void CreateAllAsync();
+
+	// Returns the pipeline for key, creating it now (or waiting for a worker already
+	// creating it) if needed.  Throws DxException if creation failed.
+	ID3D12PipelineState* Get(Key key);
+
+	// Waits for pipelines being created on workers, then writes the library to disk
+	// if pipelines were added to it since it was loaded.  A failed write is reported
+	// to the debug output and otherwise ignored.
+	void Save();
+
+	struct Stats
+	{
+		int Loaded = 0;   // pipelines read back from the library
+		int Compiled = 0; // pipelines the driver had to compile
+	};
+	Stats GetStats()const;
+
+private:
+	struct Entry
+	{
+		Key PipelineKey = 0;
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC Desc;
+
+		// Copies of everything Desc points to.
+		std::vector<std::uint8_t> Shaders[5];
+		std::vector<D3D12_INPUT_ELEMENT_DESC> InputElements;
+		std::vector<std::string> SemanticNames;
+
+		std::mutex Lock;
+		Microsoft::WRL::ComPtr<ID3D12PipelineState> Pipeline;
+		HRESULT Result = S_OK;
+	};
+
+	HRESULT Create(Entry& entry);
+
+	Microsoft::WRL::ComPtr<ID3D12Device> mDevice;
+	std::wstring mLibraryFilename;
+
+	// Null when the device has no pipeline library support.  The library reads from
+	// mLibraryData for as long as it exists.
+	Microsoft::WRL::ComPtr<ID3D12PipelineLibrary> mLibrary;
+	std::vector<char> mLibraryData;
+	std::mutex mLibraryLock;
+	bool mLibraryChanged = false;
+
+	std::unordered_map<ID3D12RootSignature*, std::uint64_t> mRootSignatureHashes;
+
+	std::mutex mEntriesLock;
+	std::unordered_map<Key, std::unique_ptr<Entry>> mEntries;
+
+	std::atomic<int> mLoaded{ 0 };
+	std::atomic<int> mCompiled{ 0 };
+
+	concurrency::task_group mTasks;
+};
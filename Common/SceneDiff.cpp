@@ -0,0 +1,250 @@
+//***************************************************************************************
+// SceneDiff.cpp
+//***************************************************************************************
+
+#include "SceneDiff.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+#include <unordered_map>
+
+namespace
+{
+	const char EditKeep = '=';
+	const char EditRemove = '-';
+	const char EditAdd = '+';
+
+	// Shortest edit script turning a[0, n) into b[0, m), as EditKeep/EditRemove/EditAdd
+	// in order.  Returns false if it takes more than maxEdits removals and additions.
+	template <class Equal>
+	bool ShortestEdit(std::uint32_t n, std::uint32_t m, Equal equal, std::uint32_t maxEdits, std::vector<char>& edits)
+	{
+		const std::int64_t maxD = std::min<std::int64_t>((std::int64_t)n + m, maxEdits);
+		const std::int64_t offset = maxD + 1;
+
+		// x reached on each diagonal k = x - y; trace[d] keeps diagonals [-d, d] after d edits.
+		std::vector<std::int64_t> v(2 * maxD + 3, 0);
+		std::vector<std::vector<std::int64_t>> trace;
+
+		for (std::int64_t d = 0; d <= maxD; ++d)
+		{
+			for (std::int64_t k = -d; k <= d; k += 2)
+			{
+				std::int64_t x = (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1])) ?
+					v[offset + k + 1] : v[offset + k - 1] + 1;
+				std::int64_t y = x - k;
+				while (x < n && y < m && equal((std::uint32_t)x, (std::uint32_t)y))
+				{
+					++x;
+					++y;
+				}
+				v[offset + k] = x;
+
+				if (x >= n && y >= m)
+				{
+					// Walk back through the trace, collecting the script in reverse.
+					edits.clear();
+					for (std::int64_t e = d; e > 0; --e)
+					{
+						const std::vector<std::int64_t>& previous = trace[e - 1];
+						const std::int64_t kk = x - y;
+						const bool down = kk == -e || (kk != e && previous[kk - 1 + e - 1] < previous[kk + 1 + e - 1]);
+						const std::int64_t previousK = down ? kk + 1 : kk - 1;
+						const std::int64_t previousX = previous[previousK + e - 1];
+						const std::int64_t previousY = previousX - previousK;
+						while (x > previousX && y > previousY)
+						{
+							edits.push_back(EditKeep);
+							--x;
+							--y;
+						}
+						edits.push_back(down ? EditAdd : EditRemove);
+						x = previousX;
+						y = previousY;
+					}
+					edits.insert(edits.end(), (std::size_t)x, EditKeep);
+					std::reverse(edits.begin(), edits.end());
+					return true;
+				}
+			}
+			trace.emplace_back(v.begin() + (offset - d), v.begin() + (offset + d + 1));
+		}
+		return false;
+	}
+
+	// Fills diff from an edit script over both whole lists.
+	void Collect(const std::vector<char>& edits, SceneListDiff& diff)
+	{
+		std::uint32_t oldIndex = 0, newIndex = 0;
+		for (std::size_t i = 0; i < edits.size(); )
+		{
+			if (edits[i] == EditKeep)
+			{
+				diff.Sources[newIndex++] = oldIndex++;
+				++i;
+				continue;
+			}
+
+			std::uint32_t removed = 0, added = 0;
+			for (; i < edits.size() && edits[i] != EditKeep; ++i)
+				(edits[i] == EditRemove ? removed : added)++;
+
+			const std::uint32_t paired = std::min(removed, added);
+			for (std::uint32_t j = 0; j < paired; ++j)
+			{
+				diff.Sources[newIndex + j] = oldIndex + j;
+				diff.Changed.push_back(newIndex + j);
+			}
+			for (std::uint32_t j = paired; j < removed; ++j)
+				diff.Removed.push_back(oldIndex + j);
+			for (std::uint32_t j = paired; j < added; ++j)
+				diff.Added.push_back(newIndex + j);
+			oldIndex += removed;
+			newIndex += added;
+		}
+	}
+
+	// Aligns old[0, n) with new[0, m) by equal(oldIndex, newIndex).
+	template <class Equal>
+	void DiffList(std::uint32_t n, std::uint32_t m, Equal equal, std::vector<char>& edits, SceneListDiff& diff)
+	{
+		diff.Clear();
+		diff.Sources.assign(m, SceneDiff::NoSource);
+
+		std::uint32_t prefix = 0;
+		while (prefix < n && prefix < m && equal(prefix, prefix))
+			++prefix;
+		std::uint32_t suffix = 0;
+		while (suffix < n - prefix && suffix < m - prefix && equal(n - 1 - suffix, m - 1 - suffix))
+			++suffix;
+
+		const std::uint32_t oldCount = n - prefix - suffix;
+		const std::uint32_t newCount = m - prefix - suffix;
+		auto middle = [&](std::uint32_t a, std::uint32_t b) { return equal(prefix + a, prefix + b); };
+		if (!ShortestEdit(oldCount, newCount, middle, SceneDiff::MaxAlignedEdits, edits))
+		{
+			// Too different to be worth aligning: one run of removals and additions.
+			edits.assign(oldCount, EditRemove);
+			edits.insert(edits.end(), newCount, EditAdd);
+		}
+
+		edits.insert(edits.begin(), prefix, EditKeep);
+		edits.insert(edits.end(), suffix, EditKeep);
+		Collect(edits, diff);
+	}
+
+	// Matches old[0, n) with new[0, m) by name, through nameMap from old names to new
+	// ones.  A name given twice counts once, by its last record.
+	template <class OldName, class NewName, class Equal>
+	void DiffByName(std::uint32_t n, std::uint32_t m, OldName oldName, NewName newName, Equal equal,
+		const std::vector<std::uint32_t>& nameMap, std::uint32_t newNameCount, SceneListDiff& diff)
+	{
+		diff.Clear();
+		diff.Sources.assign(m, SceneDiff::NoSource);
+		std::vector<std::uint32_t> oldRecordOf(newNameCount, SceneDiff::NoSource);
+		for (std::uint32_t i = 0; i < n; ++i)
+		{
+			const std::uint32_t name = nameMap[oldName(i)];
+			if (name != SceneDiff::NoSource)
+				oldRecordOf[name] = i;
+		}
+		std::vector<bool> kept(n, false);
+		for (std::uint32_t i = 0; i < m; ++i)
+		{
+			const std::uint32_t source = oldRecordOf[newName(i)];
+			diff.Sources[i] = source;
+			if (source == SceneDiff::NoSource)
+			{
+				diff.Added.push_back(i);
+				continue;
+			}
+			kept[source] = true;
+			if (!equal(source, i))
+				diff.Changed.push_back(i);
+		}
+		for (std::uint32_t i = 0; i < n; ++i)
+		{
+			if (!kept[i])
+				diff.Removed.push_back(i);
+		}
+	}
+}
+
+const std::uint32_t SceneDiff::NoSource;
+const std::uint32_t SceneDiff::MaxAlignedEdits;
+
+void SceneListDiff::Clear()
+{
+	Sources.clear();
+	Changed.clear();
+	Added.clear();
+	Removed.clear();
+}
+
+void SceneDiff::Compare(const SceneFile& before, const SceneFile& after)
+{
+	// Each old name's index in the new scene, or NoSource.
+	std::unordered_map<std::string_view, std::uint32_t> afterNames;
+	for (std::uint32_t i = 0; i < after.NameCount(); ++i)
+		afterNames.emplace(after.Name(i), i);
+	mNameMap.assign(before.NameCount(), NoSource);
+	for (std::uint32_t i = 0; i < before.NameCount(); ++i)
+	{
+		auto it = afterNames.find(before.Name(i));
+		if (it != afterNames.end())
+			mNameMap[i] = it->second;
+	}
+
+	// Whether two nodes (or the lack of one) have the same name.
+	auto sameNode = [&](std::uint32_t a, std::uint32_t b)
+	{
+		if (a == SceneNoNode || b == SceneNoNode)
+			return a == b;
+		return mNameMap[before.Nodes()[a].Name] == after.Nodes()[b].Name;
+	};
+
+	const ScenePlacement* oldPlacements = before.Placements();
+	const ScenePlacement* newPlacements = after.Placements();
+	DiffList(before.PlacementCount(), after.PlacementCount(), [&](std::uint32_t a, std::uint32_t b)
+	{
+		const ScenePlacement& p = oldPlacements[a];
+		const ScenePlacement& q = newPlacements[b];
+		return mNameMap[p.Mesh] == q.Mesh && mNameMap[p.Material] == q.Material && p.Flags == q.Flags &&
+			sameNode(p.Node, q.Node) && std::memcmp(p.Scale, q.Scale, sizeof(float) * 9) == 0;
+	}, mEdits, mPlacements);
+
+	const SceneLight* oldLights = before.Lights();
+	const SceneLight* newLights = after.Lights();
+	DiffList(before.LightCount(), after.LightCount(), [&](std::uint32_t a, std::uint32_t b)
+	{
+		return std::memcmp(&oldLights[a], &newLights[b], sizeof(SceneLight)) == 0;
+	}, mEdits, mLights);
+
+	// Materials by name; a name given twice counts once, by its last values.
+	DiffByName(before.MaterialCount(), after.MaterialCount(),
+		[&](std::uint32_t i) { return before.Materials()[i].Name; },
+		[&](std::uint32_t i) { return after.Materials()[i].Name; },
+		[&](std::uint32_t a, std::uint32_t b)
+		{
+			return std::memcmp(before.Materials()[a].DiffuseAlbedo, after.Materials()[b].DiffuseAlbedo, sizeof(float) * 8) == 0;
+		}, mNameMap, after.NameCount(), mMaterials);
+
+	DiffByName(before.NodeCount(), after.NodeCount(),
+		[&](std::uint32_t i) { return before.Nodes()[i].Name; },
+		[&](std::uint32_t i) { return after.Nodes()[i].Name; },
+		[&](std::uint32_t a, std::uint32_t b)
+		{
+			const SceneNode& p = before.Nodes()[a];
+			const SceneNode& q = after.Nodes()[b];
+			return sameNode(p.Parent, q.Parent) && std::memcmp(p.Rotation, q.Rotation, sizeof(float) * 6) == 0;
+		}, mNameMap, after.NameCount(), mNodes);
+
+	mSpritesChanged = before.SpriteCount() != after.SpriteCount();
+	for (std::uint32_t i = 0; i < after.SpriteCount() && !mSpritesChanged; ++i)
+	{
+		const SceneSprite& s = before.Sprites()[i];
+		const SceneSprite& t = after.Sprites()[i];
+		mSpritesChanged = mNameMap[s.Set] != t.Set || std::memcmp(s.Position, t.Position, sizeof(float) * 5) != 0;
+	}
+}
@@ -0,0 +1,75 @@
+//***************************************************************************************
+// SceneDiff.h
+//
+// What changed between two versions of a scene, so an edit can be applied to the live
+// level item by item instead of rebuilding it.
+//
+// Placements and lights are aligned in file order with the shortest edit script (Myers'
+// O(ND) diff) after trimming the unchanged ends, so inserting a line moves nothing else.
+// Within each run of removed and added records the two are paired in order and
+// reported as changed, which is what editing the numbers on a line looks like.
+// Materials and nodes are matched by name, and a placement's node is compared by its
+// name too.  Names are compared as strings, so two compiles of the same text compare
+// equal whatever order the names were interned in.
+//***************************************************************************************
+
+#pragma once
+
+#include "SceneFile.h"
+
+#include <cstdint>
+#include <vector>
+
+// How a list of records maps onto its edited version.  Indices are into the new list,
+// except Removed, which indexes the old one.
+struct SceneListDiff
+{
+	// Per new record, the old record it continues, or SceneDiff::NoSource.
+	std::vector<std::uint32_t> Sources;
+	// New records whose source is different.
+	std::vector<std::uint32_t> Changed;
+	// New records with no source.
+	std::vector<std::uint32_t> Added;
+	// Old records no new record continues.
+	std::vector<std::uint32_t> Removed;
+
+	bool Empty()const { return Changed.empty() && Added.empty() && Removed.empty(); }
+	void Clear();
+};
+
+class SceneDiff
+{
+public:
+	static const std::uint32_t NoSource = 0xffffffff;
+
+	// Past this many removed plus added records in the middle of a list, the middle is
+	// paired up in order instead of being aligned.
+	static const std::uint32_t MaxAlignedEdits = 1024;
+
+	// Compares two loaded scenes; both must stay loaded until this returns.
+	void Compare(const SceneFile& before, const SceneFile& after);
+
+	const SceneListDiff& Placements()const { return mPlacements; }
+	const SceneListDiff& Materials()const { return mMaterials; }
+	const SceneListDiff& Lights()const { return mLights; }
+	// A node is changed if it moved, turned or hangs under another parent.
+	const SceneListDiff& Nodes()const { return mNodes; }
+
+	// Sprites are only compared as a whole.
+	bool SpritesChanged()const { return mSpritesChanged; }
+
+	bool Empty()const
+	{
+		return mPlacements.Empty() && mMaterials.Empty() && mLights.Empty() && mNodes.Empty() && !mSpritesChanged;
+	}
+
+private:
+	SceneListDiff mPlacements;
+	SceneListDiff mMaterials;
+	SceneListDiff mLights;
+	SceneListDiff mNodes;
+	bool mSpritesChanged = false;
+
+	std::vector<std::uint32_t> mNameMap;
+	std::vector<char> mEdits;
+};
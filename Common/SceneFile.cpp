@@ -0,0 +1,468 @@
+//***************************************************************************************
+// SceneFile.cpp
+//***************************************************************************************
+
+#include "SceneFile.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	const char SceneMagic[4] = { 'S', 'C', 'N', 'E' };
+	const float DegreesToRadians = 3.1415926535f / 180.0f;
+
+	// The app's Light defaults, for the fields a light's type leaves out.
+	const SceneLight DefaultLight = { SceneLightDirectional, { 0.5f, 0.5f, 0.5f }, 1.0f, 10.0f,
+		{ 0.0f, 0.0f, 0.0f }, { 0.0f, -1.0f, 0.0f }, 64.0f };
+
+	std::uint32_t Align4(std::uint32_t size)
+	{
+		return (size + 3) & ~3u;
+	}
+
+	void AppendBytes(std::vector<std::uint8_t>& out, const void* data, std::size_t size)
+	{
+		const std::uint8_t* bytes = static_cast<const std::uint8_t*>(data);
+		out.insert(out.end(), bytes, bytes + size);
+	}
+
+	// Parses count floats from tokens[0, count); false if any is not a number.
+	bool ParseFloats(char** tokens, int count, float* out)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			char* end = nullptr;
+			out[i] = std::strtof(tokens[i], &end);
+			if (end == tokens[i] || *end != '\0')
+				return false;
+		}
+		return true;
+	}
+}
+
+bool SceneFile::Fail(const std::string& error)
+{
+	mHeader = nullptr;
+	mNameOffsets = nullptr;
+	mNames = nullptr;
+	mPlacements = nullptr;
+	mSprites = nullptr;
+	mMaterials = nullptr;
+	mLights = nullptr;
+	mNodes = nullptr;
+	mError = error;
+	return false;
+}
+
+bool SceneFile::Open(const char* filename)
+{
+	if (!mFile.Open(filename))
+		return Fail(std::string("cannot open ") + filename + " (error " + std::to_string(mFile.Error()) + ")");
+	return Check(mFile.Data(), mFile.Size());
+}
+
+#ifdef _WIN32
+bool SceneFile::Open(const wchar_t* filename)
+{
+	if (!mFile.Open(filename))
+		return Fail("cannot open scene file (error " + std::to_string(mFile.Error()) + ")");
+	return Check(mFile.Data(), mFile.Size());
+}
+#endif
+
+bool SceneFile::Load(const void* data, std::uint64_t size)
+{
+	mFile.Close();
+	return Check(data, size);
+}
+
+bool SceneFile::Check(const void* data, std::uint64_t size)
+{
+	const std::uint8_t* bytes = static_cast<const std::uint8_t*>(data);
+	if (size < sizeof(SceneHeader) || ((std::uintptr_t)bytes & 3) != 0)
+		return Fail("not a scene file");
+
+	const SceneHeader* header = reinterpret_cast<const SceneHeader*>(bytes);
+	if (std::memcmp(header->Magic, SceneMagic, sizeof(SceneMagic)) != 0)
+		return Fail("not a scene file");
+	if (header->Version != Version)
+		return Fail("scene file version " + std::to_string(header->Version) + ", expected " + std::to_string(Version));
+
+	// Sizes are summed in 64 bits so no count can wrap the check.
+	const std::uint64_t namesOffset = sizeof(SceneHeader) + 4ull * header->NameCount;
+	const std::uint64_t placementsOffset = namesOffset + ((header->NameBytes + 3ull) & ~3ull);
+	const std::uint64_t spritesOffset = placementsOffset + sizeof(ScenePlacement) * (std::uint64_t)header->PlacementCount;
+	const std::uint64_t materialsOffset = spritesOffset + sizeof(SceneSprite) * (std::uint64_t)header->SpriteCount;
+	const std::uint64_t lightsOffset = materialsOffset + sizeof(SceneMaterial) * (std::uint64_t)header->MaterialCount;
+	const std::uint64_t nodesOffset = lightsOffset + sizeof(SceneLight) * (std::uint64_t)header->LightCount;
+	const std::uint64_t end = nodesOffset + sizeof(SceneNode) * (std::uint64_t)header->NodeCount;
+	if (end > size)
+		return Fail("scene file is truncated");
+
+	const std::uint32_t* nameOffsets = reinterpret_cast<const std::uint32_t*>(bytes + sizeof(SceneHeader));
+	const char* names = reinterpret_cast<const char*>(bytes + namesOffset);
+	if (header->NameCount > 0 && (header->NameBytes == 0 || names[header->NameBytes - 1] != '\0'))
+		return Fail("scene names are not terminated");
+	for (std::uint32_t i = 0; i < header->NameCount; ++i)
+	{
+		if (nameOffsets[i] >= header->NameBytes)
+			return Fail("scene name " + std::to_string(i) + " is out of range");
+	}
+
+	const ScenePlacement* placements = reinterpret_cast<const ScenePlacement*>(bytes + placementsOffset);
+	for (std::uint32_t i = 0; i < header->PlacementCount; ++i)
+	{
+		if (placements[i].Mesh >= header->NameCount || placements[i].Material >= header->NameCount)
+			return Fail("placement " + std::to_string(i) + " names a missing mesh or material");
+		if (placements[i].Node != SceneNoNode && placements[i].Node >= header->NodeCount)
+			return Fail("placement " + std::to_string(i) + " hangs under a missing node");
+	}
+
+	const SceneSprite* sprites = reinterpret_cast<const SceneSprite*>(bytes + spritesOffset);
+	for (std::uint32_t i = 0; i < header->SpriteCount; ++i)
+	{
+		if (sprites[i].Set >= header->NameCount)
+			return Fail("sprite " + std::to_string(i) + " names a missing set");
+	}
+
+	const SceneMaterial* materials = reinterpret_cast<const SceneMaterial*>(bytes + materialsOffset);
+	for (std::uint32_t i = 0; i < header->MaterialCount; ++i)
+	{
+		if (materials[i].Name >= header->NameCount)
+			return Fail("material " + std::to_string(i) + " has a missing name");
+	}
+
+	const SceneLight* lights = reinterpret_cast<const SceneLight*>(bytes + lightsOffset);
+	for (std::uint32_t i = 0; i < header->LightCount; ++i)
+	{
+		if (lights[i].Type >= SceneLightTypeCount)
+			return Fail("light " + std::to_string(i) + " has an unknown type");
+	}
+
+	// Parents come first, so the nodes cannot form a cycle.
+	const SceneNode* nodes = reinterpret_cast<const SceneNode*>(bytes + nodesOffset);
+	for (std::uint32_t i = 0; i < header->NodeCount; ++i)
+	{
+		if (nodes[i].Name >= header->NameCount)
+			return Fail("node " + std::to_string(i) + " has a missing name");
+		if (nodes[i].Parent != SceneNoNode && nodes[i].Parent >= i)
+			return Fail("node " + std::to_string(i) + " hangs under a node that is not before it");
+	}
+
+	mHeader = header;
+	mNameOffsets = nameOffsets;
+	mNames = names;
+	mPlacements = placements;
+	mSprites = sprites;
+	mMaterials = materials;
+	mLights = lights;
+	mNodes = nodes;
+	mError.clear();
+	return true;
+}
+
+bool SceneFile::Compile(const char* text, std::size_t size, std::vector<std::uint8_t>& out, std::string& error)
+{
+	SceneWriter writer;
+	std::unordered_map<std::string, std::uint32_t> nodes;
+
+	// Tokens are cut out of one copy of the text in place.
+	std::vector<char> buffer(text, text + size);
+	buffer.push_back('\n');
+
+	const int MaxTokens = 16;
+	char* tokens[MaxTokens];
+
+	std::size_t lineStart = 0;
+	for (int line = 1; lineStart < buffer.size(); ++line)
+	{
+		std::size_t lineEnd = lineStart;
+		while (buffer[lineEnd] != '\n')
+			++lineEnd;
+
+		int count = 0;
+		bool tooMany = false;
+		for (std::size_t i = lineStart; i < lineEnd; )
+		{
+			char& c = buffer[i];
+			if (c == '#')
+				break;
+			if (c == ' ' || c == '\t' || c == '\r')
+			{
+				++i;
+				continue;
+			}
+
+			if (count == MaxTokens)
+			{
+				tooMany = true;
+				break;
+			}
+			tokens[count++] = &c;
+			while (i < lineEnd && buffer[i] != ' ' && buffer[i] != '\t' && buffer[i] != '\r' && buffer[i] != '#')
+				++i;
+			if (i == lineEnd)
+				break;
+
+			const bool comment = buffer[i] == '#';
+			buffer[i++] = '\0';
+			if (comment)
+				break;
+		}
+		buffer[lineEnd] = '\0';
+		lineStart = lineEnd + 1;
+
+		if (count == 0)
+			continue;
+
+		const std::string where = "line " + std::to_string(line) + ": ";
+		if (tooMany)
+		{
+			error = where + "too many fields";
+			return false;
+		}
+
+		if (std::strcmp(tokens[0], "place") == 0)
+		{
+			// The optional fields, from the end: "in <node>", then "collide".
+			const bool in = count >= 14 && std::strcmp(tokens[count - 2], "in") == 0;
+			const int fields = in ? count - 2 : count;
+			const bool collide = fields == 13 && std::strcmp(tokens[12], "collide") == 0;
+			if (fields != 12 && !collide)
+			{
+				error = where + "expected place <mesh> <material> <sx sy sz> <rx ry rz> <tx ty tz> [collide] [in <node>]";
+				return false;
+			}
+
+			ScenePlacement placement;
+			placement.Mesh = writer.Name(tokens[1]);
+			placement.Material = writer.Name(tokens[2]);
+			placement.Flags = collide ? (std::uint32_t)ScenePlacementCollide : 0u;
+			placement.Node = SceneNoNode;
+			if (in)
+			{
+				auto node = nodes.find(tokens[count - 1]);
+				if (node == nodes.end())
+				{
+					error = where + "unknown node '" + tokens[count - 1] + "'";
+					return false;
+				}
+				placement.Node = node->second;
+			}
+			if (!ParseFloats(tokens + 3, 3, placement.Scale) ||
+				!ParseFloats(tokens + 6, 3, placement.Rotation) ||
+				!ParseFloats(tokens + 9, 3, placement.Translation))
+			{
+				error = where + "expected a number";
+				return false;
+			}
+			for (float& angle : placement.Rotation)
+				angle *= DegreesToRadians;
+			writer.AddPlacement(placement);
+		}
+		else if (std::strcmp(tokens[0], "node") == 0)
+		{
+			if (count != 9)
+			{
+				error = where + "expected node <name> <parent or -> <rx ry rz> <tx ty tz>";
+				return false;
+			}
+
+			SceneNode node;
+			node.Parent = SceneNoNode;
+			if (std::strcmp(tokens[2], "-") != 0)
+			{
+				auto parent = nodes.find(tokens[2]);
+				if (parent == nodes.end())
+				{
+					error = where + "unknown node '" + tokens[2] + "'";
+					return false;
+				}
+				node.Parent = parent->second;
+			}
+			if (!ParseFloats(tokens + 3, 3, node.Rotation) || !ParseFloats(tokens + 6, 3, node.Translation))
+			{
+				error = where + "expected a number";
+				return false;
+			}
+			for (float& angle : node.Rotation)
+				angle *= DegreesToRadians;
+			if (nodes.count(tokens[1]) != 0)
+			{
+				error = where + "node '" + tokens[1] + "' is already declared";
+				return false;
+			}
+			node.Name = writer.Name(tokens[1]);
+			nodes.emplace(tokens[1], writer.AddNode(node));
+		}
+		else if (std::strcmp(tokens[0], "sprite") == 0)
+		{
+			if (count != 7)
+			{
+				error = where + "expected sprite <set> <x y z> <width height>";
+				return false;
+			}
+
+			SceneSprite sprite;
+			sprite.Set = writer.Name(tokens[1]);
+			if (!ParseFloats(tokens + 2, 3, sprite.Position) || !ParseFloats(tokens + 5, 2, sprite.Size))
+			{
+				error = where + "expected a number";
+				return false;
+			}
+			writer.AddSprite(sprite);
+		}
+		else if (std::strcmp(tokens[0], "material") == 0)
+		{
+			if (count != 10)
+			{
+				error = where + "expected material <name> <r g b a> <fresnel r g b> <roughness>";
+				return false;
+			}
+
+			SceneMaterial material;
+			material.Name = writer.Name(tokens[1]);
+			if (!ParseFloats(tokens + 2, 4, material.DiffuseAlbedo) ||
+				!ParseFloats(tokens + 6, 3, material.FresnelR0) ||
+				!ParseFloats(tokens + 9, 1, &material.Roughness))
+			{
+				error = where + "expected a number";
+				return false;
+			}
+			writer.AddMaterial(material);
+		}
+		else if (std::strcmp(tokens[0], "light") == 0)
+		{
+			SceneLight light = DefaultLight;
+			bool parsed;
+			if (count == 8 && std::strcmp(tokens[1], "directional") == 0)
+			{
+				light.Type = SceneLightDirectional;
+				parsed = ParseFloats(tokens + 2, 3, light.Strength) && ParseFloats(tokens + 5, 3, light.Direction);
+			}
+			else if (count == 10 && std::strcmp(tokens[1], "point") == 0)
+			{
+				light.Type = SceneLightPoint;
+				parsed = ParseFloats(tokens + 2, 3, light.Strength) && ParseFloats(tokens + 5, 3, light.Position) &&
+					ParseFloats(tokens + 8, 1, &light.FalloffStart) && ParseFloats(tokens + 9, 1, &light.FalloffEnd);
+			}
+			else if (count == 14 && std::strcmp(tokens[1], "spot") == 0)
+			{
+				light.Type = SceneLightSpot;
+				parsed = ParseFloats(tokens + 2, 3, light.Strength) && ParseFloats(tokens + 5, 3, light.Position) &&
+					ParseFloats(tokens + 8, 3, light.Direction) && ParseFloats(tokens + 11, 1, &light.FalloffStart) &&
+					ParseFloats(tokens + 12, 1, &light.FalloffEnd) && ParseFloats(tokens + 13, 1, &light.SpotPower);
+			}
+			else
+			{
+				error = where + "expected light directional <r g b> <dx dy dz>, light point <r g b> <x y z> <falloff start end> "
+					"or light spot <r g b> <x y z> <dx dy dz> <falloff start end> <power>";
+				return false;
+			}
+			if (!parsed)
+			{
+				error = where + "expected a number";
+				return false;
+			}
+			writer.AddLight(light);
+		}
+		else
+		{
+			error = where + "unknown item '" + tokens[0] + "'";
+			return false;
+		}
+	}
+
+	writer.Write(out);
+	return true;
+}
+
+std::uint32_t SceneWriter::Name(const char* name)
+{
+	auto it = mNameIndices.emplace(name, (std::uint32_t)mNames.size()).first;
+	if (it->second == mNames.size())
+		mNames.push_back(&it->first);
+	return it->second;
+}
+
+std::uint32_t SceneWriter::AddNode(const SceneNode& node)
+{
+	assert(node.Parent == SceneNoNode || node.Parent < mNodes.size());
+	mNodes.push_back(node);
+	return (std::uint32_t)mNodes.size() - 1;
+}
+
+void SceneWriter::Append(const SceneFile& scene)
+{
+	std::vector<std::uint32_t> names(scene.NameCount());
+	for (std::uint32_t i = 0; i < scene.NameCount(); ++i)
+		names[i] = Name(scene.Name(i));
+
+	const std::uint32_t firstNode = NodeCount();
+	for (std::uint32_t i = 0; i < scene.PlacementCount(); ++i)
+	{
+		ScenePlacement placement = scene.Placements()[i];
+		placement.Mesh = names[placement.Mesh];
+		placement.Material = names[placement.Material];
+		if (placement.Node != SceneNoNode)
+			placement.Node += firstNode;
+		mPlacements.push_back(placement);
+	}
+	for (std::uint32_t i = 0; i < scene.SpriteCount(); ++i)
+	{
+		SceneSprite sprite = scene.Sprites()[i];
+		sprite.Set = names[sprite.Set];
+		mSprites.push_back(sprite);
+	}
+	for (std::uint32_t i = 0; i < scene.MaterialCount(); ++i)
+	{
+		SceneMaterial material = scene.Materials()[i];
+		material.Name = names[material.Name];
+		mMaterials.push_back(material);
+	}
+	mLights.insert(mLights.end(), scene.Lights(), scene.Lights() + scene.LightCount());
+	for (std::uint32_t i = 0; i < scene.NodeCount(); ++i)
+	{
+		SceneNode node = scene.Nodes()[i];
+		node.Name = names[node.Name];
+		if (node.Parent != SceneNoNode)
+			node.Parent += firstNode;
+		mNodes.push_back(node);
+	}
+}
+
+void SceneWriter::Write(std::vector<std::uint8_t>& out)const
+{
+	std::vector<std::uint32_t> nameOffsets;
+	std::uint32_t nameBytes = 0;
+	for (const std::string* name : mNames)
+	{
+		nameOffsets.push_back(nameBytes);
+		nameBytes += (std::uint32_t)name->size() + 1;
+	}
+
+	SceneHeader header;
+	std::memcpy(header.Magic, SceneMagic, sizeof(SceneMagic));
+	header.Version = SceneFile::Version;
+	header.NameCount = (std::uint32_t)mNames.size();
+	header.NameBytes = nameBytes;
+	header.PlacementCount = (std::uint32_t)mPlacements.size();
+	header.SpriteCount = (std::uint32_t)mSprites.size();
+	header.MaterialCount = (std::uint32_t)mMaterials.size();
+	header.LightCount = (std::uint32_t)mLights.size();
+	header.NodeCount = (std::uint32_t)mNodes.size();
+
+	out.clear();
+	AppendBytes(out, &header, sizeof(header));
+	AppendBytes(out, nameOffsets.data(), nameOffsets.size() * sizeof(std::uint32_t));
+	for (const std::string* name : mNames)
+		AppendBytes(out, name->c_str(), name->size() + 1);
+	out.resize(out.size() + Align4(nameBytes) - nameBytes, 0);
+	AppendBytes(out, mPlacements.data(), mPlacements.size() * sizeof(ScenePlacement));
+	AppendBytes(out, mSprites.data(), mSprites.size() * sizeof(SceneSprite));
+	AppendBytes(out, mMaterials.data(), mMaterials.size() * sizeof(SceneMaterial));
+	AppendBytes(out, mLights.data(), mLights.size() * sizeof(SceneLight));
+	AppendBytes(out, mNodes.data(), mNodes.size() * sizeof(SceneNode));
+}
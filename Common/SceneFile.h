@@ -0,0 +1,228 @@
+//***************************************************************************************
+// SceneFile.h
+//
+// The level layout as data.  A scene is a list of placements (a named mesh with a named
+// material, scaled, rotated and translated, optionally a camera collider), a list of
+// sprite placements grouped into named sets, the values of named materials, the
+// scene's lights and the transform nodes placements can hang under.
+//
+// The binary form is what the app loads.  It is mapped, checked once and then read in
+// place: Placements() and Sprites() point straight into the mapping, so loading does
+// no per-item work or allocation.  All fields are 4-byte values in file order:
+//
+//   SceneHeader
+//   uint32 NameOffsets[NameCount]      offsets of NUL-terminated names in Names
+//   char   Names[NameBytes]            padded with zeros to a multiple of 4
+//   ScenePlacement Placements[PlacementCount]
+//   SceneSprite    Sprites[SpriteCount]
+//   SceneMaterial  Materials[MaterialCount]
+//   SceneLight     Lights[LightCount]
+//   SceneNode      Nodes[NodeCount]
+//
+// The text form is for editing; Compile turns it into the binary form.  Generated
+// scenes skip the text and are built record by record with a SceneWriter.  One item per
+// line, '#' starts a comment, rotations are in degrees:
+//
+//   place  <mesh> <material> <sx sy sz> <rx ry rz> <tx ty tz> [collide] [in <node>]
+//   node   <name> <parent or -> <rx ry rz> <tx ty tz>
+//   sprite <set> <x y z> <width height>
+//   material <name> <r g b a> <fresnel r g b> <roughness>
+//   light directional <r g b> <dx dy dz>
+//   light point <r g b> <x y z> <falloff start end>
+//   light spot  <r g b> <x y z> <dx dy dz> <falloff start end> <power>
+//
+// Nodes group placements so they move together: a placement "in" a node is placed
+// relative to it, and a node relative to its parent, so moving a tower or swinging a
+// gate is one line.  Nodes are named once each and declared before they are used.
+//***************************************************************************************
+
+#pragma once
+
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct SceneHeader
+{
+	char Magic[4];
+	std::uint32_t Version;
+	std::uint32_t NameCount;
+	std::uint32_t NameBytes;
+	std::uint32_t PlacementCount;
+	std::uint32_t SpriteCount;
+	std::uint32_t MaterialCount;
+	std::uint32_t LightCount;
+	std::uint32_t NodeCount;
+};
+
+enum ScenePlacementFlags : std::uint32_t
+{
+	// The camera cannot walk through the placement's scaled unit box.
+	ScenePlacementCollide = 1,
+};
+
+// A placement or node that hangs under no node.
+const std::uint32_t SceneNoNode = 0xffffffff;
+
+// World = Scale * RotationRollPitchYaw(Rotation[0], Rotation[1], Rotation[2]) * Translation,
+// times the world of Node if it has one.  Rotation is in radians.
+struct ScenePlacement
+{
+	std::uint32_t Mesh;
+	std::uint32_t Material;
+	std::uint32_t Flags;
+	std::uint32_t Node;
+	float Scale[3];
+	float Rotation[3];
+	float Translation[3];
+};
+
+struct SceneSprite
+{
+	std::uint32_t Set;
+	float Position[3];
+	float Size[2];
+};
+
+// Sets the constants of the app's material of that name.
+struct SceneMaterial
+{
+	std::uint32_t Name;
+	float DiffuseAlbedo[4];
+	float FresnelR0[3];
+	float Roughness;
+};
+
+enum SceneLightType : std::uint32_t
+{
+	SceneLightDirectional = 0,
+	SceneLightPoint,
+	SceneLightSpot,
+	SceneLightTypeCount
+};
+
+// The fields a light's type does not use keep the defaults of the app's Light.
+struct SceneLight
+{
+	std::uint32_t Type;
+	float Strength[3];
+	float FalloffStart;
+	float FalloffEnd;
+	float Position[3];
+	float Direction[3];
+	float SpotPower;
+};
+
+// World = RotationRollPitchYaw(Rotation[0], Rotation[1], Rotation[2]) * Translation, times
+// the world of Parent if it has one.  Nodes do not scale, so children keep their shape
+// whichever way the node turns.  Parent is below the node's own index.
+struct SceneNode
+{
+	std::uint32_t Name;
+	std::uint32_t Parent;
+	float Rotation[3];
+	float Translation[3];
+};
+
+class SceneFile
+{
+public:
+	static const std::uint32_t Version = 3;
+
+	SceneFile() = default;
+	SceneFile(const SceneFile& rhs) = delete;
+	SceneFile& operator=(const SceneFile& rhs) = delete;
+
+	// Maps a binary scene and checks it.  On failure returns false and Error() says why.
+	bool Open(const char* filename);
+#ifdef _WIN32
+	bool Open(const wchar_t* filename);
+#endif
+
+	// Checks and reads a binary scene held in memory the caller keeps alive.  Any file
+	// opened before is closed, whether or not the new scene is valid.
+	bool Load(const void* data, std::uint64_t size);
+
+	// Turns the text form into the binary form.  On failure returns false and error
+	// names the offending line.
+	static bool Compile(const char* text, std::size_t size, std::vector<std::uint8_t>& out, std::string& error);
+
+	std::uint32_t NameCount()const { return mHeader != nullptr ? mHeader->NameCount : 0; }
+	const char* Name(std::uint32_t index)const { return mNames + mNameOffsets[index]; }
+
+	std::uint32_t PlacementCount()const { return mHeader != nullptr ? mHeader->PlacementCount : 0; }
+	const ScenePlacement* Placements()const { return mPlacements; }
+
+	std::uint32_t SpriteCount()const { return mHeader != nullptr ? mHeader->SpriteCount : 0; }
+	const SceneSprite* Sprites()const { return mSprites; }
+
+	std::uint32_t MaterialCount()const { return mHeader != nullptr ? mHeader->MaterialCount : 0; }
+	const SceneMaterial* Materials()const { return mMaterials; }
+
+	std::uint32_t LightCount()const { return mHeader != nullptr ? mHeader->LightCount : 0; }
+	const SceneLight* Lights()const { return mLights; }
+
+	std::uint32_t NodeCount()const { return mHeader != nullptr ? mHeader->NodeCount : 0; }
+	const SceneNode* Nodes()const { return mNodes; }
+
+	const std::string& Error()const { return mError; }
+
+private:
+	bool Check(const void* data, std::uint64_t size);
+	bool Fail(const std::string& error);
+
+	MappedFile mFile;
+
+	const SceneHeader* mHeader = nullptr;
+	const std::uint32_t* mNameOffsets = nullptr;
+	const char* mNames = nullptr;
+	const ScenePlacement* mPlacements = nullptr;
+	const SceneSprite* mSprites = nullptr;
+	const SceneMaterial* mMaterials = nullptr;
+	const SceneLight* mLights = nullptr;
+	const SceneNode* mNodes = nullptr;
+
+	std::string mError;
+};
+
+// Builds the binary form of a scene record by record.  Names are interned: Name
+// returns the same index for the same string.
+class SceneWriter
+{
+public:
+	SceneWriter() = default;
+	SceneWriter(const SceneWriter& rhs) = delete;
+	SceneWriter& operator=(const SceneWriter& rhs) = delete;
+
+	std::uint32_t Name(const char* name);
+
+	void AddPlacement(const ScenePlacement& placement) { mPlacements.push_back(placement); }
+	void AddSprite(const SceneSprite& sprite) { mSprites.push_back(sprite); }
+	void AddMaterial(const SceneMaterial& material) { mMaterials.push_back(material); }
+	void AddLight(const SceneLight& light) { mLights.push_back(light); }
+	// Returns the node's index, for placements and later nodes to hang under.
+	std::uint32_t AddNode(const SceneNode& node);
+
+	// Adds every record of a loaded scene, with its names interned here and its node
+	// indices moved past the nodes added before.
+	void Append(const SceneFile& scene);
+
+	std::uint32_t PlacementCount()const { return (std::uint32_t)mPlacements.size(); }
+	std::uint32_t NodeCount()const { return (std::uint32_t)mNodes.size(); }
+
+	// Replaces out with the binary scene.
+	void Write(std::vector<std::uint8_t>& out)const;
+
+private:
+	std::unordered_map<std::string, std::uint32_t> mNameIndices;
+	std::vector<const std::string*> mNames;
+
+	std::vector<ScenePlacement> mPlacements;
+	std::vector<SceneSprite> mSprites;
+	std::vector<SceneMaterial> mMaterials;
+	std::vector<SceneLight> mLights;
+	std::vector<SceneNode> mNodes;
+};
@@ -0,0 +1,128 @@
+//***************************************************************************************
+// ShaderCache.cpp
+//***************************************************************************************
+
+#include "ShaderCache.h"
+
+namespace
+{
+	const std::uint64_t FnvOffset = 14695981039346656037ull;
+	const std::uint64_t FnvPrime = 1099511628211ull;
+
+	void HashBytes(std::uint64_t& hash, const void* data, std::size_t size)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (std::size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= FnvPrime;
+		}
+	}
+
+	void HashValue(std::uint64_t& hash, std::uint64_t value)
+	{
+		unsigned char bytes[8];
+		for (int i = 0; i < 8; ++i)
+			bytes[i] = (unsigned char)(value >> (8 * i));
+		HashBytes(hash, bytes, sizeof(bytes));
+	}
+
+	void HashField(std::uint64_t& hash, const void* data, std::size_t size)
+	{
+		HashValue(hash, size);
+		HashBytes(hash, data, size);
+	}
+
+	void HashString(std::uint64_t& hash, const std::string& text)
+	{
+		HashField(hash, text.data(), text.size());
+	}
+}
+
+ShaderCache::ShaderCache(const std::wstring& directory)
+	: mDirectory(directory)
+{
+}
+
+std::uint64_t ShaderCache::MakeKey(const void* preprocessedSource, std::size_t sourceSize,
+	const std::string& entryPoint, const std::string& target, const std::vector<ShaderDefine>& defines,
+	std::uint32_t compileFlags, std::uint32_t compilerVersion)
+{
+	std::uint64_t hash = FnvOffset;
+	HashField(hash, preprocessedSource, sourceSize);
+	HashString(hash, entryPoint);
+	HashString(hash, target);
+
+	HashValue(hash, defines.size());
+	for (const ShaderDefine& define : defines)
+	{
+		HashString(hash, define.Name);
+		HashString(hash, define.Value);
+	}
+
+	HashValue(hash, compileFlags);
+	HashValue(hash, compilerVersion);
+	return hash;
+}
+
+std::wstring ShaderCache::FileName(std::uint64_t key)
+{
+	static const wchar_t digits[] = L"0123456789abcdef";
+
+	std::wstring name(16, L'0');
+	for (int i = 15; i >= 0; --i)
+	{
+		name[i] = digits[key & 0xf];
+		key >>= 4;
+	}
+	return name + L".cso";
+}
+
+bool ShaderCache::ParseFileName(const std::wstring& fileName, std::uint64_t& key)
+{
+	if (fileName.size() != 20)
+		return false;
+
+	const std::wstring extension = fileName.substr(16);
+	if (extension != L".cso" && extension != L".CSO")
+		return false;
+
+	std::uint64_t value = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		const wchar_t c = fileName[i];
+		std::uint64_t digit;
+		if (c >= L'0' && c <= L'9')
+			digit = c - L'0';
+		else if (c >= L'a' && c <= L'f')
+			digit = c - L'a' + 10;
+		else if (c >= L'A' && c <= L'F')
+			digit = c - L'A' + 10;
+		else
+			return false;
+		value = (value << 4) | digit;
+	}
+
+	key = value;
+	return true;
+}
+
+std::wstring ShaderCache::BlobPath(std::uint64_t key)const
+{
+	return mDirectory + L"\\" + FileName(key);
+}
+
+bool ShaderCache::AddFile(const std::wstring& fileName)
+{
+	std::uint64_t key;
+	if (!ParseFileName(fileName, key))
+		return false;
+
+	mKeys.insert(key);
+	return true;
+}
+
+void ShaderCache::Insert(std::uint64_t key)
+{
+	mKeys.insert(key);
+}
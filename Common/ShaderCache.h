@@ -0,0 +1,70 @@
+//***************************************************************************************
+// ShaderCache.h
+//
+// On-disk cache of compiled shader blobs.  A blob is stored under a key hashed from
+// everything that decides its bytecode: the preprocessed source (so edits to included
+// files count), the entry point, the target profile, the defines, the compile flags
+// and the compiler version.  Each blob is one <key>.cso file in the cache directory.
+//
+// This class only names and indexes blobs; d3dUtil::LoadOrCompileShaders does the
+// preprocessing, file reads and compiles.  Nothing here needs the shader compiler,
+// so keys and lookups can be checked on their own.
+//
+// Blobs are never evicted.  Stale ones are simply never looked up again; delete the
+// directory to reclaim the space.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+struct ShaderDefine
+{
+	std::string Name;
+	std::string Value;
+};
+
+// One shader to load or compile.
+struct ShaderDesc
+{
+	std::wstring Filename;
+	std::vector<ShaderDefine> Defines;
+	std::string EntryPoint;
+	std::string Target;
+};
+
+class ShaderCache
+{
+public:
+	explicit ShaderCache(const std::wstring& directory);
+
+	// FNV-1a over each field, length-prefixed so no two different inputs run together
+	// into the same byte stream.
+	static std::uint64_t MakeKey(const void* preprocessedSource, std::size_t sourceSize,
+		const std::string& entryPoint, const std::string& target, const std::vector<ShaderDefine>& defines,
+		std::uint32_t compileFlags, std::uint32_t compilerVersion);
+
+	// "<16 hex digits>.cso" for key; ParseFileName accepts exactly that (either case).
+	static std::wstring FileName(std::uint64_t key);
+	static bool ParseFileName(const std::wstring& fileName, std::uint64_t& key);
+
+	const std::wstring& Directory()const { return mDirectory; }
+	std::wstring BlobPath(std::uint64_t key)const;
+
+	// Records a file found in the directory.  Returns false for files that are not
+	// cache blobs.
+	bool AddFile(const std::wstring& fileName);
+
+	// Records a blob written to BlobPath(key).
+	void Insert(std::uint64_t key);
+
+	bool Contains(std::uint64_t key)const { return mKeys.count(key) != 0; }
+	std::size_t Size()const { return mKeys.size(); }
+
+private:
+	std::wstring mDirectory;
+	std::unordered_set<std::uint64_t> mKeys;
+};
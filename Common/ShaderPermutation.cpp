@@ -0,0 +1,56 @@
+//***************************************************************************************
+// ShaderPermutation.cpp
+//***************************************************************************************
+
+#include "ShaderPermutation.h"
+#include <string>
+
+// Point and spot lights share the per-object list of MaxObjectLights indices.
+const std::uint32_t ShaderPermutation::PointBuckets[] = { 0, 1, 2, 4, 8, 12 };
+const std::uint32_t ShaderPermutation::SpotBuckets[] = { 0, 1, 4 };
+const std::uint32_t ShaderPermutation::PointBucketCount = sizeof(PointBuckets) / sizeof(PointBuckets[0]);
+const std::uint32_t ShaderPermutation::SpotBucketCount = sizeof(SpotBuckets) / sizeof(SpotBuckets[0]);
+
+namespace
+{
+	std::uint32_t Bucket(const std::uint32_t* buckets, std::uint32_t bucketCount, std::uint32_t count)
+	{
+		for (std::uint32_t i = 0; i < bucketCount; ++i)
+		{
+			if (count <= buckets[i])
+				return i;
+		}
+		return bucketCount - 1;
+	}
+}
+
+std::uint32_t ShaderPermutation::LightVariant(std::uint32_t pointLights, std::uint32_t spotLights)
+{
+	return Bucket(PointBuckets, PointBucketCount, pointLights) * SpotBucketCount +
+		Bucket(SpotBuckets, SpotBucketCount, spotLights);
+}
+
+std::uint32_t ShaderPermutation::MaxPointLights(std::uint32_t lightVariant)
+{
+	return PointBuckets[lightVariant / SpotBucketCount];
+}
+
+std::uint32_t ShaderPermutation::MaxSpotLights(std::uint32_t lightVariant)
+{
+	return SpotBuckets[lightVariant % SpotBucketCount];
+}
+
+std::vector<ShaderDefine> ShaderPermutation::Defines(std::uint32_t features, std::uint32_t lightVariant)
+{
+	std::vector<ShaderDefine> defines;
+	if (features & ShaderFeature::Fog)
+		defines.push_back({ "FOG", "1" });
+	if (features & ShaderFeature::AlphaTest)
+		defines.push_back({ "ALPHA_TEST", "1" });
+	if (features & ShaderFeature::ClusteredLights)
+		defines.push_back({ "CLUSTERED_LIGHTING", "1" });
+
+	defines.push_back({ "NUM_POINT_LIGHTS", std::to_string(MaxPointLights(lightVariant)) });
+	defines.push_back({ "NUM_SPOT_LIGHTS", std::to_string(MaxSpotLights(lightVariant)) });
+	return defines;
+}
@@ -0,0 +1,55 @@
+//***************************************************************************************
+// ShaderPermutation.h
+//
+// Names the compiled variants of the lit pixel shaders.  A variant is a set of feature
+// flags (fog, alpha testing, clustered lights) plus a light variant: how many point and spot lights the
+// shader's loops are unrolled for.  Counts are rounded up to a few buckets, so a
+// render item touched by three point lights draws with the four-light variant and
+// skips the loop iterations past its own count at run time.  Clustered shaders loop
+// over their cluster's lights instead and ignore the light variant.
+//
+// Everything here is plain data, so the selection can be checked without a device.
+//***************************************************************************************
+
+#pragma once
+
+#include "ShaderCache.h"
+#include <cstdint>
+#include <vector>
+
+namespace ShaderFeature
+{
+	enum : std::uint32_t
+	{
+		Fog = 1 << 0,
+		AlphaTest = 1 << 1,
+		ClusteredLights = 1 << 2, // lights come from the cluster grid; see LightClusters.h
+	};
+}
+
+class ShaderPermutation
+{
+public:
+	// Upper bounds of the point and spot light buckets.  The largest bucket of each
+	// is the most a single render item is lit by.
+	static const std::uint32_t PointBuckets[];
+	static const std::uint32_t SpotBuckets[];
+	static const std::uint32_t PointBucketCount;
+	static const std::uint32_t SpotBucketCount;
+
+	static std::uint32_t LightVariantCount() { return PointBucketCount * SpotBucketCount; }
+
+	// The variant every render item can draw with.
+	static std::uint32_t LargestLightVariant() { return LightVariantCount() - 1; }
+
+	// The cheapest variant whose loops cover pointLights and spotLights.  Counts past
+	// the largest bucket are clamped to it.
+	static std::uint32_t LightVariant(std::uint32_t pointLights, std::uint32_t spotLights);
+
+	static std::uint32_t MaxPointLights(std::uint32_t lightVariant);
+	static std::uint32_t MaxSpotLights(std::uint32_t lightVariant);
+
+	// FOG, ALPHA_TEST, CLUSTERED_LIGHTING, NUM_POINT_LIGHTS and NUM_SPOT_LIGHTS for
+	// the variant.
+	static std::vector<ShaderDefine> Defines(std::uint32_t features, std::uint32_t lightVariant);
+};
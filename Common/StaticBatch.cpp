@@ -0,0 +1,304 @@
+//***************************************************************************************
+// StaticBatch.cpp
+//***************************************************************************************
+
+#include "StaticBatch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <istream>
+#include <limits>
+#include <ostream>
+
+namespace
+{
+	const std::uint64_t FnvOffset = 14695981039346656037ull;
+	const std::uint64_t FnvPrime = 1099511628211ull;
+
+	void HashBytes(std::uint64_t& hash, const void* data, std::size_t size)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (std::size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= FnvPrime;
+		}
+	}
+
+	void HashValue(std::uint64_t& hash, std::uint64_t value)
+	{
+		unsigned char bytes[8];
+		for (int i = 0; i < 8; ++i)
+			bytes[i] = (unsigned char)(value >> (8 * i));
+		HashBytes(hash, bytes, sizeof(bytes));
+	}
+
+	// Bumped whenever the stored layout or the bake itself changes.
+	const char FileMagic[4] = { 'S', 'B', 'A', 'T' };
+	const std::uint32_t FileVersion = 1;
+
+	struct FileHeader
+	{
+		char Magic[4];
+		std::uint32_t Version;
+		std::uint64_t Key;
+		std::uint32_t VertexCount;
+		std::uint32_t IndexCount;
+		std::uint32_t DrawCount;
+		std::uint32_t Pad;
+	};
+
+	// An instance's world bounds, cell and the range of mesh vertices it uses.
+	struct Placed
+	{
+		std::uint32_t Instance;
+		std::int32_t CellX;
+		std::int32_t CellZ;
+		std::uint32_t MinIndex;
+		std::uint32_t MaxIndex;
+		float Min[3];
+		float Max[3];
+	};
+
+	void TransformPoint(const float m[4][4], const float p[3], float out[3])
+	{
+		for (int j = 0; j < 3; ++j)
+			out[j] = p[0] * m[0][j] + p[1] * m[1][j] + p[2] * m[2][j] + m[3][j];
+	}
+
+	void Cross(const float a[3], const float b[3], float out[3])
+	{
+		out[0] = a[1] * b[2] - a[2] * b[1];
+		out[1] = a[2] * b[0] - a[0] * b[2];
+		out[2] = a[0] * b[1] - a[1] * b[0];
+	}
+
+	// Range of vertices referenced by an instance's indices.
+	void IndexRange(const StaticInstance& instance, std::uint32_t& minIndex, std::uint32_t& maxIndex)
+	{
+		minIndex = std::numeric_limits<std::uint32_t>::max();
+		maxIndex = 0;
+		for (std::uint32_t k = 0; k < instance.IndexCount; ++k)
+		{
+			minIndex = std::min<std::uint32_t>(minIndex, instance.Indices[k]);
+			maxIndex = std::max<std::uint32_t>(maxIndex, instance.Indices[k]);
+		}
+	}
+}
+
+void StaticBatch::Clear()
+{
+	mVertices.clear();
+	mIndices.clear();
+	mDraws.clear();
+}
+
+void StaticBatch::Build(const StaticInstance* instances, std::uint32_t count, float cellSize)
+{
+	Clear();
+
+	std::vector<Placed> placed;
+	placed.reserve(count);
+	for (std::uint32_t i = 0; i < count; ++i)
+	{
+		const StaticInstance& instance = instances[i];
+		if (instance.IndexCount == 0)
+			continue;
+
+		Placed p;
+		p.Instance = i;
+		IndexRange(instance, p.MinIndex, p.MaxIndex);
+		for (int j = 0; j < 3; ++j)
+		{
+			p.Min[j] = +std::numeric_limits<float>::max();
+			p.Max[j] = -std::numeric_limits<float>::max();
+		}
+
+		for (std::uint32_t v = p.MinIndex; v <= p.MaxIndex; ++v)
+		{
+			float pos[3];
+			TransformPoint(instance.World, instance.Vertices[instance.BaseVertex + v].Pos, pos);
+			for (int j = 0; j < 3; ++j)
+			{
+				p.Min[j] = std::min(p.Min[j], pos[j]);
+				p.Max[j] = std::max(p.Max[j], pos[j]);
+			}
+		}
+
+		p.CellX = (std::int32_t)std::floor(0.5f * (p.Min[0] + p.Max[0]) / cellSize);
+		p.CellZ = (std::int32_t)std::floor(0.5f * (p.Min[2] + p.Max[2]) / cellSize);
+		placed.push_back(p);
+	}
+
+	// Stable, so instances keep their order within a draw.
+	std::stable_sort(placed.begin(), placed.end(), [&](const Placed& a, const Placed& b)
+	{
+		const std::uint32_t ma = instances[a.Instance].Material;
+		const std::uint32_t mb = instances[b.Instance].Material;
+		if (ma != mb)
+			return ma < mb;
+		if (a.CellX != b.CellX)
+			return a.CellX < b.CellX;
+		return a.CellZ < b.CellZ;
+	});
+
+	for (std::size_t first = 0; first < placed.size(); )
+	{
+		StaticDraw draw;
+		draw.Material = instances[placed[first].Instance].Material;
+		draw.StartIndex = (std::uint32_t)mIndices.size();
+		draw.BaseVertex = (std::uint32_t)mVertices.size();
+		std::memcpy(draw.BoundsMin, placed[first].Min, sizeof(draw.BoundsMin));
+		std::memcpy(draw.BoundsMax, placed[first].Max, sizeof(draw.BoundsMax));
+
+		std::size_t last = first;
+		for (; last < placed.size(); ++last)
+		{
+			const Placed& p = placed[last];
+			const StaticInstance& instance = instances[p.Instance];
+			if (instance.Material != draw.Material || p.CellX != placed[first].CellX || p.CellZ != placed[first].CellZ)
+				break;
+
+			// Normals take the inverse transpose of the upper 3x3, which is its cofactor
+			// matrix over the determinant.  Only the determinant's sign matters once the
+			// normal is renormalized; a negative one also flips the triangles' winding.
+			float cofactor[3][3];
+			Cross(instance.World[1], instance.World[2], cofactor[0]);
+			Cross(instance.World[2], instance.World[0], cofactor[1]);
+			Cross(instance.World[0], instance.World[1], cofactor[2]);
+			const float det = instance.World[0][0] * cofactor[0][0] + instance.World[0][1] * cofactor[0][1] +
+				instance.World[0][2] * cofactor[0][2];
+			const float sign = det < 0.0f ? -1.0f : 1.0f;
+
+			const std::uint32_t vertexStart = (std::uint32_t)mVertices.size() - draw.BaseVertex;
+			for (std::uint32_t v = p.MinIndex; v <= p.MaxIndex; ++v)
+			{
+				const StaticVertex& source = instance.Vertices[instance.BaseVertex + v];
+
+				StaticVertex vertex;
+				TransformPoint(instance.World, source.Pos, vertex.Pos);
+
+				float length2 = 0.0f;
+				for (int j = 0; j < 3; ++j)
+				{
+					vertex.Normal[j] = sign * (source.Normal[0] * cofactor[0][j] +
+						source.Normal[1] * cofactor[1][j] + source.Normal[2] * cofactor[2][j]);
+					length2 += vertex.Normal[j] * vertex.Normal[j];
+				}
+				if (length2 > 0.0f)
+				{
+					const float invLength = 1.0f / std::sqrt(length2);
+					for (int j = 0; j < 3; ++j)
+						vertex.Normal[j] *= invLength;
+				}
+
+				vertex.TexC[0] = source.TexC[0];
+				vertex.TexC[1] = source.TexC[1];
+				mVertices.push_back(vertex);
+			}
+
+			const std::uint32_t triangleIndices = instance.IndexCount - instance.IndexCount % 3;
+			for (std::uint32_t k = 0; k < triangleIndices; k += 3)
+			{
+				const std::uint32_t a = vertexStart + instance.Indices[k + 0] - p.MinIndex;
+				const std::uint32_t b = vertexStart + instance.Indices[k + 1] - p.MinIndex;
+				const std::uint32_t c = vertexStart + instance.Indices[k + 2] - p.MinIndex;
+				mIndices.push_back(a);
+				mIndices.push_back(det < 0.0f ? c : b);
+				mIndices.push_back(det < 0.0f ? b : c);
+			}
+
+			for (int j = 0; j < 3; ++j)
+			{
+				draw.BoundsMin[j] = std::min(draw.BoundsMin[j], p.Min[j]);
+				draw.BoundsMax[j] = std::max(draw.BoundsMax[j], p.Max[j]);
+			}
+		}
+
+		draw.IndexCount = (std::uint32_t)mIndices.size() - draw.StartIndex;
+		mDraws.push_back(draw);
+		first = last;
+	}
+}
+
+std::uint64_t StaticBatch::MakeKey(const StaticInstance* instances, std::uint32_t count, float cellSize)
+{
+	std::uint64_t hash = FnvOffset;
+	HashValue(hash, FileVersion);
+	HashValue(hash, count);
+	HashBytes(hash, &cellSize, sizeof(cellSize));
+
+	for (std::uint32_t i = 0; i < count; ++i)
+	{
+		const StaticInstance& instance = instances[i];
+		HashValue(hash, instance.IndexCount);
+		HashValue(hash, instance.Material);
+		HashBytes(hash, instance.World, sizeof(instance.World));
+		HashBytes(hash, instance.Indices, instance.IndexCount * sizeof(std::uint16_t));
+		if (instance.IndexCount == 0)
+			continue;
+
+		// The vertices used, wherever the mesh keeps them.
+		std::uint32_t minIndex, maxIndex;
+		IndexRange(instance, minIndex, maxIndex);
+		HashValue(hash, minIndex);
+		HashBytes(hash, instance.Vertices + instance.BaseVertex + minIndex,
+			(maxIndex - minIndex + 1) * sizeof(StaticVertex));
+	}
+	return hash;
+}
+
+std::string StaticBatch::FileName(std::uint64_t key)
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.sbatch", (unsigned long long)key);
+	return name;
+}
+
+bool StaticBatch::Write(std::ostream& out, std::uint64_t key)const
+{
+	FileHeader header = {};
+	std::memcpy(header.Magic, FileMagic, sizeof(header.Magic));
+	header.Version = FileVersion;
+	header.Key = key;
+	header.VertexCount = (std::uint32_t)mVertices.size();
+	header.IndexCount = (std::uint32_t)mIndices.size();
+	header.DrawCount = (std::uint32_t)mDraws.size();
+
+	out.write((const char*)&header, sizeof(header));
+	out.write((const char*)mVertices.data(), (std::streamsize)(mVertices.size() * sizeof(StaticVertex)));
+	out.write((const char*)mIndices.data(), (std::streamsize)(mIndices.size() * sizeof(std::uint32_t)));
+	out.write((const char*)mDraws.data(), (std::streamsize)(mDraws.size() * sizeof(StaticDraw)));
+	return (bool)out;
+}
+
+bool StaticBatch::Read(std::istream& in, std::uint64_t key)
+{
+	Clear();
+
+	FileHeader header;
+	if (!in.read((char*)&header, sizeof(header)) ||
+		std::memcmp(header.Magic, FileMagic, sizeof(header.Magic)) != 0 ||
+		header.Version != FileVersion || header.Key != key)
+		return false;
+
+	mVertices.resize(header.VertexCount);
+	mIndices.resize(header.IndexCount);
+	mDraws.resize(header.DrawCount);
+	in.read((char*)mVertices.data(), (std::streamsize)(mVertices.size() * sizeof(StaticVertex)));
+	in.read((char*)mIndices.data(), (std::streamsize)(mIndices.size() * sizeof(std::uint32_t)));
+	in.read((char*)mDraws.data(), (std::streamsize)(mDraws.size() * sizeof(StaticDraw)));
+
+	// A truncated file, or draws that run past the buffers, is as good as none.
+	bool valid = (bool)in;
+	for (const StaticDraw& draw : mDraws)
+	{
+		valid = valid && (std::uint64_t)draw.StartIndex + draw.IndexCount <= mIndices.size() &&
+			draw.BaseVertex <= mVertices.size();
+	}
+	if (!valid)
+		Clear();
+	return valid;
+}
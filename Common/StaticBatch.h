@@ -0,0 +1,84 @@
+//***************************************************************************************
+// StaticBatch.h
+//
+// Bakes static render items into a few large draws.  Each instance (a submesh of a
+// shared mesh placed by a world matrix) is transformed into world space, and the
+// results are merged per material and per square cell of the xz plane into one
+// vertex buffer and one 32-bit index buffer.  Every draw keeps the world-space box of
+// what it holds, so whole cells can be culled and lit as one.
+//
+// The baked buffers can be written to a stream and read back.  MakeKey hashes
+// everything Build reads, so a stored bake is only used for the exact same input.
+//
+// Everything here is plain data; no device is needed to bake.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// Position, normal and texture coordinates; the layout of the app's Vertex.
+struct StaticVertex
+{
+	float Pos[3];
+	float Normal[3];
+	float TexC[2];
+};
+
+// One placed submesh: IndexCount 16-bit indices into Vertices, offset by BaseVertex.
+// World maps row-vector positions to world space (p' = p * World).
+struct StaticInstance
+{
+	const StaticVertex* Vertices;
+	const std::uint16_t* Indices;
+	std::uint32_t IndexCount;
+	std::int32_t BaseVertex;
+	float World[4][4];
+	std::uint32_t Material;
+};
+
+// One merged draw: Indices()[StartIndex, StartIndex + IndexCount), relative to
+// BaseVertex, all of one material and one cell.
+struct StaticDraw
+{
+	std::uint32_t Material;
+	std::uint32_t StartIndex;
+	std::uint32_t IndexCount;
+	std::uint32_t BaseVertex;
+	float BoundsMin[3];
+	float BoundsMax[3];
+};
+
+class StaticBatch
+{
+public:
+	// Merges instances[0, count).  An instance goes to the cell holding the center of
+	// its world bounds.  Draws are ordered by material, then cell.
+	void Build(const StaticInstance* instances, std::uint32_t count, float cellSize);
+
+	// Hash of the instances' referenced vertices, indices, matrices and materials, and
+	// of the cell size.
+	static std::uint64_t MakeKey(const StaticInstance* instances, std::uint32_t count, float cellSize);
+
+	// "<16 hex digits>.sbatch" for key.
+	static std::string FileName(std::uint64_t key);
+
+	// Write stores the bake with key; Read fails, leaving the batch empty, unless the
+	// stream holds a whole bake stored with the same key.
+	bool Write(std::ostream& out, std::uint64_t key)const;
+	bool Read(std::istream& in, std::uint64_t key);
+
+	const std::vector<StaticVertex>& Vertices()const { return mVertices; }
+	const std::vector<std::uint32_t>& Indices()const { return mIndices; }
+	const std::vector<StaticDraw>& Draws()const { return mDraws; }
+
+private:
+	void Clear();
+
+	std::vector<StaticVertex> mVertices;
+	std::vector<std::uint32_t> mIndices;
+	std::vector<StaticDraw> mDraws;
+};
@@ -0,0 +1,558 @@
+//***************************************************************************************
+// TextureLoader.cpp
+//***************************************************************************************
+
+#include "TextureLoader.h"
+#include "DDSTextureLoader.h"
+#include "CpuProfiler.h"
+#include <cstring>
+
+using Microsoft::WRL::ComPtr;
+
+// FNV-1a over the whole file.  Reading every byte also faults the mapping in, so the
+// main thread later copies from memory rather than waiting on the disk.
+static std::uint64_t HashBytes(const std::uint8_t* data, std::uint64_t size)
+{
+	std::uint64_t hash = 14695981039346656037ull;
+	for (std::uint64_t i = 0; i < size; ++i)
+	{
+		hash ^= data[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// Absolute, lower-case path, so different spellings of one file compare equal.
+static std::wstring CanonicalPath(const std::wstring& filename)
+{
+	DWORD length = GetFullPathNameW(filename.c_str(), 0, nullptr, nullptr);
+	if (length == 0)
+		return filename;
+
+	std::wstring path(length, L'\0');
+	length = GetFullPathNameW(filename.c_str(), length, &path[0], nullptr);
+	path.resize(length);
+
+	CharLowerBuffW(&path[0], length);
+	return path;
+}
+
+// Block-compressed resources need a top mip whose dimensions are multiples of 4.
+static bool IsBlockCompressed(DXGI_FORMAT format)
+{
+	return (format >= DXGI_FORMAT_BC1_TYPELESS && format <= DXGI_FORMAT_BC5_SNORM) ||
+		(format >= DXGI_FORMAT_BC6H_TYPELESS && format <= DXGI_FORMAT_BC7_UNORM_SRGB);
+}
+
+TextureLoader::TextureLoader(ID3D12Device* device, UINT streamingTailMips)
+	: md3dDevice(device), mStreamingTailMips(streamingTailMips)
+{
+	D3D12_COMMAND_QUEUE_DESC queueDesc = {};
+	queueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+	queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+	ThrowIfFailed(md3dDevice->CreateCommandQueue(&queueDesc, IID_PPV_ARGS(&mCopyQueue)));
+
+	ThrowIfFailed(md3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&mFence)));
+
+	mFenceEvent = CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS);
+	if (mFenceEvent == nullptr)
+		ThrowIfFailed(HRESULT_FROM_WIN32(GetLastError()));
+
+	// Upload the placeholder through the normal batch path and wait for it, so the
+	// app has something to bind before any real texture arrives.
+	D3D12_RESOURCE_DESC texDesc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UNORM, 1, 1, 1, 1);
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&texDesc,
+		D3D12_RESOURCE_STATE_COMMON,
+		nullptr,
+		IID_PPV_ARGS(&mPlaceholder.Resource)));
+
+	D3D12_SUBRESOURCE_DATA texel = {};
+	texel.pData = &mPlaceholderTexel;
+	texel.RowPitch = sizeof(mPlaceholderTexel);
+	texel.SlicePitch = sizeof(mPlaceholderTexel);
+	mPlaceholder.Subresources.push_back(texel);
+	mPlaceholder.Filename = L"placeholder";
+	mPlaceholder.State = LoadState::Parsed;
+
+	SubmitBatch({ &mPlaceholder });
+	WaitForFence(mCurrentFence);
+
+	RetireBatches();
+}
+
+TextureLoader::~TextureLoader()
+{
+	// Workers hold pointers into mEntries and the copy queue still references the
+	// upload buffers, so let both finish first.
+	mTasks.wait();
+	WaitForFence(mCurrentFence);
+
+	if (mFenceEvent != nullptr)
+		CloseHandle(mFenceEvent);
+}
+
+int TextureLoader::Load(const std::wstring& filename)
+{
+	++mRequests;
+
+	std::wstring path = CanonicalPath(filename);
+	auto it = mPathHandles.find(path);
+	if (it != mPathHandles.end())
+	{
+		++mEntries[it->second]->References;
+		return it->second;
+	}
+
+	auto entry = std::make_unique<Entry>();
+	entry->Handle = (int)mEntries.size();
+	entry->Filename = filename;
+
+	Entry* e = entry.get();
+	mEntries.push_back(std::move(entry));
+	mPathHandles[path] = e->Handle;
+
+	mTasks.run([this, e]() { ParseFile(*e); });
+
+	return e->Handle;
+}
+
+void TextureLoader::ParseFile(Entry& entry)
+{
+	PROFILE_SCOPE("TextureLoader::ParseFile");
+
+	D3D12_RESOURCE_DESC texDesc;
+	HRESULT hr = DirectX::LoadDDSTextureFromFile12(entry.Filename.c_str(),
+		entry.FileData, texDesc, entry.Subresources);
+
+	if (SUCCEEDED(hr))
+	{
+		entry.FileDesc = texDesc;
+		entry.MipBytes.assign(texDesc.MipLevels, 0);
+		for (size_t i = 0; i < entry.Subresources.size(); ++i)
+		{
+			const UINT mip = (UINT)(i % texDesc.MipLevels);
+			const UINT depth = texDesc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D ?
+				std::max(1u, (UINT)texDesc.DepthOrArraySize >> mip) : 1u;
+			entry.MipBytes[mip] += (UINT64)entry.Subresources[i].SlicePitch * depth;
+		}
+
+		entry.ContentHash = HashBytes(entry.FileData.Data(), entry.FileData.Size());
+
+		// The first file with these contents owns the resource; later ones share it
+		// once it is resident and never create or upload their own.  A matching hash
+		// and size is only a candidate: the owner's file is mapped again (its own
+		// mapping may already be closed) and compared byte for byte, and a file that
+		// merely collides keeps a resource of its own.
+		const Entry* owner = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(mContentMutex);
+			auto result = mContentHandles.emplace(std::make_pair(entry.ContentHash, entry.FileData.Size()), &entry);
+			if (!result.second)
+				owner = result.first->second;
+		}
+
+		if (owner != nullptr)
+		{
+			MappedFile ownerData;
+			if (ownerData.Open(owner->Filename.c_str()) && ownerData.Size() == entry.FileData.Size() &&
+				std::memcmp(ownerData.Data(), entry.FileData.Data(), (size_t)entry.FileData.Size()) == 0)
+				entry.SharedWith = owner->Handle;
+		}
+
+		if (entry.SharedWith >= 0)
+		{
+			entry.Subresources.clear();
+			entry.FileData.Close();
+		}
+		else
+		{
+			if (IsStreaming())
+			{
+				// Start from the smallest mips and keep the file for the rest.
+				entry.FileSubresources = entry.Subresources;
+
+				entry.CoarsestTopMip = texDesc.MipLevels - 1;
+				if (IsBlockCompressed(texDesc.Format))
+				{
+					entry.CoarsestTopMip = 0;
+					for (UINT m = 1; m < texDesc.MipLevels; ++m)
+					{
+						if (((texDesc.Width >> m) % 4) != 0 || ((texDesc.Height >> m) % 4) != 0)
+							break;
+						entry.CoarsestTopMip = m;
+					}
+				}
+
+				const UINT tailTop = texDesc.MipLevels > mStreamingTailMips ? texDesc.MipLevels - mStreamingTailMips : 0;
+				entry.MostDetailedMip = std::min(tailTop, entry.CoarsestTopMip);
+				texDesc = MipRangeDesc(entry, entry.MostDetailedMip);
+				SelectUploadMips(entry, entry.MostDetailedMip);
+			}
+
+			// Resource creation is free-threaded, so do it here rather than on the main thread.
+			hr = md3dDevice->CreateCommittedResource(
+				&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+				D3D12_HEAP_FLAG_NONE,
+				&texDesc,
+				D3D12_RESOURCE_STATE_COMMON,
+				nullptr,
+				IID_PPV_ARGS(&entry.Resource));
+
+			entry.GpuBytes = md3dDevice->GetResourceAllocationInfo(0, 1, &texDesc).SizeInBytes;
+		}
+	}
+
+	entry.Result = hr;
+	entry.State.store(SUCCEEDED(hr) ? LoadState::Parsed : LoadState::Failed, std::memory_order_release);
+}
+
+D3D12_RESOURCE_DESC TextureLoader::MipRangeDesc(const Entry& entry, UINT mip)const
+{
+	D3D12_RESOURCE_DESC desc = entry.FileDesc;
+	desc.Width = std::max<UINT64>(1, desc.Width >> mip);
+	desc.Height = std::max(1u, desc.Height >> mip);
+	if (desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D)
+		desc.DepthOrArraySize = (UINT16)std::max(1, desc.DepthOrArraySize >> mip);
+	desc.MipLevels = (UINT16)(entry.FileDesc.MipLevels - mip);
+	return desc;
+}
+
+void TextureLoader::SelectUploadMips(Entry& entry, UINT mip)
+{
+	const UINT mipLevels = entry.FileDesc.MipLevels;
+	const UINT slices = entry.FileDesc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D ?
+		1u : entry.FileDesc.DepthOrArraySize;
+
+	entry.Subresources.clear();
+	for (UINT slice = 0; slice < slices; ++slice)
+	{
+		for (UINT m = mip; m < mipLevels; ++m)
+			entry.Subresources.push_back(entry.FileSubresources[slice * mipLevels + m]);
+	}
+}
+
+bool TextureLoader::RequestMip(int handle, UINT mip)
+{
+	if (!IsStreaming())
+		return false;
+
+	Entry& e = *mEntries[handle];
+	if (e.State.load(std::memory_order_acquire) != LoadState::Resident || e.SharedWith >= 0)
+		return false;
+	if (e.PendingResource != nullptr || mUpdateCount < e.RetiredUntil)
+		return false;
+
+	mip = std::min(mip, e.CoarsestTopMip);
+	if (mip == e.MostDetailedMip)
+		return false;
+
+	D3D12_RESOURCE_DESC texDesc = MipRangeDesc(e, mip);
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&texDesc,
+		D3D12_RESOURCE_STATE_COMMON,
+		nullptr,
+		IID_PPV_ARGS(&e.PendingResource)));
+
+	e.PendingMip = mip;
+	SelectUploadMips(e, mip);
+	mMipRequests.push_back(&e);
+
+	return true;
+}
+
+const std::vector<int>& TextureLoader::Update()
+{
+	++mUpdateCount;
+
+	// Frames that could sample a replaced resource have finished by now.
+	mRetired.erase(std::remove_if(mRetired.begin(), mRetired.end(),
+		[this](const RetiredResource& r) { return r.ReleaseUpdate <= mUpdateCount; }), mRetired.end());
+
+	Pump();
+
+	mResident.swap(mNewlyResident);
+	mNewlyResident.clear();
+	return mResident;
+}
+
+void TextureLoader::Pump()
+{
+	RetireBatches();
+
+	std::vector<Entry*> parsed;
+	for (auto& e : mEntries)
+	{
+		LoadState state = e->State.load(std::memory_order_acquire);
+		if (state == LoadState::Parsed)
+		{
+			if (e->SharedWith < 0)
+			{
+				parsed.push_back(e.get());
+			}
+			else if (mEntries[e->SharedWith]->State.load(std::memory_order_acquire) == LoadState::Resident)
+			{
+				// Holding a reference keeps the shared resource alive for either handle.
+				const Entry& owner = *mEntries[e->SharedWith];
+				e->Resource = owner.Resource;
+				e->GpuBytes = owner.GpuBytes;
+				e->State.store(LoadState::Resident, std::memory_order_relaxed);
+				mNewlyResident.push_back(e->Handle);
+			}
+		}
+		else if (state == LoadState::Failed)
+		{
+			throw DxException(e->Result, L"LoadDDSTextureFromFile12(" + e->Filename + L")",
+				AnsiToWString(__FILE__), __LINE__);
+		}
+	}
+
+	parsed.insert(parsed.end(), mMipRequests.begin(), mMipRequests.end());
+	mMipRequests.clear();
+
+	if (!parsed.empty())
+		SubmitBatch(parsed);
+}
+
+void TextureLoader::SubmitBatch(const std::vector<Entry*>& textures)
+{
+	PROFILE_SCOPE("TextureLoader::SubmitBatch");
+
+	// Lay every subresource of the batch out in one upload buffer.  Each texture
+	// starts on a placement boundary; GetCopyableFootprints aligns the rest.
+	std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> layouts;
+	std::vector<UINT> numRows;
+	std::vector<UINT64> rowSizes;
+	UINT64 uploadSize = 0;
+
+	for (Entry* e : textures)
+	{
+		const UINT numSubresources = (UINT)e->Subresources.size();
+		const size_t first = layouts.size();
+		layouts.resize(first + numSubresources);
+		numRows.resize(first + numSubresources);
+		rowSizes.resize(first + numSubresources);
+
+		ID3D12Resource* target = e->PendingResource ? e->PendingResource.Get() : e->Resource.Get();
+		D3D12_RESOURCE_DESC texDesc = target->GetDesc();
+		UINT64 textureBytes = 0;
+		md3dDevice->GetCopyableFootprints(&texDesc, 0, numSubresources, uploadSize,
+			&layouts[first], &numRows[first], &rowSizes[first], &textureBytes);
+
+		uploadSize = (uploadSize + textureBytes + D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1) &
+			~(UINT64)(D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1);
+	}
+
+	UploadBatch batch;
+	ThrowIfFailed(md3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(uploadSize),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&batch.UploadBuffer)));
+
+	ThrowIfFailed(md3dDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY,
+		IID_PPV_ARGS(batch.CmdListAlloc.GetAddressOf())));
+	ThrowIfFailed(md3dDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY,
+		batch.CmdListAlloc.Get(), nullptr, IID_PPV_ARGS(batch.CmdList.GetAddressOf())));
+
+	BYTE* mappedData = nullptr;
+	ThrowIfFailed(batch.UploadBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mappedData)));
+
+	size_t layout = 0;
+	for (Entry* e : textures)
+	{
+		ID3D12Resource* target = e->PendingResource ? e->PendingResource.Get() : e->Resource.Get();
+
+		for (UINT i = 0; i < (UINT)e->Subresources.size(); ++i, ++layout)
+		{
+			const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint = layouts[layout];
+
+			D3D12_MEMCPY_DEST dest = { mappedData + footprint.Offset,
+				footprint.Footprint.RowPitch, footprint.Footprint.RowPitch * numRows[layout] };
+			MemcpySubresource(&dest, &e->Subresources[i], (SIZE_T)rowSizes[layout],
+				numRows[layout], footprint.Footprint.Depth);
+
+			// Textures start in COMMON and are implicitly promoted to COPY_DEST here; they
+			// decay back to COMMON when the copy finishes, ready for the direct queue.
+			CD3DX12_TEXTURE_COPY_LOCATION dst(target, i);
+			CD3DX12_TEXTURE_COPY_LOCATION src(batch.UploadBuffer.Get(), footprint);
+			batch.CmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+		}
+
+		// The file data has been copied.  Streamed textures keep the mapping for
+		// their finer mips; others have no further use for it.
+		e->Subresources.clear();
+		if (!IsStreaming())
+			e->FileData.Close();
+
+		// A texture getting new mips stays resident with its old resource meanwhile.
+		if (e->PendingResource == nullptr)
+			e->State.store(LoadState::Uploading, std::memory_order_relaxed);
+		batch.Textures.push_back(e);
+	}
+
+	batch.UploadBuffer->Unmap(0, nullptr);
+
+	ThrowIfFailed(batch.CmdList->Close());
+	ID3D12CommandList* cmdsLists[] = { batch.CmdList.Get() };
+	mCopyQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+
+	batch.Fence = ++mCurrentFence;
+	ThrowIfFailed(mCopyQueue->Signal(mFence.Get(), batch.Fence));
+
+	mBatches.push_back(std::move(batch));
+}
+
+void TextureLoader::RetireBatches()
+{
+	UINT64 completed = mFence->GetCompletedValue();
+
+	for (auto it = mBatches.begin(); it != mBatches.end();)
+	{
+		if (it->Fence > completed)
+		{
+			++it;
+			continue;
+		}
+
+		for (Entry* e : it->Textures)
+		{
+			if (e->PendingResource != nullptr)
+			{
+				// Swap in the new mips.  Frames already recorded may still sample the
+				// old resource, so hold it for as many Updates as there are frames in flight.
+				e->RetiredUntil = mUpdateCount + gNumFrameResources + 1;
+				mRetired.push_back({ std::move(e->Resource), e->RetiredUntil });
+
+				e->Resource = std::move(e->PendingResource);
+				e->MostDetailedMip = e->PendingMip;
+				D3D12_RESOURCE_DESC texDesc = e->Resource->GetDesc();
+				e->GpuBytes = md3dDevice->GetResourceAllocationInfo(0, 1, &texDesc).SizeInBytes;
+				mNewlyResident.push_back(e->Handle);
+
+				// Handles sharing this resource switch with it.
+				for (auto& alias : mEntries)
+				{
+					// SharedWith is only safe to read once the worker is done with the entry.
+					if (alias->State.load(std::memory_order_acquire) == LoadState::Resident && alias->SharedWith == e->Handle)
+					{
+						alias->Resource = e->Resource;
+						alias->GpuBytes = e->GpuBytes;
+						mNewlyResident.push_back(alias->Handle);
+					}
+				}
+				continue;
+			}
+
+			e->State.store(LoadState::Resident, std::memory_order_relaxed);
+			if (e->Handle >= 0)
+				mNewlyResident.push_back(e->Handle);
+		}
+
+		// Frees the batch's upload buffer and command list.
+		it = mBatches.erase(it);
+	}
+}
+
+void TextureLoader::WaitForFence(UINT64 value)
+{
+	if (mFence->GetCompletedValue() >= value)
+		return;
+
+	ThrowIfFailed(mFence->SetEventOnCompletion(value, mFenceEvent));
+	WaitForSingleObject(mFenceEvent, INFINITE);
+}
+
+bool TextureLoader::IsResident(int handle)const
+{
+	return mEntries[handle]->State.load(std::memory_order_acquire) == LoadState::Resident;
+}
+
+bool TextureLoader::AllResident()const
+{
+	for (auto& e : mEntries)
+	{
+		if (e->State.load(std::memory_order_acquire) != LoadState::Resident)
+			return false;
+	}
+
+	return true;
+}
+
+ID3D12Resource* TextureLoader::Resource(int handle)const
+{
+	return mEntries[handle]->Resource.Get();
+}
+
+const std::wstring& TextureLoader::Filename(int handle)const
+{
+	return mEntries[handle]->Filename;
+}
+
+int TextureLoader::Owner(int handle)const
+{
+	const int sharedWith = mEntries[handle]->SharedWith;
+	return sharedWith >= 0 ? sharedWith : handle;
+}
+
+const D3D12_RESOURCE_DESC& TextureLoader::FileDesc(int handle)const
+{
+	return mEntries[Owner(handle)]->FileDesc;
+}
+
+const std::vector<UINT64>& TextureLoader::MipBytes(int handle)const
+{
+	return mEntries[Owner(handle)]->MipBytes;
+}
+
+UINT TextureLoader::MostDetailedMip(int handle)const
+{
+	return mEntries[Owner(handle)]->MostDetailedMip;
+}
+
+UINT TextureLoader::CoarsestMip(int handle)const
+{
+	return mEntries[Owner(handle)]->CoarsestTopMip;
+}
+
+TextureLoader::Stats TextureLoader::GetStats()const
+{
+	Stats stats;
+	stats.Requests = mRequests;
+	stats.Files = (int)mEntries.size();
+
+	for (auto& e : mEntries)
+	{
+		// SharedWith is only known once the worker has parsed the file.
+		LoadState state = e->State.load(std::memory_order_acquire);
+		if (state == LoadState::Loading || state == LoadState::Failed)
+			continue;
+
+		if (e->SharedWith < 0)
+			++stats.Uploads;
+
+		// Every reference after the first is a duplicate, and so is the first
+		// reference to a file whose contents were already loaded.
+		int duplicates = (e->SharedWith >= 0) ? e->References : e->References - 1;
+		if (state == LoadState::Resident)
+			stats.BytesSaved += duplicates * e->GpuBytes;
+	}
+
+	return stats;
+}
+
+void TextureLoader::WaitForAll()
+{
+	mTasks.wait();
+
+	// Everything is parsed now, so one pass submits the remaining uploads.  Files
+	// that share another's contents follow it in the next Update.
+	Pump();
+	WaitForFence(mCurrentFence);
+}
@@ -0,0 +1,203 @@
+//***************************************************************************************
+// TextureLoader.h
+//
+// Loads DDS textures in the background.  Files are read and parsed on worker threads
+// and their default-heap resources created there; the main thread then copies every
+// texture parsed since the previous Update into one shared upload buffer and submits
+// the copies as a single batch on a copy queue.  Until a texture is resident the app
+// draws with Placeholder(), a 1x1 grey texture that is uploaded up front.
+//
+// Loads are deduplicated.  Loading a path that was already requested returns the same
+// handle, and a file with the same bytes as an earlier file (found by hash and size,
+// then compared) shares that file's resource instead of being uploaded again.
+//
+// With streaming enabled, a texture first uploads only its smallest mips and keeps its
+// file mapped.  RequestMip then uploads a new resource holding a different range of
+// mips from the mapping.  The new resource replaces the old one when its upload
+// completes.  The old resource is released once the frames that may still sample it
+// have finished.  TextureStreamer decides which mips to request.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include "MappedFile.h"
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <ppl.h>
+
+class TextureLoader
+{
+public:
+	// streamingTailMips > 0 enables streaming: each texture starts with only that many
+	// of its smallest mips resident.  0 loads every mip up front.
+	explicit TextureLoader(ID3D12Device* device, UINT streamingTailMips = 0);
+	TextureLoader(const TextureLoader& rhs) = delete;
+	TextureLoader& operator=(const TextureLoader& rhs) = delete;
+	~TextureLoader();
+
+	struct Stats
+	{
+		int Requests = 0;      // Load calls
+		int Files = 0;         // distinct paths read from disk
+		int Uploads = 0;       // distinct textures uploaded to the GPU
+		UINT64 BytesSaved = 0; // GPU memory not spent on duplicate textures
+	};
+
+	// Starts loading filename on a worker thread and returns its handle.  Paths are
+	// compared after canonicalisation, so "a/../b.dds" and "B.dds" are the same file.
+	int Load(const std::wstring& filename);
+
+	// Call once a frame.  Submits an upload batch for textures that finished parsing
+	// and returns the handles of textures whose upload has completed since the last
+	// call, including textures whose resource was replaced by RequestMip.  The list
+	// is valid until the next call.  Throws DxException if a file failed to load.
+	const std::vector<int>& Update();
+
+	bool IsResident(int handle)const;
+	bool AllResident()const;
+
+	// The texture's default-heap resource.  Only valid to sample once resident.
+	// Handles whose files have identical contents return the same resource.
+	ID3D12Resource* Resource(int handle)const;
+	const std::wstring& Filename(int handle)const;
+
+	// The handle that owns the resource: handle itself, or the earlier handle whose
+	// file has the same contents.  Only valid once resident.
+	int Owner(int handle)const;
+
+	// Streaming.  FileDesc describes every mip in the file and MipBytes the memory of
+	// each mip across all array slices.  MostDetailedMip is the finest mip in the
+	// current resource, and CoarsestMip the coarsest RequestMip can shrink it to.  All
+	// four are only valid once resident.
+	bool IsStreaming()const { return mStreamingTailMips > 0; }
+	const D3D12_RESOURCE_DESC& FileDesc(int handle)const;
+	const std::vector<UINT64>& MipBytes(int handle)const;
+	UINT MostDetailedMip(int handle)const;
+	UINT CoarsestMip(int handle)const;
+
+	// Starts replacing the owner's resource with one holding mips mip and coarser.
+	// Returns false if the texture is not resident, not an owner, or its previous
+	// change is still uploading or waiting for its old resource to be released, so
+	// each texture holds at most one replaced resource at a time.
+	bool RequestMip(int handle, UINT mip);
+
+	// Counts over every Load so far.  Uploads only counts parsed files and
+	// BytesSaved only resident ones, so both are final once AllResident().
+	Stats GetStats()const;
+
+	// 1x1 R8G8B8A8 texture that is resident as soon as the constructor returns.
+	ID3D12Resource* Placeholder()const { return mPlaceholder.Resource.Get(); }
+
+	// Blocks until every requested texture has been uploaded.  The next Update
+	// reports them as resident.
+	void WaitForAll();
+
+private:
+	enum class LoadState
+	{
+		Loading,
+		Parsed,
+		Uploading,
+		Resident,
+		Failed
+	};
+
+	struct Entry
+	{
+		int Handle = -1;
+		std::wstring Filename;
+		int References = 1;
+
+		// Set by the worker.  SharedWith is the handle of an earlier file with the
+		// same contents, or -1 if this entry owns its resource.
+		std::uint64_t ContentHash = 0;
+		int SharedWith = -1;
+		UINT64 GpuBytes = 0;
+
+		// Mapped file; Subresources point into it until the upload is recorded.
+		// When streaming the file stays mapped, and FileSubresources describes every
+		// subresource in it for later RequestMip uploads.
+		MappedFile FileData;
+		std::vector<D3D12_SUBRESOURCE_DATA> Subresources;
+		std::vector<D3D12_SUBRESOURCE_DATA> FileSubresources;
+		D3D12_RESOURCE_DESC FileDesc = {};
+		std::vector<UINT64> MipBytes;
+
+		// Finest mip in Resource, and the coarsest mip a streamed resource may start
+		// at (block-compressed textures need dimensions that are multiples of 4).
+		UINT MostDetailedMip = 0;
+		UINT CoarsestTopMip = 0;
+
+		// Replacement for Resource while a RequestMip upload is in flight.
+		Microsoft::WRL::ComPtr<ID3D12Resource> PendingResource;
+		UINT PendingMip = 0;
+
+		// Update count at which the resource replaced by the last RequestMip is released.
+		UINT64 RetiredUntil = 0;
+
+		Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+		HRESULT Result = S_OK;
+
+		// Written by the worker (Loading -> Parsed/Failed), then by the main thread.
+		std::atomic<LoadState> State{ LoadState::Loading };
+	};
+
+	struct UploadBatch
+	{
+		Microsoft::WRL::ComPtr<ID3D12CommandAllocator> CmdListAlloc;
+		Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> CmdList;
+		Microsoft::WRL::ComPtr<ID3D12Resource> UploadBuffer;
+		UINT64 Fence = 0;
+		std::vector<Entry*> Textures;
+	};
+
+	void ParseFile(Entry& entry);
+	D3D12_RESOURCE_DESC MipRangeDesc(const Entry& entry, UINT mip)const;
+	void SelectUploadMips(Entry& entry, UINT mip);
+	void Pump();
+	void SubmitBatch(const std::vector<Entry*>& textures);
+	void RetireBatches();
+	void WaitForFence(UINT64 value);
+
+	Microsoft::WRL::ComPtr<ID3D12Device> md3dDevice;
+	Microsoft::WRL::ComPtr<ID3D12CommandQueue> mCopyQueue;
+	Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
+	UINT64 mCurrentFence = 0;
+	HANDLE mFenceEvent = nullptr;
+
+	concurrency::task_group mTasks;
+	std::vector<std::unique_ptr<Entry>> mEntries;
+	std::vector<UploadBatch> mBatches;
+
+	// Handles that became resident since the last Update, and those the last Update
+	// returned.  The two trade places so neither gives up its memory.
+	std::vector<int> mNewlyResident;
+	std::vector<int> mResident;
+
+	// Streaming.  Entries with a RequestMip waiting to be uploaded, and resources
+	// replaced by RequestMip, held until no frame in flight can sample them.
+	struct RetiredResource
+	{
+		Microsoft::WRL::ComPtr<ID3D12Resource> Resource;
+		UINT64 ReleaseUpdate;
+	};
+	UINT mStreamingTailMips = 0;
+	UINT64 mUpdateCount = 0;
+	std::vector<Entry*> mMipRequests;
+	std::vector<RetiredResource> mRetired;
+
+	// Canonical path -> handle, main thread only.
+	std::unordered_map<std::wstring, int> mPathHandles;
+	int mRequests = 0;
+
+	// (content hash, file size) -> the first file with those contents.  Workers claim
+	// entries here, so it is guarded by mContentMutex; an entry's Filename never
+	// changes once its worker starts, so they may read each other's.
+	std::mutex mContentMutex;
+	std::map<std::pair<std::uint64_t, std::uint64_t>, const Entry*> mContentHandles;
+
+	Entry mPlaceholder;
+	uint32_t mPlaceholderTexel = 0xff808080;
+};
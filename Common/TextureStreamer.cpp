@@ -0,0 +1,215 @@
+//***************************************************************************************
+// TextureStreamer.cpp
+//***************************************************************************************
+
+#include "TextureStreamer.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+TextureStreamer::TextureStreamer(std::uint64_t budgetBytes, std::uint32_t maxChangesPerUpdate)
+	: mBudget(budgetBytes), mMaxChangesPerUpdate(std::max(1u, maxChangesPerUpdate))
+{
+}
+
+int TextureStreamer::AddTexture(std::uint32_t width, std::uint32_t height, const std::vector<std::uint64_t>& mipBytes,
+	std::uint32_t residentMip, std::uint32_t coarsestMip)
+{
+	assert(!mipBytes.empty());
+
+	Texture tex;
+	tex.Width = width;
+	tex.Height = height;
+
+	tex.ChainBytes.resize(mipBytes.size() + 1, 0);
+	for (size_t m = mipBytes.size(); m-- > 0;)
+		tex.ChainBytes[m] = tex.ChainBytes[m + 1] + mipBytes[m];
+	tex.ChainBytes.pop_back();
+
+	tex.CoarsestMip = std::min(coarsestMip, (std::uint32_t)mipBytes.size() - 1);
+	tex.ResidentMip = std::min(residentMip, tex.CoarsestMip);
+	tex.WantedMip = tex.CoarsestMip;
+	tex.PendingMip = tex.ResidentMip;
+
+	mAccountedBytes += tex.ChainBytes[tex.ResidentMip];
+	mTextures.push_back(std::move(tex));
+
+	return (int)mTextures.size() - 1;
+}
+
+void TextureStreamer::BeginFrame()
+{
+	++mFrame;
+
+	for (Texture& tex : mTextures)
+	{
+		tex.WantedMip = tex.CoarsestMip;
+		tex.ScreenPixels = 0.0f;
+	}
+}
+
+void TextureStreamer::RequestScreenSize(int texture, float screenPixels)
+{
+	Texture& tex = mTextures[texture];
+	RequestMip(texture, MipForScreenSize(tex.Width, tex.Height, (std::uint32_t)tex.ChainBytes.size(), screenPixels));
+	tex.ScreenPixels = std::max(tex.ScreenPixels, screenPixels);
+}
+
+void TextureStreamer::RequestMip(int texture, std::uint32_t mip)
+{
+	Texture& tex = mTextures[texture];
+	tex.WantedMip = std::min(tex.WantedMip, mip);
+	tex.LastUsedFrame = mFrame;
+}
+
+const std::vector<TextureStreamer::Change>& TextureStreamer::Update()
+{
+	mChanges.clear();
+
+	// Over budget, as when textures arrive with more than it holds: give back what
+	// was not drawn first.
+	if (mAccountedBytes > mBudget)
+		Evict(mAccountedBytes - mBudget, -1);
+
+	// Textures drawn with finer mips than they have: those drawn this frame first, then
+	// the ones missing the most levels, then the largest on screen.
+	mWants.clear();
+	for (int i = 0; i < (int)mTextures.size(); ++i)
+	{
+		const Texture& tex = mTextures[i];
+		if (!tex.Pending && tex.WantedMip < tex.ResidentMip)
+			mWants.push_back(i);
+	}
+
+	std::sort(mWants.begin(), mWants.end(), [this](int a, int b)
+	{
+		const Texture& ta = mTextures[a];
+		const Texture& tb = mTextures[b];
+		if (ta.LastUsedFrame != tb.LastUsedFrame)
+			return ta.LastUsedFrame > tb.LastUsedFrame;
+		const std::uint32_t gapA = ta.ResidentMip - ta.WantedMip;
+		const std::uint32_t gapB = tb.ResidentMip - tb.WantedMip;
+		if (gapA != gapB)
+			return gapA > gapB;
+		return ta.ScreenPixels > tb.ScreenPixels;
+	});
+
+	for (int id : mWants)
+	{
+		if (mChanges.size() >= mMaxChangesPerUpdate)
+			break;
+
+		const Texture& tex = mTextures[id];
+
+		// The most detailed level that fits next to everything already accounted; the
+		// new chain exists alongside the old one until the swap.
+		std::uint32_t target = tex.ResidentMip;
+		for (std::uint32_t m = tex.WantedMip; m < tex.ResidentMip; ++m)
+		{
+			if (mAccountedBytes + tex.ChainBytes[m] <= mBudget)
+			{
+				target = m;
+				break;
+			}
+		}
+
+		if (target < tex.ResidentMip)
+		{
+			Start(id, target);
+			continue;
+		}
+
+		// Nothing fits.  Shrink other textures; loads resume once the shrinks land.
+		Evict(tex.ChainBytes[tex.ResidentMip - 1], id);
+		break;
+	}
+
+	return mChanges;
+}
+
+void TextureStreamer::Evict(std::uint64_t needed, int keep)
+{
+	// Those not drawn this frame go down to their coarsest mip, those drawn this frame
+	// give back only the levels they are not sampling, and only when that fits.
+	mVictims.clear();
+	for (int i = 0; i < (int)mTextures.size(); ++i)
+	{
+		const Texture& v = mTextures[i];
+		if (i == keep || v.Pending)
+			continue;
+		if (v.ResidentMip < v.WantedMip)
+			mVictims.push_back(i);
+	}
+
+	std::sort(mVictims.begin(), mVictims.end(), [this](int a, int b)
+	{
+		return mTextures[a].LastUsedFrame < mTextures[b].LastUsedFrame;
+	});
+
+	std::uint64_t freed = 0;
+	for (int v : mVictims)
+	{
+		if (freed >= needed || mChanges.size() >= mMaxChangesPerUpdate)
+			break;
+
+		const Texture& victim = mTextures[v];
+		if (victim.LastUsedFrame == mFrame && mAccountedBytes + victim.ChainBytes[victim.WantedMip] > mBudget)
+			continue;
+
+		freed += victim.ChainBytes[victim.ResidentMip] - victim.ChainBytes[victim.WantedMip];
+		Start(v, victim.WantedMip);
+	}
+}
+
+void TextureStreamer::Start(int texture, std::uint32_t mip)
+{
+	Texture& tex = mTextures[texture];
+	tex.Pending = true;
+	tex.PendingMip = mip;
+	mAccountedBytes += tex.ChainBytes[mip];
+
+	Change change;
+	change.Texture = texture;
+	change.MostDetailedMip = mip;
+	mChanges.push_back(change);
+}
+
+void TextureStreamer::OnResident(int texture, std::uint32_t mostDetailedMip)
+{
+	Texture& tex = mTextures[texture];
+	if (!tex.Pending)
+		return;
+
+	assert(mostDetailedMip == tex.PendingMip);
+	mAccountedBytes -= tex.ChainBytes[tex.ResidentMip];
+	tex.ResidentMip = mostDetailedMip;
+	tex.PendingMip = mostDetailedMip;
+	tex.Pending = false;
+}
+
+void TextureStreamer::Cancel(int texture)
+{
+	Texture& tex = mTextures[texture];
+	if (!tex.Pending)
+		return;
+
+	mAccountedBytes -= tex.ChainBytes[tex.PendingMip];
+	tex.PendingMip = tex.ResidentMip;
+	tex.Pending = false;
+}
+
+std::uint32_t TextureStreamer::MipForScreenSize(std::uint32_t width, std::uint32_t height,
+	std::uint32_t mipLevels, float screenPixels)
+{
+	if (mipLevels == 0)
+		return 0;
+	if (!(screenPixels > 0.0f))
+		return mipLevels - 1;
+
+	const float texels = (float)std::max(width, height);
+	if (screenPixels >= texels)
+		return 0;
+
+	const std::uint32_t mip = (std::uint32_t)std::floor(std::log2(texels / screenPixels));
+	return std::min(mip, mipLevels - 1);
+}
@@ -0,0 +1,111 @@
+//***************************************************************************************
+// TextureStreamer.h
+//
+// Mip residency policy for streamed textures.  Each frame the app reports how large on
+// screen each texture is drawn; Update then decides which textures should gain finer
+// mips and which should give them back, keeping the memory of every resident mip
+// chain under a fixed budget.  Textures nobody has drawn recently are evicted first
+// (least recently used), down to their coarsest mip.
+//
+// The streamer only makes decisions.  The caller performs each returned Change (by
+// rebuilding the texture with a new most detailed mip) and reports back with
+// OnResident, or Cancel if it could not start it.  Nothing here touches the GPU, so
+// the policy can be driven by synthetic camera paths.
+//
+// Memory is accounted conservatively: while a change is in flight both the old and new
+// mip chains are counted, since both exist until the swap.  Loads, and evictions of
+// textures drawn this frame, only start when they fit.  Evictions to the coarsest mip
+// start regardless, so the total is bounded by the budget plus every texture's
+// coarsest chain.  Textures arrive with whatever the loader gave them; when that
+// takes the total over the budget, Update evicts the least recently used textures to
+// their coarsest mips until it is back under, a few each frame.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class TextureStreamer
+{
+public:
+	struct Change
+	{
+		int Texture;
+		std::uint32_t MostDetailedMip;
+	};
+
+	explicit TextureStreamer(std::uint64_t budgetBytes, std::uint32_t maxChangesPerUpdate = 4);
+
+	// mipBytes[m] is the memory mip m takes across all array slices.  residentMip is
+	// the most detailed mip already resident, and coarsestMip the coarsest the texture
+	// can be shrunk to.
+	int AddTexture(std::uint32_t width, std::uint32_t height, const std::vector<std::uint64_t>& mipBytes,
+		std::uint32_t residentMip, std::uint32_t coarsestMip);
+
+	// Starts a new frame of requests.  Textures not requested this frame want only
+	// their coarsest mip, but keep what they have until the memory is needed elsewhere.
+	void BeginFrame();
+
+	// The texture is drawn screenPixels across (its whole UV range, along its longer
+	// side).  Several requests in one frame keep the most detailed.
+	void RequestScreenSize(int texture, float screenPixels);
+	void RequestMip(int texture, std::uint32_t mip);
+
+	// Returns the changes to start this frame, valid until the next call.  Each is in
+	// flight until OnResident or Cancel is called for its texture.
+	const std::vector<Change>& Update();
+	void OnResident(int texture, std::uint32_t mostDetailedMip);
+	void Cancel(int texture);
+
+	std::uint32_t ResidentMip(int texture)const { return mTextures[texture].ResidentMip; }
+	std::uint32_t WantedMip(int texture)const { return mTextures[texture].WantedMip; }
+	bool IsPending(int texture)const { return mTextures[texture].Pending; }
+
+	// Bytes of every resident mip chain, plus the new chains of changes in flight.
+	std::uint64_t AccountedBytes()const { return mAccountedBytes; }
+	std::uint64_t Budget()const { return mBudget; }
+	void SetBudget(std::uint64_t budgetBytes) { mBudget = budgetBytes; }
+
+	// Most detailed mip worth sampling when a width x height texture is drawn
+	// screenPixels across: one texel per pixel, or finer when magnified.
+	static std::uint32_t MipForScreenSize(std::uint32_t width, std::uint32_t height,
+		std::uint32_t mipLevels, float screenPixels);
+
+private:
+	struct Texture
+	{
+		std::uint32_t Width = 0;
+		std::uint32_t Height = 0;
+
+		// ChainBytes[m] is the size of mips m..end.
+		std::vector<std::uint64_t> ChainBytes;
+
+		std::uint32_t CoarsestMip = 0;
+		std::uint32_t ResidentMip = 0;
+		std::uint32_t WantedMip = 0;
+		std::uint32_t PendingMip = 0;
+		bool Pending = false;
+
+		float ScreenPixels = 0.0f;
+		std::uint64_t LastUsedFrame = 0;
+	};
+
+	void Start(int texture, std::uint32_t mip);
+
+	// Shrinks textures other than keep, least recently used first, until needed bytes
+	// are on their way out.
+	void Evict(std::uint64_t needed, int keep);
+
+	std::vector<Texture> mTextures;
+
+	// Update's lists, kept so a frame with nothing new to stream allocates nothing.
+	std::vector<Change> mChanges;
+	std::vector<int> mWants;
+	std::vector<int> mVictims;
+
+	std::uint64_t mBudget;
+	std::uint64_t mAccountedBytes = 0;
+	std::uint32_t mMaxChangesPerUpdate;
+	std::uint64_t mFrame = 0;
+};
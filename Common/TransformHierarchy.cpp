@@ -0,0 +1,313 @@
+//***************************************************************************************
+// TransformHierarchy.cpp
+//***************************************************************************************
+
+#include "TransformHierarchy.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <type_traits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TRANSFORMHIERARCHY_SSE2 1
+#else
+#define TRANSFORMHIERARCHY_SSE2 0
+#endif
+
+namespace
+{
+	// out = a * b for row-major matrices of row vectors; out must not alias b.  Each
+	// row of out is a[r][0] * b[0] + ... + a[r][3] * b[3], which is how
+	// XMMatrixMultiply does it.
+	void Multiply(const float* a, const float* b, float* out)
+	{
+#if TRANSFORMHIERARCHY_SSE2
+		const __m128 b0 = _mm_loadu_ps(b);
+		const __m128 b1 = _mm_loadu_ps(b + 4);
+		const __m128 b2 = _mm_loadu_ps(b + 8);
+		const __m128 b3 = _mm_loadu_ps(b + 12);
+		for (int r = 0; r < 4; ++r)
+		{
+			const float* row = a + 4 * r;
+			__m128 sum = _mm_mul_ps(_mm_set1_ps(row[0]), b0);
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(row[1]), b1));
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(row[2]), b2));
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(row[3]), b3));
+			_mm_storeu_ps(out + 4 * r, sum);
+		}
+#else
+		for (int r = 0; r < 4; ++r)
+		{
+			for (int c = 0; c < 4; ++c)
+			{
+				out[4 * r + c] = a[4 * r] * b[c] + a[4 * r + 1] * b[4 + c] +
+					a[4 * r + 2] * b[8 + c] + a[4 * r + 3] * b[12 + c];
+			}
+		}
+#endif
+	}
+}
+
+const std::uint32_t TransformHierarchy::NoNode;
+const std::uint32_t TransformHierarchy::ParallelBatch;
+
+std::uint32_t TransformHierarchy::Add(std::uint32_t parent, const float local[16])
+{
+	std::uint32_t handle;
+	if (mFreeHandles.empty())
+	{
+		handle = (std::uint32_t)mSlots.size();
+		mSlots.push_back(NoNode);
+	}
+	else
+	{
+		handle = mFreeHandles.back();
+		mFreeHandles.pop_back();
+	}
+
+	const std::uint32_t slot = (std::uint32_t)mHandles.size();
+	mSlots[handle] = slot;
+
+	Matrix matrix;
+	std::memcpy(matrix.M, local, sizeof(matrix.M));
+	mHandles.push_back(handle);
+	mParents.push_back(parent);
+	mChildCounts.push_back(0);
+	mLocals.push_back(matrix);
+	mWorlds.push_back(matrix);
+	mQueued.push_back(0);
+	if (parent != NoNode)
+		++mChildCounts[mSlots[parent]];
+
+	mSorted = false;
+	MarkDirty(slot);
+	return handle;
+}
+
+void TransformHierarchy::Remove(std::uint32_t node)
+{
+	const std::uint32_t slot = mSlots[node];
+	assert(mChildCounts[slot] == 0);
+	if (mParents[slot] != NoNode)
+		--mChildCounts[mSlots[mParents[slot]]];
+
+	// The last slot fills the gap; Sort puts the order right again.
+	const std::uint32_t last = (std::uint32_t)mHandles.size() - 1;
+	mHandles[slot] = mHandles[last];
+	mParents[slot] = mParents[last];
+	mChildCounts[slot] = mChildCounts[last];
+	mLocals[slot] = mLocals[last];
+	mWorlds[slot] = mWorlds[last];
+	mQueued[slot] = mQueued[last];
+	mSlots[mHandles[slot]] = slot;
+
+	mHandles.pop_back();
+	mParents.pop_back();
+	mChildCounts.pop_back();
+	mLocals.pop_back();
+	mWorlds.pop_back();
+	mQueued.pop_back();
+
+	mSlots[node] = NoNode;
+	mFreeHandles.push_back(node);
+	mSorted = false;
+}
+
+void TransformHierarchy::SetParent(std::uint32_t node, std::uint32_t parent)
+{
+	assert(parent == NoNode || !IsUnder(parent, node));
+
+	const std::uint32_t slot = mSlots[node];
+	if (mParents[slot] == parent)
+		return;
+	if (mParents[slot] != NoNode)
+		--mChildCounts[mSlots[mParents[slot]]];
+	if (parent != NoNode)
+		++mChildCounts[mSlots[parent]];
+	mParents[slot] = parent;
+
+	mSorted = false;
+	MarkDirty(slot);
+}
+
+void TransformHierarchy::SetLocal(std::uint32_t node, const float local[16])
+{
+	const std::uint32_t slot = mSlots[node];
+	std::memcpy(mLocals[slot].M, local, sizeof(mLocals[slot].M));
+	MarkDirty(slot);
+}
+
+bool TransformHierarchy::IsUnder(std::uint32_t node, std::uint32_t ancestor)const
+{
+	for (; node != NoNode; node = Parent(node))
+	{
+		if (node == ancestor)
+			return true;
+	}
+	return false;
+}
+
+void TransformHierarchy::MarkDirty(std::uint32_t slot)
+{
+	mDirty.push_back(mHandles[slot]);
+}
+
+void TransformHierarchy::Sort()
+{
+	const std::uint32_t count = Count();
+
+	// Each slot's children, grouped by parent in slot order.
+	std::vector<std::uint32_t> childStarts(count + 1, 0);
+	for (std::uint32_t slot = 0; slot < count; ++slot)
+		childStarts[slot + 1] = childStarts[slot] + mChildCounts[slot];
+	std::vector<std::uint32_t> children(childStarts[count]);
+	std::vector<std::uint32_t> fill(childStarts.begin(), childStarts.end() - 1);
+	for (std::uint32_t slot = 0; slot < count; ++slot)
+	{
+		if (mParents[slot] != NoNode)
+			children[fill[mSlots[mParents[slot]]]++] = slot;
+	}
+
+	// Breadth first from the roots.  A level ends where the nodes queued by the level
+	// before it do; each node's children are queued together.
+	std::vector<std::uint32_t> order;
+	order.reserve(count);
+	for (std::uint32_t slot = 0; slot < count; ++slot)
+	{
+		if (mParents[slot] == NoNode)
+			order.push_back(slot);
+	}
+	mFirstChildren.assign(count, 0);
+	mLevelStarts.assign(1, 0);
+	std::uint32_t levelEnd = (std::uint32_t)order.size();
+	for (std::uint32_t i = 0; i < order.size(); ++i)
+	{
+		if (i == levelEnd)
+		{
+			mLevelStarts.push_back(i);
+			levelEnd = (std::uint32_t)order.size();
+		}
+		const std::uint32_t slot = order[i];
+		mFirstChildren[i] = (std::uint32_t)order.size();
+		order.insert(order.end(), children.begin() + childStarts[slot], children.begin() + childStarts[slot + 1]);
+	}
+	assert(order.size() == count);
+	mLevelStarts.push_back(count);
+
+	auto permute = [&](auto& values)
+	{
+		typename std::decay<decltype(values)>::type sorted(count);
+		for (std::uint32_t i = 0; i < count; ++i)
+			sorted[i] = values[order[i]];
+		values.swap(sorted);
+	};
+	permute(mHandles);
+	permute(mParents);
+	permute(mChildCounts);
+	permute(mLocals);
+	permute(mWorlds);
+	permute(mQueued);
+
+	mParentSlots.resize(count);
+	for (std::uint32_t slot = 0; slot < count; ++slot)
+		mSlots[mHandles[slot]] = slot;
+	for (std::uint32_t slot = 0; slot < count; ++slot)
+		mParentSlots[slot] = mParents[slot] != NoNode ? mSlots[mParents[slot]] : NoNode;
+
+	mSorted = true;
+}
+
+void TransformHierarchy::Update()
+{
+	mChanged.clear();
+	if (mDirty.empty())
+		return;
+	if (!mSorted)
+		Sort();
+
+	// The changed slots in order, which is also level order.  Removed nodes drop out.
+	mScratch.clear();
+	for (std::uint32_t handle : mDirty)
+	{
+		if (mSlots[handle] != NoNode)
+			mScratch.push_back(mSlots[handle]);
+	}
+	mDirty.clear();
+	std::sort(mScratch.begin(), mScratch.end());
+
+	auto multiply = [this](std::uint32_t batch)
+	{
+		const std::uint32_t end = std::min((std::uint32_t)mLevel.size(), (batch + 1) * ParallelBatch);
+		for (std::uint32_t i = batch * ParallelBatch; i < end; ++i)
+		{
+			const std::uint32_t slot = mLevel[i];
+			const std::uint32_t parent = mParentSlots[slot];
+			if (parent == NoNode)
+				mWorlds[slot] = mLocals[slot];
+			else
+				Multiply(mLocals[slot].M, mWorlds[parent].M, mWorlds[slot].M);
+		}
+	};
+
+	// Each level's nodes are the children of the level above's, plus those changed
+	// themselves.  A level only reads the worlds of the one before it.
+	mLevel.clear();
+	std::size_t next = 0;
+	const std::uint32_t levelCount = (std::uint32_t)mLevelStarts.size() - 1;
+	for (std::uint32_t level = 0; level < levelCount; ++level)
+	{
+		mNextLevel.clear();
+		for (std::uint32_t slot : mLevel)
+		{
+			for (std::uint32_t child = mFirstChildren[slot]; child < mFirstChildren[slot] + mChildCounts[slot]; ++child)
+			{
+				mQueued[child] = 1;
+				mNextLevel.push_back(child);
+			}
+		}
+		for (; next < mScratch.size() && mScratch[next] < mLevelStarts[level + 1]; ++next)
+		{
+			if (!mQueued[mScratch[next]])
+			{
+				mQueued[mScratch[next]] = 1;
+				mNextLevel.push_back(mScratch[next]);
+			}
+		}
+		mLevel.swap(mNextLevel);
+
+		if (mLevel.empty())
+		{
+			if (next == mScratch.size())
+				break;
+
+			// Nothing under the changes so far; skip to the next changed node's level.
+			level = (std::uint32_t)(std::upper_bound(mLevelStarts.begin(), mLevelStarts.end(), mScratch[next]) -
+				mLevelStarts.begin()) - 2;
+			continue;
+		}
+
+		const std::uint32_t batches = ((std::uint32_t)mLevel.size() + ParallelBatch - 1) / ParallelBatch;
+		if (batches == 1)
+			multiply(0);
+		else
+			ParallelFor(batches, multiply);
+
+		for (std::uint32_t slot : mLevel)
+			mChanged.push_back(mHandles[slot]);
+	}
+
+	for (std::uint32_t handle : mChanged)
+		mQueued[mSlots[handle]] = 0;
+}
+
+std::size_t TransformHierarchy::MemoryBytes()const
+{
+	const std::size_t indices = mSlots.capacity() + mFreeHandles.capacity() + mHandles.capacity() +
+		mParents.capacity() + mChildCounts.capacity() + mParentSlots.capacity() + mFirstChildren.capacity() +
+		mLevelStarts.capacity() + mDirty.capacity() + mChanged.capacity() + mLevel.capacity() +
+		mNextLevel.capacity() + mScratch.capacity();
+	return indices * sizeof(std::uint32_t) + (mLocals.capacity() + mWorlds.capacity()) * sizeof(Matrix) +
+		mQueued.capacity();
+}
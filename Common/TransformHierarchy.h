@@ -0,0 +1,102 @@
+//***************************************************************************************
+// TransformHierarchy.h
+//
+// Parent/child transforms.  Each node has a local matrix relative to its parent, and
+// Update turns them into world matrices: World = Local * parent's World, with row
+// vectors as in DirectXMath.
+//
+// Nodes are kept as parallel arrays (parents, locals, worlds) sorted breadth first, so
+// the nodes of one level are contiguous, every parent comes before its children and
+// the children of a node are next to each other.  Update walks down from the nodes
+// changed since the last call one level at a time, multiplying only those nodes and
+// their descendants; a level is spread over threads and each multiply is four SSE2
+// rows.  Nothing that did not move is touched, so a still hierarchy costs nothing.
+//
+// Nodes are named by handles that stay valid until removed; their place in the arrays
+// moves when the hierarchy is re-sorted.  Matrices are 16 floats, row-major, the
+// layout of XMFLOAT4X4.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class TransformHierarchy
+{
+public:
+	static const std::uint32_t NoNode = 0xffffffff;
+
+	// Nodes multiplied per task; a level with fewer changed nodes stays on one thread.
+	static const std::uint32_t ParallelBatch = 512;
+
+	// Adds a node under parent (NoNode for a root) and returns its handle.  Its world
+	// is computed by the next Update.
+	std::uint32_t Add(std::uint32_t parent, const float local[16]);
+
+	// Removes a node that has no children.
+	void Remove(std::uint32_t node);
+
+	// Moves a node and its subtree under another parent, which must not be inside the
+	// subtree.
+	void SetParent(std::uint32_t node, std::uint32_t parent);
+
+	void SetLocal(std::uint32_t node, const float local[16]);
+
+	std::uint32_t Parent(std::uint32_t node)const { return mParents[mSlots[node]]; }
+	std::uint32_t ChildCount(std::uint32_t node)const { return mChildCounts[mSlots[node]]; }
+	// Whether ancestor is node or one of its ancestors.
+	bool IsUnder(std::uint32_t node, std::uint32_t ancestor)const;
+
+	const float* Local(std::uint32_t node)const { return mLocals[mSlots[node]].M; }
+	// As of the last Update.
+	const float* World(std::uint32_t node)const { return mWorlds[mSlots[node]].M; }
+
+	std::uint32_t Count()const { return (std::uint32_t)mHandles.size(); }
+
+	// Recomputes the world of every node added, moved or re-parented since the last
+	// call, and of everything under them.
+	void Update();
+
+	// The nodes whose world the last Update recomputed, parents before children.
+	const std::vector<std::uint32_t>& Changed()const { return mChanged; }
+
+	// Bytes held, including scratch space kept for the next Update.
+	std::size_t MemoryBytes()const;
+
+private:
+	struct Matrix
+	{
+		float M[16];
+	};
+
+	void MarkDirty(std::uint32_t slot);
+	void Sort();
+
+	// By handle: the node's slot, or NoNode for a free handle.
+	std::vector<std::uint32_t> mSlots;
+	std::vector<std::uint32_t> mFreeHandles;
+
+	// By slot.  Parents are handles, so removing a node moves no one's parent.
+	std::vector<std::uint32_t> mHandles;
+	std::vector<std::uint32_t> mParents;
+	std::vector<std::uint32_t> mChildCounts;
+	std::vector<Matrix> mLocals;
+	std::vector<Matrix> mWorlds;
+	std::vector<std::uint8_t> mQueued;
+
+	// Set up by Sort and kept until the next Add, Remove or SetParent: each slot's
+	// parent slot and first child slot, and the first slot of each level.
+	bool mSorted = true;
+	std::vector<std::uint32_t> mParentSlots;
+	std::vector<std::uint32_t> mFirstChildren;
+	std::vector<std::uint32_t> mLevelStarts;
+
+	// Handles whose local or parent changed since the last Update.
+	std::vector<std::uint32_t> mDirty;
+
+	std::vector<std::uint32_t> mChanged;
+	std::vector<std::uint32_t> mLevel;
+	std::vector<std::uint32_t> mNextLevel;
+	std::vector<std::uint32_t> mScratch;
+};
@@ -55,6 +55,14 @@ public:
         memcpy(&mMappedData[elementIndex*mElementByteSize], &data, sizeof(T));
     }
 
+    // Copies count consecutive elements; not for constant buffers, whose elements
+    // are padded.
+    void CopyData(int elementIndex, const T* data, UINT count)
+    {
+        assert(!mIsConstantBuffer);
+        memcpy(&mMappedData[elementIndex*mElementByteSize], data, sizeof(T)*count);
+    }
+
 private:
     Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
     BYTE* mMappedData = nullptr;
@@ -4,11 +4,41 @@
 
 #include "d3dApp.h"
 #include <WindowsX.h>
+#include <atomic>
 
 using Microsoft::WRL::ComPtr;
 using namespace std;
 using namespace DirectX;
 
+#ifdef _DEBUG
+// Every allocation of the debug CRT heap passes through its allocation hook, from
+// operator new and malloc alike and on any thread.  Only the thread that runs the
+// frame loop is counted: PPL's worker threads allocate on their own schedule (task
+// bookkeeping, the CPU profiler's per-thread buffers), which says nothing about the
+// frame that happens to be running.
+static std::atomic<std::uint64_t> gHeapAllocations{ 0 };
+static DWORD gCountedThreadId = 0;
+
+static int __cdecl CountHeapAllocation(int allocType, void* userData, size_t size, int blockType,
+	long requestNumber, const unsigned char* filename, int lineNumber)
+{
+	if ((allocType == _HOOK_ALLOC || allocType == _HOOK_REALLOC) && GetCurrentThreadId() == gCountedThreadId)
+		gHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+	return TRUE;
+}
+#endif
+
+// Heap allocations so far on the main thread; always 0 in release builds, which do
+// not count them.
+static std::uint64_t HeapAllocationCount()
+{
+#ifdef _DEBUG
+	return gHeapAllocations.load(std::memory_order_relaxed);
+#else
+	return 0;
+#endif
+}
+
 LRESULT CALLBACK
 MainWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
@@ -29,6 +59,11 @@ D3DApp::D3DApp(HINSTANCE hInstance)
     // Only one D3DApp can be constructed.
     assert(mApp == nullptr);
     mApp = this;
+
+#ifdef _DEBUG
+	gCountedThreadId = GetCurrentThreadId();
+	_CrtSetAllocHook(CountHeapAllocation);
+#endif
 }
 
 D3DApp::~D3DApp()
@@ -75,6 +110,12 @@ int D3DApp::Run()
  
 	mTimer.Reset();
 
+	if (!mTraceFilename.empty())
+	{
+		CpuProfiler::SetThreadName("Main");
+		CpuProfiler::BeginCapture();
+	}
+
 	while(msg.message != WM_QUIT)
 	{
 		// If there are Window messages then process them.
@@ -91,16 +132,34 @@ int D3DApp::Run()
 			if( !mAppPaused )
 			{
 				CalculateFrameStats();
+
+				// What the last frame took from the frame arena is free again.
+				mFrameArena.Reset();
 				Update(mTimer);	
                 Draw(mTimer);
 			}
 			else
 			{
+				// Messages handled while paused are counted with the next frame,
+				// which is not a steady one.
+				mFrameLoads = true;
 				Sleep(100);
 			}
         }
     }
 
+	if (!mFrameStatsFilename.empty())
+	{
+		mFrameStats.WriteCsv(mFrameStatsFilename + ".csv");
+		mFrameStats.WriteJson(mFrameStatsFilename + ".json");
+	}
+
+	if (!mTraceFilename.empty())
+	{
+		CpuProfiler::EndCapture();
+		CpuProfiler::WriteChromeTrace(mTraceFilename);
+	}
+
 	return (int)msg.wParam;
 }
 
@@ -144,6 +203,9 @@ void D3DApp::OnResize()
 	assert(mSwapChain);
     assert(mDirectCmdListAlloc);
 
+	// Recreating the buffers allocates.
+	mFrameLoads = true;
+
 	// Flush before changing any resources.
 	FlushCommandQueue();
 
@@ -159,7 +221,7 @@ void D3DApp::OnResize()
 		SwapChainBufferCount, 
 		mClientWidth, mClientHeight, 
 		mBackBufferFormat, 
-		DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH));
+		mSwapChainFlags));
 
 	mCurrBackBuffer = 0;
  
@@ -456,6 +518,7 @@ bool D3DApp::InitDirect3D()
 
 	ThrowIfFailed(md3dDevice->CreateFence(0, D3D12_FENCE_FLAG_NONE,
 		IID_PPV_ARGS(&mFence)));
+	mGpuTimeline = std::make_unique<D3D12FenceTimeline>(mFence.Get());
 
 	mRtvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
 	mDsvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_DSV);
@@ -535,13 +598,28 @@ void D3DApp::CreateSwapChain()
     sd.OutputWindow = mhMainWnd;
     sd.Windowed = true;
 	sd.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
-    sd.Flags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH;
+
+	// ResizeBuffers must be given the same flags the swap chain was created with.
+	mSwapChainFlags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH;
+	if (mMaxFrameLatency > 0)
+		mSwapChainFlags |= DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+    sd.Flags = mSwapChainFlags;
 
 	// Note: Swap chain uses queue to perform flush.
     ThrowIfFailed(mdxgiFactory->CreateSwapChain(
 		mCommandQueue.Get(),
 		&sd, 
 		mSwapChain.GetAddressOf()));
+
+	HANDLE waitableObject = nullptr;
+	if (mMaxFrameLatency > 0)
+	{
+		ComPtr<IDXGISwapChain2> swapChain2;
+		ThrowIfFailed(mSwapChain.As(&swapChain2));
+		ThrowIfFailed(swapChain2->SetMaximumFrameLatency(mMaxFrameLatency));
+		waitableObject = swapChain2->GetFrameLatencyWaitableObject();
+	}
+	mGpuTimeline->SetFrameLatencyWaitableObject(waitableObject);
 }
 
 void D3DApp::FlushCommandQueue()
@@ -555,17 +633,7 @@ void D3DApp::FlushCommandQueue()
     ThrowIfFailed(mCommandQueue->Signal(mFence.Get(), mCurrentFence));
 
 	// Wait until the GPU has completed commands up to this fence point.
-    if(mFence->GetCompletedValue() < mCurrentFence)
-	{
-		HANDLE eventHandle = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
-
-        // Fire event when GPU hits current fence.  
-        ThrowIfFailed(mFence->SetEventOnCompletion(mCurrentFence, eventHandle));
-
-        // Wait until the GPU hits current fence event is fired.
-		WaitForSingleObject(eventHandle, INFINITE);
-        CloseHandle(eventHandle);
-	}
+	mGpuTimeline->WaitForValue(mCurrentFence);
 }
 
 
@@ -590,29 +658,56 @@ D3D12_CPU_DESCRIPTOR_HANDLE D3DApp::DepthStencilView()const
 
 void D3DApp::CalculateFrameStats()
 {
-	// Code computes the average frames per second, and also the 
-	// average time it takes to render one frame.  These stats 
-	// are appended to the window caption bar.
+	// Closes out the previous frame in mFrameStats, and once a second appends
+	// the frame rate, frame time percentiles and memory counters to the window
+	// caption bar.  Like the frame itself, it allocates nothing from the heap.
     
+	static bool firstFrame = true;
 	static int frameCnt = 0;
 	static float timeElapsed = 0.0f;
 
+	// The timer delta spans the whole previous frame, including the phase times
+	// recorded during its Update and Draw.  The first tick has no previous frame.
+	// Heap allocations are counted from one call to the next.
+	const std::uint64_t heapAllocations = HeapAllocationCount();
+	// A frame in which the frame arena grew, or merged its blocks, is not steady.
+	if (mFrameArena.HeapAllocations() != mFrameArenaBlocks)
+		mFrameLoads = true;
+	mFrameArenaBlocks = mFrameArena.HeapAllocations();
+	if (!firstFrame)
+	{
+		mFrameStats.EndFrame(mTimer.DeltaTime() * 1000.0);
+
+		mFrameHeapAllocations = heapAllocations - mFrameStartHeapAllocations;
+		mSteadyFrames = mFrameLoads ? 0 : mSteadyFrames + 1;
+		assert(mSteadyFrames <= AllocationWarmupFrames || mFrameHeapAllocations == 0);
+	}
+	mFrameStartHeapAllocations = heapAllocations;
+	mFrameLoads = false;
+	firstFrame = false;
+
 	frameCnt++;
 
 	// Compute averages over one second period.
 	if( (mTimer.TotalTime() - timeElapsed) >= 1.0f )
 	{
 		float fps = (float)frameCnt; // fps = frameCnt / 1
-		float mspf = 1000.0f / fps;
-
-        wstring fpsStr = to_wstring(fps);
-        wstring mspfStr = to_wstring(mspf);
 
-        wstring windowText = mMainWndCaption +
-            L"    fps: " + fpsStr +
-            L"   mspf: " + mspfStr;
+        // The frame arena's counters are the last frame's; it is Reset after this.
+        wchar_t windowText[512];
+        int length = swprintf_s(windowText,
+            L"%s    fps: %f   p50: %f   p95: %f   p99: %f   max: %f   hitches: %llu"
+            L"   frame arena: %zu allocs, %.1f of %.1f KB   load arena: %llu allocs, %.1f KB peak",
+            mMainWndCaption.c_str(), fps, mFrameStats.PercentileMs(50.0), mFrameStats.PercentileMs(95.0),
+            mFrameStats.PercentileMs(99.0), mFrameStats.MaxFrameMs(), mFrameStats.HitchCount(),
+            mFrameArena.Allocations(), mFrameArena.BytesUsed() / 1024.0, mFrameArena.Capacity() / 1024.0,
+            mLoadArena.TotalAllocations(), mLoadArena.PeakBytesUsed() / 1024.0);
+#ifdef _DEBUG
+        if (length > 0)
+            swprintf_s(windowText + length, _countof(windowText) - length, L"   heap allocs: %llu", mFrameHeapAllocations);
+#endif
 
-        SetWindowText(mhMainWnd, windowText.c_str());
+        SetWindowText(mhMainWnd, windowText);
 		
 		// Reset for next average.
 		frameCnt = 0;
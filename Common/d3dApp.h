@@ -8,7 +8,11 @@
 #endif
 
 #include "d3dUtil.h"
+#include "Arena.h"
 #include "GameTimer.h"
+#include "FramePacer.h"
+#include "FrameStats.h"
+#include "CpuProfiler.h"
 
 // Link necessary d3d12 libraries.
 #pragma comment(lib,"d3dcompiler.lib")
@@ -88,6 +92,35 @@ protected:
 
 	// Used to keep track of the “delta-time” and game time (§4.4).
 	GameTimer mTimer;
+
+	// Frame time percentiles and per-phase CPU times.  Derived classes add phase
+	// times; CalculateFrameStats closes each frame.  Written to
+	// mFrameStatsFilename.csv/.json when Run returns once a derived class names them.
+	FrameStats mFrameStats{ 1 << 16 };
+	std::string mFrameStatsFilename;
+
+	// Scratch memory for one frame, Reset by Run before each Update, and memory for
+	// building the scene, which the derived class resets once it is built.  Their
+	// counters are shown next to the frame times.
+	Arena mFrameArena{ 256 * 1024 };
+	Arena mLoadArena{ 1024 * 1024 };
+
+	// Derived classes set mFrameLoads in a frame that loads, streams or resizes
+	// something, or grows a buffer it keeps between frames.  A frame in which
+	// mFrameArena takes a new block counts too.  Any other frame past the first
+	// AllocationWarmupFrames must take its temporary memory from mFrameArena: debug
+	// builds count the main thread's heap allocations over every frame and assert
+	// that such a frame made none.  Work handed to other threads is not counted.
+	static const int AllocationWarmupFrames = 60;
+	bool mFrameLoads = false;
+	std::uint64_t mFrameArenaBlocks = 0;
+	int mSteadyFrames = 0;
+	std::uint64_t mFrameStartHeapAllocations = 0;
+	std::uint64_t mFrameHeapAllocations = 0;
+
+	// When set, PROFILE_SCOPE events are captured for the whole run and written
+	// to this file as a Chrome trace when Run returns.
+	std::string mTraceFilename;
 	
     Microsoft::WRL::ComPtr<IDXGIFactory4> mdxgiFactory;
     Microsoft::WRL::ComPtr<IDXGISwapChain> mSwapChain;
@@ -95,6 +128,10 @@ protected:
 
     Microsoft::WRL::ComPtr<ID3D12Fence> mFence;
     UINT64 mCurrentFence = 0;
+
+	// Waits on mFence with a single reusable event, and on the swap chain's frame
+	// latency waitable object when mMaxFrameLatency is non-zero.
+	std::unique_ptr<D3D12FenceTimeline> mGpuTimeline;
 	
     Microsoft::WRL::ComPtr<ID3D12CommandQueue> mCommandQueue;
     Microsoft::WRL::ComPtr<ID3D12CommandAllocator> mDirectCmdListAlloc;
@@ -122,5 +159,12 @@ protected:
     DXGI_FORMAT mDepthStencilFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
 	int mClientWidth = 1280;
 	int mClientHeight = 1280;
+
+	// Number of frames DXGI may queue before the latency waitable object blocks.
+	// 0 creates the swap chain without DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT.
+	UINT mMaxFrameLatency = 0;
+	// Sync interval passed to Present; 0 presents immediately, 1 waits for vblank.
+	UINT mSyncInterval = 1;
+	UINT mSwapChainFlags = 0;
 };
 
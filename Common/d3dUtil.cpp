@@ -1,7 +1,10 @@
 
 #include "d3dUtil.h"
+#include "ShaderCache.h"
 #include <comdef.h>
 #include <fstream>
+#include <iterator>
+#include <ppl.h>
 
 using Microsoft::WRL::ComPtr;
 
@@ -113,6 +116,161 @@ ComPtr<ID3DBlob> d3dUtil::CompileShader(
 	return byteCode;
 }
 
+static bool ReadFileBytes(const std::wstring& filename, std::string& bytes)
+{
+	std::ifstream fin(filename, std::ios::binary);
+	if (!fin)
+		return false;
+
+	bytes.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+	return true;
+}
+
+// Resolves #include "file" relative to the directory of the shader being preprocessed,
+// like D3D_COMPILE_STANDARD_FILE_INCLUDE does for D3DCompileFromFile.
+class ShaderInclude : public ID3DInclude
+{
+public:
+	explicit ShaderInclude(const std::wstring& directory) : mDirectory(directory) {}
+
+	HRESULT __stdcall Open(D3D_INCLUDE_TYPE, LPCSTR fileName, LPCVOID, LPCVOID* data, UINT* bytes) override
+	{
+		std::string text;
+		if (!ReadFileBytes(mDirectory + AnsiToWString(fileName), text))
+			return E_FAIL;
+
+		char* copy = new char[text.size() + 1];
+		memcpy(copy, text.data(), text.size());
+		copy[text.size()] = '\0';
+
+		*data = copy;
+		*bytes = (UINT)text.size();
+		return S_OK;
+	}
+
+	HRESULT __stdcall Close(LPCVOID data) override
+	{
+		delete[] static_cast<const char*>(data);
+		return S_OK;
+	}
+
+private:
+	std::wstring mDirectory;
+};
+
+std::vector<ComPtr<ID3DBlob>> d3dUtil::LoadOrCompileShaders(
+	ShaderCache& cache,
+	const std::vector<ShaderDesc>& shaders)
+{
+	UINT compileFlags = 0;
+#if defined(DEBUG) || defined(_DEBUG)  
+	compileFlags = D3DCOMPILE_DEBUG | D3DCOMPILE_SKIP_OPTIMIZATION;
+#endif
+
+	__int64 countsPerSec = 0;
+	__int64 startTime = 0;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&countsPerSec);
+	QueryPerformanceCounter((LARGE_INTEGER*)&startTime);
+
+	// Index the blobs earlier runs left behind.
+	CreateDirectoryW(cache.Directory().c_str(), nullptr);
+	WIN32_FIND_DATAW found;
+	HANDLE find = FindFirstFileW((cache.Directory() + L"\\*.cso").c_str(), &found);
+	if (find != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			cache.AddFile(found.cFileName);
+		} while (FindNextFileW(find, &found));
+		FindClose(find);
+	}
+
+	std::vector<ComPtr<ID3DBlob>> blobs(shaders.size());
+	std::vector<std::uint64_t> keys(shaders.size());
+	std::vector<char> compiled(shaders.size(), 0);
+
+	// Workers only read the cache index; new blobs are added to it afterwards.
+	concurrency::parallel_for(size_t(0), shaders.size(), [&](size_t i)
+	{
+		const ShaderDesc& desc = shaders[i];
+
+		std::string source;
+		if (!ReadFileBytes(desc.Filename, source))
+			throw DxException(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND), L"LoadOrCompileShaders " + desc.Filename, AnsiToWString(__FILE__), __LINE__);
+
+		std::string sourceName;
+		for (wchar_t c : desc.Filename)
+			sourceName += (char)c;
+		const size_t slash = desc.Filename.find_last_of(L"\\/");
+		ShaderInclude include(slash == std::wstring::npos ? std::wstring() : desc.Filename.substr(0, slash + 1));
+
+		std::vector<D3D_SHADER_MACRO> macros;
+		for (const ShaderDefine& define : desc.Defines)
+			macros.push_back({ define.Name.c_str(), define.Value.c_str() });
+		macros.push_back({ nullptr, nullptr });
+
+		// The key covers the preprocessed text, so a change to any included file or to
+		// what the defines select misses the cache.
+		ComPtr<ID3DBlob> preprocessed;
+		ComPtr<ID3DBlob> errors;
+		HRESULT hr = D3DPreprocess(source.data(), source.size(), sourceName.c_str(), macros.data(), &include,
+			&preprocessed, &errors);
+		if (errors != nullptr)
+			OutputDebugStringA((char*)errors->GetBufferPointer());
+		ThrowIfFailed(hr);
+
+		keys[i] = ShaderCache::MakeKey(preprocessed->GetBufferPointer(), preprocessed->GetBufferSize(),
+			desc.EntryPoint, desc.Target, desc.Defines, compileFlags, D3D_COMPILER_VERSION);
+
+		const std::wstring path = cache.BlobPath(keys[i]);
+		if (cache.Contains(keys[i]))
+		{
+			blobs[i] = LoadBinary(path);
+			if (blobs[i]->GetBufferSize() > 0)
+				return;
+		}
+
+		errors = nullptr;
+		hr = D3DCompile(preprocessed->GetBufferPointer(), preprocessed->GetBufferSize(), sourceName.c_str(),
+			nullptr, nullptr, desc.EntryPoint.c_str(), desc.Target.c_str(), compileFlags, 0,
+			blobs[i].ReleaseAndGetAddressOf(), &errors);
+		if (errors != nullptr)
+			OutputDebugStringA((char*)errors->GetBufferPointer());
+		ThrowIfFailed(hr);
+		compiled[i] = 1;
+
+		// Write to a name no other worker is using and move it into place, so a later
+		// run never reads a partly written blob.  A failed write only costs a compile
+		// next time.
+		const std::wstring temp = path + L"." + std::to_wstring(GetCurrentThreadId()) + L".tmp";
+		std::ofstream fout(temp, std::ios::binary | std::ios::trunc);
+		fout.write((const char*)blobs[i]->GetBufferPointer(), (std::streamsize)blobs[i]->GetBufferSize());
+		fout.close();
+		if (!fout || !MoveFileExW(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+			DeleteFileW(temp.c_str());
+	});
+
+	int compiledCount = 0;
+	for (size_t i = 0; i < shaders.size(); ++i)
+	{
+		if (compiled[i])
+		{
+			cache.Insert(keys[i]);
+			++compiledCount;
+		}
+	}
+
+	__int64 endTime = 0;
+	QueryPerformanceCounter((LARGE_INTEGER*)&endTime);
+
+	std::wostringstream text;
+	text << L"Shaders: " << shaders.size() - compiledCount << L" loaded from cache, " << compiledCount
+		<< L" compiled, " << (endTime - startTime) * 1000.0 / countsPerSec << L" ms\n";
+	OutputDebugString(text.str().c_str());
+
+	return blobs;
+}
+
 std::wstring DxException::ToString()const
 {
     // Get the string description of the error code.
@@ -25,7 +25,7 @@
 #include "DDSTextureLoader.h"
 #include "MathHelper.h"
 
-extern const int gNumFrameResources;
+extern int gNumFrameResources;
 
 inline void d3dSetDebugName(IDXGIObject* obj, const char* name)
 {
@@ -84,6 +84,9 @@ inline std::wstring AnsiToWString(const std::string& str)
 #endif
 	*/
 
+class ShaderCache;
+struct ShaderDesc;
+
 class d3dUtil
 {
 public:
@@ -122,6 +125,13 @@ public:
 		const D3D_SHADER_MACRO* defines,
 		const std::string& entrypoint,
 		const std::string& target);
+
+	// Returns one blob per desc, in order.  Each source is preprocessed and hashed;
+	// blobs already in the cache are read from disk and the rest are compiled on
+	// worker threads and written to the cache.
+	static std::vector<Microsoft::WRL::ComPtr<ID3DBlob>> LoadOrCompileShaders(
+		ShaderCache& cache,
+		const std::vector<ShaderDesc>& shaders);
 };
 
 class DxException
@@ -250,7 +260,8 @@ struct Light
 	float SpotPower = 64.0f;                            // spot light only
 };
 
-#define MaxLights 16
+// Most point plus spot lights one object is lit by.
+#define MaxObjectLights 16
 
 struct MaterialConstants
 {
@@ -260,6 +271,13 @@ struct MaterialConstants
 
 	// Used in texture mapping.
 	DirectX::XMFLOAT4X4 MatTransform = MathHelper::Identity4x4();
+
+	// Heap index of the diffuse texture's array view; shaders index the bound heap
+	// with it.  DiffuseMapSlice is the texture's slice in that array.
+	UINT DiffuseMapIndex = 0;
+	UINT DiffuseMapSlice = 0;
+	UINT MaterialPad0 = 0;
+	UINT MaterialPad1 = 0;
 };
 
 // Simple struct to represent a material for our demos.  A production 3D engine
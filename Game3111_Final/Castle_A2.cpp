@@ -4,11 +4,33 @@
 
 #include "../Common/d3dApp.h"
 #include "../Common/MathHelper.h"
+#include "../Common/CommandLine.h"
 #include "../Common/UploadBuffer.h"
 #include "../Common/GeometryGenerator.h"
 #include "FrameResource.h"
 #include "Waves.h"
 #include "../Common/Camera.h"
+#include "../Common/GpuProfiler.h"
+#include "../Common/TextureLoader.h"
+#include "../Common/TextureStreamer.h"
+#include "../Common/DescriptorAllocator.h"
+#include "../Common/ShaderCache.h"
+#include "../Common/PipelineCache.h"
+#include "../Common/ShaderPermutation.h"
+#include "../Common/LightClusters.h"
+#include "../Common/LightManager.h"
+#include "../Common/StaticBatch.h"
+#include "../Common/MazeGenerator.h"
+#include "../Common/SceneDiff.h"
+#include "../Common/SceneFile.h"
+#include "../Common/TransformHierarchy.h"
+#include "../Common/EntityWorld.h"
+#include <cmath>
+#include <iterator>
+#include <map>
+#include <ppl.h>
+#include <set>
+#include <tuple>
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -17,17 +39,50 @@ using namespace DirectX::PackedVector;
 #pragma comment(lib, "d3dcompiler.lib")
 #pragma comment(lib, "D3D12.lib")
 
-const int gNumFrameResources = 3;
+// Number of frame resources in the ring.  Defaults to 3 and can be changed at
+// startup with -frameresources N; it must not change once the app is running.
+int gNumFrameResources = 3;
 
-// Lightweight structure stores parameters to draw a shape.  This will
-// vary from app-to-app.
-struct RenderItem
+// The clustered light grid: screen tiles, depth slices, and room for this many
+// entries in the per-frame light index list.  Lists past it are cut short.
+const UINT ClusterTilesX = 16;
+const UINT ClusterTilesY = 8;
+const UINT ClusterSlices = 24;
+const UINT MaxClusterLightIndices = 64 * 1024;
+
+// Static geometry is merged per material within square cells this wide on the xz
+// plane.  Bakes and compiled scenes are kept under CacheDirectory for the next run.
+const float StaticBatchCellSize = 64.0f;
+const wchar_t* const CacheDirectory = L"Cache";
+
+// Seconds between checks of a watched scene's source for a newer save.
+const float SceneCheckInterval = 0.25f;
+
+// The scene node the app animates as the drawbridge: given a Rotator that lowers it at
+// this many radians per second while the camera is within reach of its hinge.
+const char* const DrawbridgeNodeName = "drawbridge";
+const float DrawbridgeReach = 40.0f;
+const float DrawbridgeSpeed = 0.8f;
+
+enum class RenderLayer : int
 {
-	RenderItem() = default;
+	Opaque = 0,
+	Transparent,
+	AlphaTested,
+	AlphaTestedTreeSprites,
+	Count
+};
+
+// Render items are entities of mEntities (see EntityWorld.h), made of the components
+// below.  Each system reads only what it needs: UpdateObjectCBs the transforms and
+// light lists, BuildDrawLists and DrawRenderItems the bounds and draw arguments, and
+// GetMovementBooleans nothing but the colliders.
 
-	// World matrix of the shape that describes the object's local space
-	// relative to the world space, which defines the position, orientation,
-	// and scale of the object in the world.
+// World matrix of the shape that describes the object's local space relative to the
+// world space, which defines the position, orientation, and scale of the object in
+// the world.
+struct Transform
+{
 	XMFLOAT4X4 World = MathHelper::Identity4x4();
 
 	XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
@@ -37,17 +92,22 @@ struct RenderItem
 	// update to each FrameResource.  Thus, when we modify obect data we should set 
 	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
 	int NumFramesDirty = gNumFrameResources;
+};
+
+// What it takes to draw the item: its layer, its object constants, the light variant
+// of the layer's shader that covers its lights, and its material and mesh.
+struct Renderable
+{
+	RenderLayer Layer = RenderLayer::Opaque;
 
 	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
-	UINT ObjCBIndex = -1;
+	UINT ObjCBIndex = 0;
+
+	UINT LightVariant = ShaderPermutation::LargestLightVariant();
 
 	Material* Mat = nullptr;
 	MeshGeometry* Geo = nullptr;
 
-
-	//Bounding Box for Collision
-
-	BoundingBox bounding_box;
 	// Primitive topology.
 	D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 
@@ -57,19 +117,57 @@ struct RenderItem
 	int BaseVertexLocation = 0;
 };
 
-enum class RenderLayer : int
+// World-space bounds used to cull the item, pick how many mips of its texture to
+// stream and which lights reach it.  A zero radius means unknown, which is never
+// culled and asks for every mip and every light.  WorldBox is the axis-aligned box
+// WorldBounds encloses.
+struct Bounds
 {
-	Opaque = 0,
-	Transparent,
-	AlphaTested,
-	AlphaTestedTreeSprites,
-	Count
+	BoundingSphere WorldBounds = BoundingSphere(XMFLOAT3(0.0f, 0.0f, 0.0f), 0.0f);
+	BoundingBox WorldBox;
+};
+
+// The most relevant point and spot lights reaching the item's WorldBox, as indices
+// into the pass lights (points first).  Set Dirty after moving the item to have them
+// picked again.
+struct LightList
+{
+	bool Dirty = true;
+	UINT PointLightCount = 0;
+	UINT SpotLightCount = 0;
+	std::array<UINT, MaxObjectLights> LocalLights = {};
+};
+
+// A box the camera collides with.  Items baked into merged draws leave an entity with
+// only their collider behind.
+struct Collider
+{
+	BoundingBox Box;
+};
+
+// The transform node of an item placed under a scene node.  Transform::World is copied
+// from the node's world whenever the node or one above it moves.
+struct Attachment
+{
+	std::uint32_t Node = TransformHierarchy::NoNode;
+};
+
+// Swings a scene node about its x axis, on top of its placement in the scene: out to
+// OpenAngle radians while the camera is within Reach of the node, back to 0 once it
+// leaves, at Speed radians per second.
+struct Rotator
+{
+	UINT SceneNode = SceneNoNode;
+	float Angle = 0.0f;
+	float OpenAngle = 0.0f;
+	float Speed = 0.0f;
+	float Reach = 0.0f;
 };
 
 class CastleApp : public D3DApp
 {
 public:
-	CastleApp(HINSTANCE hInstance);
+	CastleApp(HINSTANCE hInstance, const char* cmdLine);
 	CastleApp(const CastleApp& rhs) = delete;
 	CastleApp& operator=(const CastleApp& rhs) = delete;
 	~CastleApp();
@@ -87,34 +185,55 @@ private:
 	void GetMovementBooleans(bool& forward, bool& backward, bool& left, bool& right);
 
 	void OnKeyboardInput(const GameTimer& gt);
+	void UpdateBenchmarkCamera();
 	void AnimateMaterials(const GameTimer& gt);
 	void UpdateObjectCBs(const GameTimer& gt);
 	void UpdateMaterialCBs(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
+	void AssignObjectLights();
+	void SelectObjectLights(const Bounds& bounds, LightList& lights, Renderable& renderable, Transform& transform)const;
+	void UpdateLightClusters();
+	void UpdateLightBuffer();
 	void UpdateWaves(const GameTimer& gt);
+	void UpdateTextureResidency();
+	void UpdateTextureStreaming();
 
 	void LoadTextures();
+	int TextureIndex(const std::string& name)const;
 	void BuildRootSignature();
 	void BuildDescriptorHeaps();
 	void BuildShadersAndInputLayouts();
 	void BuildLandGeometry();
 	void BuildWavesGeometry();
 	void BuildGeometry();
-	void BuildTreeSpritesGeometry();
-	void BuildLightningSpritesGeometry();
+	void LoadScene();
+	void ReloadScene();
+	void AddMaze(SceneFile& scene, std::vector<std::uint8_t>& bytes)const;
+	bool ResolveSceneNames(const SceneFile& scene, ArenaVector<const SubmeshGeometry*>& meshes,
+		ArenaVector<Material*>& materials, std::string& error);
+	Entity CreateItem(RenderLayer layer);
+	void PlaceItem(Entity item, const ScenePlacement& placement, const SubmeshGeometry& mesh, Material* material);
+	void RemoveItemNode(Entity item);
+	void BuildSceneNodes();
+	UINT FindSceneNode(const SceneFile& scene, const char* name)const;
+	void FindDrawbridge();
+	void AnimateRotators(const GameTimer& gt);
+	void UpdateTransforms();
+	UINT AllocateObjCBIndex();
+	void BuildSpriteGeometry(const char* set, const std::string& geoName);
+	void BuildLights();
+	void BuildTorches();
 	void BuildPSOs();
 	void BuildFrameResources();
 	void BuildMaterials();
-	void Build_Render_Item_Rotate(const char* item, XMMATRIX scale_matrix, XMMATRIX translate_matrix, XMMATRIX rotation_matrix,
-	                              const char* material, UINT ObjIndex);
-	void Build_Render_Item(const char* item, XMMATRIX scale_matrix, XMMATRIX translate_matrix,
-		const char* material, UINT ObjIndex);
-	void Build_Render_Item_Collision(const char* item, XMMATRIX scale_matrix, XMMATRIX translate_matrix,
-	                                 const char* material, UINT ObjIndex);
-	void BuildMaze(UINT& objCBIndex);
-	void BuildCastle(UINT& objCBIndex);
+	void BuildPlacements();
 	void Build_Render_Items();
-	void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
+	void BakeStaticGeometry();
+	void BuildWorldBounds();
+	void UpdateWorldBounds(const Renderable& renderable, const Transform& transform, Bounds& bounds);
+	PipelineCache::Key LayerPso(RenderLayer layer, UINT lightVariant)const;
+	void BuildDrawLists();
+	void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, RenderLayer layer);
 	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> GetStaticSamplers();
 
 	float GetHillsHeight(float x, float z)const;
@@ -126,28 +245,140 @@ private:
 	FrameResource* mCurrFrameResource = nullptr;
 	int mCurrFrameResourceIndex = 0;
 
-	UINT mCbvSrvDescriptorSize = 0;
+	// Decides when a frame resource can be reused; see FramePacer.h.
+	std::unique_ptr<FramePacer> mFramePacer;
+	// Frames allowed in flight with the latency policy; 0 selects the throughput policy.
+	int mMaxFramesInFlight = 0;
+
+	// GPU time per render layer, read back a few frames late into mFrameStats.
+	static const int MaxGpuScopes = 8;
+	std::unique_ptr<D3D12TimestampBackend> mTimestampBackend;
+	std::unique_ptr<GpuProfiler> mGpuProfiler;
+
+	// -benchmark N flies the camera along a fixed path for N frames and then quits.
+	int mBenchmarkFrameCount = 0;
+	int mBenchmarkFrame = 0;
 
 	ComPtr<ID3D12RootSignature> mRootSignature = nullptr;
 
-	ComPtr<ID3D12DescriptorHeap> mSrvDescriptorHeap = nullptr;
+	// The one shader-visible heap.  The root signature binds all of it, and shaders
+	// index textures in it by the heap index each material carries.
+	std::unique_ptr<DescriptorAllocator> mDescriptors;
 
 	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
 	std::unordered_map<std::string, std::unique_ptr<Material>> mMaterials;
 	std::unordered_map<std::string, std::unique_ptr<Texture>> mTextures;
+
+	// Textures load in the background.  Materials refer to textures by their index in
+	// mTextureSlots.  SrvIndex is the heap index of the view currently used for the
+	// texture.  It is a placeholder view until the texture is resident.  A texture whose
+	// resource the loader deduplicated borrows the first view of that resource, and
+	// OwnsSrv is false.  A new resource (for example, streamed mips) gets a new view.
+	// Every view is a texture array view; Slice picks the texture's slice in it, which
+	// is nonzero for textures TexturePacker packed together.
+	struct TextureSlot
+	{
+		std::string Name;
+		int LoaderHandle;
+		UINT Slice;
+		UINT SrvIndex;
+		bool OwnsSrv;
+		ComPtr<ID3D12Resource> ViewedResource;
+	};
+	std::unique_ptr<TextureLoader> mTextureLoader;
+	std::vector<TextureSlot> mTextureSlots;
+	UINT mPlaceholderSrv = 0;
+	bool mTextureStatsReported = false;
+
+	// -texbudget N streams mips under an N MB budget; 0 loads every mip up front.
+	// mStreamedTextures maps loader owner handles to streamer textures, and
+	// mStreamedHandles maps back.
+	UINT64 mTextureBudget = 64ull * 1024 * 1024;
+	std::unique_ptr<TextureStreamer> mTextureStreamer;
+	std::unordered_map<int, int> mStreamedTextures;
+	std::vector<int> mStreamedHandles;
+
+	// -clustered 0 lights each object with its own light list (AssignObjectLights)
+	// instead of the clustered grid, which is rebuilt from the camera every frame.
+	bool mClusteredLighting = true;
+	LightManager mLights;
+	// What AssignObjectLights last saw: the lights' version and per-type counts, and
+	// the sphere each packed light reaches.
+	std::uint64_t mObjectLightsVersion = 0;
+	std::array<UINT, (int)LightType::Count> mObjectLightCounts = {};
+	std::vector<BoundingSphere> mLightReach;
+	// -torches 0 leaves out the torches along the castle walls.
+	bool mWallTorches = true;
+	LightClusters mLightClusters{ ClusterTilesX, ClusterTilesY, ClusterSlices };
+	ShaderCache mShaderCache{ L"Shaders\\Cache" };
 	std::unordered_map<std::string, ComPtr<ID3DBlob>> mShaders;
-	std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> mPSOs;
+
+	// Pipelines are created and cached by mPipelines.  mLayerPsos holds the key of
+	// the pipeline each render layer draws with for each light variant; 0 marks a
+	// variant that was not built, and LayerPso falls back to the largest.
+	std::unique_ptr<PipelineCache> mPipelines;
+	std::array<std::vector<PipelineCache::Key>, (int)RenderLayer::Count> mLayerPsos;
 
 	std::vector<D3D12_INPUT_ELEMENT_DESC> mStdInputLayout;
 	std::vector<D3D12_INPUT_ELEMENT_DESC> mTreeSpriteInputLayout;
 
-	RenderItem* mWavesRitem = nullptr;
+	// Every render item, collider and rotator.
+	EntityWorld mEntities;
+	Entity mWavesItem;
 
-	// List of all the render items.
-	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
-
-	// Render items divided by PSO.
-	std::vector<RenderItem*> mRitemLayer[static_cast<int>(RenderLayer::Count)];
+	// This frame's visible render items divided by PSO, in mFrameArena; see
+	// BuildDrawLists.
+	struct DrawList
+	{
+		const Renderable** Items = nullptr;
+		UINT Count = 0;
+	};
+	DrawList mDrawLists[static_cast<int>(RenderLayer::Count)];
+
+	// -staticbatch 0 draws the castle and maze primitives one by one instead of as
+	// the merged draws BakeStaticGeometry makes of them.
+	bool mStaticBatching = true;
+
+	// The camera's frustum in world space; opaque items outside it are not drawn.
+	BoundingFrustum mCameraFrustum;
+
+	// The level layout.  -scene names a binary scene or its text source; a text scene
+	// is compiled into CacheDirectory whenever it is newer than its binary.
+	std::string mSceneFilename = "Scenes\\castle.txt";
+	SceneFile mScene;
+
+	// -maze N adds a generated N x N maze north of the castle to the scene, for load
+	// tests; -mazeseed picks the maze and -mazealgo wilson the algorithm.
+	UINT mMazeSize = 0;
+	std::uint64_t mMazeSeed = 3111;
+	MazeAlgorithm mMazeAlgorithm = MazeAlgorithm::Backtracker;
+	MazeGenerator mMaze;
+
+	// -watch 1 reloads the scene whenever its source is saved, and patches the live
+	// items, colliders, materials and lights where SceneDiff finds them changed.
+	// Baked items cannot be patched, so watching turns static batching off.  Once
+	// reloaded, the scene lives in mSceneBytes instead of its mapped file.
+	bool mWatchScene = false;
+	std::wstring mSceneSource;
+	ULONGLONG mSceneSourceTime = 0;
+	float mNextSceneCheck = 0.0f;
+	std::vector<std::uint8_t> mSceneBytes;
+	SceneDiff mSceneDiff;
+	// What each scene placement and light became.
+	std::vector<Entity> mPlacedItems;
+	std::vector<LightManager::Handle> mSceneLights;
+
+	// The scene's nodes and a node per item placed under one; see TransformHierarchy.h.
+	// mSceneNodes holds each scene node's handle and mNodeItems each handle's item, if
+	// it places one.
+	TransformHierarchy mTransforms;
+	std::vector<std::uint32_t> mSceneNodes;
+	std::vector<Entity> mNodeItems;
+	Entity mDrawbridge;
+
+	// Object constants in use, and those freed by removed items for new ones to reuse.
+	UINT mObjectCBCount = 0;
+	std::vector<UINT> mFreeObjCBIndices;
 
 	std::unique_ptr<Waves> mWaves;
 
@@ -191,9 +422,11 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
 
+	gNumFrameResources = (std::max)(1, GetCommandLineInt(cmdLine, "-frameresources", gNumFrameResources));
+
 	try
 	{
-		CastleApp theApp(hInstance);
+		CastleApp theApp(hInstance, cmdLine);
 		if (!theApp.Initialize())
 			return 0;
 
@@ -206,15 +439,46 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
 	}
 }
 
-CastleApp::CastleApp(HINSTANCE hInstance)
+CastleApp::CastleApp(HINSTANCE hInstance, const char* cmdLine)
 	: D3DApp(hInstance)
 {
+	// Frame pacing: -latency N caps queued presents with a waitable swap chain,
+	// -inflight N caps frames in flight, -vsync 0 presents without waiting for vblank.
+	mMaxFrameLatency = (UINT)(std::max)(0, GetCommandLineInt(cmdLine, "-latency", 0));
+	mMaxFramesInFlight = (std::max)(0, GetCommandLineInt(cmdLine, "-inflight", 0));
+	mSyncInterval = (UINT)(std::max)(0, GetCommandLineInt(cmdLine, "-vsync", 1));
+
+	mBenchmarkFrameCount = std::max(0, GetCommandLineInt(cmdLine, "-benchmark", 0));
+	// -stats name writes name.csv and name.json on exit.
+	mFrameStatsFilename = GetCommandLineString(cmdLine, "-stats", mFrameStatsFilename);
+
+	// -trace file.json captures PROFILE_SCOPE events as a Chrome trace.
+	mTraceFilename = GetCommandLineString(cmdLine, "-trace", mTraceFilename);
+
+	mTextureBudget = (UINT64)std::max(0, GetCommandLineInt(cmdLine, "-texbudget", (int)(mTextureBudget >> 20))) << 20;
+
+	mClusteredLighting = GetCommandLineInt(cmdLine, "-clustered", 1) != 0;
+	mWallTorches = GetCommandLineInt(cmdLine, "-torches", 1) != 0;
+	mStaticBatching = GetCommandLineInt(cmdLine, "-staticbatch", 1) != 0;
+	mSceneFilename = GetCommandLineString(cmdLine, "-scene", mSceneFilename);
+	mWatchScene = GetCommandLineInt(cmdLine, "-watch", 0) != 0;
+	// 65535 is the largest square maze whose cells fit MazeGenerator's 32-bit indices.
+	mMazeSize = (UINT)(std::min)((std::max)(0, GetCommandLineInt(cmdLine, "-maze", 0)), 65535);
+	mMazeSeed = (std::uint64_t)GetCommandLineInt(cmdLine, "-mazeseed", (int)mMazeSeed);
+	if (GetCommandLineString(cmdLine, "-mazealgo", "backtracker") == "wilson")
+		mMazeAlgorithm = MazeAlgorithm::Wilson;
+	if (mWatchScene)
+		mStaticBatching = false;
 }
 
 CastleApp::~CastleApp()
 {
 	if (md3dDevice != nullptr)
 		FlushCommandQueue();
+
+	// Keep any pipelines created since startup for the next run.
+	if (mPipelines != nullptr)
+		mPipelines->Save();
 }
 
 bool CastleApp::Initialize()
@@ -225,23 +489,32 @@ bool CastleApp::Initialize()
 	// Reset the command list to prep for initialization commands.
 	ThrowIfFailed(mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr));
 
-	// Get the increment size of a descriptor in this heap type.  This is hardware specific, 
-	// so we have to query this information.
-	mCbvSrvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
-
 	mWaves = std::make_unique<Waves>(248, 248, 1.0f, 0.03f, 4.0f, 0.2f);
 	m_Camera.SetPosition(0.0f, 18.5f, -110.0f);
+
+	// Streamed textures start with their 4 smallest mips.
+	mTextureLoader = std::make_unique<TextureLoader>(md3dDevice.Get(), mTextureBudget > 0 ? 4 : 0);
+	if (mTextureBudget > 0)
+		mTextureStreamer = std::make_unique<TextureStreamer>(mTextureBudget);
 	LoadTextures();
+	mPipelines = std::make_unique<PipelineCache>(md3dDevice.Get(), L"Shaders\\Cache\\pipelines.plib");
 	BuildRootSignature();
 	BuildDescriptorHeaps();
 	BuildShadersAndInputLayouts();
 	BuildLandGeometry();
 	BuildWavesGeometry();
 	BuildGeometry();
-	BuildTreeSpritesGeometry();
-	BuildLightningSpritesGeometry();
+	LoadScene();
+	BuildSpriteGeometry("trees", "treeSpritesGeo");
+	BuildSpriteGeometry("lightning", "lightningSpritesGeo");
 	BuildMaterials();
 	Build_Render_Items();
+	if (mStaticBatching)
+		BakeStaticGeometry();
+	BuildWorldBounds();
+	BuildLights();
+	if (!mClusteredLighting)
+		AssignObjectLights();
 	BuildFrameResources();
 	BuildPSOs();
 
@@ -253,6 +526,21 @@ bool CastleApp::Initialize()
 	// Wait until initialization is complete.
 	FlushCommandQueue();
 
+	// The pipelines were created on workers meanwhile; store them for the next run.
+	mPipelines->Save();
+	PipelineCache::Stats pipelineStats = mPipelines->GetStats();
+	std::wostringstream pipelineText;
+	pipelineText << L"Pipelines: " << pipelineStats.Loaded << L" loaded from library, "
+		<< pipelineStats.Compiled << L" compiled\n";
+	OutputDebugString(pipelineText.str().c_str());
+
+	// Benchmarks measure the finished scene, not the placeholders.
+	if (mBenchmarkFrameCount > 0)
+		mTextureLoader->WaitForAll();
+
+	// The scene is built; what building it needed goes back to the heap.
+	mLoadArena.Release();
+
 	return true;
 }
 
@@ -263,6 +551,7 @@ void CastleApp::OnResize()
 	
 
 	m_Camera.SetLens(0.25f*MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
+	mLightClusters.SetProjection(m_Camera.GetFovY(), m_Camera.GetAspect(), m_Camera.GetNearZ(), m_Camera.GetFarZ());
 	//Old Camera Code
 	 /*//The window resized, so update the aspect ratio and recompute the projection matrix.
 	 XMMATRIX P = XMMatrixPerspectiveFovLH(0.25f * MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
@@ -271,26 +560,42 @@ void CastleApp::OnResize()
 
 void CastleApp::Update(const GameTimer& gt)
 {
-	OnKeyboardInput(gt);
+	if (mWatchScene)
+	{
+		// A reload builds its temporaries in mLoadArena.
+		ReloadScene();
+		mLoadArena.Release();
+	}
 
-	// Cycle through the circular frame resource array.
-	mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % gNumFrameResources;
+	UpdateTextureResidency();
+
+	if (mBenchmarkFrameCount > 0)
+		UpdateBenchmarkCamera();
+	else
+		OnKeyboardInput(gt);
+
+	UpdateTextureStreaming();
+
+	// Move to the next frame resource, blocking until the GPU is far enough
+	// along for the pacing policy to let us overwrite it.
+	mCurrFrameResourceIndex = mFramePacer->BeginFrame();
 	mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
+	mDescriptors->BeginFrame(mCurrFrameResourceIndex);
 
-	// Has the GPU finished processing the commands of the current frame resource?
-	// If not, wait until the GPU has completed commands up to this fence point.
-	if (mCurrFrameResource->Fence != 0 && mFence->GetCompletedValue() < mCurrFrameResource->Fence)
 	{
-		HANDLE eventHandle = CreateEventEx(nullptr, nullptr, false, EVENT_ALL_ACCESS);
-		ThrowIfFailed(mFence->SetEventOnCompletion(mCurrFrameResource->Fence, eventHandle));
-		WaitForSingleObject(eventHandle, INFINITE);
-		CloseHandle(eventHandle);
+		ScopedFramePhase phase(mFrameStats, FramePhase::CBUpload);
+		AnimateMaterials(gt);
+		AnimateRotators(gt);
+		UpdateTransforms();
+		if (mClusteredLighting)
+			UpdateLightClusters();
+		else
+			AssignObjectLights();
+		UpdateLightBuffer();
+		UpdateObjectCBs(gt);
+		UpdateMaterialCBs(gt);
+		UpdateMainPassCB(gt);
 	}
-
-	AnimateMaterials(gt);
-	UpdateObjectCBs(gt);
-	UpdateMaterialCBs(gt);
-	UpdateMainPassCB(gt);
 	UpdateWaves(gt);
 
 	
@@ -298,6 +603,10 @@ void CastleApp::Update(const GameTimer& gt)
 
 void CastleApp::Draw(const GameTimer& gt)
 {
+	long long recordStart = GameTimer::Ticks();
+
+	BuildDrawLists();
+
 	auto cmdListAlloc = mCurrFrameResource->CmdListAlloc;
 
 	// Reuse the memory associated with command recording.
@@ -306,7 +615,10 @@ void CastleApp::Draw(const GameTimer& gt)
 
 	// A command list can be reset after it has been added to the command queue via ExecuteCommandList.
 	// Reusing the command list reuses memory.
-	ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
+	ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), nullptr));
+
+	mGpuProfiler->BeginFrame(mCurrFrameResourceIndex, mFrameStats);
+	int gpuFrameScope = mGpuProfiler->BeginScope(FramePhase::GpuFrame);
 
 	mCommandList->RSSetViewports(1, &mScreenViewport);
 	mCommandList->RSSetScissorRects(1, &mScissorRect);
@@ -322,48 +634,74 @@ void CastleApp::Draw(const GameTimer& gt)
 	// Specify the buffers we are going to render to.
 	mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, &DepthStencilView());
 
-	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
+	ID3D12DescriptorHeap* descriptorHeaps[] = { mDescriptors->Heap() };
 	mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
 
 	mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
 
+	// Every texture is reachable through this table for the whole frame.
+	mCommandList->SetGraphicsRootDescriptorTable(0, mDescriptors->GpuHandle(0));
+
 	auto passCB = mCurrFrameResource->PassCB->Resource();
 	mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
+
+	mCommandList->SetGraphicsRootShaderResourceView(4, mCurrFrameResource->ClusterRanges->Resource()->GetGPUVirtualAddress());
+	mCommandList->SetGraphicsRootShaderResourceView(5, mCurrFrameResource->ClusterLightIndices->Resource()->GetGPUVirtualAddress());
+	mCommandList->SetGraphicsRootShaderResourceView(6, mCurrFrameResource->Lights->Resource()->GetGPUVirtualAddress());
 	
-	//4 PSOS
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+	//4 layers; each render item picks its layer's pipeline for its light variant.
+	{
+		ScopedGpuPhase gpuPhase(*mGpuProfiler, FramePhase::GpuOpaque);
+		DrawRenderItems(mCommandList.Get(), RenderLayer::Opaque);
+	}
 
-	mCommandList->SetPipelineState(mPSOs["alphaTested"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTested]);
+	{
+		ScopedGpuPhase gpuPhase(*mGpuProfiler, FramePhase::GpuAlphaTested);
+		DrawRenderItems(mCommandList.Get(), RenderLayer::AlphaTested);
+	}
 
-	mCommandList->SetPipelineState(mPSOs["treeSprites"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites]);
+	{
+		ScopedGpuPhase gpuPhase(*mGpuProfiler, FramePhase::GpuTreeSprites);
+		DrawRenderItems(mCommandList.Get(), RenderLayer::AlphaTestedTreeSprites);
+	}
 
-	mCommandList->SetPipelineState(mPSOs["transparent"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Transparent]);
+	{
+		ScopedGpuPhase gpuPhase(*mGpuProfiler, FramePhase::GpuTransparent);
+		DrawRenderItems(mCommandList.Get(), RenderLayer::Transparent);
+	}
 
 	// Indicate a state transition on the resource usage.
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
 		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT));
 
+	mGpuProfiler->EndScope(gpuFrameScope);
+	mGpuProfiler->ResolveFrame();
+
 	// Done recording commands.
 	ThrowIfFailed(mCommandList->Close());
 
+	long long submitStart = GameTimer::Ticks();
+	mFrameStats.AddPhaseTime(FramePhase::Record, GameTimer::TicksToMs(submitStart - recordStart));
+
 	// Add the command list to the queue for execution.
 	ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
 	mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
 
 	// Swap the back and front buffers
-	ThrowIfFailed(mSwapChain->Present(0, 0));
+	ThrowIfFailed(mSwapChain->Present(mSyncInterval, 0));
 	mCurrBackBuffer = (mCurrBackBuffer + 1) % SwapChainBufferCount;
 
 	// Advance the fence value to mark commands up to this fence point.
-	mCurrFrameResource->Fence = ++mCurrentFence;
+	++mCurrentFence;
 
 	// Add an instruction to the command queue to set a new fence point. 
 	// Because we are on the GPU timeline, the new fence point won't be 
 	// set until the GPU finishes processing all the commands prior to this Signal().
 	mCommandQueue->Signal(mFence.Get(), mCurrentFence);
+	mFramePacer->EndFrame(mCurrentFence);
+	mGpuProfiler->EndFrame(mCurrentFence);
+
+	mFrameStats.AddPhaseTime(FramePhase::Submit, GameTimer::TicksToMs(GameTimer::Ticks() - submitStart));
 }
 
 void CastleApp::OnMouseDown(WPARAM btnState, int x, int y)
@@ -436,6 +774,7 @@ void CastleApp::OnMouseMove(WPARAM btnState, int x, int y)
 }
 void CastleApp::GetMovementBooleans(bool& forward, bool& backward, bool& left, bool& right)
 {
+	PROFILE_SCOPE("GetMovementBooleans");
 	
 	//Reset movement booleans to true - modified in for loop and returned to movement function scope as reference.
 	moveForward = true;
@@ -443,11 +782,12 @@ void CastleApp::GetMovementBooleans(bool& forward, bool& backward, bool& left, b
 	moveLeft = true;
 	moveRight = true;
 
-	//Go through every opaque/visible render item in layer.
-	for (int i = 0; i < mRitemLayer[static_cast<int>(RenderLayer::Opaque)].size(); i++)
+	//Go through every collision box.
+	mEntities.ForEach<Collider>([this](Entity, const Collider& collider)
 	{
-		//Check if bounding box of render item intersects with camera position + direction.
-		if (mRitemLayer[static_cast<int>(RenderLayer::Opaque)][i]->bounding_box.Intersects(m_Camera.GetPosition(), m_Camera.GetLook(), temp_cam)) {
+		const BoundingBox& box = collider.Box;
+		//Check if bounding box intersects with camera position + direction.
+		if (box.Intersects(m_Camera.GetPosition(), m_Camera.GetLook(), temp_cam)) {
 			
 			//Check if our distance is less than camera collision distance.
 			if (temp_cam < camera_collision_distance) {
@@ -456,32 +796,39 @@ void CastleApp::GetMovementBooleans(bool& forward, bool& backward, bool& left, b
 				moveForward = false;
 			}
 		}
-		if (mRitemLayer[static_cast<int>(RenderLayer::Opaque)][i]->bounding_box.Intersects(m_Camera.GetPosition(), m_Camera.GetLook() * -1.0f, temp_cam)) {
+		if (box.Intersects(m_Camera.GetPosition(), m_Camera.GetLook() * -1.0f, temp_cam)) {
 			if (temp_cam < camera_collision_distance) {
 				moveBackward= false;
 			}
 		}
-		if (mRitemLayer[static_cast<int>(RenderLayer::Opaque)][i]->bounding_box.Intersects(m_Camera.GetPosition(), m_Camera.GetRight() * -1.0f, temp_cam)) {
+		if (box.Intersects(m_Camera.GetPosition(), m_Camera.GetRight() * -1.0f, temp_cam)) {
 			if (temp_cam < camera_collision_distance) {
 				moveLeft = false;
 			}
 		}
-		if (mRitemLayer[static_cast<int>(RenderLayer::Opaque)][i]->bounding_box.Intersects(m_Camera.GetPosition(),  m_Camera.GetRight(), temp_cam)) {
+		if (box.Intersects(m_Camera.GetPosition(),  m_Camera.GetRight(), temp_cam)) {
 			if (temp_cam < camera_collision_distance) {
 				moveRight = false;
 			}
 		}
-	}
+	});
 }
 
 void CastleApp::OnKeyboardInput(const GameTimer& gt)
 {
+	PROFILE_SCOPE("OnKeyboardInput");
+
 	//step3: we handle keyboard input to move the camera:
 
 	const float dt = gt.DeltaTime();
 	//Here we check all opaque render items 
-	GetMovementBooleans(moveForward, moveBackward, moveLeft, moveRight);
+	{
+		ScopedFramePhase phase(mFrameStats, FramePhase::Collision);
+		GetMovementBooleans(moveForward, moveBackward, moveLeft, moveRight);
+	}
 	
+	ScopedFramePhase phase(mFrameStats, FramePhase::Input);
+
 	//GetAsyncKeyState returns a short (2 bytes)
 	if((GetAsyncKeyState('W') & 0x8000) && moveForward) //most significant bit (MSB) is 1 when key is pressed (1000 000 000 000)
 		m_Camera.Walk(m_CameraSpeed*dt);
@@ -504,6 +851,42 @@ void CastleApp::OnKeyboardInput(const GameTimer& gt)
 	m_Camera.UpdateViewMatrix();
 }
 
+//Fixed camera path for -benchmark: walk up to the front gate, then circle the castle once.
+void CastleApp::UpdateBenchmarkCamera()
+{
+	if (mBenchmarkFrame == mBenchmarkFrameCount)
+	{
+		PostQuitMessage(0);
+	}
+
+	//Keep the collision queries in the frame so the benchmark measures them too.
+	{
+		ScopedFramePhase phase(mFrameStats, FramePhase::Collision);
+		GetMovementBooleans(moveForward, moveBackward, moveLeft, moveRight);
+	}
+
+	ScopedFramePhase phase(mFrameStats, FramePhase::Input);
+
+	float t = (float)std::min(mBenchmarkFrame++, mBenchmarkFrameCount) / (float)mBenchmarkFrameCount;
+
+	XMFLOAT3 pos;
+	XMFLOAT3 target(0.0f, 10.0f, 0.0f);
+	if (t < 0.5f)
+	{
+		//Approach from the starting position to just outside the maze.
+		pos = XMFLOAT3(0.0f, 18.5f, -110.0f + 40.0f * (t / 0.5f));
+	}
+	else
+	{
+		//Orbit around the castle, rising and falling once.
+		float angle = XM_2PI * (t - 0.5f) / 0.5f;
+		pos = XMFLOAT3(70.0f * sinf(angle), 18.5f + 20.0f * sinf(0.5f * angle), -70.0f * cosf(angle));
+	}
+
+	m_Camera.LookAt(pos, target, XMFLOAT3(0.0f, 1.0f, 0.0f));
+	m_Camera.UpdateViewMatrix();
+}
+
 void CastleApp::AnimateMaterials(const GameTimer& gt)
 {
 	// Scroll the water material texture coordinates.
@@ -530,26 +913,44 @@ void CastleApp::AnimateMaterials(const GameTimer& gt)
 
 void CastleApp::UpdateObjectCBs(const GameTimer& gt)
 {
-	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
-	for (auto& e : mAllRitems)
+	PROFILE_SCOPE("UpdateObjectCBs");
+
+	// A frame resource's buffer grows when a scene reload adds items past it.  Like
+	// the light buffer, the old one can go, and the new one is written in full.
+	FrameResource* frame = mCurrFrameResource;
+	const bool grown = frame->ObjectCapacity < mObjectCBCount;
+	if (grown)
+	{
+		mFrameLoads = true;
+		frame->ObjectCapacity = std::max(mObjectCBCount, 2 * frame->ObjectCapacity);
+		frame->ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(md3dDevice.Get(), frame->ObjectCapacity, true);
+	}
+
+	// Items write disjoint constants, so blocks of them go to different threads.
+	auto currObjectCB = frame->ObjectCB.get();
+	mEntities.ParallelForEach<Transform, Renderable, LightList>([&](Entity, Transform& t, const Renderable& r, const LightList& lights)
 	{
 		// Only update the cbuffer data if the constants have changed.  
 		// This needs to be tracked per frame resource.
-		if (e->NumFramesDirty > 0)
+		if (t.NumFramesDirty > 0 || grown)
 		{
-			XMMATRIX world = XMLoadFloat4x4(&e->World);
-			XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
+			XMMATRIX world = XMLoadFloat4x4(&t.World);
+			XMMATRIX texTransform = XMLoadFloat4x4(&t.TexTransform);
 
 			ObjectConstants objConstants;
 			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
 			XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
+			objConstants.PointLightCount = lights.PointLightCount;
+			objConstants.SpotLightCount = lights.SpotLightCount;
+			std::copy(lights.LocalLights.begin(), lights.LocalLights.end(), objConstants.LocalLights);
 
-			currObjectCB->CopyData(e->ObjCBIndex, objConstants);
+			currObjectCB->CopyData(r.ObjCBIndex, objConstants);
 
 			// Next FrameResource need to be updated too.
-			e->NumFramesDirty--;
+			if (t.NumFramesDirty > 0)
+				t.NumFramesDirty--;
 		}
-	}
+	});
 }
 
 void CastleApp::UpdateMaterialCBs(const GameTimer& gt)
@@ -569,6 +970,8 @@ void CastleApp::UpdateMaterialCBs(const GameTimer& gt)
 			matConstants.FresnelR0 = mat->FresnelR0;
 			matConstants.Roughness = mat->Roughness;
 			XMStoreFloat4x4(&matConstants.MatTransform, XMMatrixTranspose(matTransform));
+			matConstants.DiffuseMapIndex = mTextureSlots[mat->DiffuseSrvHeapIndex].SrvIndex;
+			matConstants.DiffuseMapSlice = mTextureSlots[mat->DiffuseSrvHeapIndex].Slice;
 
 			currMaterialCB->CopyData(mat->MatCBIndex, matConstants);
 
@@ -590,6 +993,10 @@ void CastleApp::UpdateMainPassCB(const GameTimer& gt)
     XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
     XMMATRIX invProj = XMMatrixInverse(&XMMatrixDeterminant(proj), proj);
     XMMATRIX invViewProj = XMMatrixInverse(&XMMatrixDeterminant(viewProj), viewProj);
+
+	// World-space view frustum the opaque items are culled against.
+	BoundingFrustum::CreateFromMatrix(mCameraFrustum, proj);
+	mCameraFrustum.Transform(mCameraFrustum, invView);
 	//Storing view projection values
     XMStoreFloat4x4(&mMainPassCB.View, XMMatrixTranspose(view));
     XMStoreFloat4x4(&mMainPassCB.InvView, XMMatrixTranspose(invView));
@@ -607,84 +1014,334 @@ void CastleApp::UpdateMainPassCB(const GameTimer& gt)
     mMainPassCB.TotalTime = gt.TotalTime();
     mMainPassCB.DeltaTime = gt.DeltaTime();
 	
+	// The lights themselves live in mLights and reach the GPU through UpdateLightBuffer.
+
+    auto currPassCB = mCurrFrameResource->PassCB.get();
+    currPassCB->CopyData(0, mMainPassCB);
+}
+
+// The app's light for a scene light; both keep the types in the same order.
+static Light ToLight(const SceneLight& sceneLight)
+{
+	static_assert((int)SceneLightTypeCount == (int)LightType::Count, "SceneLightType must match LightType");
+
+	Light light;
+	light.Strength = XMFLOAT3(sceneLight.Strength);
+	light.FalloffStart = sceneLight.FalloffStart;
+	light.FalloffEnd = sceneLight.FalloffEnd;
+	light.Position = XMFLOAT3(sceneLight.Position);
+	light.Direction = XMFLOAT3(sceneLight.Direction);
+	light.SpotPower = sceneLight.SpotPower;
+	return light;
+}
+
+void CastleApp::BuildLights()
+{
 	//HERE WE BUILD LIGHTING!
 	
 	//Ambient Lighting
     mMainPassCB.AmbientLight = { 0.7f, 0.5f, 0.7f, 1.0f };
-	
-	//0 - 1 Directional Lighting
-    mMainPassCB.Lights[0].Direction = { 0.5f, -0.6f, 0.5f };
-    mMainPassCB.Lights[0].Strength = { 1.88f, 1.24f, 2.44f };
-	
-	mMainPassCB.Lights[1].Direction = { -0.65f, -0.65f, -0.5f };
-	mMainPassCB.Lights[1].Strength = { 0.94f, 0.72f, 1.22f };
-	
-	
-	//2 - 11 Point Light
-	mMainPassCB.Lights[2].Position = { -19.0f, 17.0f, -19.0f };
-	mMainPassCB.Lights[2].Strength = { 4.7f, 3.1f, 6.6f };
-    mMainPassCB.Lights[3].Position = { -19.0f, 17.0f, -19.0f };
-    mMainPassCB.Lights[3].Strength = { 4.7f, 3.1f, 6.6f };
-	mMainPassCB.Lights[4].Position = { -19.0f, 17.0f, 19.0f };
-	mMainPassCB.Lights[4].Strength = { 4.7f, 3.1f, 6.6f };
-	mMainPassCB.Lights[5].Position = { 19.0f, 17.0f, 19.0f };
-	mMainPassCB.Lights[5].Strength = { 4.7f, 3.1f, 6.6f };
-	mMainPassCB.Lights[6].Position = { 19.0f, 17.0f, -19.0f };
-	mMainPassCB.Lights[6].Strength = { 4.7f, 3.1f, 6.6f };
-	mMainPassCB.Lights[7].Position = { 0.0f, 14.0f, -27.0f };
-	mMainPassCB.Lights[7].Strength = { 4.7f, 3.1f, 6.6f };
-	//Lightning Bolts - Additional modifers
-	mMainPassCB.Lights[8].Position = { -13.0f, 6.f, 8.0f };
-	mMainPassCB.Lights[8].Strength = { 4.7f, 3.1f, 6.6f };
-	mMainPassCB.Lights[8].FalloffStart = 1;
-	mMainPassCB.Lights[8].FalloffEnd = 5;
-	mMainPassCB.Lights[8].SpotPower = 0.01;
-	mMainPassCB.Lights[9].Position = { 10.0f, 6.f, 50.0f };
-	mMainPassCB.Lights[9].Strength = { 4.7f, 3.1f, 6.6f };
-	mMainPassCB.Lights[9].FalloffStart = 4;
-	mMainPassCB.Lights[9].FalloffEnd = 12;
-	mMainPassCB.Lights[9].SpotPower = 0.1;
-	//Torch Lights
-	mMainPassCB.Lights[10].Position = { 3.0f, 6.f, -25.0f };
-	mMainPassCB.Lights[10].Strength = { 4.7f, 1.f, 1.f };
-	mMainPassCB.Lights[10].FalloffStart = 1;
-	mMainPassCB.Lights[10].FalloffEnd = 1.1;
-	mMainPassCB.Lights[11].Position = { -3.0f, 6.f, -25.0f };
-	mMainPassCB.Lights[11].Strength = { 4.7f, 1.f, 1.f };
-	mMainPassCB.Lights[11].FalloffStart = 1;
-	mMainPassCB.Lights[11].FalloffEnd = 1.1;
-	mMainPassCB.Lights[12].Position = { 0, 10, -77};
-	mMainPassCB.Lights[12].Strength = { 4.7f, 3.1f, 6.6f };
-	//13- Spotlight-Pyramid
-	mMainPassCB.Lights[13].Position = { 0.0f, 25.0f, 0.0f };
-	mMainPassCB.Lights[13].Strength = { 4.7f, 3.1f, 6.6f };
-	
 
-	
-    auto currPassCB = mCurrFrameResource->PassCB.get();
-    currPassCB->CopyData(0, mMainPassCB);
+	// Directional, point and spot lights come from the scene.
+	mSceneLights.clear();
+	for (UINT i = 0; i < mScene.LightCount(); ++i)
+	{
+		const SceneLight& light = mScene.Lights()[i];
+		mSceneLights.push_back(mLights.Add((LightType)light.Type, ToLight(light)));
+	}
+
+	if (mWallTorches)
+		BuildTorches();
 }
 
-void CastleApp::UpdateWaves(const GameTimer& gt)
+void CastleApp::BuildTorches()
+{
+	// A torch every two units along both faces of the outer walls and the courtyard
+	// face of the inner walls, just below the battlements.
+	Light torch;
+	torch.Strength = { 1.6f, 0.8f, 0.3f };
+	torch.FalloffStart = 0.5f;
+	torch.FalloffEnd = 4.0f;
+
+	// The front (-z) wall has a gateway gateHalfWidth either side of its middle.
+	auto torchRing = [&](float halfExtent, float wallOffset, float gateHalfWidth)
+	{
+		for (float t = -halfExtent; t <= halfExtent; t += 2.0f)
+		{
+			const XMFLOAT3 positions[] =
+			{
+				{ t, 12.0f, -wallOffset }, { t, 12.0f, wallOffset },
+				{ -wallOffset, 12.0f, t }, { wallOffset, 12.0f, t },
+			};
+			for (const XMFLOAT3& position : positions)
+			{
+				if (position.z == -wallOffset && std::abs(t) < gateHalfWidth)
+					continue;
+
+				torch.Position = position;
+				mLights.Add(LightType::Point, torch);
+			}
+		}
+	};
+
+	// Outer walls are centred 23 units out and 2 thick; inner walls 19 units out.
+	torchRing(21.0f, 24.5f, 2.0f);
+	torchRing(21.0f, 21.5f, 2.0f);
+	torchRing(17.0f, 17.5f, 8.0f);
+}
+
+// The world-space sphere a light reaches: its range for a point light, the
+// bounding sphere of its cone for a spot light.
+static BoundingSphere LightReach(const Light& light, bool spot)
+{
+	if (!spot)
+		return BoundingSphere(light.Position, light.FalloffEnd);
+
+	// The cone ends where its spot factor drops below 1/256.
+	XMFLOAT3 direction;
+	XMStoreFloat3(&direction, XMVector3Normalize(XMLoadFloat3(&light.Direction)));
+	const float cosHalfAngle = std::pow(1.0f / 256.0f, 1.0f / std::max(light.SpotPower, 1e-3f));
+	ClusterLight cone = LightClusters::ConeBounds(&light.Position.x, &direction.x, light.FalloffEnd, cosHalfAngle);
+	return BoundingSphere(XMFLOAT3(cone.X, cone.Y, cone.Z), cone.Radius);
+}
+
+void CastleApp::AssignObjectLights()
+{
+	PROFILE_SCOPE("AssignObjectLights");
+
+	// If a type gained or lost lights, indices moved under every item's list, so
+	// every item is redone.
+	bool allItems = false;
+	for (int t = 0; t < (int)LightType::Count; ++t)
+	{
+		allItems |= mObjectLightCounts[t] != mLights.Count((LightType)t);
+		mObjectLightCounts[t] = mLights.Count((LightType)t);
+	}
+
+	// Refresh the reach of the point and spot lights changed since the last call.
+	const UINT firstPoint = mLights.First(LightType::Point);
+	const UINT firstSpot = mLights.First(LightType::Spot);
+	mLightReach.resize(mLights.Count());
+	ArenaVector<UINT> changedLights(mFrameArena);
+	changedLights.reserve(mLights.Count());
+	mLights.ForEachChangedSince(mObjectLightsVersion, [&](UINT i, const Light& light)
+	{
+		if (i < firstPoint)
+			return;
+		mLightReach[i] = LightReach(light, i >= firstSpot);
+		changedLights.push_back(i);
+	});
+	mObjectLightsVersion = mLights.Version();
+
+	bool anyDirty = allItems || !changedLights.empty();
+	if (!anyDirty)
+		mEntities.ForEach<LightList>([&](Entity, const LightList& lights) { anyDirty |= lights.Dirty; });
+	if (!anyDirty)
+		return;
+
+	// A changed light matters to an item it lit before or reaches now; a light that
+	// neither lit the item nor reaches it cannot change its pick.
+	mEntities.ParallelForEach<Bounds, LightList, Renderable, Transform>([&](Entity, const Bounds& bounds,
+		LightList& lights, Renderable& renderable, Transform& transform)
+	{
+		bool dirty = allItems || lights.Dirty;
+		for (size_t c = 0; c < changedLights.size() && !dirty; ++c)
+		{
+			const UINT i = changedLights[c];
+			const auto listed = lights.LocalLights.begin() + lights.PointLightCount + lights.SpotLightCount;
+			dirty = std::find(lights.LocalLights.begin(), listed, i) != listed ||
+				bounds.WorldBounds.Radius <= 0.0f || mLightReach[i].Intersects(bounds.WorldBox);
+		}
+
+		if (dirty)
+		{
+			lights.Dirty = false;
+			SelectObjectLights(bounds, lights, renderable, transform);
+		}
+	});
+}
+
+void CastleApp::SelectObjectLights(const Bounds& bounds, LightList& lights, Renderable& renderable, Transform& transform)const
+{
+	const UINT maxPoint = ShaderPermutation::MaxPointLights(ShaderPermutation::LargestLightVariant());
+	const UINT maxSpot = ShaderPermutation::MaxSpotLights(ShaderPermutation::LargestLightVariant());
+
+	// How much of a light reaches the item: its brightness times its falloff at the
+	// closest point of the item's box.  Zero if its reach misses the box.
+	const bool unknown = bounds.WorldBounds.Radius <= 0.0f;
+	const XMVECTOR boxMin = XMLoadFloat3(&bounds.WorldBox.Center) - XMLoadFloat3(&bounds.WorldBox.Extents);
+	const XMVECTOR boxMax = XMLoadFloat3(&bounds.WorldBox.Center) + XMLoadFloat3(&bounds.WorldBox.Extents);
+	auto relevance = [&](UINT i)
+	{
+		const Light& light = mLights.Lights()[i];
+		if (!unknown && !mLightReach[i].Intersects(bounds.WorldBox))
+			return 0.0f;
+
+		XMVECTOR position = XMLoadFloat3(&light.Position);
+		float distance = unknown ? 0.0f : XMVectorGetX(XMVector3Length(XMVectorClamp(position, boxMin, boxMax) - position));
+		float falloff = MathHelper::Clamp((light.FalloffEnd - distance) /
+			std::max(light.FalloffEnd - light.FalloffStart, 1e-3f), 0.0f, 1.0f);
+		return falloff * (0.2126f * light.Strength.x + 0.7152f * light.Strength.y + 0.0722f * light.Strength.z);
+	};
+
+	// Writes the indices of the (at most) k most relevant lights of [first, first + n)
+	// to out in increasing order, so an unchanged pick compares equal.
+	auto pick = [&](UINT first, UINT n, UINT k, UINT* out)
+	{
+		std::array<std::pair<float, UINT>, MaxObjectLights> best;
+		UINT count = 0;
+		for (UINT i = first; i < first + n && k > 0; ++i)
+		{
+			const float r = relevance(i);
+			if (r <= 0.0f || (count == k && r <= best[k - 1].first))
+				continue;
+
+			UINT j = count < k ? count++ : k - 1;
+			for (; j > 0 && best[j - 1].first < r; --j)
+				best[j] = best[j - 1];
+			best[j] = std::make_pair(r, i);
+		}
+
+		for (UINT j = 0; j < count; ++j)
+			out[j] = best[j].second;
+		std::sort(out, out + count);
+		return count;
+	};
+
+	std::array<UINT, MaxObjectLights> picked = {};
+	const UINT pointCount = pick(mLights.First(LightType::Point), mLights.Count(LightType::Point), maxPoint, picked.data());
+	const UINT spotCount = pick(mLights.First(LightType::Spot), mLights.Count(LightType::Spot), maxSpot, picked.data() + pointCount);
+
+	if (pointCount != lights.PointLightCount || spotCount != lights.SpotLightCount || picked != lights.LocalLights)
+	{
+		lights.PointLightCount = pointCount;
+		lights.SpotLightCount = spotCount;
+		lights.LocalLights = picked;
+		transform.NumFramesDirty = gNumFrameResources;
+	}
+
+	renderable.LightVariant = ShaderPermutation::LightVariant(pointCount, spotCount);
+}
+
+void CastleApp::UpdateLightClusters()
 {
-	// Every quarter second, generate a random wave.
-	static float t_base = 0.0f;
-	if ((mTimer.TotalTime() - t_base) >= 0.05f)
+	PROFILE_SCOPE("UpdateLightClusters");
+
+	XMMATRIX view = m_Camera.GetView();
+
+	// Point lights, then spot lights, as view-space bounding spheres.
+	ArenaVector<ClusterLight> clusterLights(mFrameArena);
+	clusterLights.reserve(mLights.Count(LightType::Point) + mLights.Count(LightType::Spot));
+	const UINT firstPoint = mLights.First(LightType::Point);
+	for (UINT i = firstPoint; i < firstPoint + mLights.Count(LightType::Point); ++i)
+	{
+		const Light& light = mLights.Lights()[i];
+		XMFLOAT3 center;
+		XMStoreFloat3(&center, XMVector3TransformCoord(XMLoadFloat3(&light.Position), view));
+		clusterLights.push_back({ center.x, center.y, center.z, light.FalloffEnd });
+	}
+
+	const UINT firstSpot = mLights.First(LightType::Spot);
+	for (UINT i = firstSpot; i < firstSpot + mLights.Count(LightType::Spot); ++i)
+	{
+		const Light& light = mLights.Lights()[i];
+		XMFLOAT3 apex;
+		XMFLOAT3 direction;
+		XMStoreFloat3(&apex, XMVector3TransformCoord(XMLoadFloat3(&light.Position), view));
+		XMStoreFloat3(&direction, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&light.Direction), view)));
+
+		// The cone ends where its spot factor drops below 1/256.
+		const float cosHalfAngle = std::pow(1.0f / 256.0f, 1.0f / std::max(light.SpotPower, 1e-3f));
+		clusterLights.push_back(LightClusters::ConeBounds(&apex.x, &direction.x, light.FalloffEnd, cosHalfAngle));
+	}
+
+	// The cluster lists grow the first time the camera sees more light-cluster pairs
+	// than before.
+	const size_t clusterCapacity = mLightClusters.CapacityBytes();
+	mLightClusters.Build(clusterLights.data(), (UINT)clusterLights.size());
+	if (mLightClusters.CapacityBytes() != clusterCapacity)
+		mFrameLoads = true;
+
+	// Cut lists that run past the end of the index buffer.
+	const std::vector<ClusterRange>& ranges = mLightClusters.Ranges();
+	const std::vector<std::uint32_t>& indices = mLightClusters.Indices();
+	auto rangeBuffer = mCurrFrameResource->ClusterRanges.get();
+	if (indices.size() <= MaxClusterLightIndices)
+		rangeBuffer->CopyData(0, ranges.data(), (UINT)ranges.size());
+	else
 	{
-		t_base += 0.25f;
+		for (size_t i = 0; i < ranges.size(); ++i)
+		{
+			ClusterRange range = ranges[i];
+			range.Count = std::min(range.Count, MaxClusterLightIndices - std::min(range.Offset, MaxClusterLightIndices));
+			rangeBuffer->CopyData((int)i, range);
+		}
+	}
+
+	const UINT indexCount = (UINT)std::min<size_t>(indices.size(), MaxClusterLightIndices);
+	if (indexCount > 0)
+		mCurrFrameResource->ClusterLightIndices->CopyData(0, indices.data(), indexCount);
+
+	mMainPassCB.ClusterCountX = mLightClusters.TilesX();
+	mMainPassCB.ClusterCountY = mLightClusters.TilesY();
+	mMainPassCB.ClusterCountZ = mLightClusters.Slices();
+	mMainPassCB.ClusterLightBase = firstPoint;
+	mMainPassCB.ClusterSliceScale = mLightClusters.SliceScale();
+	mMainPassCB.ClusterSliceBias = mLightClusters.SliceBias();
+	mMainPassCB.ClusterSpotStart = mLights.Count(LightType::Point);
+}
 
-		int i = MathHelper::Rand(4, mWaves->RowCount() - 5);
-		int j = MathHelper::Rand(4, mWaves->ColumnCount() - 5);
+void CastleApp::UpdateLightBuffer()
+{
+	PROFILE_SCOPE("UpdateLightBuffer");
 
-		float r = MathHelper::RandF(0.5f, 1.f);
-		//Commenting out disturb - waves poke through bottom
-		mWaves->Disturb(i, j, r);
+	// A frame resource's buffer grows when the lights outgrow it.  The GPU is done
+	// with it by now, so the old one can go; the new one is written in full.
+	FrameResource* frame = mCurrFrameResource;
+	if (frame->Lights == nullptr || frame->LightCapacity < mLights.Count())
+	{
+		mFrameLoads = true;
+		frame->LightCapacity = std::max({ 64u, mLights.Count(), 2 * frame->LightCapacity });
+		frame->Lights = std::make_unique<UploadBuffer<Light>>(md3dDevice.Get(), frame->LightCapacity, false);
+		frame->LightVersion = 0;
 	}
 
-	// Update the wave simulation.
-	mWaves->Update(gt.DeltaTime());
+	mLights.ForEachChangedSince(frame->LightVersion, [frame](UINT index, const Light& light)
+	{
+		frame->Lights->CopyData((int)index, light);
+	});
+	frame->LightVersion = mLights.Version();
+
+	mMainPassCB.DirLightCount = mLights.Count(LightType::Directional);
+}
+
+void CastleApp::UpdateWaves(const GameTimer& gt)
+{
+	PROFILE_SCOPE("UpdateWaves");
+
+	{
+		ScopedFramePhase phase(mFrameStats, FramePhase::WaveSim);
+
+		// Every quarter second, generate a random wave.
+		static float t_base = 0.0f;
+		if ((mTimer.TotalTime() - t_base) >= 0.05f)
+		{
+			t_base += 0.25f;
+
+			int i = MathHelper::Rand(4, mWaves->RowCount() - 5);
+			int j = MathHelper::Rand(4, mWaves->ColumnCount() - 5);
+
+			float r = MathHelper::RandF(0.5f, 1.f);
+			//Commenting out disturb - waves poke through bottom
+			mWaves->Disturb(i, j, r);
+		}
+
+		// Update the wave simulation.
+		mWaves->Update(gt.DeltaTime());
+	}
 
 	// Update the wave vertex buffer with the new solution.
+	ScopedFramePhase phase(mFrameStats, FramePhase::CBUpload);
 	auto currWavesVB = mCurrFrameResource->WavesVB.get();
 	for (int i = 0; i < mWaves->VertexCount(); ++i)
 	{
@@ -702,120 +1359,135 @@ void CastleApp::UpdateWaves(const GameTimer& gt)
 	}
 
 	// Set the dynamic VB of the wave renderitem to the current frame VB.
-	mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
+	mEntities.Get<Renderable>(mWavesItem).Geo->VertexBufferGPU = currWavesVB->Resource();
+}
+
+// Where TexturePacker put a texture: the array file and the slice in it.
+struct PackedTexture
+{
+	std::wstring ArrayFilename;
+	UINT Slice;
+};
+
+// Reads the textures.pack manifest TexturePacker writes next to its arrays, keyed by
+// lower-case input file name.  Returns an empty map if the textures were never packed.
+static std::unordered_map<std::wstring, PackedTexture> ReadTexturePack(const std::wstring& directory)
+{
+	std::unordered_map<std::wstring, PackedTexture> pack;
+
+	std::wifstream fin(directory + L"/textures.pack");
+	std::wstring line;
+	while (std::getline(fin, line))
+	{
+		if (line.empty() || line[0] == L'#')
+			continue;
+
+		const size_t tab1 = line.find(L'\t');
+		const size_t tab2 = tab1 == std::wstring::npos ? tab1 : line.find(L'\t', tab1 + 1);
+		if (tab2 == std::wstring::npos)
+			continue;
+
+		PackedTexture entry;
+		entry.ArrayFilename = directory + L"/" + line.substr(tab1 + 1, tab2 - tab1 - 1);
+		entry.Slice = (UINT)std::wcstoul(line.c_str() + tab2 + 1, nullptr, 10);
+		pack[line.substr(0, tab1)] = entry;
+	}
+
+	return pack;
+}
+
+static std::wstring LowerFileName(const std::wstring& path)
+{
+	const size_t slash = path.find_last_of(L"/\\");
+	std::wstring name = slash == std::wstring::npos ? path : path.substr(slash + 1);
+	std::transform(name.begin(), name.end(), name.begin(), ::towlower);
+	return name;
 }
 
 void CastleApp::LoadTextures()
 {
-	//Loading textures from files.
-	auto grassTex = std::make_unique<Texture>();
-	grassTex->Name = "grassTex";
-	grassTex->Filename = L"../Texture/grass.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), grassTex->Filename.c_str(),
-		grassTex->Resource, grassTex->UploadHeap));
-	//Water Texture
-	auto waterTex = std::make_unique<Texture>();
-	waterTex->Name = "waterTex";
-	waterTex->Filename = L"../Texture/water3.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), waterTex->Filename.c_str(),
-		waterTex->Resource, waterTex->UploadHeap));
-	//Wall Texture
-	auto wallTex = std::make_unique<Texture>();
-	wallTex->Name = "wallTex";
-	wallTex->Filename = L"../Texture/walltex2.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), wallTex->Filename.c_str(),
-		wallTex->Resource, wallTex->UploadHeap));
-	//Dark Earthy Texture - Tower Tops
-	auto earthTex = std::make_unique<Texture>();
-	earthTex->Name = "earthTex";
-	earthTex->Filename = L"../Texture/darkearth2.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), earthTex->Filename.c_str(),
-		earthTex->Resource, earthTex->UploadHeap));
-	//Gold Texture
-	auto goldTex = std::make_unique<Texture>();
-	goldTex->Name = "goldTex";
-	goldTex->Filename = L"../Texture/gold.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), goldTex->Filename.c_str(),
-		goldTex->Resource, goldTex->UploadHeap));
-	//Lightning Texture
-	auto rock01Tex = std::make_unique<Texture>();
-	rock01Tex->Name = "rock01Tex";
-	rock01Tex->Filename = L"../Texture/lightning.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), rock01Tex->Filename.c_str(),
-		rock01Tex->Resource, rock01Tex->UploadHeap));
-	//Placeholder texture - for future use.
-	auto rock02Tex = std::make_unique<Texture>();
-	rock02Tex->Name = "rock02Tex";
-	rock02Tex->Filename = L"../Texture/lightning.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), rock02Tex->Filename.c_str(),
-		rock02Tex->Resource, rock02Tex->UploadHeap));
-	//Placeholder texture - for future use
-	auto weird1Tex = std::make_unique<Texture>();
-	weird1Tex->Name = "weird1Tex";
-	weird1Tex->Filename = L"../Texture/lightning.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), weird1Tex->Filename.c_str(),
-		weird1Tex->Resource, weird1Tex->UploadHeap));
-	//Not used - green interesting material - can be changed for future projects
-	auto weird2Tex = std::make_unique<Texture>();
-	weird2Tex->Name = "weird2Tex";
-	weird2Tex->Filename = L"../Texture/weirdtex2.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), weird2Tex->Filename.c_str(),
-		weird2Tex->Resource, weird2Tex->UploadHeap));
-	//Grey/Beige Pattern used for spheres
-	auto weird3Tex = std::make_unique<Texture>();
-	weird3Tex->Name = "weird3Tex";
-	weird3Tex->Filename = L"../Texture/weirdtex3.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), weird3Tex->Filename.c_str(),
-		weird3Tex->Resource, weird3Tex->UploadHeap));
-	//Door texture - name needs to be changed.
-	auto emeraldTex = std::make_unique<Texture>();
-	emeraldTex->Name = "emeraldTex";
-	emeraldTex->Filename = L"../Texture/door.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), emeraldTex->Filename.c_str(),
-		emeraldTex->Resource, emeraldTex->UploadHeap));
-	//Tree texture
-	auto treeArrayTex = std::make_unique<Texture>();
-	treeArrayTex->Name = "treeArrayTex";
-	treeArrayTex->Filename = L"../Texture/treeArray.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), treeArrayTex->Filename.c_str(),
-		treeArrayTex->Resource, treeArrayTex->UploadHeap));
-
-
-	//Sending our textures
-	mTextures[grassTex->Name] = std::move(grassTex);
-	mTextures[waterTex->Name] = std::move(waterTex);
-	mTextures[wallTex->Name] = std::move(wallTex);
-	mTextures[earthTex->Name] = std::move(earthTex);
-	mTextures[goldTex->Name] = std::move(goldTex);
-	mTextures[rock01Tex->Name] = std::move(rock01Tex);
-	mTextures[rock02Tex->Name] = std::move(rock02Tex);
-	mTextures[weird1Tex->Name] = std::move(weird1Tex);
-	mTextures[weird2Tex->Name] = std::move(weird2Tex);
-	mTextures[weird3Tex->Name] = std::move(weird3Tex);
-	mTextures[emeraldTex->Name] = std::move(emeraldTex);
-	mTextures[treeArrayTex->Name] = std::move(treeArrayTex);
+	//Loading textures from files on worker threads.  Materials look textures up by
+	//name.  A file listed more than once is loaded, uploaded and given a descriptor
+	//only once.  Files that TexturePacker packed into an array are drawn from their
+	//slice of that array instead, so they share one resource and one view.
+	struct TextureFile
+	{
+		const char* Name;
+		const wchar_t* Filename;
+	};
+	const TextureFile textures[] =
+	{
+		{ "grassTex", L"../Texture/grass.dds" },
+		{ "waterTex", L"../Texture/water3.dds" },
+		{ "wallTex", L"../Texture/walltex2.dds" },
+		//Dark Earthy Texture - Tower Tops
+		{ "earthTex", L"../Texture/darkearth2.dds" },
+		{ "goldTex", L"../Texture/gold.dds" },
+		//Lightning Texture
+		{ "rock01Tex", L"../Texture/lightning.dds" },
+		//Placeholder textures - for future use.
+		{ "rock02Tex", L"../Texture/lightning.dds" },
+		{ "weird1Tex", L"../Texture/lightning.dds" },
+		//Not used - green interesting material - can be changed for future projects
+		{ "weird2Tex", L"../Texture/weirdtex2.dds" },
+		//Grey/Beige Pattern used for spheres
+		{ "weird3Tex", L"../Texture/weirdtex3.dds" },
+		//Door texture - name needs to be changed.
+		{ "emeraldTex", L"../Texture/door.dds" },
+		//Tree texture
+		{ "treeArrayTex", L"../Texture/treeArray.dds" },
+	};
+
+	const auto packed = ReadTexturePack(L"../Texture/Packed");
+
+	for (const auto& t : textures)
+	{
+		auto tex = std::make_unique<Texture>();
+		tex->Name = t.Name;
+		tex->Filename = t.Filename;
+
+		UINT slice = 0;
+		auto it = packed.find(LowerFileName(t.Filename));
+		if (it != packed.end())
+		{
+			tex->Filename = it->second.ArrayFilename;
+			slice = it->second.Slice;
+		}
+
+		mTextureSlots.push_back({ tex->Name, mTextureLoader->Load(tex->Filename), slice });
+
+		//Sending our textures - Resource is filled in once the texture is resident.
+		mTextures[tex->Name] = std::move(tex);
+	}
+}
+
+int CastleApp::TextureIndex(const std::string& name)const
+{
+	for (size_t i = 0; i < mTextureSlots.size(); ++i)
+	{
+		if (mTextureSlots[i].Name == name)
+			return (int)i;
+	}
 
+	throw DxException(E_INVALIDARG, L"TextureIndex(" + AnsiToWString(name) + L")", AnsiToWString(__FILE__), __LINE__);
 }
 
 void CastleApp::BuildRootSignature()
 {
+	// Unbounded tables over the whole heap need resource binding tier 2; tier 1
+	// caps a table at 128 SRVs.
+	D3D12_FEATURE_DATA_D3D12_OPTIONS options = {};
+	ThrowIfFailed(md3dDevice->CheckFeatureSupport(D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options)));
+	if (options.ResourceBindingTier < D3D12_RESOURCE_BINDING_TIER_2)
+		throw DxException(E_NOTIMPL, L"Bindless textures need resource binding tier 2", AnsiToWString(__FILE__), __LINE__);
+
+	// The whole heap, seen as texture arrays (t0).  Materials pick a descriptor by its
+	// heap index and a slice within it.
 	CD3DX12_DESCRIPTOR_RANGE texTable;
-	texTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0);
+	texTable.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, UINT_MAX, 0, 0);
 
 	// Root parameter can be a table, root descriptor or root constants.
-	CD3DX12_ROOT_PARAMETER slotRootParameter[4];
+	CD3DX12_ROOT_PARAMETER slotRootParameter[7];
 
 	// Perfomance TIP: Order from most frequent to least frequent.
 	slotRootParameter[0].InitAsDescriptorTable(1, &texTable, D3D12_SHADER_VISIBILITY_PIXEL);
@@ -823,10 +1495,17 @@ void CastleApp::BuildRootSignature()
 	slotRootParameter[2].InitAsConstantBufferView(1);
 	slotRootParameter[3].InitAsConstantBufferView(2);
 
+	// The light grid's ranges and index list (t0 and t1, space1).
+	slotRootParameter[4].InitAsShaderResourceView(0, 1, D3D12_SHADER_VISIBILITY_PIXEL);
+	slotRootParameter[5].InitAsShaderResourceView(1, 1, D3D12_SHADER_VISIBILITY_PIXEL);
+
+	// Every light, packed by type (t2, space1).
+	slotRootParameter[6].InitAsShaderResourceView(2, 1, D3D12_SHADER_VISIBILITY_PIXEL);
+
 	auto staticSamplers = GetStaticSamplers();
 
 	// A root signature is an array of root parameters.
-	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(4, slotRootParameter,
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(_countof(slotRootParameter), slotRootParameter,
 		(UINT)staticSamplers.size(), staticSamplers.data(),
 		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
@@ -847,142 +1526,223 @@ void CastleApp::BuildRootSignature()
 		serializedRootSig->GetBufferPointer(),
 		serializedRootSig->GetBufferSize(),
 		IID_PPV_ARGS(mRootSignature.GetAddressOf())));
+
+	mPipelines->AddRootSignature(mRootSignature.Get(), serializedRootSig->GetBufferPointer(), serializedRootSig->GetBufferSize());
 }
 
-void CastleApp::BuildDescriptorHeaps()
+// Single textures are viewed as one-slice arrays so every material samples the same way.
+static D3D12_SHADER_RESOURCE_VIEW_DESC TextureSrvDesc(ID3D12Resource* texture)
 {
-	//
-	// Create the SRV heap.
-	//
-	D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
-	srvHeapDesc.NumDescriptors = 12;
-	srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-	srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&mSrvDescriptorHeap)));
-
-	//
-	// Fill out the heap with actual descriptors.
-	//
-	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
-	
-	auto grassTex = mTextures["grassTex"]->Resource;
-	auto waterTex = mTextures["waterTex"]->Resource;
-	auto wallTex = mTextures["wallTex"]->Resource;
-	auto earthTex = mTextures["earthTex"]->Resource;
-	auto goldTex = mTextures["goldTex"]->Resource;
-	auto rock01Tex = mTextures["rock01Tex"]->Resource;
-	auto rock02Tex = mTextures["rock02Tex"]->Resource;
-	auto weird1Tex = mTextures["weird1Tex"]->Resource;
-	auto weird2Tex = mTextures["weird2Tex"]->Resource;
-	auto weird3Tex = mTextures["weird3Tex"]->Resource;
-	auto emeraldTex = mTextures["emeraldTex"]->Resource;
-	auto treeArrayTex = mTextures["treeArrayTex"]->Resource;
-
 	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = texture->GetDesc().Format;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+	srvDesc.Texture2DArray.MostDetailedMip = 0;
+	srvDesc.Texture2DArray.MipLevels = -1;
+	srvDesc.Texture2DArray.FirstArraySlice = 0;
+	srvDesc.Texture2DArray.ArraySize = texture->GetDesc().DepthOrArraySize;
 
-	srvDesc.Format = grassTex->GetDesc().Format;
-	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-	srvDesc.Texture2D.MostDetailedMip = 0;
-	srvDesc.Texture2D.MipLevels = -1;
-	md3dDevice->CreateShaderResourceView(grassTex.Get(), &srvDesc, hDescriptor);
+	return srvDesc;
+}
 
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+void CastleApp::BuildDescriptorHeaps()
+{
+	// Persistent views for textures and whatever else needs one, plus a per-frame
+	// region for transient views.
+	mDescriptors = std::make_unique<DescriptorAllocator>(md3dDevice.Get(), 4096, 256, gNumFrameResources);
 
-	srvDesc.Format = waterTex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(waterTex.Get(), &srvDesc, hDescriptor);
+	//
+	// Texture views are created by UpdateTextureResidency; until then every
+	// texture is drawn with the placeholder.
+	//
+	auto placeholder = mTextureLoader->Placeholder();
 
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	mPlaceholderSrv = mDescriptors->Allocate();
+	md3dDevice->CreateShaderResourceView(placeholder, &TextureSrvDesc(placeholder), mDescriptors->CpuHandle(mPlaceholderSrv));
 
-	srvDesc.Format = wallTex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(wallTex.Get(), &srvDesc, hDescriptor);
+	for (TextureSlot& slot : mTextureSlots)
+	{
+		slot.SrvIndex = mPlaceholderSrv;
+		slot.OwnsSrv = false;
+	}
+}
 
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+void CastleApp::UpdateTextureResidency()
+{
+	// Loading textures and finishing streamed mips allocate.
+	const std::vector<int>& resident = mTextureLoader->Update();
+	if (!resident.empty() || !mTextureLoader->AllResident())
+		mFrameLoads = true;
 
-	srvDesc.Format = earthTex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(earthTex.Get(), &srvDesc, hDescriptor);
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	for (int handle : resident)
+	{
+		for (const TextureSlot& slot : mTextureSlots)
+		{
+			if (slot.LoaderHandle == handle)
+				mTextures[slot.Name]->Resource = mTextureLoader->Resource(handle);
+		}
 
-	srvDesc.Format = goldTex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(goldTex.Get(), &srvDesc, hDescriptor);
+		// A texture starts streaming once its smallest mips are resident; later
+		// notifications for it are finished mip changes.
+		if (mTextureStreamer != nullptr)
+		{
+			const int owner = mTextureLoader->Owner(handle);
+			auto it = mStreamedTextures.find(owner);
+			if (it != mStreamedTextures.end())
+			{
+				mTextureStreamer->OnResident(it->second, mTextureLoader->MostDetailedMip(owner));
+			}
+			else if (owner == handle)
+			{
+				const D3D12_RESOURCE_DESC& desc = mTextureLoader->FileDesc(handle);
+				mStreamedTextures[handle] = mTextureStreamer->AddTexture((UINT)desc.Width, desc.Height,
+					mTextureLoader->MipBytes(handle), mTextureLoader->MostDetailedMip(handle), mTextureLoader->CoarsestMip(handle));
+				mStreamedHandles.push_back(handle);
+			}
+		}
+	}
 
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	// Give every texture a view of its newest resource.  Old views are freed, but the
+	// allocator keeps them intact until frames already recorded have finished.
+	for (UINT i = 0; i < (UINT)mTextureSlots.size(); ++i)
+	{
+		TextureSlot& slot = mTextureSlots[i];
+		ID3D12Resource* texture = mTextures[slot.Name]->Resource.Get();
+		if (texture == nullptr || texture == slot.ViewedResource.Get())
+			continue;
 
-	srvDesc.Format = rock01Tex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(rock01Tex.Get(), &srvDesc, hDescriptor);
-	
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+		if (slot.OwnsSrv)
+			mDescriptors->Free(slot.SrvIndex);
 
-	srvDesc.Format = rock02Tex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(rock02Tex.Get(), &srvDesc, hDescriptor);
-	
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+		// Slots that share a resource share the first one's view.
+		slot.OwnsSrv = true;
+		for (UINT j = 0; j < i; ++j)
+		{
+			if (mTextureSlots[j].ViewedResource.Get() == texture)
+			{
+				slot.SrvIndex = mTextureSlots[j].SrvIndex;
+				slot.OwnsSrv = false;
+				break;
+			}
+		}
 
-	srvDesc.Format = weird1Tex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(weird1Tex.Get(), &srvDesc, hDescriptor);
-	
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+		if (slot.OwnsSrv)
+		{
+			slot.SrvIndex = mDescriptors->Allocate();
+			md3dDevice->CreateShaderResourceView(texture, &TextureSrvDesc(texture), mDescriptors->CpuHandle(slot.SrvIndex));
+		}
 
-	srvDesc.Format = weird2Tex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(weird2Tex.Get(), &srvDesc, hDescriptor);
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+		slot.ViewedResource = texture;
 
-	srvDesc.Format = weird3Tex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(weird3Tex.Get(), &srvDesc, hDescriptor);
-	
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+		// Materials carry the view's heap index in their constants.
+		for (auto& e : mMaterials)
+		{
+			if (e.second->DiffuseSrvHeapIndex == (int)i)
+				e.second->NumFramesDirty = gNumFrameResources;
+		}
+	}
 
-	srvDesc.Format = emeraldTex->GetDesc().Format;
-	md3dDevice->CreateShaderResourceView(emeraldTex.Get(), &srvDesc, hDescriptor);
-	
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	if (!mTextureStatsReported && mTextureLoader->AllResident())
+	{
+		mTextureStatsReported = true;
 
-	auto desc = treeArrayTex->GetDesc();
-	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
-	srvDesc.Format = treeArrayTex->GetDesc().Format;
-	srvDesc.Texture2DArray.MostDetailedMip = 0;
-	srvDesc.Texture2DArray.MipLevels = -1;
-	srvDesc.Texture2DArray.FirstArraySlice = 0;
-	srvDesc.Texture2DArray.ArraySize = treeArrayTex->GetDesc().DepthOrArraySize;
-	md3dDevice->CreateShaderResourceView(treeArrayTex.Get(), &srvDesc, hDescriptor);
+		TextureLoader::Stats stats = mTextureLoader->GetStats();
+		std::wostringstream text;
+		text << L"Textures: " << stats.Requests << L" requested, " << stats.Files << L" files, "
+			<< stats.Uploads << L" uploaded, " << stats.BytesSaved << L" bytes saved by deduplication\n";
+		if (mTextureStreamer != nullptr)
+		{
+			text << L"Texture streaming: " << mStreamedHandles.size() << L" textures, "
+				<< mTextureStreamer->AccountedBytes() << L" of " << mTextureStreamer->Budget() << L" bytes resident\n";
+		}
+		OutputDebugString(text.str().c_str());
+	}
+}
+
+// Largest factor by which a texture transform scales UVs, i.e. how many times the
+// texture repeats across the surface.
+static float TextureTiling(const XMFLOAT4X4& transform)
+{
+	const float u = sqrtf(transform._11 * transform._11 + transform._12 * transform._12);
+	const float v = sqrtf(transform._21 * transform._21 + transform._22 * transform._22);
+	return std::max(u, v);
+}
+
+void CastleApp::UpdateTextureStreaming()
+{
+	if (mTextureStreamer == nullptr)
+		return;
+
+	PROFILE_SCOPE("UpdateTextureStreaming");
 
+	mTextureStreamer->BeginFrame();
 
+	// Pixels covered by one unit of size at one unit of distance.
+	const float projectionScale = 0.5f * mClientHeight / tanf(0.5f * m_Camera.GetFovY());
+	const XMVECTOR eye = m_Camera.GetPosition();
 
+	mEntities.ForEach<Renderable, Transform, Bounds>([&](Entity, const Renderable& r, const Transform& t, const Bounds& b)
+	{
+		if (r.Mat == nullptr || r.Mat->DiffuseSrvHeapIndex < 0)
+			return;
+
+		const int handle = mTextureSlots[r.Mat->DiffuseSrvHeapIndex].LoaderHandle;
+		if (!mTextureLoader->IsResident(handle))
+			return;
+
+		auto it = mStreamedTextures.find(mTextureLoader->Owner(handle));
+		if (it == mStreamedTextures.end())
+			return;
+
+		const BoundingSphere& bounds = b.WorldBounds;
+		if (bounds.Radius <= 0.0f)
+		{
+			mTextureStreamer->RequestMip(it->second, 0);
+			return;
+		}
+
+		// Projected diameter of the bounds, measured at their nearest point, divided
+		// by the number of times the texture repeats across them.
+		float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Center) - eye)) - bounds.Radius;
+		distance = std::max(distance, m_Camera.GetNearZ());
+		const float screenPixels = 2.0f * bounds.Radius * projectionScale / distance;
+		const float tiling = TextureTiling(t.TexTransform) * TextureTiling(r.Mat->MatTransform);
+
+		mTextureStreamer->RequestScreenSize(it->second, screenPixels / std::max(tiling, 0.001f));
+	});
+
+	const std::vector<TextureStreamer::Change>& changes = mTextureStreamer->Update();
+	if (!changes.empty())
+		mFrameLoads = true;
+	for (const TextureStreamer::Change& change : changes)
+	{
+		if (!mTextureLoader->RequestMip(mStreamedHandles[change.Texture], change.MostDetailedMip))
+			mTextureStreamer->Cancel(change.Texture);
+	}
 }
 
 void CastleApp::BuildShadersAndInputLayouts()
 {
-	const D3D_SHADER_MACRO defines[] =
+	// Pixel shaders come in light variants and are compiled by BuildPSOs, once the
+	// render items show which variants are needed.
+	const char* names[] =
 	{
-		"FOG", "1",
-		NULL, NULL
+		"standardVS",
+		"treeSpriteVS", "treeSpriteGS",
 	};
 
-	const D3D_SHADER_MACRO alphaTestDefines[] =
+	const std::vector<ShaderDesc> shaders =
 	{
-		"FOG", "1",
-		"ALPHA_TEST", "1",
-		NULL, NULL
-	};
+		{ L"Shaders\\Default.hlsl", {}, "VS", "vs_5_1" },
 
-	mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", defines, "PS", "ps_5_1");
-	mShaders["alphaTestedPS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", alphaTestDefines, "PS", "ps_5_1");
+		{ L"Shaders\\TreeSprite.hlsl", {}, "VS", "vs_5_1" },
+		{ L"Shaders\\TreeSprite.hlsl", {}, "GS", "gs_5_1" },
+	};
 
-	mShaders["treeSpriteVS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["treeSpriteGS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "GS", "gs_5_1");
-	mShaders["treeSpritePS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", alphaTestDefines, "PS", "ps_5_1");
+	// Unchanged shaders load from the blob cache; the rest compile in parallel.
+	auto blobs = d3dUtil::LoadOrCompileShaders(mShaderCache, shaders);
+	for (size_t i = 0; i < blobs.size(); ++i)
+		mShaders[names[i]] = blobs[i];
 
 	mStdInputLayout =
 	{
@@ -1309,205 +2069,35 @@ void CastleApp::BuildGeometry()
 	mGeometries[geo->Name] = std::move(geo);
 }
 
-void CastleApp::BuildTreeSpritesGeometry()
-{
-	//step5
-	struct TreeSpriteVertex
-	{
-		XMFLOAT3 Pos;
-		XMFLOAT2 Size;
-	};
-
-	static const int treeCount = 16;
-	std::array<TreeSpriteVertex, 16> vertices;
-	for (UINT i = 1; i < treeCount; ++i)
-	{
-		float x = 0;
-		float z = 0;
-		float y = 0;
-		switch (i) {
-		case 1:
-			x = -18;
-			y = 13;
-			z = -33;
-			break;
-		case 2:
-			x = -5;
-			y = 13;
-			z = -28;
-			break;
-		case 3:
-			x = 10;
-			y = 13;
-			z = -35;
-			break;
-		case 4:
-			x = -38;
-			y = 11;
-			z = 25;
-			break;
-		case 5:
-			x = -35;
-			y = 11;
-			z = -30;
-			break;
-		case 6:
-			x = -35;
-			y = 14;
-			z = 10;
-			break;
-		case 7:
-			x = 32;
-			y = 12;
-			z = 0;
-			break;
-
-		case 8:
-			x = 35;
-			y = 12;
-			z = -38;
-			break;
-
-		case 9:
-			x = 35;
-			y = 13;
-			z = 30;
-			break;
-		case 10:
-			x = 7;
-			y = 11;
-			z = 47;
-			break;
-		case 11:
-			//Left of 21
-			//4.5, 10, -63
-			x = 2.5;
-			y = 10;
-			z = -63;
-			break;
-		case 12:
-			//Above 24
-			//-5, 10, -53.5
-			x = -5;
-			y = 10;
-			z = -50.5;
-			break;
-		case 13:
-			//In front Cylinder left
-			//7, 12.5, -76.5
-			x = 7;
-			y = 11;
-			z = -79.5;
-			break;
-		
-		case 14:
-			//In front Cylinder right
-			//-7, 12.5, -76.5
-			x = -7;
-			y = 11;
-			z = -79.5;
-			break;
-		case 15:
-			//Above 35
-			//-21.5, 10, -66.5
-			x = -21.5;
-			y = 10;
-			z = -64.5;
-			break;
-		case 16:
-			//Above 27
-			//-12, 10, -49
-			x = -12;
-			y = 10;
-			z = -47;
-			break;
-		default:
-			
-			break;
-		}
-		
-		
-
-		// Move tree slightly above land height.
-		//y = 9.0f;
-
-		vertices[i].Pos = XMFLOAT3(x, y, z);
-		vertices[i].Size = XMFLOAT2(20.0f, 20.0f);
-	}
-
-	std::array<std::uint16_t, 16> indices =
-	{
-		0, 1, 2, 3, 4, 5, 6, 7,
-		8, 9, 10, 11, 12, 13, 14, 15
-	};
-
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(TreeSpriteVertex);
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
-
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "treeSpritesGeo";
-
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
-
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
-
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
-
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
-
-	geo->VertexByteStride = sizeof(TreeSpriteVertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
-
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
-
-	geo->DrawArgs["points"] = submesh;
-
-	mGeometries["treeSpritesGeo"] = std::move(geo);
-}
-//Creating separate build for lightning sprites.
-void CastleApp::BuildLightningSpritesGeometry()
+void CastleApp::BuildSpriteGeometry(const char* set, const std::string& geoName)
 {
-	//step5
-	struct LightningSpriteVertex
+	struct SpriteVertex
 	{
 		XMFLOAT3 Pos;
 		XMFLOAT2 Size;
 	};
 
-	static const int treeCount = 2;
-	std::array<LightningSpriteVertex, 2> vertices;
-	for (UINT i = 0; i < treeCount; ++i)
+	std::vector<SpriteVertex> vertices;
+	for (UINT i = 0; i < mScene.SpriteCount(); ++i)
 	{
-
-		// Move tree slightly above land height.
-		
-		vertices[0].Pos = XMFLOAT3(10, 50, 50);
-		vertices[0].Size = XMFLOAT2(25.0f, 100.0f);
-
-		vertices[1].Pos = XMFLOAT3(-13, 30, 8);
-		vertices[1].Size = XMFLOAT2(10.0f, 55.0f);
+		const SceneSprite& sprite = mScene.Sprites()[i];
+		if (strcmp(mScene.Name(sprite.Set), set) == 0)
+			vertices.push_back({ XMFLOAT3(sprite.Position), XMFLOAT2(sprite.Size) });
 	}
 
-	std::array<std::uint16_t, 16> indices =
-	{
-		0,
-		1
-	};
+	// An empty set still gets one zero-sized sprite, so its render item draws nothing.
+	if (vertices.empty())
+		vertices.push_back({ XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT2(0.0f, 0.0f) });
 
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(LightningSpriteVertex);
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+	std::vector<std::uint32_t> indices(vertices.size());
+	for (UINT i = 0; i < (UINT)indices.size(); ++i)
+		indices[i] = i;
+
+	const UINT vbByteSize = (UINT)vertices.size() * sizeof(SpriteVertex);
+	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint32_t);
 
 	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "lightningSpritesGeo";
+	geo->Name = geoName;
 
 	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
 	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
@@ -1521,9 +2111,9 @@ void CastleApp::BuildLightningSpritesGeometry()
 	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
 		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
 
-	geo->VertexByteStride = sizeof(LightningSpriteVertex);
+	geo->VertexByteStride = sizeof(SpriteVertex);
 	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+	geo->IndexFormat = DXGI_FORMAT_R32_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
 
 	SubmeshGeometry submesh;
@@ -1533,7 +2123,7 @@ void CastleApp::BuildLightningSpritesGeometry()
 
 	geo->DrawArgs["points"] = submesh;
 
-	mGeometries["lightningSpritesGeo"] = std::move(geo);
+	mGeometries[geoName] = std::move(geo);
 }
 void CastleApp::BuildPSOs()
 {
@@ -1551,11 +2141,6 @@ void CastleApp::BuildPSOs()
 		reinterpret_cast<BYTE*>(mShaders["standardVS"]->GetBufferPointer()),
 		mShaders["standardVS"]->GetBufferSize()
 	};
-	opaquePsoDesc.PS =
-	{
-		reinterpret_cast<BYTE*>(mShaders["opaquePS"]->GetBufferPointer()),
-		mShaders["opaquePS"]->GetBufferSize()
-	};
 	opaquePsoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
 	opaquePsoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
 	opaquePsoDesc.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
@@ -1567,7 +2152,6 @@ void CastleApp::BuildPSOs()
 	opaquePsoDesc.SampleDesc.Count = m4xMsaaState ? 4 : 1;
 	opaquePsoDesc.SampleDesc.Quality = m4xMsaaState ? (m4xMsaaQuality - 1) : 0;
 	opaquePsoDesc.DSVFormat = mDepthStencilFormat;
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaquePsoDesc, IID_PPV_ARGS(&mPSOs["opaque"])));
 	
 	// PSO transparent objects
 	
@@ -1588,19 +2172,12 @@ void CastleApp::BuildPSOs()
 	//transparentPsoDesc.BlendState.AlphaToCoverageEnable = true;
 
 	transparentPsoDesc.BlendState.RenderTarget[0] = transparencyBlendDesc;
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&transparentPsoDesc, IID_PPV_ARGS(&mPSOs["transparent"])));
 
 	
 	// PSO alpha tested objects
 
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC alphaTestedPsoDesc = opaquePsoDesc;
-	alphaTestedPsoDesc.PS =
-	{
-		reinterpret_cast<BYTE*>(mShaders["alphaTestedPS"]->GetBufferPointer()),
-		mShaders["alphaTestedPS"]->GetBufferSize()
-	};
 	alphaTestedPsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&alphaTestedPsoDesc, IID_PPV_ARGS(&mPSOs["alphaTested"])));
 	
 	// PSO tree sprites
 	
@@ -1615,19 +2192,75 @@ void CastleApp::BuildPSOs()
 		reinterpret_cast<BYTE*>(mShaders["treeSpriteGS"]->GetBufferPointer()),
 		mShaders["treeSpriteGS"]->GetBufferSize()
 	};
-	treeSpritePsoDesc.PS =
-	{
-		reinterpret_cast<BYTE*>(mShaders["treeSpritePS"]->GetBufferPointer()),
-		mShaders["treeSpritePS"]->GetBufferSize()
-	};
 
-	
 	//step1
 	treeSpritePsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_POINT;
 	treeSpritePsoDesc.InputLayout = { mTreeSpriteInputLayout.data(), (UINT)mTreeSpriteInputLayout.size() };
 	treeSpritePsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
 
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&treeSpritePsoDesc, IID_PPV_ARGS(&mPSOs["treeSprites"])));
+	// Each layer's pixel shader, compiled per light variant its render items use,
+	// plus the largest variant, which any item can fall back to.  Clustered shaders
+	// do not depend on the variant, so only the largest is built.
+	struct LayerPipeline
+	{
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC Desc;
+		const wchar_t* PixelShaderFile;
+		UINT Features;
+	};
+	LayerPipeline layers[(int)RenderLayer::Count];
+	layers[(int)RenderLayer::Opaque] = { opaquePsoDesc, L"Shaders\\Default.hlsl", ShaderFeature::Fog };
+	layers[(int)RenderLayer::Transparent] = { transparentPsoDesc, L"Shaders\\Default.hlsl", ShaderFeature::Fog };
+	layers[(int)RenderLayer::AlphaTested] = { alphaTestedPsoDesc, L"Shaders\\Default.hlsl", ShaderFeature::Fog | ShaderFeature::AlphaTest };
+	layers[(int)RenderLayer::AlphaTestedTreeSprites] = { treeSpritePsoDesc, L"Shaders\\TreeSprite.hlsl", ShaderFeature::Fog | ShaderFeature::AlphaTest };
+
+	// Layers sharing a pixel shader share its variants' blobs.
+	std::map<std::tuple<std::wstring, UINT, UINT>, size_t> shaderIndices;
+	std::vector<ShaderDesc> shaders;
+	std::vector<std::pair<int, UINT>> pipelines;
+	std::array<std::set<UINT>, (int)RenderLayer::Count> layerVariants;
+	if (!mClusteredLighting)
+	{
+		mEntities.ForEach<Renderable>([&](Entity, const Renderable& r)
+		{
+			layerVariants[(int)r.Layer].insert(r.LightVariant);
+		});
+	}
+	for (int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		std::set<UINT>& variants = layerVariants[layer];
+		variants.insert(ShaderPermutation::LargestLightVariant());
+		if (mClusteredLighting)
+			layers[layer].Features |= ShaderFeature::ClusteredLights;
+
+		for (UINT variant : variants)
+		{
+			const LayerPipeline& lp = layers[layer];
+			auto key = std::make_tuple(std::wstring(lp.PixelShaderFile), lp.Features, variant);
+			if (shaderIndices.emplace(key, shaders.size()).second)
+				shaders.push_back({ lp.PixelShaderFile, ShaderPermutation::Defines(lp.Features, variant), "PS", "ps_5_1" });
+			pipelines.push_back({ layer, variant });
+		}
+	}
+
+	auto blobs = d3dUtil::LoadOrCompileShaders(mShaderCache, shaders);
+
+	for (auto& keys : mLayerPsos)
+		keys.assign(ShaderPermutation::LightVariantCount(), 0);
+
+	for (const auto& pipeline : pipelines)
+	{
+		LayerPipeline& lp = layers[pipeline.first];
+		const ComPtr<ID3DBlob>& ps = blobs[shaderIndices[std::make_tuple(std::wstring(lp.PixelShaderFile), lp.Features, pipeline.second)]];
+		lp.Desc.PS =
+		{
+			reinterpret_cast<BYTE*>(ps->GetBufferPointer()),
+			ps->GetBufferSize()
+		};
+		mLayerPsos[pipeline.first][pipeline.second] = mPipelines->Add(lp.Desc);
+	}
+
+	// Create them on worker threads while the initialization commands run.
+	mPipelines->CreateAllAsync();
 }
 
 void CastleApp::BuildFrameResources()
@@ -1635,534 +2268,850 @@ void CastleApp::BuildFrameResources()
 	for (int i = 0; i < gNumFrameResources; ++i)
 	{
 		mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-			1, (UINT)mAllRitems.size(), (UINT)mMaterials.size(), mWaves->VertexCount()));
+			1, mObjectCBCount, (UINT)mMaterials.size(), mWaves->VertexCount(),
+			mLightClusters.ClusterCount(), MaxClusterLightIndices));
 	}
+
+	std::unique_ptr<FramePacingPolicy> policy;
+	if (mMaxFramesInFlight > 0)
+		policy = std::make_unique<LatencyPacingPolicy>(mMaxFramesInFlight);
+	else
+		policy = std::make_unique<ThroughputPacingPolicy>();
+
+	mFramePacer = std::make_unique<FramePacer>(*mGpuTimeline, std::move(policy), gNumFrameResources);
+
+	// Two timestamps per scope.
+	mTimestampBackend = std::make_unique<D3D12TimestampBackend>(md3dDevice.Get(), mCommandQueue.Get(),
+		mCommandList.Get(), gNumFrameResources, 2 * MaxGpuScopes);
+	mGpuProfiler = std::make_unique<GpuProfiler>(*mTimestampBackend, *mGpuTimeline, gNumFrameResources, MaxGpuScopes);
+}
+
+// A scene node's transform relative to its parent.
+static XMMATRIX NodeMatrix(const SceneNode& node)
+{
+	return XMMatrixRotationRollPitchYaw(node.Rotation[0], node.Rotation[1], node.Rotation[2]) *
+		XMMatrixTranslation(node.Translation[0], node.Translation[1], node.Translation[2]);
+}
+
+// Sets a material's constants from the scene.
+static void ApplySceneMaterial(Material& material, const SceneMaterial& sceneMaterial)
+{
+	material.DiffuseAlbedo = XMFLOAT4(sceneMaterial.DiffuseAlbedo);
+	material.FresnelR0 = XMFLOAT3(sceneMaterial.FresnelR0);
+	material.Roughness = sceneMaterial.Roughness;
+	material.NumFramesDirty = gNumFrameResources;
 }
 
 void CastleApp::BuildMaterials()
 {
-	//Build Material Definitions
-	
-	int i = 0;
-	auto grass = std::make_unique<Material>();
-	grass->Name = "grass";
-	grass->MatCBIndex = i;
-	grass->DiffuseSrvHeapIndex = i;
-	grass->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	grass->FresnelR0 = XMFLOAT3(0.01f, 0.01f, 0.01f);
-	grass->Roughness = 0.125f;
-	i++;
-	// This is not a good water material definition, but we do not have all the rendering
-	// tools we need (transparency, environment reflection), so we fake it for now.
-	auto water = std::make_unique<Material>();
-	water->Name = "water";
-	water->MatCBIndex = i;
-	water->DiffuseSrvHeapIndex = i;
-	water->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 0.5f);
-	water->FresnelR0 = XMFLOAT3(0.1f, 0.1f, 0.1f);
-	water->Roughness = 0.0f;
-	//Incrementing material location
-	i++;
-	//Default
-	auto wirefence = std::make_unique<Material>();
-	wirefence->Name = "wall";
-	wirefence->MatCBIndex = i;
-	wirefence->DiffuseSrvHeapIndex = i;
-	wirefence->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	wirefence->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	wirefence->Roughness = 0.25f;
-	//Incrementing material location
-	i++;
-	auto stone = std::make_unique<Material>();
-	stone->Name = "stone";
-	stone->MatCBIndex = i;
-	stone->DiffuseSrvHeapIndex = i;
-	stone->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	stone->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	stone->Roughness = 0.2f;
-	//Incrementing material location
-	i++;
-	auto gold = std::make_unique<Material>();
-	gold->Name = "gold";
-	gold->MatCBIndex = i;
-	gold->DiffuseSrvHeapIndex = i;
-	gold->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	gold->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	gold->Roughness = 0.9f;
-	//Incrementing material location
-	i++;
-	auto earth = std::make_unique<Material>();
-	earth->Name = "earth";
-	earth->MatCBIndex = i;
-	earth->DiffuseSrvHeapIndex = i;
-	earth->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	earth->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	earth->Roughness = 0.9f;
-	//Incrementing material location
-	i++;
-	auto rock1 = std::make_unique<Material>();
-	rock1->Name = "rock1";
-	rock1->MatCBIndex = i;
-	rock1->DiffuseSrvHeapIndex = i;
-	rock1->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	rock1->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	rock1->Roughness = 0.9f;
-	//Incrementing material location
-	i++;
-	auto rock2 = std::make_unique<Material>();
-	rock2->Name = "rock2";
-	rock2->MatCBIndex = i;
-	rock2->DiffuseSrvHeapIndex = i;
-	rock2->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	rock2->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	rock2->Roughness = 0.9f;
-	//Incrementing material location
-	i++;
-	auto weird1 = std::make_unique<Material>();
-	weird1->Name = "weird1";
-	weird1->MatCBIndex = i;
-	weird1->DiffuseSrvHeapIndex = i;
-	weird1->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	weird1->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	weird1->Roughness = 0.9f;
-	//Incrementing material location
-	i++;
-	auto weird2 = std::make_unique<Material>();
-	weird2->Name = "weird2";
-	weird2->MatCBIndex = i;
-	weird2->DiffuseSrvHeapIndex = i;
-	weird2->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	weird2->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	weird2->Roughness = 0.9f;
-	//Incrementing material location
-	i++;
-	auto weird3 = std::make_unique<Material>();
-	weird3->Name = "weird3";
-	weird3->MatCBIndex = i;
-	weird3->DiffuseSrvHeapIndex = i;
-	weird3->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	weird3->FresnelR0 = XMFLOAT3(0.02f, 0.02f, 0.02f);
-	weird3->Roughness = 0.9f;
-	//Incrementing material location
-	i++;
-	auto treeSprites = std::make_unique<Material>();
-	treeSprites->Name = "treeSprites";
-	treeSprites->MatCBIndex = i;
-	treeSprites->DiffuseSrvHeapIndex = i;
-	treeSprites->DiffuseAlbedo = XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f);
-	treeSprites->FresnelR0 = XMFLOAT3(0.01f, 0.01f, 0.01f);
-	treeSprites->Roughness = 0.125f;
-
-
-	//Send them over
-	mMaterials["grass"] = std::move(grass);
-	mMaterials["water"] = std::move(water);
-	mMaterials["wall"] = std::move(wirefence);
-	mMaterials["stone"] = std::move(stone);
-	mMaterials["gold"] = std::move(gold);
-	mMaterials["earth"] = std::move(earth);
-	mMaterials["rock1"] = std::move(rock1);
-	mMaterials["rock2"] = std::move(rock2);
-	mMaterials["weird1"] = std::move(weird1);
-	mMaterials["weird2"] = std::move(weird2);
-	mMaterials["weird3"] = std::move(weird3);
-	mMaterials["treeSprites"] = std::move(treeSprites);
+	//Build Material Definitions: each material's name and texture.  Their constants
+	//come from the scene.
+	const std::pair<const char*, const char*> definitions[] =
+	{
+		{ "grass", "grassTex" },
+		{ "water", "waterTex" },
+		{ "wall", "wallTex" },
+		{ "stone", "earthTex" },
+		{ "gold", "goldTex" },
+		{ "earth", "rock01Tex" },
+		{ "rock1", "rock02Tex" },
+		{ "rock2", "weird1Tex" },
+		{ "weird1", "weird2Tex" },
+		{ "weird2", "weird3Tex" },
+		{ "weird3", "emeraldTex" },
+		{ "treeSprites", "treeArrayTex" },
+	};
 
+	int i = 0;
+	for (const auto& definition : definitions)
+	{
+		auto material = std::make_unique<Material>();
+		material->Name = definition.first;
+		material->MatCBIndex = i++;
+		material->DiffuseSrvHeapIndex = TextureIndex(definition.second);
+		mMaterials[material->Name] = std::move(material);
+	}
 
+	for (UINT m = 0; m < mScene.MaterialCount(); ++m)
+	{
+		const SceneMaterial& sceneMaterial = mScene.Materials()[m];
+		auto material = mMaterials.find(mScene.Name(sceneMaterial.Name));
+		if (material == mMaterials.end())
+		{
+			throw DxException(E_INVALIDARG, L"BuildMaterials: unknown material '" + AnsiToWString(mScene.Name(sceneMaterial.Name)) + L"'",
+				AnsiToWString(__FILE__), __LINE__);
+		}
+		ApplySceneMaterial(*material->second, sceneMaterial);
+	}
 }
 
 //Build Shape Item That Rotates
-void CastleApp::Build_Render_Item_Rotate(const char* item, XMMATRIX scale_matrix, XMMATRIX translate_matrix, XMMATRIX rotation_matrix, const char* material, UINT ObjIndex)
+// Last write time of a file, or 0 if it does not exist.
+static ULONGLONG LastWriteTime(const std::wstring& path)
 {
-	BoundingBox bounding_box;
-	auto shape_render_item = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&shape_render_item->World, scale_matrix * rotation_matrix * translate_matrix);
-	shape_render_item->ObjCBIndex = ObjIndex;
-	shape_render_item->Mat = mMaterials[material].get();
-	shape_render_item->Geo = mGeometries["boxGeo"].get();
-	shape_render_item->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	shape_render_item->IndexCount = shape_render_item->Geo->DrawArgs[item].IndexCount;
-	shape_render_item->StartIndexLocation = shape_render_item->Geo->DrawArgs[item].StartIndexLocation;
-	shape_render_item->BaseVertexLocation = shape_render_item->Geo->DrawArgs[item].BaseVertexLocation;
-	
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(shape_render_item.get());
-	mAllRitems.push_back(std::move(shape_render_item));
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &attributes))
+		return 0;
+	return ((ULONGLONG)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
 }
-//Build Shape Item No Rotation
-void CastleApp::Build_Render_Item(const char* item, XMMATRIX scale_matrix, XMMATRIX translate_matrix, const char* material, UINT ObjIndex)
+
+void CastleApp::LoadScene()
 {
-	BoundingBox bounding_box;
-	std::string str = item;
-	auto shape_render_item = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&shape_render_item->World, scale_matrix * translate_matrix);
-	shape_render_item->ObjCBIndex = ObjIndex;
-	shape_render_item->Mat = mMaterials[material].get();
-	shape_render_item->Geo = mGeometries["boxGeo"].get();
-	shape_render_item->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	shape_render_item->IndexCount = shape_render_item->Geo->DrawArgs[item].IndexCount;
-	shape_render_item->StartIndexLocation = shape_render_item->Geo->DrawArgs[item].StartIndexLocation;
-	shape_render_item->BaseVertexLocation = shape_render_item->Geo->DrawArgs[item].BaseVertexLocation;
-	
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(shape_render_item.get());
-	mAllRitems.push_back(std::move(shape_render_item));
+	PROFILE_SCOPE("LoadScene");
+
+	std::wstring binary = AnsiToWString(mSceneFilename);
+	mSceneSource = binary;
+	mSceneSourceTime = LastWriteTime(mSceneSource);
+	const std::wstring textExtension = L".txt";
+	if (binary.size() > textExtension.size() &&
+		binary.compare(binary.size() - textExtension.size(), textExtension.size(), textExtension) == 0)
+	{
+		const std::wstring source = binary;
+		const size_t nameStart = source.find_last_of(L"\\/") + 1;
+		binary = std::wstring(CacheDirectory) + L"\\" +
+			source.substr(nameStart, source.size() - textExtension.size() - nameStart) + L".scene";
+
+		// A compiled scene of an older format is compiled again too.
+		bool stale = LastWriteTime(source) > LastWriteTime(binary);
+		if (!stale)
+		{
+			SceneFile cached;
+			stale = !cached.Open(binary.c_str());
+		}
+		if (stale)
+		{
+			ComPtr<ID3DBlob> text = d3dUtil::LoadBinary(source);
+
+			std::vector<std::uint8_t> compiled;
+			std::string error;
+			if (!SceneFile::Compile((const char*)text->GetBufferPointer(), text->GetBufferSize(), compiled, error))
+				throw DxException(E_INVALIDARG, L"LoadScene(" + source + L"): " + AnsiToWString(error), AnsiToWString(__FILE__), __LINE__);
+
+			// Written aside and moved into place, like the shader cache's blobs.
+			CreateDirectoryW(CacheDirectory, nullptr);
+			const std::wstring temp = binary + L".tmp";
+			std::ofstream fout(temp, std::ios::binary | std::ios::trunc);
+			fout.write((const char*)compiled.data(), (std::streamsize)compiled.size());
+			fout.close();
+			if (!fout || !MoveFileExW(temp.c_str(), binary.c_str(), MOVEFILE_REPLACE_EXISTING))
+			{
+				DeleteFileW(temp.c_str());
+				throw DxException(HRESULT_FROM_WIN32(GetLastError()), L"LoadScene(" + binary + L")", AnsiToWString(__FILE__), __LINE__);
+			}
+		}
+	}
+
+	if (!mScene.Open(binary.c_str()))
+		throw DxException(E_INVALIDARG, L"LoadScene(" + binary + L"): " + AnsiToWString(mScene.Error()), AnsiToWString(__FILE__), __LINE__);
+
+	if (mMazeSize > 0)
+	{
+		PROFILE_SCOPE("GenerateMaze");
+		if (!mMaze.Generate(mMazeSize, mMazeSize, mMazeSeed, mMazeAlgorithm))
+			throw DxException(E_INVALIDARG, L"GenerateMaze (too many cells)", AnsiToWString(__FILE__), __LINE__);
+		AddMaze(mScene, mSceneBytes);
+	}
 }
 
+void CastleApp::AddMaze(SceneFile& scene, std::vector<std::uint8_t>& bytes)const
+{
+	if (mMazeSize == 0)
+		return;
+
+	// Centered on x, starting past the far edge of the castle's ground.
+	MazeLayout layout;
+	layout.Origin[0] = -0.5f * mMazeSize * layout.CellSize;
+	layout.Origin[1] = 5.0f;
+	layout.Origin[2] = 110.0f;
+
+	SceneWriter writer;
+	writer.Append(scene);
+	mMaze.PlaceWalls(writer, layout);
+
+	// scene may read from bytes, so it is loaded again before the old bytes go.
+	std::vector<std::uint8_t> merged;
+	writer.Write(merged);
+	bytes.swap(merged);
+	scene.Load(bytes.data(), bytes.size());
+}
 
-void CastleApp::Build_Render_Item_Collision(const char* item, XMMATRIX scale_matrix, XMMATRIX translate_matrix, const char* material, UINT ObjIndex)
+void CastleApp::ReloadScene()
 {
-	BoundingBox bounding_box;
-	auto shape_render_item = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&shape_render_item->World, scale_matrix * translate_matrix);
-	shape_render_item->ObjCBIndex = ObjIndex;
-	shape_render_item->Mat = mMaterials[material].get();
-	shape_render_item->Geo = mGeometries["boxGeo"].get();
-	shape_render_item->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	shape_render_item->IndexCount = shape_render_item->Geo->DrawArgs[item].IndexCount;
-	shape_render_item->StartIndexLocation = shape_render_item->Geo->DrawArgs[item].StartIndexLocation;
-	shape_render_item->BaseVertexLocation = shape_render_item->Geo->DrawArgs[item].BaseVertexLocation;
-
-	//Setting render items bounding box center and extents for use with directXCollision.
-	XMStoreFloat3(&bounding_box.Center, XMVectorSet(XMVectorGetX(translate_matrix.r[3]), XMVectorGetY(translate_matrix.r[3]), XMVectorGetZ(translate_matrix.r[3]), 1.0f));
-	XMStoreFloat3(&bounding_box.Extents, 0.5f * XMVectorSet(XMVectorGetX(scale_matrix.r[0]), XMVectorGetY(scale_matrix.r[1]), XMVectorGetZ(scale_matrix.r[2]), 1.0f));
-	
-	shape_render_item->bounding_box = bounding_box;
+	// Polling is one attribute query a few times a second.
+	if (mTimer.TotalTime() < mNextSceneCheck)
+		return;
+	mNextSceneCheck = mTimer.TotalTime() + SceneCheckInterval;
+
+	const ULONGLONG writeTime = LastWriteTime(mSceneSource);
+	if (writeTime == mSceneSourceTime)
+		return;
+	mSceneSourceTime = writeTime;
+	mFrameLoads = true;
+
+	PROFILE_SCOPE("ReloadScene");
+	long long reloadStart = GameTimer::Ticks();
+
+	// A save that cannot be read, compiled or resolved is reported and the live scene
+	// kept; the next save is tried again.  An editor may still hold the file open.
+	std::vector<std::uint8_t> bytes;
+	std::string error;
+	std::ifstream fin(mSceneSource, std::ios::binary);
+	std::vector<char> source((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+	const std::wstring textExtension = L".txt";
+	const bool text = mSceneSource.size() > textExtension.size() &&
+		mSceneSource.compare(mSceneSource.size() - textExtension.size(), textExtension.size(), textExtension) == 0;
+	if (!fin.is_open())
+		error = "cannot open the file";
+	else if (text)
+		SceneFile::Compile(source.data(), source.size(), bytes, error);
+	else
+		bytes.assign(source.begin(), source.end());
+
+	SceneFile scene;
+	ArenaVector<const SubmeshGeometry*> meshes(mLoadArena);
+	ArenaVector<Material*> materials(mLoadArena);
+	if (error.empty() && !scene.Load(bytes.data(), bytes.size()))
+		error = scene.Error();
+	if (error.empty())
+	{
+		AddMaze(scene, bytes);
+		ResolveSceneNames(scene, meshes, materials, error);
+	}
+	if (!error.empty())
+	{
+		OutputDebugString((L"Scene reload failed: " + AnsiToWString(error) + L"\n").c_str());
+		return;
+	}
 
+	mSceneDiff.Compare(mScene, scene);
+	const SceneListDiff& placements = mSceneDiff.Placements();
+	const SceneListDiff& lights = mSceneDiff.Lights();
+	const SceneListDiff& nodes = mSceneDiff.Nodes();
 
+	// Nodes first, parents before children, so placements can hang under new ones.  A
+	// moved node carries everything under it along in UpdateTransforms.  Nodes dropped
+	// from the scene go last, once nothing hangs under them.
+	std::vector<std::uint32_t> sceneNodes(scene.NodeCount());
+	for (UINT i = 0; i < scene.NodeCount(); ++i)
+	{
+		const SceneNode& node = scene.Nodes()[i];
+		const std::uint32_t parent = node.Parent != SceneNoNode ? sceneNodes[node.Parent] : TransformHierarchy::NoNode;
+		XMFLOAT4X4 local;
+		XMStoreFloat4x4(&local, NodeMatrix(node));
+		if (nodes.Sources[i] == SceneDiff::NoSource)
+		{
+			sceneNodes[i] = mTransforms.Add(parent, &local.m[0][0]);
+			continue;
+		}
 
-	
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(shape_render_item.get());
-	mAllRitems.push_back(std::move(shape_render_item));
+		sceneNodes[i] = mSceneNodes[nodes.Sources[i]];
+		if (std::binary_search(nodes.Changed.begin(), nodes.Changed.end(), i))
+		{
+			mTransforms.SetParent(sceneNodes[i], parent);
+			mTransforms.SetLocal(sceneNodes[i], &local.m[0][0]);
+		}
+	}
+	ArenaVector<std::uint32_t> removedNodes(mLoadArena);
+	removedNodes.reserve(nodes.Removed.size());
+	for (UINT i : nodes.Removed)
+		removedNodes.push_back(mSceneNodes[i]);
+	mSceneNodes.swap(sceneNodes);
+
+	// Placements: removed items go, changed ones are placed again where they are, and
+	// added ones get new items.  Every other item and its constants stay untouched.
+	std::vector<Entity> placed(scene.PlacementCount());
+	for (UINT i = 0; i < scene.PlacementCount(); ++i)
+	{
+		if (placements.Sources[i] != SceneDiff::NoSource)
+			placed[i] = mPlacedItems[placements.Sources[i]];
+	}
+
+	for (UINT i : placements.Removed)
+	{
+		const Entity item = mPlacedItems[i];
+		if (mEntities.Has<Attachment>(item))
+			RemoveItemNode(item);
+		mFreeObjCBIndices.push_back(mEntities.Get<Renderable>(item).ObjCBIndex);
+		mEntities.Destroy(item);
+	}
+
+	for (UINT i : placements.Changed)
+	{
+		const ScenePlacement& placement = scene.Placements()[i];
+		PlaceItem(placed[i], placement, *meshes[placement.Mesh], materials[placement.Material]);
+		UpdateWorldBounds(mEntities.Get<Renderable>(placed[i]), mEntities.Get<Transform>(placed[i]), mEntities.Get<Bounds>(placed[i]));
+	}
+
+	for (UINT i : placements.Added)
+	{
+		const ScenePlacement& placement = scene.Placements()[i];
+
+		placed[i] = CreateItem(RenderLayer::Opaque);
+		PlaceItem(placed[i], placement, *meshes[placement.Mesh], materials[placement.Material]);
+		UpdateWorldBounds(mEntities.Get<Renderable>(placed[i]), mEntities.Get<Transform>(placed[i]), mEntities.Get<Bounds>(placed[i]));
+	}
+	mPlacedItems.swap(placed);
+
+	// Children were declared after their parents, so going backwards frees them first.
+	for (auto node = removedNodes.rbegin(); node != removedNodes.rend(); ++node)
+		mTransforms.Remove(*node);
+
+	// Materials take their new values.  One dropped from the scene keeps its last ones.
+	auto applyMaterial = [&](UINT i)
+	{
+		const SceneMaterial& sceneMaterial = scene.Materials()[i];
+		ApplySceneMaterial(*materials[sceneMaterial.Name], sceneMaterial);
+	};
+	std::for_each(mSceneDiff.Materials().Changed.begin(), mSceneDiff.Materials().Changed.end(), applyMaterial);
+	std::for_each(mSceneDiff.Materials().Added.begin(), mSceneDiff.Materials().Added.end(), applyMaterial);
+
+	// Lights keep their handles, so only the edited ones are repacked and rewritten.
+	std::vector<LightManager::Handle> sceneLights(scene.LightCount(), LightManager::InvalidHandle);
+	for (UINT i = 0; i < scene.LightCount(); ++i)
+	{
+		if (lights.Sources[i] != SceneDiff::NoSource)
+			sceneLights[i] = mSceneLights[lights.Sources[i]];
+	}
+	for (UINT i : lights.Removed)
+		mLights.Remove(mSceneLights[i]);
+	for (UINT i : lights.Changed)
+	{
+		const SceneLight& light = scene.Lights()[i];
+		if (light.Type == mScene.Lights()[lights.Sources[i]].Type)
+		{
+			mLights.Update(sceneLights[i], ToLight(light));
+		}
+		else
+		{
+			mLights.Remove(sceneLights[i]);
+			sceneLights[i] = mLights.Add((LightType)light.Type, ToLight(light));
+		}
+	}
+	for (UINT i : lights.Added)
+		sceneLights[i] = mLights.Add((LightType)scene.Lights()[i].Type, ToLight(scene.Lights()[i]));
+	mSceneLights.swap(sceneLights);
+
+	if (mSceneDiff.SpritesChanged())
+		OutputDebugString(L"Scene reload: sprite edits take effect on the next run\n");
+
+	// The new scene stays in memory; this also unmaps the compiled file.
+	mSceneBytes.swap(bytes);
+	mScene.Load(mSceneBytes.data(), mSceneBytes.size());
+	FindDrawbridge();
+	UpdateTransforms();
+
+	std::wostringstream report;
+	report << L"Scene reloaded in " << GameTimer::TicksToMs(GameTimer::Ticks() - reloadStart) << L" ms: "
+		<< placements.Changed.size() << L" changed, " << placements.Added.size() << L" added, "
+		<< placements.Removed.size() << L" removed placements; " << nodes.Changed.size() + nodes.Added.size() +
+		nodes.Removed.size() << L" nodes; " << mSceneDiff.Materials().Changed.size() +
+		mSceneDiff.Materials().Added.size() << L" materials; " << lights.Changed.size() + lights.Added.size() +
+		lights.Removed.size() << L" lights\n";
+	OutputDebugString(report.str().c_str());
 }
 
-void CastleApp::BuildMaze(UINT& objCBIndex)
+bool CastleApp::ResolveSceneNames(const SceneFile& scene, ArenaVector<const SubmeshGeometry*>& meshes,
+	ArenaVector<Material*>& materials, std::string& error)
 {
-	//Wall One
-	Build_Render_Item_Collision("box", XMMatrixScaling(2, 10.f, 8.f), XMMatrixTranslation(-6, 10, -27), "wall", objCBIndex++);
-	//Wall Two
-	Build_Render_Item_Collision("box", XMMatrixScaling(2, 10.f, 8.f), XMMatrixTranslation(6, 10, -27), "wall", objCBIndex++);
-	//Wall Two/2
-	Build_Render_Item_Collision("box", XMMatrixScaling(3, 10.f, 1.f), XMMatrixTranslation(6, 10, -28), "wall", objCBIndex++);
-	//Wall Two/2
-	Build_Render_Item_Collision("box", XMMatrixScaling(3, 10.f, 1.f), XMMatrixTranslation(-6, 10, -28), "wall", objCBIndex++);
-	
-	//Maze Cylinder Front MiddleR
-	Build_Render_Item("cylinder", XMMatrixScaling(3.f, 15.f, 3.f), XMMatrixTranslation(-7, 12.5, -76.5), "weird2", objCBIndex++);
-	//Maze Cylinder Front MiddleL
-	Build_Render_Item("cylinder", XMMatrixScaling(3.f, 15.f, 3.f), XMMatrixTranslation(7, 12.5, -76.5), "weird2", objCBIndex++);
+	// Resolve each name once; a name is a mesh of boxGeo, a material, or neither.
+	MeshGeometry* shapes = mGeometries["boxGeo"].get();
+	meshes.assign(scene.NameCount(), nullptr);
+	materials.assign(scene.NameCount(), nullptr);
+	for (UINT i = 0; i < scene.NameCount(); ++i)
+	{
+		auto mesh = shapes->DrawArgs.find(scene.Name(i));
+		if (mesh != shapes->DrawArgs.end())
+			meshes[i] = &mesh->second;
+		auto material = mMaterials.find(scene.Name(i));
+		if (material != mMaterials.end())
+			materials[i] = material->second.get();
+	}
+
+	for (UINT i = 0; i < scene.PlacementCount(); ++i)
+	{
+		const ScenePlacement& placement = scene.Placements()[i];
+		if (meshes[placement.Mesh] == nullptr || materials[placement.Material] == nullptr)
+		{
+			error = std::string("placement ") + std::to_string(i) + ": unknown mesh '" + scene.Name(placement.Mesh) +
+				"' or material '" + scene.Name(placement.Material) + "'";
+			return false;
+		}
+	}
+	for (UINT i = 0; i < scene.MaterialCount(); ++i)
+	{
+		if (materials[scene.Materials()[i].Name] == nullptr)
+		{
+			error = std::string("unknown material '") + scene.Name(scene.Materials()[i].Name) + "'";
+			return false;
+		}
+	}
+	return true;
+}
 
-	//Inner Sphere MiddleR
-	Build_Render_Item("sphere", XMMatrixScaling(2.f, 2.f, 2.f), XMMatrixTranslation(-7, 20, -76.5), "stone", objCBIndex++);
-	//Inner Sphere MiddleL
-	Build_Render_Item("sphere", XMMatrixScaling(2.f, 2.f, 2.f), XMMatrixTranslation(7, 20, -76.5), "stone", objCBIndex++);
+Entity CastleApp::CreateItem(RenderLayer layer)
+{
+	Renderable renderable;
+	renderable.Layer = layer;
+	renderable.ObjCBIndex = AllocateObjCBIndex();
+	return mEntities.Create(Transform(), renderable, Bounds(), LightList());
+}
 
-	
-	//Maze Cylinder Front MiddleR
-	Build_Render_Item("cylinder", XMMatrixScaling(3.f, 15.f, 3.f), XMMatrixTranslation(-30, 12.5, -76.5), "weird2", objCBIndex++);
-	//Maze Cylinder Front MiddleL
-	Build_Render_Item("cylinder", XMMatrixScaling(3.f, 15.f, 3.f), XMMatrixTranslation(30, 12.5, -76.5), "weird2", objCBIndex++);
-
-	//Inner Sphere MiddleR
-	Build_Render_Item("sphere", XMMatrixScaling(2.f, 2.f, 2.f), XMMatrixTranslation(-30, 20, -76.5), "stone", objCBIndex++);
-	//Inner Sphere MiddleL
-	Build_Render_Item("sphere", XMMatrixScaling(2.f, 2.f, 2.f), XMMatrixTranslation(30, 20, -76.5), "stone", objCBIndex++);
-	
-	// Maze Ground
-	Build_Render_Item_Collision("box", XMMatrixScaling(150, 5.f, 200.f), XMMatrixTranslation(0, 2.5, 0), "grass", objCBIndex++);
-	// Front Wedge
-	Build_Render_Item_Collision("wedge", XMMatrixScaling(150, 5.f, 10.f), XMMatrixTranslation(0, 2.5, -105), "grass", objCBIndex++);
-	// Left Wedge
-	Build_Render_Item_Rotate("wedge", XMMatrixScaling(200, 5.f, 10.f), XMMatrixTranslation(-80, 2.5, 0), XMMatrixRotationY(1.5707963268), "grass", objCBIndex++);
-	// Right Wedge
-	Build_Render_Item_Rotate("wedge", XMMatrixScaling(200, 5.f, 10.f), XMMatrixTranslation(80, 2.5, 0), XMMatrixRotationY(4.7123889804), "grass", objCBIndex++);
-	//Maze 1 ( Back Left Wall )
-	Build_Render_Item_Collision("box", XMMatrixScaling(24.f, 10.f, 1.f), XMMatrixTranslation(-18.5, 10, -30.5), "wall", objCBIndex++);
-	//Maze 2 ( Back Right wall )
-	Build_Render_Item_Collision("box", XMMatrixScaling(24.f, 10.f, 1.f), XMMatrixTranslation(18.5, 10, -30.5), "wall", objCBIndex++);
-	//Maze 3 ( Outer Left Wall )
-	Build_Render_Item_Collision("box", XMMatrixScaling(1.f, 10.f, 46.f), XMMatrixTranslation(-30, 10, -54), "wall", objCBIndex++);
-	//Maze 4 ( Outer Right Wall )
-	Build_Render_Item_Collision("box", XMMatrixScaling(1.f, 10.f, 46.f), XMMatrixTranslation(30, 10, -54), "wall", objCBIndex++);
-	// Maze 5 ( front Left Wall )
-	Build_Render_Item_Collision("box", XMMatrixScaling(24.f, 10.f, 1.f), XMMatrixTranslation(-18.5, 10, -76.5), "wall", objCBIndex++);
-	//Maze 2 ( Front Right wall )
-	Build_Render_Item_Collision("box", XMMatrixScaling(24.f, 10.f, 1.f), XMMatrixTranslation(18.5, 10, -76.5), "wall", objCBIndex++);
-	//#5 - Difference of 4.5
-	Build_Render_Item_Collision("box", XMMatrixScaling(51.f, 10.f, 1.f), XMMatrixTranslation(0, 10, -71.5), "wall", objCBIndex++);
-	//#6 - Difference of 4.5
-	Build_Render_Item_Collision("box", XMMatrixScaling(1.f, 10.f, 14.f), XMMatrixTranslation(25, 10, -65), "wall", objCBIndex++);
-	//#7 - Difference of 4.5
-	Build_Render_Item_Collision("box", XMMatrixScaling(6.f, 10.f, 1.f), XMMatrixTranslation(22, 10, -58.5), "wall", objCBIndex++);
-	//#8
-	Build_Render_Item_Collision("box", XMMatrixScaling(1.f, 10.f, 8.f), XMMatrixTranslation(19.5, 10, -63), "wall", objCBIndex++);
-	//#9 - Difference of 4.5
-	Build_Render_Item_Collision("box", XMMatrixScaling(6.f, 10.f, 1.f), XMMatrixTranslation(17, 10, -66.5), "wall", objCBIndex++);
-	//#10
-	Build_Render_Item_Collision("box", XMMatrixScaling(1.f, 10.f, 8.f), XMMatrixTranslation(14.5, 10, -62), "wall", objCBIndex++);
-	//#11
-	Build_Render_Item_Collision("box", XMMatrixScaling(16.f, 10.f, 1.f), XMMatrixTranslation(22, 10, -53.5), "wall", objCBIndex++);
-	//#12
-	Build_Render_Item_Collision("box", XMMatrixScaling(12.f, 10.f, 1.f), XMMatrixTranslation(20, 10, -48.5), "wall", objCBIndex++);
-	//#13
-	Build_Render_Item_Collision("box", XMMatrixScaling(1.f, 10.f, 8.f), XMMatrixTranslation(26, 10, -45), "wall", objCBIndex++);
-	//--Addition1
-	Build_Render_Item_Collision("box", XMMatrixScaling(6.f, 10.f, 1.f), XMMatrixTranslation(24, 10, -36), "wall", objCBIndex++);
-	//--Addition2
-	Build_Render_Item_Collision("box", XMMatrixScaling(1.f, 10.f, 6.f), XMMatrixTranslation(20.5, 10, -38.5), "wall", objCBIndex++);
-	//--Addition3
-	Build_Render_Item_Collision("box", XMMatrixScaling(1.f, 10.f, 6.f), XMMatrixTranslation(20.5, 10, -33.5), "wall", objCBIndex++);
-	//#14
-	Build_Render_Item_Collision("box", XMMatrixScaling(1.f, 10.f, 14.f), XMMatrixTranslation(14.5, 10, -42), "wall", objCBIndex++);
-	//#15-
-	Build_Render_Item_Collision("box", XMMatrixScaling(6.f, 10.f, 1.f), XMMatrixTranslation(12, 10, -36), "wall", objCBIndex++);
-	//#16-
-	Build_Render_Item_Collision("box", XMMatrixScaling(1.f, 10.f, 13.5f), XMMatrixTranslation(9.5, 10, -42), "wall", objCBIndex++);
-	//#17
-	Build_Render_Item_Collision("box", XMMatrixScaling(8.f, 10.f, 1.f), XMMatrixTranslation(6, 10, -48.5), "wall", objCBIndex++);
-	//#18
-	Build_Render_Item_Collision("box", XMMatrixScaling(1.f, 10.f, 16.f), XMMatrixTranslation(2, 10, -46), "wall", objCBIndex++);
-	//#19
-	Build_Render_Item_Collision("box", XMMatrixScaling(8.f, 10.f, 1.f), XMMatrixTranslation(6, 10, -53.5), "wall", objCBIndex++);
-	//#20
-	Build_Render_Item_Collision("box", XMMatrixScaling(1.f, 10.f, 14.f), XMMatrixTranslation(9.5, 10, -60.), "wall", objCBIndex++);
-	//#21
-	Build_Render_Item_Collision("box", XMMatrixScaling(1.f, 10.f, 8.f), XMMatrixTranslation(4.5, 10, -63), "wall", objCBIndex++);
-	//#22
-	Build_Render_Item_Collision("box", XMMatrixScaling(6.f, 10.f, 1.f), XMMatrixTranslation(1, 10, -59.5), "wall", objCBIndex++);
-	//#23
-	Build_Render_Item_Collision("box", XMMatrixScaling(1.f, 10.f, 16.f), XMMatrixTranslation(-2.5, 10, -52.), "wall", objCBIndex++);
-	//#EXTRA
-	Build_Render_Item_Collision("box", XMMatrixScaling(10.f, 10.f, 1.f), XMMatrixTranslation(-3, 10, -38.5), "wall", objCBIndex++);
-	//#24
-	Build_Render_Item_Collision("box", XMMatrixScaling(5.f, 10.f, 1.f), XMMatrixTranslation(-5, 10, -53.5), "wall", objCBIndex++);
-	//#25
-	Build_Render_Item_Collision("box", XMMatrixScaling(1.f, 10.f, 10.f), XMMatrixTranslation(-7, 10, -49), "wall", objCBIndex++);
-	//#26
-	Build_Render_Item_Collision("box", XMMatrixScaling(5.f, 10.f, 1.f), XMMatrixTranslation(-9.5, 10, -44.5), "wall", objCBIndex++);
-	//#27
-	Build_Render_Item_Collision("box", XMMatrixScaling(1.f, 10.f, 10.f), XMMatrixTranslation(-12, 10, -49), "wall", objCBIndex++);
-	//#28
-	Build_Render_Item_Collision("box", XMMatrixScaling(12.f, 10.f, 1.f), XMMatrixTranslation(-19, 10, -38.5), "wall", objCBIndex++);
-	//#29 
-	Build_Render_Item_Collision("box", XMMatrixScaling(5.f, 10.f, 1.f), XMMatrixTranslation(-15, 10, -53.5), "wall", objCBIndex++);
-	//#30
-	Build_Render_Item_Collision("box", XMMatrixScaling(11.f, 10.f, 1.f), XMMatrixTranslation(-1, 10, -66.5), "wall", objCBIndex++);
-	//#31
-	Build_Render_Item_Collision("box", XMMatrixScaling(1.f, 10.f, 8.f), XMMatrixTranslation(-7, 10, -63), "wall", objCBIndex++);
-	//#32
-	Build_Render_Item_Collision("box", XMMatrixScaling(5.f, 10.f, 1.f), XMMatrixTranslation(-9.5, 10, -59.5), "wall", objCBIndex++);
-	//#33
-	Build_Render_Item_Collision("box", XMMatrixScaling(1.f, 10.f, 8.f), XMMatrixTranslation(-12, 10, -63), "wall", objCBIndex++);
-	//#34
-	Build_Render_Item_Collision("box", XMMatrixScaling(1.f, 10.f, 22.f), XMMatrixTranslation(-18, 10, -56), "wall", objCBIndex++);
-	//#35
-	Build_Render_Item_Collision("box", XMMatrixScaling(8.f, 10.f, 1.f), XMMatrixTranslation(-21.5, 10, -66.5), "wall", objCBIndex++);
-	//#36
-	Build_Render_Item_Collision("box", XMMatrixScaling(1.f, 10.f, 10.f), XMMatrixTranslation(-25, 10, -62), "wall", objCBIndex++);
-	//#37
-	Build_Render_Item_Collision("box", XMMatrixScaling(8.f, 10.f, 1.f), XMMatrixTranslation(-25.5, 10, -53.5), "wall", objCBIndex++);
-	//#38
-	Build_Render_Item_Collision("box", XMMatrixScaling(1.f, 10.f, 8.f), XMMatrixTranslation(-25, 10, -42), "wall", objCBIndex++);
-	//EXTRA2
-	Build_Render_Item_Collision("box", XMMatrixScaling(4.f, 10.f, 1.f), XMMatrixTranslation(-23.5, 10, -45.5), "wall", objCBIndex++);
-	//EXTRA3
-	Build_Render_Item_Collision("box", XMMatrixScaling(4.f, 10.f, 1.f), XMMatrixTranslation(-23.5, 10, -57.5), "wall", objCBIndex++);
-	//EXTRA 4
-	Build_Render_Item_Collision("box", XMMatrixScaling(1.f, 10.f, 4.f), XMMatrixTranslation(-25, 10, -48), "wall", objCBIndex++);
-	//#FINAL PIECE
-	Build_Render_Item_Collision("box", XMMatrixScaling(1.f, 10.f, 8.f), XMMatrixTranslation(-7.5, 10, -34), "wall", objCBIndex++);
-}
-
-
-void CastleApp::BuildCastle(UINT& objCBIndex)
-{
-	//Front wall Left
-	Build_Render_Item_Collision("box", XMMatrixScaling(20, 10.f, 2.f), XMMatrixTranslation(-12, 10, -23), "wall", objCBIndex++);
-	//Front wall Right
-	Build_Render_Item_Collision("box", XMMatrixScaling(20, 10.f, 2.f), XMMatrixTranslation(12, 10, -23), "wall", objCBIndex++);
-	
-	////Front wall Top
-	Build_Render_Item_Collision("box", XMMatrixScaling(4, 2.f, 2.f), XMMatrixTranslation(0, 14, -23), "wall", objCBIndex++);
-	////Back wall
-	Build_Render_Item_Collision("box", XMMatrixScaling(44.f, 10.f, 2.f), XMMatrixTranslation(0, 10, 23), "wall", objCBIndex++);
-	////Left wall
-	Build_Render_Item_Collision("box", XMMatrixScaling(2.f, 10.f, 48.f), XMMatrixTranslation(-23, 10, 0), "wall", objCBIndex++);
-	////Right wall
-	Build_Render_Item_Collision("box", XMMatrixScaling(2.f, 10.f, 48.f), XMMatrixTranslation(23, 10, 0), "wall", objCBIndex++);
-
-	//Inner front wall
-	Build_Render_Item_Collision("box", XMMatrixScaling(12.f, 10.f, 2.f), XMMatrixTranslation(14, 10, -19), "wall", objCBIndex++);/**/
-	Build_Render_Item_Collision("box", XMMatrixScaling(12.f, 10.f, 2.f), XMMatrixTranslation(-14, 10, -19), "wall", objCBIndex++);
-	//Inner back wall
-	Build_Render_Item_Collision("box", XMMatrixScaling(38.5f, 10.f, 2.f), XMMatrixTranslation(0, 10, 19), "wall", objCBIndex++);
-	//Inner left wall
-	Build_Render_Item_Collision("box", XMMatrixScaling(2.f, 10.f, 38.5f), XMMatrixTranslation(-19, 10, 0), "wall", objCBIndex++);
-	//Inner right wall
-	Build_Render_Item_Collision("box", XMMatrixScaling(2.f, 10.f, 38.5f), XMMatrixTranslation(19, 10, 0), "wall", objCBIndex++);
-
-	////Pyramid
-	Build_Render_Item_Rotate("pyramid", XMMatrixScaling(20.f, 20.f, 20.f), XMMatrixRotationY(0.7853981634), XMMatrixTranslation(0, 14.5, 0), "gold", objCBIndex++);
-
-	////Wedges
-	for (int i = 0; i < 44; ++i)
-	{
-		if (i % 2 == 0)
+void CastleApp::PlaceItem(Entity item, const ScenePlacement& placement, const SubmeshGeometry& mesh, Material* material)
+{
+	XMMATRIX world = XMMatrixScaling(placement.Scale[0], placement.Scale[1], placement.Scale[2]) *
+		XMMatrixRotationRollPitchYaw(placement.Rotation[0], placement.Rotation[1], placement.Rotation[2]) *
+		XMMatrixTranslation(placement.Translation[0], placement.Translation[1], placement.Translation[2]);
+
+	// Adding and removing components moves the item's others, so that comes first.
+	if (placement.Node == SceneNoNode)
+	{
+		if (mEntities.Has<Attachment>(item))
+			RemoveItemNode(item);
+	}
+	else
+	{
+		// Placed relative to the node; the next UpdateTransforms sets World, the bounds
+		// and the collider.
+		XMFLOAT4X4 local;
+		XMStoreFloat4x4(&local, world);
+		const std::uint32_t parent = mSceneNodes[placement.Node];
+		if (!mEntities.Has<Attachment>(item))
+		{
+			Attachment attachment;
+			attachment.Node = mTransforms.Add(parent, &local.m[0][0]);
+			mNodeItems.resize(std::max<size_t>(mNodeItems.size(), attachment.Node + 1));
+			mNodeItems[attachment.Node] = item;
+			mEntities.Add(item, attachment);
+		}
+		else
 		{
-			//Wedge front
-			Build_Render_Item("wedge", XMMatrixScaling(1.f, 1.f, 1.f), XMMatrixTranslation(-21 + i, 15.5, -23), "weird1", objCBIndex++);
-			//Wedge back
-			Build_Render_Item_Rotate("wedge", XMMatrixScaling(1.f, 1.f, 1.f), XMMatrixTranslation(-21 + i, 15.5, 23),  XMMatrixRotationY(3.1415926536), "weird1", objCBIndex++);
-			////Wedge left
-			Build_Render_Item_Rotate("wedge", XMMatrixScaling(1.f, 1.f, 1.f), XMMatrixTranslation(-23, 15.5, -21 + i), XMMatrixRotationY(1.5707963268),  "weird1", objCBIndex++);
-			//Wedge right
-			Build_Render_Item_Rotate("wedge", XMMatrixScaling(1.f, 1.f, 1.f), XMMatrixTranslation(23, 15.5, -21 + i), XMMatrixRotationY(4.7123889804),  "weird1", objCBIndex++);
+			const std::uint32_t node = mEntities.Get<Attachment>(item).Node;
+			mTransforms.SetParent(node, parent);
+			mTransforms.SetLocal(node, &local.m[0][0]);
 		}
+	}
+
+	//Setting the collider's bounding box center and extents for use with directXCollision.
+	if (placement.Flags & ScenePlacementCollide)
+	{
+		Collider collider;
+		collider.Box.Center = XMFLOAT3(placement.Translation);
+		collider.Box.Extents = XMFLOAT3(0.5f * placement.Scale[0], 0.5f * placement.Scale[1], 0.5f * placement.Scale[2]);
+		mEntities.Add(item, collider);
+	}
+	else
+	{
+		mEntities.Remove<Collider>(item);
+	}
+
+	Transform& transform = mEntities.Get<Transform>(item);
+	if (placement.Node == SceneNoNode)
+		XMStoreFloat4x4(&transform.World, world);
+	transform.NumFramesDirty = gNumFrameResources;
+
+	Renderable& ri = mEntities.Get<Renderable>(item);
+	ri.Mat = material;
+	ri.Geo = mGeometries["boxGeo"].get();
+	ri.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	ri.IndexCount = mesh.IndexCount;
+	ri.StartIndexLocation = mesh.StartIndexLocation;
+	ri.BaseVertexLocation = mesh.BaseVertexLocation;
+
+	mEntities.Get<LightList>(item).Dirty = true;
+}
+
+void CastleApp::RemoveItemNode(Entity item)
+{
+	const std::uint32_t node = mEntities.Get<Attachment>(item).Node;
+	mNodeItems[node] = Entity();
+	mTransforms.Remove(node);
+	mEntities.Remove<Attachment>(item);
+}
+
+void CastleApp::BuildSceneNodes()
+{
+	mSceneNodes.clear();
+	for (UINT i = 0; i < mScene.NodeCount(); ++i)
+	{
+		const SceneNode& node = mScene.Nodes()[i];
+		XMFLOAT4X4 local;
+		XMStoreFloat4x4(&local, NodeMatrix(node));
+		const std::uint32_t parent = node.Parent != SceneNoNode ? mSceneNodes[node.Parent] : TransformHierarchy::NoNode;
+		mSceneNodes.push_back(mTransforms.Add(parent, &local.m[0][0]));
+	}
+	FindDrawbridge();
+}
+
+UINT CastleApp::FindSceneNode(const SceneFile& scene, const char* name)const
+{
+	for (UINT i = 0; i < scene.NodeCount(); ++i)
+	{
+		if (strcmp(scene.Name(scene.Nodes()[i].Name), name) == 0)
+			return i;
+	}
+	return SceneNoNode;
+}
+
+void CastleApp::FindDrawbridge()
+{
+	// The rotator follows the node through reloads, and goes if the node does.
+	const UINT node = FindSceneNode(mScene, DrawbridgeNodeName);
+	if (node == SceneNoNode)
+	{
+		if (mEntities.Alive(mDrawbridge))
+			mEntities.Destroy(mDrawbridge);
+		mDrawbridge = Entity();
+		return;
+	}
 
+	if (!mEntities.Alive(mDrawbridge))
+	{
+		Rotator rotator;
+		rotator.OpenAngle = XM_PIDIV2;
+		rotator.Speed = DrawbridgeSpeed;
+		rotator.Reach = DrawbridgeReach;
+		mDrawbridge = mEntities.Create(rotator);
 	}
+	mEntities.Get<Rotator>(mDrawbridge).SceneNode = node;
+}
+
+void CastleApp::AnimateRotators(const GameTimer& gt)
+{
+	mEntities.ForEach<Rotator>([&](Entity, Rotator& rotator)
+	{
+		// Opened while the camera is near the node, closed again once it leaves.
+		const std::uint32_t node = mSceneNodes[rotator.SceneNode];
+		const float* world = mTransforms.World(node);
+		const XMVECTOR hinge = XMVectorSet(world[12], world[13], world[14], 1.0f);
+		const float distance = XMVectorGetX(XMVector3Length(m_Camera.GetPosition() - hinge));
+		const float target = distance < rotator.Reach ? rotator.OpenAngle : 0.0f;
+		if (rotator.Angle == target)
+			return;
+
+		const float step = rotator.Speed * gt.DeltaTime();
+		rotator.Angle = target > rotator.Angle ?
+			std::min(target, rotator.Angle + step) : std::max(target, rotator.Angle - step);
+
+		// Turning about -x swings the top of the drawbridge out, away from the castle.
+		XMFLOAT4X4 local;
+		XMStoreFloat4x4(&local, XMMatrixRotationX(-rotator.Angle) * NodeMatrix(mScene.Nodes()[rotator.SceneNode]));
+		mTransforms.SetLocal(node, &local.m[0][0]);
+	});
+}
 
-	//Outer Cylinder Front Left
-	Build_Render_Item("cylinder", XMMatrixScaling(4.f, 15.f, 4.f), XMMatrixTranslation(-23, 12.5, -23), "weird2", objCBIndex++);
-	//Outer Cylinder Front Right
-	Build_Render_Item("cylinder", XMMatrixScaling(4.f, 15.f, 4.f), XMMatrixTranslation(23, 12.5, -23), "weird2", objCBIndex++);
-	//Outer Cylinder Back Left
-	Build_Render_Item("cylinder", XMMatrixScaling(4.f, 15.f, 4.f), XMMatrixTranslation(-23, 12.5, 23), "weird2", objCBIndex++);
-	//Outer Cylinder Back Right
-	Build_Render_Item("cylinder", XMMatrixScaling(4.f, 15.f, 4.f), XMMatrixTranslation(23, 12.5, 23), "weird2", objCBIndex++);
-
-
-	//Inner Cylinder Front Left
-	Build_Render_Item("cylinder", XMMatrixScaling(2.f, 15.f, 2.f), XMMatrixTranslation(-19, 12.5, -19), "weird2", objCBIndex++);
-	//Inner Cylinder Front Right
-	Build_Render_Item("cylinder", XMMatrixScaling(2.f, 15.f, 2.f), XMMatrixTranslation(19, 12.5, -19), "weird2", objCBIndex++);
-	//Inner Cylinder Front MiddleR
-	Build_Render_Item("cylinder", XMMatrixScaling(3.f, 15.f, 3.f), XMMatrixTranslation(-7, 12.5, -19), "weird2", objCBIndex++);
-	//Inner Cylinder Front MiddleL
-	Build_Render_Item("cylinder", XMMatrixScaling(3.f, 15.f, 3.f), XMMatrixTranslation(7, 12.5, -19), "weird2", objCBIndex++);
-	//Inner Cylinder Back Left
-	Build_Render_Item("cylinder", XMMatrixScaling(2.f, 15.f, 2.f), XMMatrixTranslation(-19, 12.5, 19), "weird2", objCBIndex++);
-	//Inner Cylinder Back Right
-	Build_Render_Item("cylinder", XMMatrixScaling(2.f, 15.f, 2.f), XMMatrixTranslation(19, 12.5, 19), "weird2", objCBIndex++);
-
-
-
-	//Outer cone Front Left
-	Build_Render_Item("cone", XMMatrixScaling(4.f, 6.f, 4.f), XMMatrixTranslation(-23, 22, 23), "stone", objCBIndex++);
-	//Outer cone Front Right
-	Build_Render_Item("cone", XMMatrixScaling(4.f, 6.f, 4.f), XMMatrixTranslation(23, 22, -23), "stone", objCBIndex++);
-	//Outer cone Back Left
-	Build_Render_Item("cone", XMMatrixScaling(4.f, 6.f, 4.f), XMMatrixTranslation(-23, 22, -23), "stone", objCBIndex++);
-	//Outer cone Back Right
-	Build_Render_Item("cone", XMMatrixScaling(4.f, 6.f, 4.f), XMMatrixTranslation(23, 22, 23), "stone", objCBIndex++);
-
-	//Inner Sphere Front Left
-	Build_Render_Item("sphere", XMMatrixScaling(2.f, 2.f, 2.f), XMMatrixTranslation(-19, 20, -19), "weird1", objCBIndex++);
-	//Inner Sphere Front Right
-	Build_Render_Item("sphere", XMMatrixScaling(2.f, 2.f, 2.f), XMMatrixTranslation(19, 20, -19), "weird1", objCBIndex++);
-	//Inner Sphere MiddleR
-	Build_Render_Item("sphere", XMMatrixScaling(2.f, 2.f, 2.f), XMMatrixTranslation(-7, 20, -19), "gold", objCBIndex++);
-	//Inner Sphere MiddleL
-	Build_Render_Item("sphere", XMMatrixScaling(2.f, 2.f, 2.f), XMMatrixTranslation(7, 20, -19), "gold", objCBIndex++);
-	//Inner Sphere Back Left
-	Build_Render_Item("sphere", XMMatrixScaling(2.f, 2.f, 2.f), XMMatrixTranslation(-19, 20, 19), "weird1", objCBIndex++);
-	//Inner Sphere Back Right
-	Build_Render_Item("sphere", XMMatrixScaling(2.f, 2.f, 2.f), XMMatrixTranslation(19, 20, 19), "weird1", objCBIndex++);
-
-	////Front Gate
-	Build_Render_Item_Rotate("box", XMMatrixScaling(4.f, 8.f, 2.f), XMMatrixTranslation(0, 9, -23), XMMatrixRotationY(3.14159),  "weird3", objCBIndex++);
-	//Ramp
-	Build_Render_Item("wedge", XMMatrixScaling(6.f, 5.f, 8.f), XMMatrixTranslation(0, 2.5, -30),  "weird1", objCBIndex++);
-	//Torch(s)
-	//Torch(s)
-	Build_Render_Item("cylinder", XMMatrixScaling(1.f, 1.f, 1.f), XMMatrixTranslation(3, 5.5, -25),  "weird3", objCBIndex++);
-	Build_Render_Item("cylinder", XMMatrixScaling(1.f, 1.f, 1.f), XMMatrixTranslation(-3, 5.5, -25),  "weird3", objCBIndex++);
+void CastleApp::UpdateTransforms()
+{
+	// Only the nodes that moved, and those under them, come back changed.
+	mTransforms.Update();
+	for (std::uint32_t node : mTransforms.Changed())
+	{
+		const Entity item = node < mNodeItems.size() ? mNodeItems[node] : Entity();
+		if (!mEntities.Alive(item))
+			continue;
+
+		Transform& transform = mEntities.Get<Transform>(item);
+		memcpy(&transform.World, mTransforms.World(node), sizeof(transform.World));
+		transform.NumFramesDirty = gNumFrameResources;
+		mEntities.Get<LightList>(item).Dirty = true;
+		UpdateWorldBounds(mEntities.Get<Renderable>(item), transform, mEntities.Get<Bounds>(item));
+
+		// A collider is the box around its item's turned unit box.
+		if (mEntities.Has<Collider>(item))
+		{
+			BoundingBox unit(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.5f, 0.5f, 0.5f));
+			unit.Transform(mEntities.Get<Collider>(item).Box, XMLoadFloat4x4(&transform.World));
+		}
+	}
+}
+
+UINT CastleApp::AllocateObjCBIndex()
+{
+	if (mFreeObjCBIndices.empty())
+		return mObjectCBCount++;
+
+	UINT index = mFreeObjCBIndices.back();
+	mFreeObjCBIndices.pop_back();
+	return index;
+}
+
+void CastleApp::BuildPlacements()
+{
+	ArenaVector<const SubmeshGeometry*> meshes(mLoadArena);
+	ArenaVector<Material*> materials(mLoadArena);
+	std::string error;
+	if (!ResolveSceneNames(mScene, meshes, materials, error))
+		throw DxException(E_INVALIDARG, L"BuildPlacements: " + AnsiToWString(error), AnsiToWString(__FILE__), __LINE__);
+
+	BuildSceneNodes();
+
+	mPlacedItems.clear();
+	mPlacedItems.reserve(mScene.PlacementCount());
+	for (UINT i = 0; i < mScene.PlacementCount(); ++i)
+	{
+		const ScenePlacement& placement = mScene.Placements()[i];
+
+		const Entity item = CreateItem(RenderLayer::Opaque);
+		PlaceItem(item, placement, *meshes[placement.Mesh], materials[placement.Material]);
+		mPlacedItems.push_back(item);
+	}
+	UpdateTransforms();
 }
 
 void CastleApp::Build_Render_Items()
 {
+	// An item drawing a whole submesh with one material.
+	auto addItem = [&](RenderLayer layer, const char* material, const char* geometry, const char* submesh,
+		D3D12_PRIMITIVE_TOPOLOGY primitiveType)
+	{
+		const Entity item = CreateItem(layer);
+		Renderable& ri = mEntities.Get<Renderable>(item);
+		ri.Mat = mMaterials[material].get();
+		ri.Geo = mGeometries[geometry].get();
+		ri.PrimitiveType = primitiveType;
+		ri.IndexCount = ri.Geo->DrawArgs[submesh].IndexCount;
+		ri.StartIndexLocation = ri.Geo->DrawArgs[submesh].StartIndexLocation;
+		ri.BaseVertexLocation = ri.Geo->DrawArgs[submesh].BaseVertexLocation;
+		return item;
+	};
+
 	//Build the water
-	UINT objCBIndex = 0;
-	auto wavesRitem = std::make_unique<RenderItem>();
-	wavesRitem->World = MathHelper::Identity4x4();
-	XMStoreFloat4x4(&wavesRitem->TexTransform, XMMatrixScaling(5.0f, 5.0f, 1.0f));
-	wavesRitem->ObjCBIndex = objCBIndex;
-	wavesRitem->Mat = mMaterials["water"].get();
-	wavesRitem->Geo = mGeometries["waterGeo"].get();
-	wavesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	wavesRitem->IndexCount = wavesRitem->Geo->DrawArgs["grid"].IndexCount;
-	wavesRitem->StartIndexLocation = wavesRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-	wavesRitem->BaseVertexLocation = wavesRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
-
-	mWavesRitem = wavesRitem.get();
-
-	mRitemLayer[(int)RenderLayer::Transparent].push_back(wavesRitem.get());
+	mWavesItem = addItem(RenderLayer::Transparent, "water", "waterGeo", "grid", D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	XMStoreFloat4x4(&mEntities.Get<Transform>(mWavesItem).TexTransform, XMMatrixScaling(5.0f, 5.0f, 1.0f));
+
 	//Build the land
-	auto gridRitem = std::make_unique<RenderItem>();
-	gridRitem->World = MathHelper::Identity4x4();
-	XMStoreFloat4x4(&gridRitem->TexTransform, XMMatrixScaling(5.0f, 5.0f, 1.0f));
-	objCBIndex++;
-	gridRitem->ObjCBIndex = objCBIndex;
-	gridRitem->Mat = mMaterials["grass"].get();
-	gridRitem->Geo = mGeometries["landGeo"].get();
-	gridRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
-	gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-	gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
-
-	mRitemLayer[(int)RenderLayer::Transparent].push_back(gridRitem.get());
-	
+	const Entity land = addItem(RenderLayer::Transparent, "grass", "landGeo", "grid", D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	XMStoreFloat4x4(&mEntities.Get<Transform>(land).TexTransform, XMMatrixScaling(5.0f, 5.0f, 1.0f));
 
+	//Build the ground, castle and maze from the scene.
+	BuildPlacements();
 
-	//Build Ground & Grass
-	Build_Render_Item("grid", XMMatrixScaling(1, 1, 1), XMMatrixTranslation(0.0f, 10.f, 0.0f), "stone", objCBIndex++);
-	//Ground
-	//Build_Render_Item("truncatedpyramid", XMMatrixScaling(70, 5.f, 70.f), XMMatrixTranslation(0, 2.5, 0), "grass", objCBIndex++);
-	//Grass
-	Build_Render_Item("truncatedcone", XMMatrixScaling(80, 2.f, 80.f), XMMatrixTranslation(0, 1, 0), "grass", objCBIndex++);
-	
-	//Build castle---------------------------------------------------
-	BuildCastle(objCBIndex);
-	//Finished Building Castle----------------------------------------------------------
-	BuildMaze(objCBIndex);
-	////// All the render items are opaque.
-	
-	// All the render items are opaque.
-	//Our application will maintain lists of render items based on how they need to be
-	//drawn; that is, render items that need different PSOs will be kept in different lists.Layer::AlphaTested].push_back(boxRitem.get());*/
-	
 	//Building Trees
-	auto treeSpritesRitem = std::make_unique<RenderItem>();
-	treeSpritesRitem->World = MathHelper::Identity4x4();
-	treeSpritesRitem->ObjCBIndex = objCBIndex;
-	treeSpritesRitem->Mat = mMaterials["treeSprites"].get();
-	treeSpritesRitem->Geo = mGeometries["treeSpritesGeo"].get();
 	//step2
-	treeSpritesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
-	treeSpritesRitem->IndexCount = treeSpritesRitem->Geo->DrawArgs["points"].IndexCount;
-	treeSpritesRitem->StartIndexLocation = treeSpritesRitem->Geo->DrawArgs["points"].StartIndexLocation;
-	treeSpritesRitem->BaseVertexLocation = treeSpritesRitem->Geo->DrawArgs["points"].BaseVertexLocation;
-
-	mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites].push_back(treeSpritesRitem.get());
+	addItem(RenderLayer::AlphaTestedTreeSprites, "treeSprites", "treeSpritesGeo", "points", D3D_PRIMITIVE_TOPOLOGY_POINTLIST);
 
 	//Building Lightning
-	auto lightningSpritesRitem = std::make_unique<RenderItem>();
-	lightningSpritesRitem->World = MathHelper::Identity4x4();
-	lightningSpritesRitem->ObjCBIndex = objCBIndex;
-	lightningSpritesRitem->Mat = mMaterials["rock1"].get();
-	lightningSpritesRitem->Geo = mGeometries["lightningSpritesGeo"].get();
-	//step2
-	lightningSpritesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
-	lightningSpritesRitem->IndexCount = lightningSpritesRitem->Geo->DrawArgs["points"].IndexCount;
-	lightningSpritesRitem->StartIndexLocation = lightningSpritesRitem->Geo->DrawArgs["points"].StartIndexLocation;
-	lightningSpritesRitem->BaseVertexLocation = lightningSpritesRitem->Geo->DrawArgs["points"].BaseVertexLocation;
+	addItem(RenderLayer::AlphaTestedTreeSprites, "rock1", "lightningSpritesGeo", "points", D3D_PRIMITIVE_TOPOLOGY_POINTLIST);
+}
+
+void CastleApp::BakeStaticGeometry()
+{
+	PROFILE_SCOPE("BakeStaticGeometry");
+
+	// The castle and maze primitives: opaque items placed from the shared shape mesh.
+	static_assert(sizeof(Vertex) == sizeof(StaticVertex), "StaticVertex must match Vertex");
+	MeshGeometry* shapes = mGeometries["boxGeo"].get();
+	assert(shapes->IndexFormat == DXGI_FORMAT_R16_UINT);
+
+	// Rotators move their nodes, so what hangs under one stays a separate item.
+	ArenaVector<std::uint32_t> moving(mLoadArena);
+	mEntities.ForEach<Rotator>([&](Entity, const Rotator& rotator) { moving.push_back(mSceneNodes[rotator.SceneNode]); });
+
+	const XMFLOAT4X4 identity = MathHelper::Identity4x4();
+	ArenaVector<Entity> baked(mLoadArena);
+	ArenaVector<Material*> materials(mLoadArena);
+	ArenaVector<StaticInstance> instances(mLoadArena);
+	// Room for every item, so the long lists do not leave copies behind in the arena.
+	baked.reserve(mEntities.Count<Renderable>());
+	instances.reserve(mEntities.Count<Renderable>());
+	mEntities.ForEach<Renderable, Transform>([&](Entity item, const Renderable& ri, const Transform& transform)
+	{
+		if (ri.Layer != RenderLayer::Opaque || ri.Geo != shapes || memcmp(&transform.TexTransform, &identity, sizeof(identity)) != 0)
+			return;
+
+		if (mEntities.Has<Attachment>(item))
+		{
+			const std::uint32_t node = mEntities.Get<Attachment>(item).Node;
+			if (std::any_of(moving.begin(), moving.end(), [&](std::uint32_t m) { return mTransforms.IsUnder(node, m); }))
+				return;
+		}
+
+		auto material = std::find(materials.begin(), materials.end(), ri.Mat);
+		if (material == materials.end())
+			material = materials.insert(materials.end(), ri.Mat);
+
+		StaticInstance instance;
+		instance.Vertices = static_cast<const StaticVertex*>(shapes->VertexBufferCPU->GetBufferPointer());
+		instance.Indices = static_cast<const std::uint16_t*>(shapes->IndexBufferCPU->GetBufferPointer()) + ri.StartIndexLocation;
+		instance.IndexCount = ri.IndexCount;
+		instance.BaseVertex = ri.BaseVertexLocation;
+		memcpy(instance.World, &transform.World, sizeof(instance.World));
+		instance.Material = (std::uint32_t)(material - materials.begin());
+		instances.push_back(instance);
+		baked.push_back(item);
+	});
+
+	if (instances.empty())
+		return;
+
+	// Reuse the bake of an earlier run if nothing it was made from has changed.
+	StaticBatch batch;
+	const std::uint64_t key = StaticBatch::MakeKey(instances.data(), (std::uint32_t)instances.size(), StaticBatchCellSize);
+	const std::wstring path = std::wstring(CacheDirectory) + L"\\" + AnsiToWString(StaticBatch::FileName(key));
+	std::ifstream fin(path, std::ios::binary);
+	if (!fin || !batch.Read(fin, key))
+	{
+		batch.Build(instances.data(), (std::uint32_t)instances.size(), StaticBatchCellSize);
+
+		// Written aside and moved into place, like the shader cache's blobs.  A failed
+		// write only costs a bake next time.
+		CreateDirectoryW(CacheDirectory, nullptr);
+		const std::wstring temp = path + L".tmp";
+		std::ofstream fout(temp, std::ios::binary | std::ios::trunc);
+		const bool written = batch.Write(fout, key);
+		fout.close();
+		if (!written || !fout || !MoveFileExW(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+			DeleteFileW(temp.c_str());
+	}
+
+	const UINT vbByteSize = (UINT)(batch.Vertices().size() * sizeof(StaticVertex));
+	const UINT ibByteSize = (UINT)(batch.Indices().size() * sizeof(std::uint32_t));
+
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "staticGeo";
+
+	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
+	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), batch.Vertices().data(), vbByteSize);
+
+	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
+	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), batch.Indices().data(), ibByteSize);
+
+	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+		mCommandList.Get(), batch.Vertices().data(), vbByteSize, geo->VertexBufferUploader);
+
+	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+		mCommandList.Get(), batch.Indices().data(), ibByteSize, geo->IndexBufferUploader);
+
+	geo->VertexByteStride = sizeof(Vertex);
+	geo->VertexBufferByteSize = vbByteSize;
+	geo->IndexFormat = DXGI_FORMAT_R32_UINT;
+	geo->IndexBufferByteSize = ibByteSize;
+
+	// Replace the baked items with one item per merged draw.  A baked item's collider
+	// stays behind as an entity of its own.
+	for (Entity item : baked)
+	{
+		if (mEntities.Has<Attachment>(item))
+			RemoveItemNode(item);
+		if (mEntities.Has<Collider>(item))
+		{
+			const Collider collider = mEntities.Get<Collider>(item);
+			mEntities.Create(collider);
+		}
+		mEntities.Destroy(item);
+	}
+	mPlacedItems.clear();
+
+	for (size_t i = 0; i < batch.Draws().size(); ++i)
+	{
+		const StaticDraw& draw = batch.Draws()[i];
+
+		SubmeshGeometry submesh;
+		submesh.IndexCount = draw.IndexCount;
+		submesh.StartIndexLocation = draw.StartIndex;
+		submesh.BaseVertexLocation = (INT)draw.BaseVertex;
+		BoundingBox::CreateFromPoints(submesh.Bounds,
+			XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(draw.BoundsMin)),
+			XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(draw.BoundsMax)));
+		geo->DrawArgs["batch" + std::to_string(i)] = submesh;
+
+		Renderable& ri = mEntities.Get<Renderable>(CreateItem(RenderLayer::Opaque));
+		ri.Mat = materials[draw.Material];
+		ri.Geo = geo.get();
+		ri.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+		ri.IndexCount = submesh.IndexCount;
+		ri.StartIndexLocation = submesh.StartIndexLocation;
+		ri.BaseVertexLocation = submesh.BaseVertexLocation;
+	}
+
+	mGeometries[geo->Name] = std::move(geo);
+
+	// Object constants are indexed by item; close the gaps the baked items left.
+	mObjectCBCount = 0;
+	mFreeObjCBIndices.clear();
+	mEntities.ForEach<Renderable>([this](Entity, Renderable& ri) { ri.ObjCBIndex = mObjectCBCount++; });
+}
+
+void CastleApp::BuildWorldBounds()
+{
+	mEntities.ForEach<Renderable, Transform, Bounds>([this](Entity, const Renderable& ri, const Transform& transform, Bounds& bounds)
+	{
+		UpdateWorldBounds(ri, transform, bounds);
+	});
+
+	// The waves' vertices live in the frame resources; use the extent of the grid.
+	BoundingBox waves(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.5f * mWaves->Width(), 1.0f, 0.5f * mWaves->Depth()));
+	Bounds& wavesBounds = mEntities.Get<Bounds>(mWavesItem);
+	waves.Transform(wavesBounds.WorldBox, XMLoadFloat4x4(&mEntities.Get<Transform>(mWavesItem).World));
+	BoundingSphere::CreateFromBoundingBox(wavesBounds.WorldBounds, wavesBounds.WorldBox);
+}
+
+void CastleApp::UpdateWorldBounds(const Renderable& ri, const Transform& transform, Bounds& bounds)
+{
+	const MeshGeometry* geo = ri.Geo;
+	if (geo->VertexBufferCPU == nullptr || geo->IndexBufferCPU == nullptr || ri.IndexCount == 0)
+		return;
+
+	// Every vertex format here starts with its position.
+	const BYTE* vertices = static_cast<const BYTE*>(geo->VertexBufferCPU->GetBufferPointer());
+	const BYTE* indices = static_cast<const BYTE*>(geo->IndexBufferCPU->GetBufferPointer());
 
-	mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites].push_back(lightningSpritesRitem.get());
-	mAllRitems.push_back(std::move(wavesRitem));
-	mAllRitems.push_back(std::move(gridRitem));
-	mAllRitems.push_back(std::move(treeSpritesRitem));
-	mAllRitems.push_back(std::move(lightningSpritesRitem));
+	XMVECTOR vMin = XMVectorReplicate(+MathHelper::Infinity);
+	XMVECTOR vMax = XMVectorReplicate(-MathHelper::Infinity);
+	for (UINT k = ri.StartIndexLocation; k < ri.StartIndexLocation + ri.IndexCount; ++k)
+	{
+		UINT index = geo->IndexFormat == DXGI_FORMAT_R16_UINT ?
+			reinterpret_cast<const std::uint16_t*>(indices)[k] : reinterpret_cast<const std::uint32_t*>(indices)[k];
+
+		XMFLOAT3 pos;
+		memcpy(&pos, vertices + (size_t)(index + ri.BaseVertexLocation) * geo->VertexByteStride, sizeof(pos));
+
+		XMVECTOR p = XMLoadFloat3(&pos);
+		vMin = XMVectorMin(vMin, p);
+		vMax = XMVectorMax(vMax, p);
+	}
+
+	BoundingBox box;
+	BoundingBox::CreateFromPoints(box, vMin, vMax);
+	box.Transform(bounds.WorldBox, XMLoadFloat4x4(&transform.World));
+	BoundingSphere::CreateFromBoundingBox(bounds.WorldBounds, bounds.WorldBox);
+}
+
+PipelineCache::Key CastleApp::LayerPso(RenderLayer layer, UINT lightVariant)const
+{
+	const auto& keys = mLayerPsos[(int)layer];
+	return keys[lightVariant] != 0 ? keys[lightVariant] : keys[ShaderPermutation::LargestLightVariant()];
+}
+
+void CastleApp::BuildDrawLists()
+{
+	PROFILE_SCOPE("BuildDrawLists");
+
+	// Each list has room for every item, so none has to grow.
+	const std::uint32_t itemCount = mEntities.Count<Renderable>();
+	for (DrawList& list : mDrawLists)
+	{
+		list.Items = mFrameArena.AllocateArray<const Renderable*>(itemCount);
+		list.Count = 0;
+	}
+
+	// Opaque items have tight bounds; skip the ones the camera cannot see.  The water
+	// and land were the first items made, so the water is still drawn before the land.
+	mEntities.ForEach<Renderable, Bounds>([this](Entity, const Renderable& ri, const Bounds& bounds)
+	{
+		if (ri.Layer == RenderLayer::Opaque && bounds.WorldBounds.Radius > 0.0f && !mCameraFrustum.Intersects(bounds.WorldBox))
+			return;
+		DrawList& list = mDrawLists[(int)ri.Layer];
+		list.Items[list.Count++] = &ri;
+	});
 }
 
-void CastleApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
+void CastleApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, RenderLayer layer)
 {
+	PROFILE_SCOPE("DrawRenderItems");
+
+	const DrawList& ritems = mDrawLists[(int)layer];
+	ID3D12PipelineState* currentPso = nullptr;
+
 	UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
 	UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
 
@@ -2170,23 +3119,26 @@ void CastleApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::v
 	auto matCB = mCurrFrameResource->MaterialCB->Resource();
 
 	// For each render item...
-	for (size_t i = 0; i < ritems.size(); ++i)
+	for (UINT i = 0; i < ritems.Count; ++i)
 	{
-		auto ri = ritems[i];
+		auto ri = ritems.Items[i];
+
+		// Items of a layer differ only in light variant; switch when it changes.
+		ID3D12PipelineState* pso = mPipelines->Get(LayerPso(layer, ri->LightVariant));
+		if (pso != currentPso)
+		{
+			cmdList->SetPipelineState(pso);
+			currentPso = pso;
+		}
 
 		cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
 		cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
 		//step3
 		cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
-		
-		//Offset to the CBV in the descriptor heap for this object and for this frame resource.
-		CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-		tex.Offset(ri->Mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
 
 		D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex * objCBByteSize;
 		D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB->GetGPUVirtualAddress() + ri->Mat->MatCBIndex * matCBByteSize;
 
-		cmdList->SetGraphicsRootDescriptorTable(0, tex);
 		cmdList->SetGraphicsRootConstantBufferView(1, objCBAddress);
 		cmdList->SetGraphicsRootConstantBufferView(3, matCBAddress);
 
@@ -1,6 +1,7 @@
 #include "FrameResource.h"
 
-FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT waveVertCount)
+FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT waveVertCount,
+    UINT clusterCount, UINT clusterLightIndexCount)
 {
     ThrowIfFailed(device->CreateCommandAllocator(
         D3D12_COMMAND_LIST_TYPE_DIRECT,
@@ -10,8 +11,12 @@ FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCo
     PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
     MaterialCB = std::make_unique<UploadBuffer<MaterialConstants>>(device, materialCount, true);
     ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
+    ObjectCapacity = objectCount;
 
     WavesVB = std::make_unique<UploadBuffer<Vertex>>(device, waveVertCount, false);
+
+    ClusterRanges = std::make_unique<UploadBuffer<ClusterRange>>(device, clusterCount, false);
+    ClusterLightIndices = std::make_unique<UploadBuffer<UINT>>(device, clusterLightIndexCount, false);
 }
 
 FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount)
@@ -24,6 +29,7 @@ FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCo
 	PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
 	MaterialCB = std::make_unique<UploadBuffer<MaterialConstants>>(device, materialCount, true);
 	ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
+	ObjectCapacity = objectCount;
 
 }
 
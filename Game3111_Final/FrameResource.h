@@ -3,11 +3,20 @@
 #include "../Common/d3dUtil.h"
 #include "../Common/MathHelper.h"
 #include "../Common/UploadBuffer.h"
+#include "../Common/LightClusters.h"
 
 struct ObjectConstants
 {
     DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
 	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+
+	// The point and spot lights that reach the object, as indices into the light
+	// buffer: PointLightCount point lights, then SpotLightCount spots.
+	UINT PointLightCount = 0;
+	UINT SpotLightCount = 0;
+	UINT ObjectPad0 = 0;
+	UINT ObjectPad1 = 0;
+	UINT LocalLights[MaxObjectLights] = {};
 };
 
 struct PassConstants
@@ -34,11 +43,19 @@ struct PassConstants
 	float gFogRange = 300.0f;
 	DirectX::XMFLOAT2 cbPerObjectPad2;
 
-    // Indices [0, NUM_DIR_LIGHTS) are directional lights;
-    // indices [NUM_DIR_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHTS) are point lights;
-    // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
-    // are spot lights for a maximum of MaxLights per object.
-    Light Lights[MaxLights];
+	// The light grid.  Cluster lists index Lights[ClusterLightBase + i]; indices from
+	// ClusterSpotStart on are spot lights.
+	UINT ClusterCountX = 1;
+	UINT ClusterCountY = 1;
+	UINT ClusterCountZ = 1;
+	UINT ClusterLightBase = 0;
+	float ClusterSliceScale = 0.0f;
+	float ClusterSliceBias = 0.0f;
+	UINT ClusterSpotStart = 0;
+
+	// The lights themselves are in FrameResource::Lights, packed by type; the first
+	// DirLightCount are directional.
+	UINT DirLightCount = 0;
 };
 
 struct Vertex
@@ -55,7 +72,8 @@ struct FrameResource
 {
 public:
     
-    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT waveVertCount);
+    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT waveVertCount,
+        UINT clusterCount, UINT clusterLightIndexCount);
 	FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount);
     FrameResource(const FrameResource& rhs) = delete;
     FrameResource& operator=(const FrameResource& rhs) = delete;
@@ -71,12 +89,23 @@ public:
     std::unique_ptr<UploadBuffer<PassConstants>> PassCB = nullptr;
     std::unique_ptr<UploadBuffer<MaterialConstants>> MaterialCB = nullptr;
     std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
+    // Object constants ObjectCB has room for; the app grows it past objectCount.
+    UINT ObjectCapacity = 0;
 
     // We cannot update a dynamic vertex buffer until the GPU is done processing
     // the commands that reference it.  So each frame needs their own.
     std::unique_ptr<UploadBuffer<Vertex>> WavesVB = nullptr;
 
-    // Fence value to mark commands up to this fence point.  This lets us
-    // check if these frame resources are still in use by the GPU.
-    UINT64 Fence = 0;
+    // The light grid's ranges and index list, rebuilt every frame.
+    std::unique_ptr<UploadBuffer<ClusterRange>> ClusterRanges = nullptr;
+    std::unique_ptr<UploadBuffer<UINT>> ClusterLightIndices = nullptr;
+
+    // Every light, as LightManager packs them.  Created and grown by the app, and
+    // rewritten only where the lights changed after LightVersion.
+    std::unique_ptr<UploadBuffer<Light>> Lights = nullptr;
+    UINT LightCapacity = 0;
+    std::uint64_t LightVersion = 0;
+
+    // The fence value marking when the GPU is done with this frame resource is
+    // tracked by FramePacer, which decides when the resource can be reused.
 };
\ No newline at end of file
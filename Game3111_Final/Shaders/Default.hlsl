@@ -4,23 +4,12 @@
 // Default shader, currently supports lighting.
 //***************************************************************************************
 
-// Defaults for number of lights.
-#ifndef NUM_DIR_LIGHTS
-    #define NUM_DIR_LIGHTS 2
-#endif
-
-#ifndef NUM_POINT_LIGHTS
-    #define NUM_POINT_LIGHTS 12
-#endif
-
-#ifndef NUM_SPOT_LIGHTS
-    #define NUM_SPOT_LIGHTS 1
-#endif
-
 // Include structures and functions for lighting.
 #include "LightingUtil.hlsl"
 
-Texture2D    gDiffuseMap : register(t0);
+// Every view in the descriptor heap, seen as arrays; materials pick theirs with
+// gDiffuseMapIndex and a slice in it with gDiffuseMapSlice.
+Texture2DArray gTextureMaps[] : register(t0);
 
 
 SamplerState gsamPointWrap        : register(s0);
@@ -30,11 +19,27 @@ SamplerState gsamLinearClamp      : register(s3);
 SamplerState gsamAnisotropicWrap  : register(s4);
 SamplerState gsamAnisotropicClamp : register(s5);
 
+// Every light, packed by type: directional, then point, then spot.  Point and spot
+// lights are picked per cluster, or per object with gLocalLights.
+StructuredBuffer<Light> gLights : register(t2, space1);
+
+#ifdef CLUSTERED_LIGHTING
+// The light grid: each cluster's (offset, count) into gClusterLightIndices.
+StructuredBuffer<uint2> gClusterRanges       : register(t0, space1);
+StructuredBuffer<uint>  gClusterLightIndices : register(t1, space1);
+#endif
+
 // Constant data that varies per frame.
 cbuffer cbPerObject : register(b0)
 {
     float4x4 gWorld;
 	float4x4 gTexTransform;
+
+	// The point and spot lights that reach this object, as indices into gLights.
+	uint     gPointLightCount;
+	uint     gSpotLightCount;
+	uint2    cbPerObjectPad0;
+	uint4    gLocalLights[MaxObjectLights / 4];
 };
 
 // Constant data that varies per material.
@@ -61,11 +66,15 @@ cbuffer cbPass : register(b1)
 	float gFogRange;
 	float2 cbPerObjectPad2;
 
-    // Indices [0, NUM_DIR_LIGHTS) are directional lights;
-    // indices [NUM_DIR_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHTS) are point lights;
-    // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
-    // are spot lights for a maximum of MaxLights per object.
-    Light gLights[MaxLights];
+	// The light grid; see ClusterIndex and ComputeClusteredLighting.
+	uint3 gClusterCount;
+	uint gClusterLightBase;
+	float gClusterSliceScale;
+	float gClusterSliceBias;
+	uint gClusterSpotStart;
+
+	// gLights holds directional lights first, gDirLightCount of them.
+	uint gDirLightCount;
 };
 
 cbuffer cbMaterial : register(b2)
@@ -74,6 +83,9 @@ cbuffer cbMaterial : register(b2)
     float3   gFresnelR0;
     float    gRoughness;
 	float4x4 gMatTransform;
+	uint     gDiffuseMapIndex;
+	uint     gDiffuseMapSlice;
+	uint2    cbMaterialPad;
 };
 
 struct VertexIn
@@ -114,7 +126,7 @@ VertexOut VS(VertexIn vin)
 
 float4 PS(VertexOut pin) : SV_Target
 {
-    float4 diffuseAlbedo = gDiffuseMap.Sample(gsamAnisotropicWrap, pin.TexC) * gDiffuseAlbedo;
+    float4 diffuseAlbedo = gTextureMaps[gDiffuseMapIndex].Sample(gsamAnisotropicWrap, float3(pin.TexC, gDiffuseMapSlice)) * gDiffuseAlbedo;
 	
 #ifdef ALPHA_TEST
 	// Discard pixel if texture alpha < 0.1.  We do this test as soon 
@@ -137,8 +149,16 @@ float4 PS(VertexOut pin) : SV_Target
     const float shininess = 1.0f - gRoughness;
     Material mat = { diffuseAlbedo, gFresnelR0, shininess };
     float3 shadowFactor = 1.0f;
-    float4 directLight = ComputeLighting(gLights, mat, pin.PosW,
-        pin.NormalW, toEyeW, shadowFactor);
+#ifdef CLUSTERED_LIGHTING
+    float viewDepth = mul(float4(pin.PosW, 1.0f), gView).z;
+    uint cluster = ClusterIndex(pin.PosH.xy, viewDepth, gInvRenderTargetSize,
+        gClusterCount, gClusterSliceScale, gClusterSliceBias);
+    float4 directLight = ComputeClusteredLighting(gLights, gDirLightCount, gClusterLightIndices, gClusterRanges[cluster],
+        gClusterLightBase, gClusterSpotStart, mat, pin.PosW, pin.NormalW, toEyeW, shadowFactor);
+#else
+    float4 directLight = ComputeLighting(gLights, gDirLightCount, gLocalLights, gPointLightCount, gSpotLightCount,
+        mat, pin.PosW, pin.NormalW, toEyeW, shadowFactor);
+#endif
 
     float4 litColor = ambient + directLight;
 
@@ -4,7 +4,23 @@
 // Contains API for shader lighting.
 //***************************************************************************************
 
-#define MaxLights 16
+// Most point plus spot lights one object is lit by; see cbPerObject.
+#define MaxObjectLights 16
+
+// Light-count variants.  The app compiles each lit pixel shader once per bucket of
+// point and spot light counts; these defaults are the largest bucket.  NUM_DIR_LIGHTS
+// only caps the directional loop; the app passes the actual count.
+#ifndef NUM_DIR_LIGHTS
+    #define NUM_DIR_LIGHTS 3
+#endif
+
+#ifndef NUM_POINT_LIGHTS
+    #define NUM_POINT_LIGHTS 12
+#endif
+
+#ifndef NUM_SPOT_LIGHTS
+    #define NUM_SPOT_LIGHTS 4
+#endif
 
 struct Light
 {
@@ -135,36 +151,88 @@ float3 ComputeSpotLight(Light L, Material mat, float3 pos, float3 normal, float3
     return BlinnPhong(lightStrength, lightVec, normal, toEye, mat);
 }
 
-float4 ComputeLighting(Light gLights[MaxLights], Material mat,
+// Directional lights are gLights[0, dirLightCount).  The object's own point and spot
+// lights are listed in localLights: pointLightCount point light indices, then
+// spotLightCount spot light indices.  The loops stop at the object's counts, so a
+// variant compiled for more lights than the object has only costs the unrolled code.
+float4 ComputeLighting(StructuredBuffer<Light> gLights, uint dirLightCount, uint4 localLights[MaxObjectLights / 4],
+                       uint pointLightCount, uint spotLightCount, Material mat,
                        float3 pos, float3 normal, float3 toEye,
                        float3 shadowFactor)
 {
     float3 result = 0.0f;
 
-    int i = 0;
+    uint i = 0;
 
 #if (NUM_DIR_LIGHTS > 0)
-    for(i = 0; i < NUM_DIR_LIGHTS; ++i)
+    for(i = 0; i < NUM_DIR_LIGHTS && i < dirLightCount; ++i)
     {
         result += shadowFactor[i] * ComputeDirectionalLight(gLights[i], mat, normal, toEye);
     }
 #endif
 
 #if (NUM_POINT_LIGHTS > 0)
-    for(i = NUM_DIR_LIGHTS; i < NUM_DIR_LIGHTS+NUM_POINT_LIGHTS; ++i)
+    for(i = 0; i < NUM_POINT_LIGHTS && i < pointLightCount; ++i)
     {
-        result += ComputePointLight(gLights[i], mat, pos, normal, toEye);
+        uint index = localLights[i / 4][i % 4];
+        result += ComputePointLight(gLights[index], mat, pos, normal, toEye);
     }
 #endif
 
 #if (NUM_SPOT_LIGHTS > 0)
-    for(i = NUM_DIR_LIGHTS + NUM_POINT_LIGHTS; i < NUM_DIR_LIGHTS + NUM_POINT_LIGHTS + NUM_SPOT_LIGHTS; ++i)
+    for(i = 0; i < NUM_SPOT_LIGHTS && i < spotLightCount; ++i)
+    {
+        uint slot = pointLightCount + i;
+        uint index = localLights[slot / 4][slot % 4];
+        result += ComputeSpotLight(gLights[index], mat, pos, normal, toEye);
+    }
+#endif
+
+    return float4(result, 0.0f);
+}
+
+#ifdef CLUSTERED_LIGHTING
+// The cluster of the light grid a pixel falls in; see LightClusters.h.  Tile (0, 0) is
+// the top-left of the screen, and depth slices are spaced exponentially.
+uint ClusterIndex(float2 pixel, float viewDepth, float2 invRenderTargetSize,
+                  uint3 clusterCount, float sliceScale, float sliceBias)
+{
+    uint2 tile = min((uint2)(pixel * invRenderTargetSize * clusterCount.xy), clusterCount.xy - 1);
+    float slice = floor(log(max(viewDepth, 1e-4f)) * sliceScale + sliceBias);
+    uint z = (uint)clamp(slice, 0.0f, clusterCount.z - 1.0f);
+    return (z * clusterCount.y + tile.y) * clusterCount.x + tile.x;
+}
+
+// Directional lights, then the point and spot lights of one cluster.  The cluster's
+// lights are lightIndices[range.x, range.x + range.y), each an index i naming
+// gLights[lightBase + i]; indices from spotStart on are spot lights.
+float4 ComputeClusteredLighting(StructuredBuffer<Light> gLights, uint dirLightCount, StructuredBuffer<uint> lightIndices,
+                                uint2 range, uint lightBase, uint spotStart, Material mat,
+                                float3 pos, float3 normal, float3 toEye,
+                                float3 shadowFactor)
+{
+    float3 result = 0.0f;
+
+    uint i = 0;
+
+#if (NUM_DIR_LIGHTS > 0)
+    for(i = 0; i < NUM_DIR_LIGHTS && i < dirLightCount; ++i)
     {
-        result += ComputeSpotLight(gLights[i], mat, pos, normal, toEye);
+        result += shadowFactor[i] * ComputeDirectionalLight(gLights[i], mat, normal, toEye);
+    }
+#endif
+
+    for(i = 0; i < range.y; ++i)
+    {
+        uint index = lightIndices[range.x + i];
+        if(index < spotStart)
+            result += ComputePointLight(gLights[lightBase + index], mat, pos, normal, toEye);
+        else
+            result += ComputeSpotLight(gLights[lightBase + index], mat, pos, normal, toEye);
     }
-#endif 
 
     return float4(result, 0.0f);
 }
+#endif
 
 
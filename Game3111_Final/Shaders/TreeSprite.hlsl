@@ -2,23 +2,12 @@
 // TreeSprite.hlsl.
 //***************************************************************************************
 
-// Defaults for number of lights.
-#ifndef NUM_DIR_LIGHTS
-    #define NUM_DIR_LIGHTS 3
-#endif
-
-#ifndef NUM_POINT_LIGHTS
-    #define NUM_POINT_LIGHTS 1
-#endif
-
-#ifndef NUM_SPOT_LIGHTS
-    #define NUM_SPOT_LIGHTS 1
-#endif
-
 // Include structures and functions for lighting.
 #include "LightingUtil.hlsl"
 //step5
-Texture2DArray gTreeMapArray : register(t0);
+// Every view in the descriptor heap, seen as arrays; materials pick theirs with
+// gDiffuseMapIndex and their first slice with gDiffuseMapSlice.
+Texture2DArray gTextureMaps[] : register(t0);
 
 //you can use dynamic indexing as well. Pay attention how we changed the sampler!
 //Texture2D gTreeMapArray[3] : register(t0);
@@ -31,11 +20,27 @@ SamplerState gsamLinearClamp      : register(s3);
 SamplerState gsamAnisotropicWrap  : register(s4);
 SamplerState gsamAnisotropicClamp : register(s5);
 
+// Every light, packed by type: directional, then point, then spot.  Point and spot
+// lights are picked per cluster, or per object with gLocalLights.
+StructuredBuffer<Light> gLights : register(t2, space1);
+
+#ifdef CLUSTERED_LIGHTING
+// The light grid: each cluster's (offset, count) into gClusterLightIndices.
+StructuredBuffer<uint2> gClusterRanges       : register(t0, space1);
+StructuredBuffer<uint>  gClusterLightIndices : register(t1, space1);
+#endif
+
 // Constant data that varies per frame.
 cbuffer cbPerObject : register(b0)
 {
     float4x4 gWorld;
 	float4x4 gTexTransform;
+
+	// The point and spot lights that reach this object, as indices into gLights.
+	uint     gPointLightCount;
+	uint     gSpotLightCount;
+	uint2    cbPerObjectPad0;
+	uint4    gLocalLights[MaxObjectLights / 4];
 };
 
 // Constant data that varies per material.
@@ -62,11 +67,15 @@ cbuffer cbPass : register(b1)
 	float gFogRange;
 	float2 cbPerObjectPad2;
 
-    // Indices [0, NUM_DIR_LIGHTS) are directional lights;
-    // indices [NUM_DIR_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHTS) are point lights;
-    // indices [NUM_DIR_LIGHTS+NUM_POINT_LIGHTS, NUM_DIR_LIGHTS+NUM_POINT_LIGHT+NUM_SPOT_LIGHTS)
-    // are spot lights for a maximum of MaxLights per object.
-    Light gLights[MaxLights];
+	// The light grid; see ClusterIndex and ComputeClusteredLighting.
+	uint3 gClusterCount;
+	uint gClusterLightBase;
+	float gClusterSliceScale;
+	float gClusterSliceBias;
+	uint gClusterSpotStart;
+
+	// gLights holds directional lights first, gDirLightCount of them.
+	uint gDirLightCount;
 };
 
 cbuffer cbMaterial : register(b2)
@@ -75,6 +84,9 @@ cbuffer cbMaterial : register(b2)
     float3   gFresnelR0;
     float    gRoughness;
 	float4x4 gMatTransform;
+	uint     gDiffuseMapIndex;
+	uint     gDiffuseMapSlice;
+	uint2    cbMaterialPad;
 };
  
 struct VertexIn
@@ -170,8 +182,8 @@ void GS(point VertexOut gin[1], //PrimitiveType InputVertexType InputName[NumEle
 //step6
 float4 PS(GeoOut pin) : SV_Target
 {
-	float3 uvw = float3(pin.TexC, pin.PrimID%3);
-    float4 diffuseAlbedo = gTreeMapArray.Sample(gsamAnisotropicWrap, uvw) * gDiffuseAlbedo;
+	float3 uvw = float3(pin.TexC, gDiffuseMapSlice + pin.PrimID%3);
+    float4 diffuseAlbedo = gTextureMaps[gDiffuseMapIndex].Sample(gsamAnisotropicWrap, uvw) * gDiffuseAlbedo;
 
     //using dynamic indexing
     //float4 diffuseAlbedo = gTreeMapArray[pin.PrimID % 3].Sample(gsamAnisotropicWrap, pin.TexC) * gDiffuseAlbedo;
@@ -198,8 +210,16 @@ float4 PS(GeoOut pin) : SV_Target
     const float shininess = 1.0f - gRoughness;
     Material mat = { diffuseAlbedo, gFresnelR0, shininess };
     float3 shadowFactor = 1.0f;
-    float4 directLight = ComputeLighting(gLights, mat, pin.PosW,
-        pin.NormalW, toEyeW, shadowFactor);
+#ifdef CLUSTERED_LIGHTING
+    float viewDepth = mul(float4(pin.PosW, 1.0f), gView).z;
+    uint cluster = ClusterIndex(pin.PosH.xy, viewDepth, gInvRenderTargetSize,
+        gClusterCount, gClusterSliceScale, gClusterSliceBias);
+    float4 directLight = ComputeClusteredLighting(gLights, gDirLightCount, gClusterLightIndices, gClusterRanges[cluster],
+        gClusterLightBase, gClusterSpotStart, mat, pin.PosW, pin.NormalW, toEyeW, shadowFactor);
+#else
+    float4 directLight = ComputeLighting(gLights, gDirLightCount, gLocalLights, gPointLightCount, gSpotLightCount,
+        mat, pin.PosW, pin.NormalW, toEyeW, shadowFactor);
+#endif
 
     float4 litColor = ambient + directLight;
 
@@ -3,6 +3,7 @@
 //***************************************************************************************
 
 #include "Waves.h"
+#include "../Common/CpuProfiler.h"
 #include <ppl.h>
 #include <algorithm>
 #include <vector>
@@ -10,6 +11,10 @@
 
 using namespace DirectX;
 
+// The solver hands rows to the worker threads in blocks, so each worker's share of
+// a step shows up as a handful of profiler scopes rather than one per row.
+static const int RowsPerBlock = 16;
+
 Waves::Waves(int m, int n, float dx, float dt, float speed, float damping)
 {
     mNumRows = m;
@@ -87,6 +92,8 @@ float Waves::Depth()const
 
 void Waves::Update(float dt)
 {
+	PROFILE_SCOPE("Waves::Update");
+
 	static float t = 0;
 
 	// Accumulate time.
@@ -96,27 +103,34 @@ void Waves::Update(float dt)
 	if( t >= mTimeStep )
 	{
 		// Only update interior points; we use zero boundary conditions.
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
-		//for(int i = 1; i < mNumRows-1; ++i)
+		const int blockCount = (mNumRows - 2 + RowsPerBlock - 1) / RowsPerBlock;
+		concurrency::parallel_for(0, blockCount, [this](int block)
 		{
-			for(int j = 1; j < mNumCols-1; ++j)
+			PROFILE_SCOPE("Waves::Solve");
+
+			int rowBegin = 1 + block*RowsPerBlock;
+			int rowEnd = std::min(rowBegin + RowsPerBlock, mNumRows - 1);
+			for(int i = rowBegin; i < rowEnd; ++i)
 			{
-				// After this update we will be discarding the old previous
-				// buffer, so overwrite that buffer with the new update.
-				// Note how we can do this inplace (read/write to same element) 
-				// because we won't need prev_ij again and the assignment happens last.
-
-				// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
-				// Moreover, our +z axis goes "down"; this is just to 
-				// keep consistent with our row indices going down.
-
-				mPrevSolution[i*mNumCols+j].y = 
-					mK1*mPrevSolution[i*mNumCols+j].y +
-					mK2*mCurrSolution[i*mNumCols+j].y +
-					mK3*(mCurrSolution[(i+1)*mNumCols+j].y + 
-					     mCurrSolution[(i-1)*mNumCols+j].y + 
-					     mCurrSolution[i*mNumCols+j+1].y + 
-						 mCurrSolution[i*mNumCols+j-1].y);
+				for(int j = 1; j < mNumCols-1; ++j)
+				{
+					// After this update we will be discarding the old previous
+					// buffer, so overwrite that buffer with the new update.
+					// Note how we can do this inplace (read/write to same element) 
+					// because we won't need prev_ij again and the assignment happens last.
+
+					// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
+					// Moreover, our +z axis goes "down"; this is just to 
+					// keep consistent with our row indices going down.
+
+					mPrevSolution[i*mNumCols+j].y = 
+						mK1*mPrevSolution[i*mNumCols+j].y +
+						mK2*mCurrSolution[i*mNumCols+j].y +
+						mK3*(mCurrSolution[(i+1)*mNumCols+j].y + 
+						     mCurrSolution[(i-1)*mNumCols+j].y + 
+						     mCurrSolution[i*mNumCols+j+1].y + 
+							 mCurrSolution[i*mNumCols+j-1].y);
+				}
 			}
 		});
 
@@ -130,25 +144,31 @@ void Waves::Update(float dt)
 		//
 		// Compute normals using finite difference scheme.
 		//
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
-		//for(int i = 1; i < mNumRows - 1; ++i)
+		concurrency::parallel_for(0, blockCount, [this](int block)
 		{
-			for(int j = 1; j < mNumCols-1; ++j)
+			PROFILE_SCOPE("Waves::Normals");
+
+			int rowBegin = 1 + block*RowsPerBlock;
+			int rowEnd = std::min(rowBegin + RowsPerBlock, mNumRows - 1);
+			for(int i = rowBegin; i < rowEnd; ++i)
 			{
-				float l = mCurrSolution[i*mNumCols+j-1].y;
-				float r = mCurrSolution[i*mNumCols+j+1].y;
-				float t = mCurrSolution[(i-1)*mNumCols+j].y;
-				float b = mCurrSolution[(i+1)*mNumCols+j].y;
-				mNormals[i*mNumCols+j].x = -r+l;
-				mNormals[i*mNumCols+j].y = 2.0f*mSpatialStep;
-				mNormals[i*mNumCols+j].z = b-t;
-
-				XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&mNormals[i*mNumCols+j]));
-				XMStoreFloat3(&mNormals[i*mNumCols+j], n);
-
-				mTangentX[i*mNumCols+j] = XMFLOAT3(2.0f*mSpatialStep, r-l, 0.0f);
-				XMVECTOR T = XMVector3Normalize(XMLoadFloat3(&mTangentX[i*mNumCols+j]));
-				XMStoreFloat3(&mTangentX[i*mNumCols+j], T);
+				for(int j = 1; j < mNumCols-1; ++j)
+				{
+					float l = mCurrSolution[i*mNumCols+j-1].y;
+					float r = mCurrSolution[i*mNumCols+j+1].y;
+					float t = mCurrSolution[(i-1)*mNumCols+j].y;
+					float b = mCurrSolution[(i+1)*mNumCols+j].y;
+					mNormals[i*mNumCols+j].x = -r+l;
+					mNormals[i*mNumCols+j].y = 2.0f*mSpatialStep;
+					mNormals[i*mNumCols+j].z = b-t;
+
+					XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&mNormals[i*mNumCols+j]));
+					XMStoreFloat3(&mNormals[i*mNumCols+j], n);
+
+					mTangentX[i*mNumCols+j] = XMFLOAT3(2.0f*mSpatialStep, r-l, 0.0f);
+					XMVECTOR T = XMVector3Normalize(XMLoadFloat3(&mTangentX[i*mNumCols+j]));
+					XMStoreFloat3(&mTangentX[i*mNumCols+j], T);
+				}
 			}
 		});
 	}
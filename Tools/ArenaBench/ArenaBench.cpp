@@ -0,0 +1,301 @@
+//***************************************************************************************
+// ArenaBench.cpp
+//
+// Times a frame's scratch lists built three ways, for 1k to 1M items: sorting the
+// items into four draw lists by layer and listing the one in 64 that changed.
+//
+//   fresh    new std::vectors every frame, grown by push_back
+//   reused   std::vectors kept between frames and cleared, which keep their memory
+//   arena    lists taken from an Arena that is Reset every frame, each sized for
+//            every item, as CastleApp::BuildDrawLists does
+//
+// heap is the number of heap allocations per frame once warmed up, counted by a
+// replacement operator new.  Before anything is timed, an arena is put through
+// frames of random allocations of random sizes and alignments, each filled with its
+// own pattern and checked at the end of the frame, and must stop taking blocks from
+// the heap once it has seen its largest frame.
+//
+// Usage: ArenaBench [iterations]
+//
+// Build (from the repository root):
+//   g++ -std=c++14 -O2 -ICommon Tools/ArenaBench/ArenaBench.cpp Common/Arena.cpp -o ArenaBench
+//   cl /O2 /EHsc /ICommon Tools\ArenaBench\ArenaBench.cpp Common\Arena.cpp
+//***************************************************************************************
+
+#include "Arena.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <vector>
+
+namespace
+{
+	std::atomic<std::uint64_t> gHeapAllocations(0);
+}
+
+void* operator new(std::size_t size)
+{
+	++gHeapAllocations;
+	if (void* p = std::malloc(size != 0 ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+namespace
+{
+	const int LayerCount = 4;
+
+	double Milliseconds(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	struct Item
+	{
+		std::uint32_t Layer;
+		bool Changed;
+	};
+
+	// Frames of random allocations; each is filled with a byte of its own and checked
+	// before the Reset that ends the frame.
+	bool VerifyArena()
+	{
+		std::mt19937 rng(3111);
+		Arena arena(4096);
+
+		struct Allocation
+		{
+			unsigned char* Data;
+			std::size_t Size;
+			unsigned char Fill;
+		};
+		std::vector<Allocation> allocations;
+
+		std::uint64_t warmHeapAllocations = 0;
+		for (int frame = 0; frame < 200; ++frame)
+		{
+			// The first frames grow.  The rest stop before they would outgrow the
+			// block the arena kept.
+			const int count = frame < 20 ? 50 * (frame + 1) : (int)(rng() % 1000);
+			allocations.clear();
+			std::size_t bytes = 0;
+			for (int i = 0; i < count; ++i)
+			{
+				const std::size_t size = rng() % 3 == 0 ? rng() % 2000 : rng() % 64;
+				const std::size_t alignment = std::size_t(1) << (rng() % 7);
+				if (frame > 20 && arena.BytesUsed() + size + alignment > arena.Capacity())
+					break;
+				unsigned char* data = static_cast<unsigned char*>(arena.Allocate(size, alignment));
+				if (reinterpret_cast<std::uintptr_t>(data) % alignment != 0)
+				{
+					std::fprintf(stderr, "frame %d: allocation %d is not aligned to %zu\n", frame, i, alignment);
+					return false;
+				}
+
+				const unsigned char fill = (unsigned char)rng();
+				std::memset(data, fill, size);
+				allocations.push_back({ data, size, fill });
+				bytes += size;
+			}
+
+			for (const Allocation& a : allocations)
+			{
+				for (std::size_t b = 0; b < a.Size; ++b)
+				{
+					if (a.Data[b] != a.Fill)
+					{
+						std::fprintf(stderr, "frame %d: allocations overlap\n", frame);
+						return false;
+					}
+				}
+			}
+			if (arena.Allocations() != allocations.size() || arena.BytesUsed() < bytes || arena.BytesUsed() > arena.Capacity())
+			{
+				std::fprintf(stderr, "frame %d: counted %zu allocations of %zu bytes, expected %zu of at least %zu\n",
+					frame, arena.Allocations(), arena.BytesUsed(), allocations.size(), bytes);
+				return false;
+			}
+
+			arena.Reset();
+			if (frame == 20)
+				warmHeapAllocations = arena.HeapAllocations();
+			if (frame > 20 && arena.HeapAllocations() != warmHeapAllocations)
+			{
+				std::fprintf(stderr, "frame %d: the arena took a block after warming up\n", frame);
+				return false;
+			}
+		}
+
+		// Containers: growth, copies and swaps within one arena.
+		ArenaVector<int> a(arena);
+		ArenaVector<int> b(arena);
+		for (int i = 0; i < 1000; ++i)
+			a.push_back(i);
+		b = a;
+		a.swap(b);
+		b.assign(10, 7);
+		if (a.size() != 1000 || a[999] != 999 || b.size() != 10 || b[9] != 7)
+		{
+			std::fprintf(stderr, "ArenaVector lost its contents\n");
+			return false;
+		}
+		return true;
+	}
+
+	// The frame's lists, built from fresh vectors, from kept ones, or in an arena.
+	// Each returns a checksum so the three can be compared.
+	std::uint64_t FreshFrame(const std::vector<Item>& items)
+	{
+		std::vector<std::uint32_t> lists[LayerCount];
+		std::vector<std::uint32_t> changed;
+		for (std::uint32_t i = 0; i < items.size(); ++i)
+		{
+			lists[items[i].Layer].push_back(i);
+			if (items[i].Changed)
+				changed.push_back(i);
+		}
+
+		std::uint64_t sum = changed.size();
+		for (const auto& list : lists)
+			sum = sum * 31 + list.size() + (list.empty() ? 0 : list.back());
+		return sum;
+	}
+
+	std::uint64_t ReusedFrame(const std::vector<Item>& items, std::vector<std::uint32_t>* lists, std::vector<std::uint32_t>& changed)
+	{
+		for (int l = 0; l < LayerCount; ++l)
+			lists[l].clear();
+		changed.clear();
+		for (std::uint32_t i = 0; i < items.size(); ++i)
+		{
+			lists[items[i].Layer].push_back(i);
+			if (items[i].Changed)
+				changed.push_back(i);
+		}
+
+		std::uint64_t sum = changed.size();
+		for (int l = 0; l < LayerCount; ++l)
+			sum = sum * 31 + lists[l].size() + (lists[l].empty() ? 0 : lists[l].back());
+		return sum;
+	}
+
+	std::uint64_t ArenaFrame(const std::vector<Item>& items, Arena& arena)
+	{
+		arena.Reset();
+
+		const std::uint32_t count = (std::uint32_t)items.size();
+		std::uint32_t* lists[LayerCount];
+		std::uint32_t sizes[LayerCount] = {};
+		for (int l = 0; l < LayerCount; ++l)
+			lists[l] = arena.AllocateArray<std::uint32_t>(count);
+		ArenaVector<std::uint32_t> changed(arena);
+		changed.reserve(count / 64 + 1);
+		for (std::uint32_t i = 0; i < count; ++i)
+		{
+			const std::uint32_t layer = items[i].Layer;
+			lists[layer][sizes[layer]++] = i;
+			if (items[i].Changed)
+				changed.push_back(i);
+		}
+
+		std::uint64_t sum = changed.size();
+		for (int l = 0; l < LayerCount; ++l)
+			sum = sum * 31 + sizes[l] + (sizes[l] == 0 ? 0 : lists[l][sizes[l] - 1]);
+		return sum;
+	}
+
+	struct Timing
+	{
+		double Ms;
+		double HeapPerFrame;
+		std::uint64_t Checksum;
+	};
+
+	// Median time over iterations after two frames of warming up, and the heap
+	// allocations of the timed frames.
+	template <class Frame>
+	Timing Time(int iterations, Frame frame)
+	{
+		Timing timing = { 0.0, 0.0, frame() };
+		frame();
+
+		std::vector<double> times;
+		times.reserve(iterations);
+		std::uint64_t heap = 0;
+		for (int i = 0; i < iterations; ++i)
+		{
+			const std::uint64_t heapBefore = gHeapAllocations;
+			auto start = std::chrono::steady_clock::now();
+			const std::uint64_t checksum = frame();
+			times.push_back(Milliseconds(start));
+			heap += gHeapAllocations - heapBefore;
+			if (checksum != timing.Checksum)
+				timing.Checksum = 0;
+		}
+		std::sort(times.begin(), times.end());
+		timing.Ms = times[times.size() / 2];
+		timing.HeapPerFrame = (double)heap / iterations;
+		return timing;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const int iterations = (argc > 1) ? std::max(1, std::atoi(argv[1])) : 20;
+
+	if (!VerifyArena())
+		return 1;
+
+	std::printf("%d iterations, median ms per frame (heap allocations per frame)\n\n", iterations);
+	std::printf("%8s %18s %18s %18s %10s\n", "items", "fresh", "reused", "arena", "arena KB");
+
+	const std::uint32_t counts[] = { 1000, 10000, 100000, 1000000 };
+	for (std::uint32_t count : counts)
+	{
+		// Mostly opaque, as the castle and maze are.
+		std::mt19937 rng(count);
+		std::vector<Item> items(count);
+		for (Item& item : items)
+		{
+			const std::uint32_t r = rng() % 16;
+			item.Layer = r < 13 ? 0 : r - 12;
+			item.Changed = rng() % 64 == 0;
+		}
+
+		const Timing fresh = Time(iterations, [&]() { return FreshFrame(items); });
+
+		std::vector<std::uint32_t> lists[LayerCount];
+		std::vector<std::uint32_t> changed;
+		const Timing reused = Time(iterations, [&]() { return ReusedFrame(items, lists, changed); });
+
+		Arena arena;
+		const Timing scratch = Time(iterations, [&]() { return ArenaFrame(items, arena); });
+
+		if (fresh.Checksum == 0 || fresh.Checksum != reused.Checksum || fresh.Checksum != scratch.Checksum)
+		{
+			std::fprintf(stderr, "%u items: the three frames built different lists\n", count);
+			return 1;
+		}
+
+		std::printf("%8u %10.3f (%5.1f) %10.3f (%5.1f) %10.3f (%5.1f) %10.1f\n", count, fresh.Ms, fresh.HeapPerFrame,
+			reused.Ms, reused.HeapPerFrame, scratch.Ms, scratch.HeapPerFrame, arena.Capacity() / 1024.0);
+	}
+
+	return 0;
+}
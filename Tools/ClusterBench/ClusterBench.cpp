@@ -0,0 +1,129 @@
+//***************************************************************************************
+// ClusterBench.cpp
+//
+// Times LightClusters::Build on random light sets of 1k to 10k lights.  Lights are
+// spheres scattered through the view frustum of the app's camera, with ranges like
+// the castle's torches and lamps.  Every binning is first checked against the slow
+// per-cluster reference test, so a timing is only printed for a correct result.
+// Building the same lights again must not grow the lists Build keeps, which is what
+// lets the app's steady frames run without allocating.
+//
+// Usage: ClusterBench [iterations]
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -pthread -ICommon Tools/ClusterBench/ClusterBench.cpp Common/LightClusters.cpp -o ClusterBench
+//   cl /std:c++17 /O2 /EHsc /ICommon Tools\ClusterBench\ClusterBench.cpp Common\LightClusters.cpp
+//***************************************************************************************
+
+#include "LightClusters.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace
+{
+	// The app's camera and cluster grid.
+	const float FovY = 0.25f * 3.1415926535f;
+	const float Aspect = 800.0f / 600.0f;
+	const float NearZ = 1.0f;
+	const float FarZ = 1000.0f;
+
+	std::vector<ClusterLight> RandomLights(std::uint32_t count, std::uint32_t seed)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+		const float tanY = std::tan(0.5f * FovY);
+		const float tanX = Aspect * tanY;
+
+		std::vector<ClusterLight> lights(count);
+		for (ClusterLight& light : lights)
+		{
+			// Denser near the camera, like a scene seen from inside it.
+			light.Z = NearZ + (300.0f - NearZ) * unit(rng) * unit(rng);
+			light.X = (2.0f * unit(rng) - 1.0f) * tanX * light.Z * 1.1f;
+			light.Y = (2.0f * unit(rng) - 1.0f) * tanY * light.Z * 1.1f;
+			light.Radius = 1.0f + 11.0f * unit(rng);
+		}
+		return lights;
+	}
+
+	bool Verify(const LightClusters& clusters, const std::vector<ClusterLight>& lights)
+	{
+		const std::vector<ClusterRange>& ranges = clusters.Ranges();
+		const std::vector<std::uint32_t>& indices = clusters.Indices();
+
+		std::vector<std::uint32_t> expected;
+		for (std::uint32_t c = 0; c < clusters.ClusterCount(); ++c)
+		{
+			expected.clear();
+			for (std::uint32_t i = 0; i < (std::uint32_t)lights.size(); ++i)
+			{
+				if (clusters.Touches(c, lights[i]))
+					expected.push_back(i);
+			}
+
+			if (ranges[c].Count != expected.size() ||
+				!std::equal(expected.begin(), expected.end(), indices.begin() + ranges[c].Offset))
+			{
+				std::fprintf(stderr, "cluster %u: %u lights binned, %u expected\n",
+					c, ranges[c].Count, (unsigned)expected.size());
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const int iterations = (argc > 1) ? std::max(1, std::atoi(argv[1])) : 50;
+
+	LightClusters clusters(16, 8, 24);
+	clusters.SetProjection(FovY, Aspect, NearZ, FarZ);
+
+	std::printf("%u clusters (16 x 8 x 24), %d iterations\n\n", clusters.ClusterCount(), iterations);
+	std::printf("%8s %10s %10s %12s %12s\n", "lights", "median ms", "min ms", "indices", "max/cluster");
+
+	const std::uint32_t counts[] = { 1000, 2000, 5000, 10000 };
+	for (std::uint32_t count : counts)
+	{
+		const std::vector<ClusterLight> lights = RandomLights(count, count);
+
+		clusters.Build(lights.data(), count);
+		if (!Verify(clusters, lights))
+			return 1;
+		const std::size_t capacity = clusters.CapacityBytes();
+
+		std::vector<double> times;
+		for (int i = 0; i < iterations; ++i)
+		{
+			auto start = std::chrono::steady_clock::now();
+			clusters.Build(lights.data(), count);
+			auto end = std::chrono::steady_clock::now();
+			times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+		}
+		std::sort(times.begin(), times.end());
+
+		if (clusters.CapacityBytes() != capacity)
+		{
+			std::fprintf(stderr, "%u lights: rebuilding grew the lists from %zu to %zu bytes\n",
+				count, capacity, clusters.CapacityBytes());
+			return 1;
+		}
+
+		std::uint32_t maxPerCluster = 0;
+		for (const ClusterRange& range : clusters.Ranges())
+			maxPerCluster = std::max(maxPerCluster, range.Count);
+
+		std::printf("%8u %10.3f %10.3f %12u %12u\n", count, times[times.size() / 2], times.front(),
+			(unsigned)clusters.Indices().size(), maxPerCluster);
+	}
+
+	return 0;
+}
@@ -0,0 +1,390 @@
+//***************************************************************************************
+// DdsFuzzBench.cpp
+//
+// Feeds DdsImage::Parse malformed files built from six valid ones: a BC1 2D texture,
+// an RGBA8 one with a legacy bit-mask header, a BC7 array, a BC3 cube map, an RGBA8
+// volume and a 1D R16_FLOAT texture, all with full mip chains and no bytes past the
+// last mip.  Each is checked to parse first, then broken three ways:
+//
+//   - cut short at every length, which must always be rejected
+//   - every 32-bit word of the headers set in turn to zero, one, the D3D limits and
+//     their neighbours, the sign bit, all ones, and one either side of its own value
+//   - a few random bytes changed, mostly in the headers, sometimes with the file also
+//     cut short or a maxSize passed to skip leading mips
+//
+// Every case is parsed from a buffer of exactly its own length, so a read past the end
+// is caught by the address sanitizer when it is built with one.  A file that is still
+// accepted must describe only bytes inside it: every subresource in bounds, the slices
+// and mips the image reports, and sizes that agree with GetSurfaceInfo.
+//
+//   bytes     size of the valid file
+//   mutation  truncated, header word or random
+//   cases     files parsed
+//   accepted  files Parse returned Ok for
+//   ns/parse  average Parse time over all the cases
+//
+// Usage: DdsFuzzBench [random cases per file]
+//
+// Build (from the repository root):
+//   g++ -std=c++14 -O2 -ICommon Tools/DdsFuzzBench/DdsFuzzBench.cpp Common/DdsImage.cpp -o DdsFuzzBench
+//   g++ -std=c++14 -O1 -g -fsanitize=address,undefined -ICommon Tools/DdsFuzzBench/DdsFuzzBench.cpp Common/DdsImage.cpp -o DdsFuzzBench
+//   cl /O2 /EHsc /ICommon Tools\DdsFuzzBench\DdsFuzzBench.cpp Common\DdsImage.cpp
+//***************************************************************************************
+
+#include "DdsImage.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	const std::uint32_t DdsMagic = 0x20534444; // "DDS "
+
+	// DDS_HEADER flags, DDS_PIXELFORMAT flags and caps.
+	const std::uint32_t DdsdCaps = 0x1;
+	const std::uint32_t DdsdHeight = 0x2;
+	const std::uint32_t DdsdWidth = 0x4;
+	const std::uint32_t DdsdPixelFormat = 0x1000;
+	const std::uint32_t DdsdMipMapCount = 0x20000;
+	const std::uint32_t DdsdDepth = 0x800000;
+	const std::uint32_t DdpfAlphaPixels = 0x1;
+	const std::uint32_t DdpfFourCC = 0x4;
+	const std::uint32_t DdpfRgb = 0x40;
+	const std::uint32_t DdsCapsTexture = 0x1000;
+	const std::uint32_t DdsCapsComplex = 0x8;
+	const std::uint32_t DdsCapsMipMap = 0x400000;
+	const std::uint32_t DdsCubemapAllFaces = 0x200 | 0xfc00;
+
+	std::uint32_t MakeFourCC(char ch0, char ch1, char ch2, char ch3)
+	{
+		return (std::uint32_t)(std::uint8_t)ch0 | ((std::uint32_t)(std::uint8_t)ch1 << 8) |
+			((std::uint32_t)(std::uint8_t)ch2 << 16) | ((std::uint32_t)(std::uint8_t)ch3 << 24);
+	}
+
+	struct Seed
+	{
+		const char* Name;
+		std::vector<std::uint8_t> Bytes;
+		std::size_t HeaderBytes; // magic and headers, where the mutations go
+	};
+
+	struct Result
+	{
+		std::uint64_t Cases = 0;
+		std::uint64_t Accepted = 0;
+		double Seconds = 0.0;
+	};
+
+	// A file holding exactly the headers and the mips they describe, texels zeroed.
+	Seed MakeSeed(const char* name, DdsHeader header, const DdsHeaderDxt10* ext, DdsFormat format,
+		std::uint32_t slices)
+	{
+		header.size = sizeof(DdsHeader);
+		header.ddspf.size = sizeof(DdsPixelFormat);
+		header.flags |= DdsdCaps | DdsdHeight | DdsdWidth | DdsdPixelFormat | DdsdMipMapCount;
+		header.caps |= DdsCapsTexture | DdsCapsComplex | DdsCapsMipMap;
+
+		std::size_t texelBytes = 0;
+		for (std::uint32_t slice = 0; slice < slices; ++slice)
+		{
+			std::size_t w = header.width;
+			std::size_t h = header.height;
+			std::size_t d = (std::max)(1u, header.depth);
+			for (std::uint32_t mip = 0; mip < header.mipMapCount; ++mip)
+			{
+				std::size_t numBytes = 0;
+				DdsImage::GetSurfaceInfo(w, h, format, &numBytes, nullptr, nullptr);
+				texelBytes += numBytes * d;
+				w = (std::max)((std::size_t)1, w >> 1);
+				h = (std::max)((std::size_t)1, h >> 1);
+				d = (std::max)((std::size_t)1, d >> 1);
+			}
+		}
+
+		Seed seed;
+		seed.Name = name;
+		seed.Bytes.resize(sizeof(DdsMagic) + sizeof(DdsHeader));
+		std::memcpy(seed.Bytes.data(), &DdsMagic, sizeof(DdsMagic));
+		std::memcpy(seed.Bytes.data() + sizeof(DdsMagic), &header, sizeof(header));
+		if (ext != nullptr)
+		{
+			const std::uint8_t* bytes = reinterpret_cast<const std::uint8_t*>(ext);
+			seed.Bytes.insert(seed.Bytes.end(), bytes, bytes + sizeof(DdsHeaderDxt10));
+		}
+		seed.HeaderBytes = seed.Bytes.size();
+		seed.Bytes.resize(seed.Bytes.size() + texelBytes, 0);
+		return seed;
+	}
+
+	std::vector<Seed> MakeSeeds()
+	{
+		std::vector<Seed> seeds;
+
+		DdsHeader header = {};
+		header.width = 128;
+		header.height = 128;
+		header.mipMapCount = 8;
+		header.ddspf.flags = DdpfFourCC;
+		header.ddspf.fourCC = MakeFourCC('D', 'X', 'T', '1');
+		seeds.push_back(MakeSeed("bc1", header, nullptr, DdsFormat::BC1_UNORM, 1));
+
+		header = {};
+		header.width = 64;
+		header.height = 32;
+		header.mipMapCount = 7;
+		header.ddspf.flags = DdpfRgb | DdpfAlphaPixels;
+		header.ddspf.RGBBitCount = 32;
+		header.ddspf.RBitMask = 0x000000ff;
+		header.ddspf.GBitMask = 0x0000ff00;
+		header.ddspf.BBitMask = 0x00ff0000;
+		header.ddspf.ABitMask = 0xff000000;
+		seeds.push_back(MakeSeed("rgba8", header, nullptr, DdsFormat::R8G8B8A8_UNORM, 1));
+
+		header = {};
+		header.width = 64;
+		header.height = 64;
+		header.mipMapCount = 7;
+		header.ddspf.flags = DdpfFourCC;
+		header.ddspf.fourCC = MakeFourCC('D', 'X', '1', '0');
+		DdsHeaderDxt10 ext = {};
+		ext.dxgiFormat = (std::uint32_t)DdsFormat::BC7_UNORM;
+		ext.resourceDimension = (std::uint32_t)DdsDimension::Texture2D;
+		ext.arraySize = 3;
+		seeds.push_back(MakeSeed("bc7 array", header, &ext, DdsFormat::BC7_UNORM, 3));
+
+		header = {};
+		header.width = 32;
+		header.height = 32;
+		header.mipMapCount = 6;
+		header.ddspf.flags = DdpfFourCC;
+		header.ddspf.fourCC = MakeFourCC('D', 'X', 'T', '5');
+		header.caps2 = DdsCubemapAllFaces;
+		seeds.push_back(MakeSeed("bc3 cube", header, nullptr, DdsFormat::BC3_UNORM, 6));
+
+		header = {};
+		header.width = 16;
+		header.height = 16;
+		header.depth = 8;
+		header.mipMapCount = 5;
+		header.flags = DdsdDepth;
+		header.ddspf.flags = DdpfFourCC;
+		header.ddspf.fourCC = MakeFourCC('D', 'X', '1', '0');
+		ext = {};
+		ext.dxgiFormat = (std::uint32_t)DdsFormat::R8G8B8A8_UNORM;
+		ext.resourceDimension = (std::uint32_t)DdsDimension::Texture3D;
+		ext.arraySize = 1;
+		seeds.push_back(MakeSeed("volume", header, &ext, DdsFormat::R8G8B8A8_UNORM, 1));
+
+		header = {};
+		header.width = 256;
+		header.height = 1;
+		header.mipMapCount = 9;
+		header.ddspf.flags = DdpfFourCC;
+		header.ddspf.fourCC = MakeFourCC('D', 'X', '1', '0');
+		ext = {};
+		ext.dxgiFormat = (std::uint32_t)DdsFormat::R16_FLOAT;
+		ext.resourceDimension = (std::uint32_t)DdsDimension::Texture1D;
+		ext.arraySize = 1;
+		seeds.push_back(MakeSeed("1d", header, &ext, DdsFormat::R16_FLOAT, 1));
+
+		return seeds;
+	}
+
+	// An accepted file must only describe bytes inside it.
+	bool VerifyAccepted(const DdsImage& image, std::uint64_t size, std::uint32_t maxSize, const char* what)
+	{
+		const std::vector<DdsSubresource>& subs = image.Subresources();
+		if (subs.empty() || image.MipLevels() == 0 || image.ArraySize() == 0 ||
+			subs.size() != (std::size_t)image.MipLevels() * image.ArraySize())
+		{
+			std::fprintf(stderr, "%s: accepted with %zu subresources for %u mips of %u slices\n",
+				what, subs.size(), image.MipLevels(), image.ArraySize());
+			return false;
+		}
+
+		for (std::size_t i = 0; i < subs.size(); ++i)
+		{
+			const DdsSubresource& sub = subs[i];
+			std::size_t numBytes = 0;
+			std::size_t rowBytes = 0;
+			std::size_t numRows = 0;
+			DdsImage::GetSurfaceInfo(sub.Width, sub.Height, image.Format(), &numBytes, &rowBytes, &numRows);
+
+			if (sub.Width == 0 || sub.Height == 0 || sub.Depth == 0 ||
+				sub.SlicePitch != numBytes || sub.RowPitch != rowBytes || sub.RowCount != numRows ||
+				sub.Offset > size || sub.SlicePitch * sub.Depth > size - sub.Offset)
+			{
+				std::fprintf(stderr, "%s: subresource %zu is %ux%ux%u, %llu bytes at %llu, in a file of %llu\n",
+					what, i, sub.Width, sub.Height, sub.Depth, (unsigned long long)(sub.SlicePitch * sub.Depth),
+					(unsigned long long)sub.Offset, (unsigned long long)size);
+				return false;
+			}
+
+			if (maxSize != 0 && image.MipLevels() > 1 && (sub.Width > maxSize || sub.Height > maxSize || sub.Depth > maxSize))
+			{
+				std::fprintf(stderr, "%s: kept a %ux%ux%u mip with a maxSize of %u\n",
+					what, sub.Width, sub.Height, sub.Depth, maxSize);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Parses a copy of bytes[0, length) in a buffer of exactly that size.
+	bool ParseCase(const std::uint8_t* bytes, std::size_t length, std::uint32_t maxSize, const char* what,
+		DdsResult& parsed, Result& result)
+	{
+		const std::vector<std::uint8_t> file(bytes, bytes + length);
+		const std::uint8_t* data = file.empty() ? nullptr : file.data();
+
+		DdsImage image;
+		auto start = std::chrono::steady_clock::now();
+		parsed = image.Parse(data, file.size(), maxSize);
+		result.Seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		++result.Cases;
+		if (parsed != DdsResult::Ok)
+			return true;
+		++result.Accepted;
+		return VerifyAccepted(image, file.size(), maxSize, what);
+	}
+
+	bool Truncate(const Seed& seed, Result& result)
+	{
+		for (std::size_t length = 0; length < seed.Bytes.size(); ++length)
+		{
+			DdsResult parsed;
+			if (!ParseCase(seed.Bytes.data(), length, 0, seed.Name, parsed, result))
+				return false;
+			if (parsed == DdsResult::Ok)
+			{
+				std::fprintf(stderr, "%s: accepted when cut to %zu of %zu bytes\n", seed.Name, length, seed.Bytes.size());
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool MutateWords(const Seed& seed, Result& result)
+	{
+		const std::uint32_t values[] =
+		{
+			0, 1, 2, 3, 4, 6, 15, 16, 255, 256,
+			2048, 2049, 16384, 16385, 65536,
+			0x7fffffff, 0x80000000, 0xfffffffe, 0xffffffff,
+		};
+
+		std::vector<std::uint8_t> bytes = seed.Bytes;
+		for (std::size_t offset = 0; offset + 4 <= seed.HeaderBytes; offset += 4)
+		{
+			std::uint32_t original;
+			std::memcpy(&original, seed.Bytes.data() + offset, sizeof(original));
+
+			std::vector<std::uint32_t> tries(std::begin(values), std::end(values));
+			tries.push_back(original + 1);
+			tries.push_back(original - 1);
+			for (std::uint32_t value : tries)
+			{
+				std::memcpy(bytes.data() + offset, &value, sizeof(value));
+				DdsResult parsed;
+				char what[128];
+				std::snprintf(what, sizeof(what), "%s, word at %zu set to 0x%x", seed.Name, offset, value);
+				if (!ParseCase(bytes.data(), bytes.size(), 0, what, parsed, result))
+					return false;
+			}
+			std::memcpy(bytes.data() + offset, &original, sizeof(original));
+		}
+		return true;
+	}
+
+	bool MutateBytes(const Seed& seed, int cases, Result& result)
+	{
+		const std::uint32_t maxSizes[] = { 0, 0, 1, 8, 64 };
+
+		std::uint32_t state = 0x9e3779b9;
+		auto next = [&state]()
+		{
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return state;
+		};
+
+		std::vector<std::uint8_t> bytes;
+		for (int c = 0; c < cases; ++c)
+		{
+			bytes = seed.Bytes;
+			const int changes = 1 + (int)(next() % 8);
+			for (int i = 0; i < changes; ++i)
+			{
+				const std::size_t range = (next() % 4 != 0) ? seed.HeaderBytes : bytes.size();
+				bytes[next() % range] = (std::uint8_t)next();
+			}
+
+			std::size_t length = bytes.size();
+			if (next() % 8 == 0)
+				length = next() % bytes.size();
+			const std::uint32_t maxSize = maxSizes[next() % 5];
+
+			DdsResult parsed;
+			char what[128];
+			std::snprintf(what, sizeof(what), "%s, random case %d", seed.Name, c);
+			if (!ParseCase(bytes.data(), length, maxSize, what, parsed, result))
+				return false;
+		}
+		return true;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const int randomCases = (argc > 1) ? (std::max)(1, std::atoi(argv[1])) : 20000;
+
+	const std::vector<Seed> seeds = MakeSeeds();
+
+	std::printf("%10s %8s %12s %9s %9s %9s\n", "file", "bytes", "mutation", "cases", "accepted", "ns/parse");
+	Result total;
+	for (const Seed& seed : seeds)
+	{
+		// The untouched file must parse, or the mutations test nothing.
+		Result check;
+		DdsResult parsed;
+		if (!ParseCase(seed.Bytes.data(), seed.Bytes.size(), 0, seed.Name, parsed, check))
+			return 1;
+		if (parsed != DdsResult::Ok)
+		{
+			std::fprintf(stderr, "%s: the valid file was rejected: %s\n", seed.Name, DdsResultName(parsed));
+			return 1;
+		}
+
+		struct Mutation
+		{
+			const char* Name;
+			Result Counts;
+		};
+		Mutation mutations[3] = { { "truncated", {} }, { "header word", {} }, { "random", {} } };
+		if (!Truncate(seed, mutations[0].Counts) ||
+			!MutateWords(seed, mutations[1].Counts) ||
+			!MutateBytes(seed, randomCases, mutations[2].Counts))
+			return 1;
+
+		for (const Mutation& m : mutations)
+		{
+			std::printf("%10s %8zu %12s %9llu %9llu %9.1f\n", seed.Name, seed.Bytes.size(), m.Name,
+				(unsigned long long)m.Counts.Cases, (unsigned long long)m.Counts.Accepted,
+				m.Counts.Seconds * 1e9 / (double)m.Counts.Cases);
+			total.Cases += m.Counts.Cases;
+			total.Accepted += m.Counts.Accepted;
+			total.Seconds += m.Counts.Seconds;
+		}
+	}
+
+	std::printf("\n%llu cases, %llu accepted, none out of bounds, %.1f ns/parse\n",
+		(unsigned long long)total.Cases, (unsigned long long)total.Accepted, total.Seconds * 1e9 / (double)total.Cases);
+
+	return 0;
+}
@@ -0,0 +1,479 @@
+//***************************************************************************************
+// EntityBench.cpp
+//
+// Times the app's per-frame item systems over 10k to 1M items, once with every item
+// a heap-allocated struct holding all of its data (as RenderItem was) and once with
+// the data split into EntityWorld components:
+//
+//   upload   copying the constants of the items changed this frame (one in 64) into
+//            an object constant array, which means finding them among all the others
+//   cull     testing each drawn item's bounds against a view frustum and listing the
+//            visible ones
+//   collide  the camera's four rays against every collider box
+//
+// upload is also timed with ParallelForEach.  Each system reads only the components
+// it needs; the struct version drags every item's whole struct through the cache.
+//
+// Before anything is timed, a world is put through a long random run of creates,
+// destroys, adds and removes and compared with a plain model of what it should hold,
+// and every system's result is compared between the two layouts.
+//
+// Usage: EntityBench [iterations]
+//
+// Build (from the repository root):
+//   g++ -std=c++14 -O2 -pthread -ICommon Tools/EntityBench/EntityBench.cpp Common/EntityWorld.cpp -o EntityBench
+//   cl /O2 /EHsc /ICommon Tools\EntityBench\EntityBench.cpp Common\EntityWorld.cpp
+//***************************************************************************************
+
+#include "EntityWorld.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace
+{
+	const std::uint32_t MaxObjectLights = 16;
+	const float CollisionDistance = 3.0f;
+
+	double Milliseconds(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	struct Aabb
+	{
+		float Center[3];
+		float Extents[3];
+	};
+
+	struct Sphere
+	{
+		float Center[3];
+		float Radius;
+	};
+
+	// What the object constant buffer holds per item.
+	struct ObjectConstants
+	{
+		float World[16];
+		float TexTransform[16];
+		std::uint32_t PointLightCount;
+		std::uint32_t SpotLightCount;
+		std::uint32_t Pad[2];
+		std::uint32_t LocalLights[MaxObjectLights];
+	};
+
+	// Everything in one struct, laid out like RenderItem.
+	struct Item
+	{
+		float World[16];
+		float TexTransform[16];
+		int NumFramesDirty;
+		std::uint32_t ObjCBIndex;
+		std::uint32_t Node;
+		const void* Mat;
+		const void* Geo;
+		Aabb Collider;
+		bool Collides;
+		Sphere WorldBounds;
+		Aabb WorldBox;
+		bool LightsDirty;
+		std::uint32_t PointLightCount;
+		std::uint32_t SpotLightCount;
+		std::uint32_t LocalLights[MaxObjectLights];
+		std::uint32_t LightVariant;
+		std::uint32_t PrimitiveType;
+		std::uint32_t IndexCount;
+		std::uint32_t StartIndexLocation;
+		int BaseVertexLocation;
+	};
+
+	// The same data as components, split by the systems that use it.
+	struct Transform
+	{
+		float World[16];
+		float TexTransform[16];
+		int NumFramesDirty;
+	};
+
+	struct Renderable
+	{
+		std::uint32_t ObjCBIndex;
+		std::uint32_t LightVariant;
+		const void* Mat;
+		const void* Geo;
+		std::uint32_t PrimitiveType;
+		std::uint32_t IndexCount;
+		std::uint32_t StartIndexLocation;
+		int BaseVertexLocation;
+	};
+
+	struct Bounds
+	{
+		Sphere WorldBounds;
+		Aabb WorldBox;
+	};
+
+	struct LightList
+	{
+		bool Dirty;
+		std::uint32_t PointLightCount;
+		std::uint32_t SpotLightCount;
+		std::uint32_t LocalLights[MaxObjectLights];
+	};
+
+	struct Collider
+	{
+		Aabb Box;
+	};
+
+	// Planes (a, b, c, d) with a point inside where ax + by + cz + d >= 0: a box 400
+	// units wide around the middle of the level, which sees about a quarter of it.
+	struct Frustum
+	{
+		float Planes[6][4];
+	};
+
+	Frustum MakeFrustum(float side)
+	{
+		const float half = 0.25f * side;
+		const float mid = 0.5f * side;
+		Frustum f = { {
+			{ 1, 0, 0, -(mid - half) }, { -1, 0, 0, mid + half },
+			{ 0, 1, 0, 100.0f }, { 0, -1, 0, 100.0f },
+			{ 0, 0, 1, -(mid - half) }, { 0, 0, -1, mid + half },
+		} };
+		return f;
+	}
+
+	bool Visible(const Frustum& frustum, const Sphere& sphere)
+	{
+		for (const float* p : frustum.Planes)
+		{
+			if (p[0] * sphere.Center[0] + p[1] * sphere.Center[1] + p[2] * sphere.Center[2] + p[3] < -sphere.Radius)
+				return false;
+		}
+		return true;
+	}
+
+	// Distance along a ray to a box, or a negative number for a miss.
+	float RayBox(const float origin[3], const float direction[3], const Aabb& box)
+	{
+		float tMin = 0.0f, tMax = 1e30f;
+		for (int a = 0; a < 3; ++a)
+		{
+			const float lo = box.Center[a] - box.Extents[a] - origin[a];
+			const float hi = box.Center[a] + box.Extents[a] - origin[a];
+			if (std::fabs(direction[a]) < 1e-8f)
+			{
+				if (lo > 0.0f || hi < 0.0f)
+					return -1.0f;
+				continue;
+			}
+			float t0 = lo / direction[a], t1 = hi / direction[a];
+			if (t0 > t1)
+				std::swap(t0, t1);
+			tMin = std::max(tMin, t0);
+			tMax = std::min(tMax, t1);
+			if (tMin > tMax)
+				return -1.0f;
+		}
+		return tMin;
+	}
+
+	// The four rays GetMovementBooleans casts; a bit per ray stopped within reach.
+	std::uint32_t Collide(const Aabb& box, const float eye[3])
+	{
+		static const float directions[4][3] = { { 0, 0, 1 }, { 0, 0, -1 }, { -1, 0, 0 }, { 1, 0, 0 } };
+		std::uint32_t hits = 0;
+		for (int r = 0; r < 4; ++r)
+		{
+			const float t = RayBox(eye, directions[r], box);
+			if (t >= 0.0f && t < CollisionDistance)
+				hits |= 1u << r;
+		}
+		return hits;
+	}
+
+	// Items on a grid, a wall every other one.
+	void MakeItem(std::uint32_t i, std::uint32_t side, Item& item)
+	{
+		std::memset(&item, 0, sizeof(item));
+		const float x = 2.0f * (i % side), z = 2.0f * (i / side);
+		for (int k = 0; k < 16; k += 5)
+			item.World[k] = item.TexTransform[k] = 1.0f;
+		item.World[12] = x;
+		item.World[14] = z;
+		item.ObjCBIndex = i;
+		item.Collides = (i % 2) == 0;
+		item.Collider = Aabb{ { x, 1.0f, z }, { 0.9f, 1.0f, 0.2f } };
+		item.WorldBounds = Sphere{ { x, 1.0f, z }, 1.0f };
+		item.WorldBox = item.Collider;
+		item.PointLightCount = i % 4;
+		for (std::uint32_t l = 0; l < MaxObjectLights; ++l)
+			item.LocalLights[l] = i + l;
+		item.IndexCount = 36;
+	}
+
+	void WriteConstants(const float world[16], const float texTransform[16], const LightList& lights, ObjectConstants& out)
+	{
+		std::copy(world, world + 16, out.World);
+		std::copy(texTransform, texTransform + 16, out.TexTransform);
+		out.PointLightCount = lights.PointLightCount;
+		out.SpotLightCount = lights.SpotLightCount;
+		std::copy(lights.LocalLights, lights.LocalLights + MaxObjectLights, out.LocalLights);
+	}
+
+	// Median time of run(i) over iterations, each after an untimed prepare(i).
+	template <class Prepare, class Run>
+	double Median(int iterations, Prepare prepare, Run run)
+	{
+		std::vector<double> times;
+		for (int i = 0; i < iterations; ++i)
+		{
+			prepare(i);
+			auto start = std::chrono::steady_clock::now();
+			run(i);
+			times.push_back(Milliseconds(start));
+		}
+		std::sort(times.begin(), times.end());
+		return times[times.size() / 2];
+	}
+
+	// Random creates, destroys, adds and removes against a model of each entity's
+	// components (a value per type, or -1 for none).
+	bool VerifyWorld()
+	{
+		struct A { int Value; };
+		struct B { double Value; int Pad[3]; };
+		struct C { std::uint8_t Value; };
+
+		EntityWorld world;
+		std::mt19937 rng(3111);
+		std::map<std::uint32_t, std::pair<Entity, std::array<int, 3>>> model;
+		std::vector<Entity> dead;
+		for (int step = 0; step < 200000; ++step)
+		{
+			const int op = rng() % 8;
+			const int value = (int)(rng() % 200);
+			if (op == 0 || model.empty())
+			{
+				const Entity e = world.Create(A{ value }, C{ (std::uint8_t)(value + 1) });
+				model[e.Index] = std::make_pair(e, std::array<int, 3>{ { value, -1, (value + 1) & 0xff } });
+				continue;
+			}
+
+			auto it = model.begin();
+			std::advance(it, rng() % model.size());
+			const Entity e = it->second.first;
+			std::array<int, 3>& values = it->second.second;
+			switch (op)
+			{
+			case 1:
+				world.Destroy(e);
+				dead.push_back(e);
+				model.erase(it);
+				break;
+			case 2: world.Add(e, A{ value }); values[0] = value; break;
+			case 3: world.Add(e, B{ (double)value, {} }); values[1] = value; break;
+			case 4: world.Add(e, C{ (std::uint8_t)value }); values[2] = value; break;
+			case 5: world.Remove<A>(e); values[0] = -1; break;
+			case 6: world.Remove<B>(e); values[1] = -1; break;
+			default: world.Remove<C>(e); values[2] = -1; break;
+			}
+		}
+
+		for (const Entity& e : dead)
+		{
+			if (world.Alive(e))
+			{
+				std::fprintf(stderr, "destroyed entity %u is alive\n", e.Index);
+				return false;
+			}
+		}
+		for (const auto& entry : model)
+		{
+			const Entity e = entry.second.first;
+			const std::array<int, 3>& values = entry.second.second;
+			const bool ok = world.Alive(e) &&
+				world.Has<A>(e) == (values[0] >= 0) && (values[0] < 0 || world.Get<A>(e).Value == values[0]) &&
+				world.Has<B>(e) == (values[1] >= 0) && (values[1] < 0 || world.Get<B>(e).Value == values[1]) &&
+				world.Has<C>(e) == (values[2] >= 0) && (values[2] < 0 || world.Get<C>(e).Value == values[2]);
+			if (!ok)
+			{
+				std::fprintf(stderr, "entity %u does not match the model\n", e.Index);
+				return false;
+			}
+		}
+
+		// ForEach and ParallelForEach visit exactly the entities with the components.
+		std::uint32_t withAC = 0;
+		for (const auto& entry : model)
+			withAC += entry.second.second[0] >= 0 && entry.second.second[2] >= 0;
+		std::uint32_t visited = 0;
+		world.ForEach<A, C>([&](Entity e, A& a, C&) { visited += (model.at(e.Index).second[0] == a.Value); });
+		std::vector<std::uint8_t> seen(world.EntityCount() + model.rbegin()->first + 1, 0);
+		world.ParallelForEach<A, C>([&](Entity e, A&, C&) { seen[e.Index] = 1; });
+		const std::uint32_t seenCount = (std::uint32_t)std::count(seen.begin(), seen.end(), 1);
+		if (model.size() != world.EntityCount() || visited != withAC || seenCount != withAC || world.Count<A, C>() != withAC)
+		{
+			std::fprintf(stderr, "iteration visited %u and %u of %u entities\n", visited, seenCount, withAC);
+			return false;
+		}
+		return true;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const int iterations = (argc > 1) ? std::max(1, std::atoi(argv[1])) : 20;
+
+	if (!VerifyWorld())
+		return 1;
+
+	std::printf("%d iterations, median ms\n\n", iterations);
+	std::printf("%8s %9s %9s %9s %9s %9s %9s %9s %9s %9s\n", "items", "upload", "", "", "cull", "", "collide", "",
+		"struct MB", "world MB");
+	std::printf("%8s %9s %9s %9s %9s %9s %9s %9s\n", "", "struct", "world", "parallel", "struct", "world", "struct", "world");
+
+	const std::uint32_t counts[] = { 10000, 100000, 1000000 };
+	for (std::uint32_t count : counts)
+	{
+		const std::uint32_t side = (std::uint32_t)std::ceil(std::sqrt((double)count));
+
+		// The struct layout: one allocation per item, reached through a pointer.
+		std::vector<std::unique_ptr<Item>> items;
+		EntityWorld world;
+		for (std::uint32_t i = 0; i < count; ++i)
+		{
+			auto item = std::make_unique<Item>();
+			MakeItem(i, side, *item);
+
+			Transform transform;
+			std::copy(item->World, item->World + 16, transform.World);
+			std::copy(item->TexTransform, item->TexTransform + 16, transform.TexTransform);
+			transform.NumFramesDirty = 0;
+			Renderable renderable = { item->ObjCBIndex, 0, nullptr, nullptr, 0, item->IndexCount, 0, 0 };
+			Bounds bounds = { item->WorldBounds, item->WorldBox };
+			LightList lights = {};
+			lights.PointLightCount = item->PointLightCount;
+			std::copy(item->LocalLights, item->LocalLights + MaxObjectLights, lights.LocalLights);
+
+			const Entity e = world.Create(transform, renderable, bounds, lights);
+			if (item->Collides)
+				world.Add(e, Collider{ item->Collider });
+			items.push_back(std::move(item));
+		}
+
+		std::vector<ObjectConstants> structCB(count), worldCB(count);
+		auto markDirty = [&](int frame)
+		{
+			for (std::uint32_t i = frame % 64; i < count; i += 64)
+				items[i]->NumFramesDirty = 1;
+			world.ForEach<Transform, Renderable>([&](Entity, Transform& t, const Renderable& r)
+			{
+				if (r.ObjCBIndex % 64 == (std::uint32_t)frame % 64)
+					t.NumFramesDirty = 1;
+			});
+		};
+
+		const double uploadStruct = Median(iterations, markDirty, [&](int)
+		{
+			for (auto& item : items)
+			{
+				if (item->NumFramesDirty > 0)
+				{
+					LightList lights = { false, item->PointLightCount, item->SpotLightCount, {} };
+					std::copy(item->LocalLights, item->LocalLights + MaxObjectLights, lights.LocalLights);
+					WriteConstants(item->World, item->TexTransform, lights, structCB[item->ObjCBIndex]);
+					--item->NumFramesDirty;
+				}
+			}
+		});
+		auto uploadWorld = [&](Entity, Transform& t, const Renderable& r, const LightList& lights)
+		{
+			if (t.NumFramesDirty > 0)
+			{
+				WriteConstants(t.World, t.TexTransform, lights, worldCB[r.ObjCBIndex]);
+				--t.NumFramesDirty;
+			}
+		};
+		const double uploadWorldMs = Median(iterations, markDirty, [&](int)
+		{
+			world.ForEach<Transform, Renderable, LightList>(uploadWorld);
+		});
+		const double uploadParallel = Median(iterations, markDirty, [&](int)
+		{
+			world.ParallelForEach<Transform, Renderable, LightList>(uploadWorld);
+		});
+		if (std::memcmp(structCB.data(), worldCB.data(), count * sizeof(ObjectConstants)) != 0)
+		{
+			std::fprintf(stderr, "%u items: uploaded constants differ\n", count);
+			return 1;
+		}
+
+		const Frustum frustum = MakeFrustum(2.0f * side);
+		std::vector<const Item*> visibleItems;
+		std::vector<const Renderable*> visibleWorld;
+		const double cullStruct = Median(iterations, [](int) {}, [&](int)
+		{
+			visibleItems.clear();
+			for (const auto& item : items)
+			{
+				if (Visible(frustum, item->WorldBounds))
+					visibleItems.push_back(item.get());
+			}
+		});
+		const double cullWorld = Median(iterations, [](int) {}, [&](int)
+		{
+			visibleWorld.clear();
+			world.ForEach<Renderable, Bounds>([&](Entity, const Renderable& r, const Bounds& b)
+			{
+				if (Visible(frustum, b.WorldBounds))
+					visibleWorld.push_back(&r);
+			});
+		});
+		if (visibleItems.size() != visibleWorld.size() || visibleItems.empty())
+		{
+			std::fprintf(stderr, "%u items: %zu and %zu visible\n", count, visibleItems.size(), visibleWorld.size());
+			return 1;
+		}
+
+		// The camera stands beside an item near the middle.
+		const float eye[3] = { (float)side, 1.0f, (float)side + 1.0f };
+		std::uint32_t hitsStruct = 0, hitsWorld = 0;
+		const double collideStruct = Median(iterations, [](int) {}, [&](int)
+		{
+			hitsStruct = 0;
+			for (const auto& item : items)
+			{
+				if (item->Collides)
+					hitsStruct |= Collide(item->Collider, eye);
+			}
+		});
+		const double collideWorld = Median(iterations, [](int) {}, [&](int)
+		{
+			hitsWorld = 0;
+			world.ForEach<Collider>([&](Entity, const Collider& c) { hitsWorld |= Collide(c.Box, eye); });
+		});
+		if (hitsStruct != hitsWorld || hitsStruct == 0)
+		{
+			std::fprintf(stderr, "%u items: rays stopped %x and %x\n", count, hitsStruct, hitsWorld);
+			return 1;
+		}
+
+		std::printf("%8u %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f %9.2f %9.2f\n", count, uploadStruct, uploadWorldMs,
+			uploadParallel, cullStruct, cullWorld, collideStruct, collideWorld,
+			count * (sizeof(Item) + sizeof(void*)) / (1024.0 * 1024.0), world.MemoryBytes() / (1024.0 * 1024.0));
+	}
+
+	return 0;
+}
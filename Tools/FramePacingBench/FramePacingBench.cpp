@@ -0,0 +1,177 @@
+//***************************************************************************************
+// FramePacingBench.cpp
+//
+// Runs FramePacer against SimulatedGpuTimeline for three workloads, each a fixed CPU
+// and GPU cost per frame, and prints what every pacing setting the app accepts
+// (-frameresources, -inflight and -latency) does to them:
+//
+//   fps      frames completed on the GPU per second of simulated time
+//   latency  average ms from the CPU starting a frame to the GPU finishing it
+//   stalls   frames whose BeginFrame had to wait on the fence
+//
+// Before the table, cases whose steady state is known are checked: a CPU that may run
+// N frames ahead of a busy GPU sees N GPU frames of latency, one frame in flight or a
+// swap chain latency of one serializes CPU and GPU, and no setting beats the slower of
+// the two.
+//
+// Usage: FramePacingBench [frames]
+//
+// Build (from the repository root):
+//   g++ -std=c++14 -O2 -ICommon Tools/FramePacingBench/FramePacingBench.cpp Common/FramePacer.cpp -o FramePacingBench
+//   cl /O2 /EHsc /ICommon Tools\FramePacingBench\FramePacingBench.cpp Common\FramePacer.cpp Common\d3dUtil.cpp Common\ShaderCache.cpp d3d12.lib d3dcompiler.lib
+//***************************************************************************************
+
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+namespace
+{
+	struct Workload
+	{
+		const char* Name;
+		double CpuMs;
+		double GpuMs;
+	};
+
+	const Workload Workloads[] =
+	{
+		{ "cpu bound", 10.0, 4.0 },
+		{ "balanced", 8.0, 8.0 },
+		{ "gpu bound", 4.0, 10.0 },
+	};
+
+	// The pacing settings, as -frameresources, -inflight and -latency give them.
+	// inflight 0 is the throughput policy.
+	struct Setting
+	{
+		int FrameResources;
+		int FramesInFlight;
+		int MaxFrameLatency;
+	};
+
+	std::unique_ptr<FramePacingPolicy> MakePolicy(int framesInFlight)
+	{
+		if (framesInFlight > 0)
+			return std::unique_ptr<FramePacingPolicy>(new LatencyPacingPolicy(framesInFlight));
+		return std::unique_ptr<FramePacingPolicy>(new ThroughputPacingPolicy());
+	}
+
+	FramePacingSimResult Simulate(const Setting& setting, const Workload& workload, int frames)
+	{
+		return SimulateFramePacing(MakePolicy(setting.FramesInFlight), setting.FrameResources,
+			setting.MaxFrameLatency, workload.CpuMs, workload.GpuMs, frames);
+	}
+
+	// Averages include the frames before the steady state, so allow a little.
+	bool Near(double value, double expected)
+	{
+		return std::fabs(value - expected) <= 0.01 * expected;
+	}
+
+	bool Check(const Setting& setting, const Workload& workload, int frames,
+		double fps, double latencyMs, long long stalls)
+	{
+		const FramePacingSimResult r = Simulate(setting, workload, frames);
+		if (Near(r.FramesPerSecond, fps) && Near(r.AverageLatencyMs, latencyMs) && (stalls < 0 || (long long)r.Stalls == stalls))
+			return true;
+
+		std::fprintf(stderr, "%s, %d frame resources, inflight %d, latency %d: %.2f fps, %.2f ms, %llu stalls; expected %.2f fps, %.2f ms",
+			workload.Name, setting.FrameResources, setting.FramesInFlight, setting.MaxFrameLatency,
+			r.FramesPerSecond, r.AverageLatencyMs, (unsigned long long)r.Stalls, fps, latencyMs);
+		if (stalls >= 0)
+			std::fprintf(stderr, ", %lld stalls", stalls);
+		std::fprintf(stderr, "\n");
+		return false;
+	}
+
+	bool VerifyPacing(int frames)
+	{
+		const Workload& cpuBound = Workloads[0];
+		const Workload& gpuBound = Workloads[2];
+		const double serialMs = gpuBound.CpuMs + gpuBound.GpuMs;
+
+		// Running ahead: the CPU waits for the frame that last used its frame resource,
+		// so a busy GPU always has N frames queued and each takes N GPU frames to finish.
+		for (int n = 2; n <= 4; ++n)
+		{
+			if (!Check({ n, 0, 0 }, gpuBound, frames, 1000.0 / gpuBound.GpuMs, n * gpuBound.GpuMs, -1))
+				return false;
+		}
+
+		// Frames in flight cap the queue below the frame resources.
+		if (!Check({ 3, 2, 0 }, gpuBound, frames, 1000.0 / gpuBound.GpuMs, 2 * gpuBound.GpuMs, frames - 2))
+			return false;
+
+		// One frame in flight, one frame resource, or a swap chain that queues one
+		// frame: the CPU and GPU take turns.  The swap chain's wait is not a fence stall.
+		if (!Check({ 3, 1, 0 }, gpuBound, frames, 1000.0 / serialMs, serialMs, frames - 1) ||
+			!Check({ 1, 0, 0 }, gpuBound, frames, 1000.0 / serialMs, serialMs, frames - 1) ||
+			!Check({ 3, 0, 1 }, gpuBound, frames, 1000.0 / serialMs, serialMs, 0))
+			return false;
+
+		// A GPU that keeps up is never waited on.
+		if (!Check({ 3, 0, 0 }, cpuBound, frames, 1000.0 / cpuBound.CpuMs, cpuBound.CpuMs + cpuBound.GpuMs, 0))
+			return false;
+
+		// Nothing is faster than the slower side or quicker than doing both in turn.
+		for (int resources = 1; resources <= 4; ++resources)
+		{
+			for (int inflight = 0; inflight <= 3; ++inflight)
+			{
+				for (int latency = 0; latency <= 3; ++latency)
+				{
+					for (const Workload& w : Workloads)
+					{
+						const FramePacingSimResult r = Simulate({ resources, inflight, latency }, w, frames);
+						if (r.FramesPerSecond > 1000.0 / (std::max)(w.CpuMs, w.GpuMs) * 1.0001 ||
+							r.AverageLatencyMs < (w.CpuMs + w.GpuMs) * 0.9999)
+						{
+							std::fprintf(stderr, "%s, %d frame resources, inflight %d, latency %d: %.2f fps at %.2f ms is impossible\n",
+								w.Name, resources, inflight, latency, r.FramesPerSecond, r.AverageLatencyMs);
+							return false;
+						}
+					}
+				}
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const int frames = (argc > 1) ? (std::max)(100, std::atoi(argv[1])) : 1000;
+
+	if (!VerifyPacing(frames))
+		return 1;
+
+	std::printf("%d frames, fps / latency ms / stalls\n\n", frames);
+	std::printf("%9s %8s %7s ", "resources", "inflight", "latency");
+	for (const Workload& w : Workloads)
+		std::printf(" %22s", w.Name);
+	std::printf("\n");
+
+	const Setting settings[] =
+	{
+		{ 3, 0, 0 }, { 2, 0, 0 }, { 4, 0, 0 },
+		{ 3, 1, 0 }, { 3, 2, 0 },
+		{ 3, 0, 1 }, { 3, 0, 2 }, { 3, 2, 1 },
+	};
+	for (const Setting& s : settings)
+	{
+		std::printf("%9d %8d %7d ", s.FrameResources, s.FramesInFlight, s.MaxFrameLatency);
+		for (const Workload& w : Workloads)
+		{
+			const FramePacingSimResult r = Simulate(s, w, frames);
+			std::printf(" %7.1f %7.2f %6llu", r.FramesPerSecond, r.AverageLatencyMs, (unsigned long long)r.Stalls);
+		}
+		std::printf("\n");
+	}
+
+	return 0;
+}
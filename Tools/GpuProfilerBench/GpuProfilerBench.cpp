@@ -0,0 +1,235 @@
+//***************************************************************************************
+// GpuProfilerBench.cpp
+//
+// Runs GpuProfiler the way the app does, paced by a FramePacer, with
+// SimulatedGpuTimeline standing in for the GPU and SimulatedTimestampBackend for its
+// timestamp queries.  Every frame brackets an opaque and a transparent pass, nested in
+// a whole-frame scope, with lengths that differ from frame to frame.
+//
+// For each workload and frame resource count the frames read back are compared with
+// the frames that had completed: the phase times added to each FrameStats sample must
+// be those of exactly the frames whose fence had passed, the resolve latency must be
+// the age of the newest of them, and no frame may be dropped.  Then:
+//
+//   latency   resolve latency once steady, in frames
+//   resolved  frames read back
+//   dropped   frames whose queries were overwritten before being read
+//   ns/frame  CPU cost of the profiler's bookkeeping for one frame
+//
+// A profiler whose GPU never finishes must drop every frame once its frame resources
+// come round again, and scopes beyond the limit must be ignored.
+//
+// Usage: GpuProfilerBench [frames]
+//
+// Build (from the repository root):
+//   g++ -std=c++14 -O2 -ICommon Tools/GpuProfilerBench/GpuProfilerBench.cpp Common/GpuProfiler.cpp Common/FramePacer.cpp Common/FrameStats.cpp -o GpuProfilerBench
+//   cl /O2 /EHsc /ICommon Tools\GpuProfilerBench\GpuProfilerBench.cpp Common\GpuProfiler.cpp Common\FramePacer.cpp Common\FrameStats.cpp Common\d3dUtil.cpp Common\ShaderCache.cpp d3d12.lib d3dcompiler.lib
+//***************************************************************************************
+
+#include "GpuProfiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+namespace
+{
+	// Timestamps in microseconds.
+	const std::uint64_t Frequency = 1000000;
+
+	struct Workload
+	{
+		const char* Name;
+		double CpuMs;
+		double GpuMs;
+	};
+
+	const Workload Workloads[] =
+	{
+		{ "cpu bound", 10.0, 4.0 },
+		{ "gpu bound", 4.0, 10.0 },
+	};
+
+	// Pass lengths in timestamp ticks, different for every frame.
+	std::uint64_t OpaqueTicks(int frame) { return 1000 + (std::uint64_t)(frame % 97) * 10; }
+	std::uint64_t TransparentTicks(int frame) { return 200 + (std::uint64_t)(frame % 13) * 7; }
+
+	struct Result
+	{
+		std::uint64_t Latency;
+		std::uint64_t Resolved;
+		std::uint64_t Dropped;
+		double NsPerFrame;
+	};
+
+	// Runs frames through a FramePacer and GpuProfiler.  With verify, checks each
+	// FrameStats sample against the frames that had completed when it was read.
+	bool Run(const Workload& workload, int frameResources, int frames, bool verify, Result& result)
+	{
+		SimulatedGpuTimeline timeline;
+		FramePacer pacer(timeline, std::unique_ptr<FramePacingPolicy>(new ThroughputPacingPolicy()), frameResources);
+		SimulatedTimestampBackend backend(frameResources, 6, Frequency);
+		GpuProfiler profiler(backend, timeline, frameResources, 3);
+		FrameStats stats(1024);
+
+		const double ticksToMs = 1000.0 / Frequency;
+		int lastRead = -1;
+		double profilerSeconds = 0.0;
+		for (int frame = 0; frame < frames; ++frame)
+		{
+			const int index = pacer.BeginFrame();
+
+			// Frames complete in order and fence frame+1 ends frame.
+			const int newestComplete = (int)timeline.CompletedValue() - 1;
+
+			auto start = std::chrono::steady_clock::now();
+			profiler.BeginFrame(index, stats);
+			{
+				ScopedGpuPhase frameScope(profiler, FramePhase::GpuFrame);
+				{
+					ScopedGpuPhase opaque(profiler, FramePhase::GpuOpaque);
+					backend.Advance(OpaqueTicks(frame));
+				}
+				{
+					ScopedGpuPhase transparent(profiler, FramePhase::GpuTransparent);
+					backend.Advance(TransparentTicks(frame));
+				}
+			}
+			profiler.ResolveFrame();
+			profilerSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			timeline.AdvanceCpu(workload.CpuMs);
+			timeline.Submit(frame + 1, workload.GpuMs);
+			pacer.EndFrame(frame + 1);
+			profiler.EndFrame(frame + 1);
+			stats.EndFrame(workload.CpuMs);
+
+			if (!verify)
+				continue;
+
+			double opaqueMs = 0.0;
+			double transparentMs = 0.0;
+			for (int read = lastRead + 1; read <= newestComplete; ++read)
+			{
+				opaqueMs += OpaqueTicks(read) * ticksToMs;
+				transparentMs += TransparentTicks(read) * ticksToMs;
+			}
+
+			FrameSample sample;
+			stats.ReadRecent(&sample, 1);
+			const float* ms = sample.PhaseMs;
+			if (std::fabs(ms[(int)FramePhase::GpuOpaque] - opaqueMs) > 1e-4 ||
+				std::fabs(ms[(int)FramePhase::GpuTransparent] - transparentMs) > 1e-4 ||
+				std::fabs(ms[(int)FramePhase::GpuFrame] - (opaqueMs + transparentMs)) > 1e-4)
+			{
+				std::fprintf(stderr, "%s, %d frame resources, frame %d: read opaque %.3f, transparent %.3f, frame %.3f ms; expected %.3f, %.3f ms from frames %d to %d\n",
+					workload.Name, frameResources, frame, ms[(int)FramePhase::GpuOpaque], ms[(int)FramePhase::GpuTransparent],
+					ms[(int)FramePhase::GpuFrame], opaqueMs, transparentMs, lastRead + 1, newestComplete);
+				return false;
+			}
+
+			if (newestComplete > lastRead)
+			{
+				if (profiler.ResolveLatency() != (std::uint64_t)(frame - newestComplete))
+				{
+					std::fprintf(stderr, "%s, %d frame resources, frame %d: resolve latency %llu, expected %d\n",
+						workload.Name, frameResources, frame, (unsigned long long)profiler.ResolveLatency(), frame - newestComplete);
+					return false;
+				}
+				lastRead = newestComplete;
+			}
+
+			if (profiler.ResolvedFrameCount() != (std::uint64_t)(lastRead + 1) || profiler.DroppedFrameCount() != 0)
+			{
+				std::fprintf(stderr, "%s, %d frame resources, frame %d: %llu frames resolved and %llu dropped, expected %d and 0\n",
+					workload.Name, frameResources, frame, (unsigned long long)profiler.ResolvedFrameCount(),
+					(unsigned long long)profiler.DroppedFrameCount(), lastRead + 1);
+				return false;
+			}
+		}
+
+		result.Latency = profiler.ResolveLatency();
+		result.Resolved = profiler.ResolvedFrameCount();
+		result.Dropped = profiler.DroppedFrameCount();
+		result.NsPerFrame = profilerSeconds * 1e9 / frames;
+		return true;
+	}
+
+	// Nothing completes, so every frame is overwritten unread; and a fourth scope in a
+	// profiler allowing three is ignored.
+	bool VerifyDropsAndLimits()
+	{
+		const int frameResources = 3;
+		SimulatedGpuTimeline timeline;
+		SimulatedTimestampBackend backend(frameResources, 6, Frequency);
+		GpuProfiler profiler(backend, timeline, frameResources, 3);
+		FrameStats stats(64);
+
+		const int frames = 10;
+		for (int frame = 0; frame < frames; ++frame)
+		{
+			profiler.BeginFrame(frame % frameResources, stats);
+			int scopes[4];
+			for (int& scope : scopes)
+				scope = profiler.BeginScope(FramePhase::GpuOpaque);
+			for (int s = 3; s >= 0; --s)
+				profiler.EndScope(scopes[s]);
+			if (scopes[3] != -1)
+			{
+				std::fprintf(stderr, "a scope beyond the limit was recorded\n");
+				return false;
+			}
+			profiler.ResolveFrame();
+			profiler.EndFrame(frame + 1);
+		}
+
+		if (profiler.ResolvedFrameCount() != 0 || profiler.DroppedFrameCount() != frames - frameResources)
+		{
+			std::fprintf(stderr, "with no frame completing, %llu frames resolved and %llu dropped, expected 0 and %d\n",
+				(unsigned long long)profiler.ResolvedFrameCount(), (unsigned long long)profiler.DroppedFrameCount(), frames - frameResources);
+			return false;
+		}
+		return true;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const int frames = (argc > 1) ? (std::max)(100, std::atoi(argv[1])) : 10000;
+
+	if (!VerifyDropsAndLimits())
+		return 1;
+
+	std::printf("%d frames\n\n", frames);
+	std::printf("%10s %9s %8s %9s %8s %9s\n", "workload", "resources", "latency", "resolved", "dropped", "ns/frame");
+	for (const Workload& w : Workloads)
+	{
+		for (int frameResources = 1; frameResources <= 4; ++frameResources)
+		{
+			Result result;
+			if (!Run(w, frameResources, frames, true, result))
+				return 1;
+
+			// A busy GPU is behind by as many frames as the CPU may run ahead.  One that
+			// keeps up is still on the frame just submitted but has finished the one
+			// before, unless a single frame resource made the CPU wait for it.
+			const std::uint64_t expected = (std::uint64_t)(w.GpuMs > w.CpuMs ? frameResources : (std::min)(frameResources, 2));
+			if (result.Latency != expected)
+			{
+				std::fprintf(stderr, "%s, %d frame resources: resolve latency %llu, expected %llu\n",
+					w.Name, frameResources, (unsigned long long)result.Latency, (unsigned long long)expected);
+				return 1;
+			}
+
+			Run(w, frameResources, frames, false, result);
+			std::printf("%10s %9d %8llu %9llu %8llu %9.1f\n", w.Name, frameResources, (unsigned long long)result.Latency,
+				(unsigned long long)result.Resolved, (unsigned long long)result.Dropped, result.NsPerFrame);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,240 @@
+//***************************************************************************************
+// HierarchyBench.cpp
+//
+// Times TransformHierarchy on levels of 16 to 4096 castles, each a tree of 227 nodes
+// up to nine deep: eight towers with their roofs, orbs and crenellations, four walls
+// with theirs, and a gate with a drawbridge hanging two chains of six links.
+//
+//   build   adding every node and the first Update, which sorts them
+//   still   an Update with nothing changed
+//   gates   every castle's drawbridge lowered a little, as an animation does each frame
+//   castle  one castle moved
+//   all     every castle moved, which recomputes every node
+//
+// changed is how many worlds the timed Update recomputed.  Every result is first
+// compared with worlds computed directly from the parents, and again after towers are
+// moved between castles and crenellations removed, so a timing is only printed for a
+// correct result.
+//
+// Usage: HierarchyBench [iterations]
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -pthread -ICommon Tools/HierarchyBench/HierarchyBench.cpp Common/TransformHierarchy.cpp -o HierarchyBench
+//   cl /std:c++17 /O2 /EHsc /ICommon Tools\HierarchyBench\HierarchyBench.cpp Common\TransformHierarchy.cpp
+//***************************************************************************************
+
+#include "TransformHierarchy.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+namespace
+{
+	const std::uint32_t NodesPerCastle = 227;
+
+	double Milliseconds(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// A rotation about y, then about x, then a translation, as row-major row vectors.
+	void Transform(float yaw, float pitch, float x, float y, float z, float out[16])
+	{
+		const float cy = std::cos(yaw), sy = std::sin(yaw);
+		const float cp = std::cos(pitch), sp = std::sin(pitch);
+		const float m[16] =
+		{
+			cy, 0.0f, -sy, 0.0f,
+			sy * sp, cp, cy * sp, 0.0f,
+			sy * cp, -sp, cy * cp, 0.0f,
+			x, y, z, 1.0f,
+		};
+		std::copy(m, m + 16, out);
+	}
+
+	struct Castle
+	{
+		std::uint32_t Root;
+		std::uint32_t Drawbridge;
+		std::vector<std::uint32_t> Towers;
+		std::vector<std::uint32_t> Crenellations;
+	};
+
+	Castle AddCastle(TransformHierarchy& hierarchy, std::uint32_t index, std::uint32_t side)
+	{
+		float m[16];
+		auto add = [&](std::uint32_t parent, float yaw, float x, float y, float z)
+		{
+			Transform(yaw, 0.0f, x, y, z, m);
+			return hierarchy.Add(parent, m);
+		};
+
+		Castle castle;
+		castle.Root = add(TransformHierarchy::NoNode, 0.1f * index, 100.0f * (index % side), 0.0f, 100.0f * (index / side));
+		for (int t = 0; t < 8; ++t)
+		{
+			const float angle = 0.785f * t;
+			const std::uint32_t tower = add(castle.Root, angle, 23.0f * std::cos(angle), 0.0f, 23.0f * std::sin(angle));
+			castle.Towers.push_back(tower);
+			add(tower, 0.0f, 0.0f, 12.5f, 0.0f);
+			add(tower, 0.0f, 0.0f, 22.0f, 0.0f);
+			add(tower, 0.0f, 0.0f, 20.0f, 0.0f);
+			for (int c = 0; c < 12; ++c)
+				castle.Crenellations.push_back(add(tower, 0.52f * c, 2.0f * std::cos(0.52f * c), 20.0f, 2.0f * std::sin(0.52f * c)));
+		}
+		for (int w = 0; w < 4; ++w)
+		{
+			const std::uint32_t wall = add(castle.Root, 1.57f * w, 0.0f, 10.0f, 23.0f);
+			for (int c = 0; c < 20; ++c)
+				castle.Crenellations.push_back(add(wall, 0.0f, -19.0f + 2.0f * c, 5.5f, 0.0f));
+		}
+
+		const std::uint32_t gate = add(castle.Root, 0.0f, 0.0f, 5.0f, -24.0f);
+		castle.Drawbridge = add(gate, 0.0f, 0.0f, 0.0f, 0.0f);
+		for (int side = -1; side <= 1; side += 2)
+		{
+			std::uint32_t link = add(castle.Drawbridge, 0.0f, 1.8f * side, 8.0f, 0.0f);
+			for (int l = 1; l < 6; ++l)
+				link = add(link, 0.0f, 0.0f, -0.5f, 0.0f);
+		}
+		return castle;
+	}
+
+	// Worlds straight from the definition, in double precision, one chain of parents
+	// per node.
+	bool Verify(const TransformHierarchy& hierarchy, const std::vector<std::uint32_t>& nodes)
+	{
+		for (std::uint32_t node : nodes)
+		{
+			double world[16];
+			const float* local = hierarchy.Local(node);
+			std::copy(local, local + 16, world);
+			for (std::uint32_t parent = hierarchy.Parent(node); parent != TransformHierarchy::NoNode; parent = hierarchy.Parent(parent))
+			{
+				const float* p = hierarchy.Local(parent);
+				double product[16];
+				for (int r = 0; r < 4; ++r)
+				{
+					for (int c = 0; c < 4; ++c)
+					{
+						product[4 * r + c] = world[4 * r] * p[c] + world[4 * r + 1] * p[4 + c] +
+							world[4 * r + 2] * p[8 + c] + world[4 * r + 3] * p[12 + c];
+					}
+				}
+				std::copy(product, product + 16, world);
+			}
+
+			const float* actual = hierarchy.World(node);
+			for (int i = 0; i < 16; ++i)
+			{
+				if (std::fabs(actual[i] - world[i]) > 1e-3 * std::max(1.0, std::fabs(world[i])))
+				{
+					std::fprintf(stderr, "node %u: world[%d] is %f, expected %f\n", node, i, actual[i], world[i]);
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// Median Update time over iterations, each after change() marks its nodes.
+	template <class Change>
+	double TimeUpdate(TransformHierarchy& hierarchy, int iterations, Change change)
+	{
+		std::vector<double> times;
+		for (int i = 0; i < iterations; ++i)
+		{
+			change(i);
+			auto start = std::chrono::steady_clock::now();
+			hierarchy.Update();
+			times.push_back(Milliseconds(start));
+		}
+		std::sort(times.begin(), times.end());
+		return times[times.size() / 2];
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const int iterations = (argc > 1) ? std::max(1, std::atoi(argv[1])) : 20;
+
+	std::printf("%u nodes per castle, %d iterations, median ms (changed nodes)\n\n", NodesPerCastle, iterations);
+	std::printf("%8s %8s %10s %8s %18s %18s %20s %8s\n", "castles", "nodes", "build", "still", "gates", "castle", "all", "MB");
+
+	const std::uint32_t counts[] = { 16, 256, 4096 };
+	for (std::uint32_t count : counts)
+	{
+		const std::uint32_t side = (std::uint32_t)std::ceil(std::sqrt((double)count));
+
+		TransformHierarchy hierarchy;
+		std::vector<Castle> castles;
+		auto start = std::chrono::steady_clock::now();
+		for (std::uint32_t i = 0; i < count; ++i)
+			castles.push_back(AddCastle(hierarchy, i, side));
+		hierarchy.Update();
+		const double buildMs = Milliseconds(start);
+
+		std::vector<std::uint32_t> nodes(hierarchy.Changed());
+		if (nodes.size() != count * NodesPerCastle || !Verify(hierarchy, nodes))
+			return 1;
+
+		float m[16];
+		const double stillMs = TimeUpdate(hierarchy, iterations, [](int) {});
+
+		const double gatesMs = TimeUpdate(hierarchy, iterations, [&](int i)
+		{
+			Transform(0.0f, -0.05f * (i + 1), 0.0f, 0.0f, 0.0f, m);
+			for (const Castle& castle : castles)
+				hierarchy.SetLocal(castle.Drawbridge, m);
+		});
+		const std::size_t gatesChanged = hierarchy.Changed().size();
+
+		const double castleMs = TimeUpdate(hierarchy, iterations, [&](int i)
+		{
+			const float* local = hierarchy.Local(castles[0].Root);
+			Transform(0.1f * i, 0.0f, local[12] + 1.0f, 0.0f, local[14], m);
+			hierarchy.SetLocal(castles[0].Root, m);
+		});
+		const std::size_t castleChanged = hierarchy.Changed().size();
+
+		const double allMs = TimeUpdate(hierarchy, iterations, [&](int i)
+		{
+			for (const Castle& castle : castles)
+			{
+				float local[16];
+				std::copy(hierarchy.Local(castle.Root), hierarchy.Local(castle.Root) + 16, local);
+				local[13] = 0.01f * i;
+				hierarchy.SetLocal(castle.Root, local);
+			}
+		});
+		const std::size_t allChanged = hierarchy.Changed().size();
+		if (!Verify(hierarchy, nodes))
+			return 1;
+
+		// Edits: every other castle's first tower goes to the next castle, and the first
+		// crenellation of every castle is knocked off.
+		std::mt19937 rng(count);
+		for (std::uint32_t i = 0; i + 1 < count; i += 2)
+			hierarchy.SetParent(castles[i].Towers[0], castles[i + 1].Root);
+		for (Castle& castle : castles)
+		{
+			const std::uint32_t crenellation = castle.Crenellations[rng() % castle.Crenellations.size()];
+			hierarchy.Remove(crenellation);
+			nodes.erase(std::find(nodes.begin(), nodes.end(), crenellation));
+		}
+		hierarchy.Update();
+		if (!Verify(hierarchy, nodes))
+			return 1;
+
+		std::printf("%8u %8u %10.3f %8.3f %10.3f (%5u) %10.3f (%5u) %10.3f (%7u) %8.2f\n", count, count * NodesPerCastle,
+			buildMs, stillMs, gatesMs, (unsigned)gatesChanged, castleMs, (unsigned)castleChanged, allMs,
+			(unsigned)allChanged, hierarchy.MemoryBytes() / (1024.0 * 1024.0));
+	}
+
+	return 0;
+}
@@ -0,0 +1,334 @@
+//***************************************************************************************
+// MazeBench.cpp
+//
+// Builds mazes of 16x16 to 1000x1000 cells with both algorithms and measures how
+// their cost grows: generating the maze, placing its walls into a compiled scene,
+// the memory both take, and the per-frame CPU work the app does for every placed
+// item, timed over a camera flying across the maze:
+//
+//   cull       the app's frustum test of each item's bounding sphere
+//   collision  the app's four camera rays against every collider box
+//   record     appending a draw for every visible item; a stand-in for command
+//              list recording, which needs a device (run the app with -maze N
+//              -benchmark F -stats file.csv for the real thing)
+//
+// hits is the average number of camera rays per frame stopped by a wall, as a check
+// that the collision test sees the maze.
+//
+// Every maze is first checked to be perfect (all cells connected, no loops) and the
+// same for the same seed, so a timing is only printed for a correct result.  A maze
+// too large for 32-bit cell indices must be refused without allocating, and the
+// app's -maze, -mazeseed and -mazealgo options must read the same in any order.
+//
+// Usage: MazeBench [seed]
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -ICommon Tools/MazeBench/MazeBench.cpp Common/MazeGenerator.cpp Common/SceneFile.cpp Common/MappedFile.cpp Common/CommandLine.cpp -o MazeBench
+//   cl /std:c++17 /O2 /EHsc /ICommon Tools\MazeBench\MazeBench.cpp Common\MazeGenerator.cpp Common\SceneFile.cpp Common\MappedFile.cpp Common\CommandLine.cpp
+//***************************************************************************************
+
+#include "CommandLine.h"
+#include "MazeGenerator.h"
+#include "SceneFile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+	const int FrameCount = 64;
+
+	// The app's lens: a quarter-pi vertical field of view at 16:9, 1 to 1000.
+	const float FovY = 0.25f * 3.1415926535f;
+	const float Aspect = 16.0f / 9.0f;
+	const float NearZ = 1.0f;
+	const float FarZ = 1000.0f;
+	const float CollisionDistance = 3.0f;
+
+	double Milliseconds(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	struct Vec3
+	{
+		float x, y, z;
+	};
+
+	Vec3 operator-(Vec3 a, Vec3 b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+	Vec3 operator*(Vec3 a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+	float Dot(Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+	Vec3 Cross(Vec3 a, Vec3 b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+	Vec3 Normalize(Vec3 a) { return a * (1.0f / std::sqrt(Dot(a, a))); }
+
+	// What the app keeps per placed item: its world box and the sphere around it.
+	struct Item
+	{
+		Vec3 Center;
+		Vec3 Extents;
+		float Radius;
+		std::uint32_t ObjCBIndex;
+		std::uint32_t IndexCount;
+	};
+
+	struct Draw
+	{
+		std::uint64_t ObjectAddress;
+		std::uint32_t IndexCount;
+		std::uint32_t StartIndex;
+	};
+
+	// Every cell reachable from cell 0 through open sides, with one fewer passage
+	// than cells: a spanning tree.
+	bool IsPerfect(const MazeGenerator& maze)
+	{
+		const std::uint32_t width = maze.Width();
+		const std::uint32_t height = maze.Height();
+		std::vector<bool> reached((std::size_t)width * height, false);
+		std::vector<std::uint32_t> open;
+		open.push_back(0);
+		reached[0] = true;
+
+		std::uint64_t passages = 0, count = 0;
+		while (!open.empty())
+		{
+			const std::uint32_t cell = open.back();
+			open.pop_back();
+			++count;
+
+			const std::uint32_t x = cell % width, y = cell / width;
+			auto visit = [&](std::uint32_t next)
+			{
+				if (!reached[next])
+				{
+					reached[next] = true;
+					open.push_back(next);
+				}
+			};
+			if (x + 1 < width && !maze.WallPositiveX(x, y)) { ++passages; visit(cell + 1); }
+			if (y + 1 < height && !maze.WallPositiveZ(x, y)) { ++passages; visit(cell + width); }
+			if (x > 0 && !maze.WallPositiveX(x - 1, y)) visit(cell - 1);
+			if (y > 0 && !maze.WallPositiveZ(x, y - 1)) visit(cell - width);
+		}
+		return count == (std::uint64_t)width * height && passages == count - 1;
+	}
+
+	bool SameMaze(const MazeGenerator& a, const MazeGenerator& b)
+	{
+		for (std::uint32_t y = 0; y < a.Height(); ++y)
+		{
+			for (std::uint32_t x = 0; x < a.Width(); ++x)
+			{
+				if (a.WallPositiveX(x, y) != b.WallPositiveX(x, y) || a.WallPositiveZ(x, y) != b.WallPositiveZ(x, y))
+					return false;
+			}
+		}
+		return true;
+	}
+
+	// The slab test DirectXCollision's BoundingBox::Intersects does for a ray.
+	bool RayHitsBox(Vec3 origin, Vec3 direction, const Item& box, float& distance)
+	{
+		const float o[3] = { origin.x - box.Center.x, origin.y - box.Center.y, origin.z - box.Center.z };
+		const float d[3] = { direction.x, direction.y, direction.z };
+		const float e[3] = { box.Extents.x, box.Extents.y, box.Extents.z };
+		float tMin = -1e30f, tMax = 1e30f;
+		for (int i = 0; i < 3; ++i)
+		{
+			if (std::fabs(d[i]) < 1e-20f)
+			{
+				if (std::fabs(o[i]) > e[i])
+					return false;
+				continue;
+			}
+			float t0 = (-e[i] - o[i]) / d[i];
+			float t1 = (e[i] - o[i]) / d[i];
+			if (t0 > t1)
+				std::swap(t0, t1);
+			tMin = std::max(tMin, t0);
+			tMax = std::min(tMax, t1);
+		}
+		if (tMax < 0.0f || tMin > tMax)
+			return false;
+		distance = std::max(tMin, 0.0f);
+		return true;
+	}
+
+	struct FrameCosts
+	{
+		double CullMs = 0.0;
+		double CollisionMs = 0.0;
+		double RecordMs = 0.0;
+		double Visible = 0.0;
+		double Hits = 0.0;
+	};
+
+	// Walks diagonally across the maze through the walls at half their height,
+	// looking ahead and slightly down.
+	FrameCosts TimeFrames(const std::vector<Item>& items, const std::vector<Item>& colliders, Vec3 mazeMin, Vec3 mazeMax)
+	{
+		FrameCosts costs;
+		std::vector<Draw> draws;
+		draws.reserve(items.size());
+
+		const float tanY = std::tan(0.5f * FovY);
+		const float tanX = tanY * Aspect;
+		const float cosY = 1.0f / std::sqrt(1.0f + tanY * tanY), sinY = tanY * cosY;
+		const float cosX = 1.0f / std::sqrt(1.0f + tanX * tanX), sinX = tanX * cosX;
+
+		for (int frame = 0; frame < FrameCount; ++frame)
+		{
+			const float t = (frame + 0.5f) / FrameCount;
+			const Vec3 eye = { mazeMin.x + t * (mazeMax.x - mazeMin.x), mazeMin.y + 5.0f, mazeMin.z + t * (mazeMax.z - mazeMin.z) };
+			const Vec3 look = Normalize({ 1.0f, -0.1f, 1.0f });
+			const Vec3 right = Normalize(Cross({ 0.0f, 1.0f, 0.0f }, look));
+			const Vec3 up = Cross(look, right);
+
+			auto start = std::chrono::steady_clock::now();
+			std::vector<const Item*> visible;
+			visible.reserve(items.size());
+			for (const Item& item : items)
+			{
+				const Vec3 v = item.Center - eye;
+				const float z = Dot(v, look);
+				const float x = std::fabs(Dot(v, right));
+				const float y = std::fabs(Dot(v, up));
+				if (z < NearZ - item.Radius || z > FarZ + item.Radius ||
+					x * cosX - z * sinX > item.Radius || y * cosY - z * sinY > item.Radius)
+					continue;
+				visible.push_back(&item);
+			}
+			costs.CullMs += Milliseconds(start);
+			costs.Visible += (double)visible.size();
+
+			start = std::chrono::steady_clock::now();
+			const Vec3 rays[4] = { look, look * -1.0f, right * -1.0f, right };
+			for (const Item& box : colliders)
+			{
+				for (const Vec3& ray : rays)
+				{
+					float distance;
+					if (RayHitsBox(eye, ray, box, distance) && distance < CollisionDistance)
+						costs.Hits += 1.0;
+				}
+			}
+			costs.CollisionMs += Milliseconds(start);
+
+			start = std::chrono::steady_clock::now();
+			draws.clear();
+			for (const Item* item : visible)
+				draws.push_back({ 0x10000ull + 256ull * item->ObjCBIndex, item->IndexCount, 0 });
+			costs.RecordMs += Milliseconds(start);
+		}
+
+		costs.CullMs /= FrameCount;
+		costs.CollisionMs /= FrameCount;
+		costs.RecordMs /= FrameCount;
+		costs.Visible /= FrameCount;
+		costs.Hits /= FrameCount;
+		return costs;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const std::uint64_t seed = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 3111;
+
+	// The options share a prefix, so each must be found as a whole word.
+	const char* const commandLines[] =
+	{
+		"-maze 200 -mazeseed 7 -mazealgo wilson",
+		"-mazeseed 7 -maze 200 -mazealgo wilson",
+		"-mazealgo wilson -mazeseed 7 -maze 200",
+		"-mazealgo wilson -maze 200 -mazeseed 7 -benchmark 100",
+	};
+	for (const char* cmdLine : commandLines)
+	{
+		if (GetCommandLineInt(cmdLine, "-maze", 0) != 200 || GetCommandLineInt(cmdLine, "-mazeseed", 0) != 7 ||
+			GetCommandLineString(cmdLine, "-mazealgo", "backtracker") != "wilson" || GetCommandLineInt(cmdLine, "-maz", 0) != 0)
+		{
+			std::fprintf(stderr, "\"%s\" read as -maze %d -mazeseed %d -mazealgo %s\n", cmdLine, GetCommandLineInt(cmdLine, "-maze", 0),
+				GetCommandLineInt(cmdLine, "-mazeseed", 0), GetCommandLineString(cmdLine, "-mazealgo", "backtracker").c_str());
+			return 1;
+		}
+	}
+
+	MazeGenerator oversize;
+	if (oversize.Generate(65536, 65536, seed, MazeAlgorithm::Backtracker) || oversize.Width() != 0 || oversize.Height() != 0)
+	{
+		std::fprintf(stderr, "a 65536x65536 maze was not refused\n");
+		return 1;
+	}
+
+	std::printf("%6s %-11s %10s %10s %10s %8s %8s %9s %9s %9s %8s %6s\n", "cells", "algorithm", "walls", "gen ms",
+		"place ms", "scene MB", "gen MB", "cull ms", "coll ms", "rec ms", "visible", "hits");
+
+	const std::uint32_t sizes[] = { 16, 64, 256, 1000 };
+	const MazeAlgorithm algorithms[] = { MazeAlgorithm::Backtracker, MazeAlgorithm::Wilson };
+	for (std::uint32_t size : sizes)
+	{
+		for (MazeAlgorithm algorithm : algorithms)
+		{
+			MazeGenerator maze;
+			auto start = std::chrono::steady_clock::now();
+			maze.Generate(size, size, seed, algorithm);
+			const double generateMs = Milliseconds(start);
+
+			MazeGenerator again;
+			again.Generate(size, size, seed, algorithm);
+			if (!IsPerfect(maze) || !SameMaze(maze, again))
+			{
+				std::fprintf(stderr, "%ux%u maze is not perfect or not deterministic\n", size, size);
+				return 1;
+			}
+
+			MazeLayout layout;
+			layout.Origin[0] = -0.5f * size * layout.CellSize;
+			layout.Origin[1] = 5.0f;
+			layout.Origin[2] = 110.0f;
+
+			start = std::chrono::steady_clock::now();
+			SceneWriter writer;
+			const std::uint32_t walls = maze.PlaceWalls(writer, layout);
+			std::vector<std::uint8_t> compiled;
+			writer.Write(compiled);
+			SceneFile scene;
+			if (!scene.Load(compiled.data(), compiled.size()))
+			{
+				std::fprintf(stderr, "%s\n", scene.Error().c_str());
+				return 1;
+			}
+			const double placeMs = Milliseconds(start);
+
+			// Items and colliders as the app builds them from the placements.
+			std::vector<Item> items, colliders;
+			for (std::uint32_t i = 0; i < scene.PlacementCount(); ++i)
+			{
+				const ScenePlacement& p = scene.Placements()[i];
+				Item item;
+				item.Center = { p.Translation[0], p.Translation[1], p.Translation[2] };
+				item.Extents = { 0.5f * p.Scale[0], 0.5f * p.Scale[1], 0.5f * p.Scale[2] };
+				item.Radius = std::sqrt(Dot(item.Extents, item.Extents));
+				item.ObjCBIndex = i;
+				item.IndexCount = 36;
+				items.push_back(item);
+				if (p.Flags & ScenePlacementCollide)
+					colliders.push_back(item);
+			}
+
+			const Vec3 mazeMin = { layout.Origin[0], layout.Origin[1], layout.Origin[2] };
+			const Vec3 mazeMax = { mazeMin.x + size * layout.CellSize, mazeMin.y, mazeMin.z + size * layout.CellSize };
+			const FrameCosts costs = TimeFrames(items, colliders, mazeMin, mazeMax);
+
+			std::printf("%6u %-11s %10u %10.2f %10.2f %8.2f %8.2f %9.3f %9.3f %9.3f %8.0f %6.2f\n", size,
+				algorithm == MazeAlgorithm::Wilson ? "wilson" : "backtracker", walls, generateMs, placeMs,
+				compiled.size() / (1024.0 * 1024.0), maze.MemoryBytes() / (1024.0 * 1024.0),
+				costs.CullMs, costs.CollisionMs, costs.RecordMs, costs.Visible, costs.Hits);
+		}
+	}
+	return 0;
+}
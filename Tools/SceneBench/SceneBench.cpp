@@ -0,0 +1,345 @@
+//***************************************************************************************
+// SceneBench.cpp
+//
+// Times the scene format on generated levels of 1k to 100k placements: compiling the
+// text form, and opening the compiled file (mapping it, checking it and walking every
+// placement the way the app does).  Each compiled scene is first read back and
+// compared with what was generated, so a timing is only printed for a correct result.
+//
+// Then times SceneDiff on each level against a copy with a few lines edited, removed
+// and added, the way a hot reload sees a save.  The diff must find exactly those edits
+// and map every other placement onto its unchanged original.
+//
+// Usage: SceneBench [scene.txt]
+//   With a text scene, also compiles it and prints what it holds.
+//
+// Build (from the repository root):
+//   g++ -std=c++17 -O2 -ICommon Tools/SceneBench/SceneBench.cpp Common/SceneFile.cpp Common/SceneDiff.cpp Common/MappedFile.cpp -o SceneBench
+//   cl /std:c++17 /O2 /EHsc /ICommon Tools\SceneBench\SceneBench.cpp Common\SceneFile.cpp Common\SceneDiff.cpp Common\MappedFile.cpp
+//***************************************************************************************
+
+#include "SceneDiff.h"
+#include "SceneFile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+	const char* const Meshes[] = { "box", "sphere", "cylinder", "cone", "wedge", "pyramid" };
+	const char* const Materials[] = { "wall", "stone", "grass", "gold", "weird1", "weird2", "weird3" };
+	const char* const TempFile = "SceneBench.scene";
+
+	double Milliseconds(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Placements on a maze-like grid with the castle's sizes; every fourth one collides.
+	std::string RandomScene(std::uint32_t count, std::uint32_t seed)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_int_distribution<int> cell(-500, 500);
+		std::uniform_int_distribution<int> size(1, 24);
+		std::uniform_int_distribution<int> quarter(0, 3);
+
+		std::string text = "# generated by SceneBench\n";
+		char line[256];
+		for (std::uint32_t i = 0; i < count; ++i)
+		{
+			std::snprintf(line, sizeof(line), "place %s %s %d 10 1 0 %d 0 %.1f 10 %.1f%s\n",
+				Meshes[i % 6], Materials[i % 7], size(rng), 90 * quarter(rng),
+				0.5f * cell(rng), 0.5f * cell(rng), (i % 4 == 0) ? " collide" : "");
+			text += line;
+		}
+		for (std::uint32_t i = 0; i < count / 100; ++i)
+		{
+			std::snprintf(line, sizeof(line), "sprite trees %d 12 %d 20 20\n", cell(rng), cell(rng));
+			text += line;
+		}
+		return text;
+	}
+
+	bool WriteFile(const char* filename, const std::vector<std::uint8_t>& bytes)
+	{
+		std::ofstream fout(filename, std::ios::binary | std::ios::trunc);
+		fout.write((const char*)bytes.data(), (std::streamsize)bytes.size());
+		return (bool)fout;
+	}
+
+	// Opens the compiled file and sums what a loader reads from every placement.
+	bool OpenAndWalk(double& checksum)
+	{
+		SceneFile scene;
+		if (!scene.Open(TempFile))
+		{
+			std::fprintf(stderr, "%s\n", scene.Error().c_str());
+			return false;
+		}
+
+		checksum = 0.0;
+		for (std::uint32_t i = 0; i < scene.PlacementCount(); ++i)
+		{
+			const ScenePlacement& p = scene.Placements()[i];
+			checksum += p.Mesh + p.Material + p.Flags + p.Scale[0] + p.Rotation[1] + p.Translation[2];
+		}
+		return true;
+	}
+
+	// Re-parses the generated text independently and compares it with the compiled file.
+	bool Verify(const std::string& text)
+	{
+		SceneFile scene;
+		if (!scene.Open(TempFile))
+			return false;
+
+		std::uint32_t placement = 0;
+		const char* cursor = text.c_str();
+		while (*cursor != '\0')
+		{
+			const char* end = std::strchr(cursor, '\n');
+			std::string line(cursor, end);
+			cursor = end + 1;
+			if (line.compare(0, 6, "place ") != 0)
+				continue;
+
+			char mesh[32], material[32], collide[16] = "";
+			float s, r, tx, tz;
+			std::sscanf(line.c_str(), "place %31s %31s %f 10 1 0 %f 0 %f 10 %f %15s", mesh, material, &s, &r, &tx, &tz, collide);
+
+			const ScenePlacement& p = scene.Placements()[placement++];
+			const bool collides = std::string(collide) == "collide";
+			if (std::string(scene.Name(p.Mesh)) != mesh || std::string(scene.Name(p.Material)) != material ||
+				p.Scale[0] != s || p.Translation[0] != tx || p.Translation[2] != tz ||
+				std::fabs(p.Rotation[1] - r * 3.1415926535f / 180.0f) > 1e-5f ||
+				((p.Flags & ScenePlacementCollide) != 0) != collides)
+			{
+				std::fprintf(stderr, "placement %u does not match: %s\n", placement - 1, line.c_str());
+				return false;
+			}
+		}
+		return placement == scene.PlacementCount();
+	}
+
+	// Lines of text, without their newlines.
+	std::vector<std::string> SplitLines(const std::string& text)
+	{
+		std::vector<std::string> lines;
+		for (std::size_t start = 0; start < text.size(); )
+		{
+			const std::size_t end = text.find('\n', start);
+			lines.push_back(text.substr(start, end - start));
+			start = end + 1;
+		}
+		return lines;
+	}
+
+	// Edits every stride-th placement line of text, cycling through changing it,
+	// removing it and adding a new line after it.
+	std::string EditScene(const std::string& text, std::uint32_t stride, std::uint32_t& changed,
+		std::uint32_t& removed, std::uint32_t& added)
+	{
+		changed = removed = added = 0;
+		std::string edited;
+		std::uint32_t placement = 0;
+		for (const std::string& line : SplitLines(text))
+		{
+			const bool place = line.compare(0, 6, "place ") == 0;
+			if (!place || ++placement % stride != 0)
+			{
+				edited += line + "\n";
+				continue;
+			}
+
+			switch ((placement / stride) % 3)
+			{
+			case 0:
+			{
+				// Toggles whether it collides.
+				const std::size_t collide = line.find(" collide");
+				edited += (collide == std::string::npos ? line + " collide" : line.substr(0, collide)) + "\n";
+				++changed;
+				break;
+			}
+			case 1:
+				++removed;
+				break;
+			default:
+				edited += line + "\n";
+				edited += "place box gold 1 2 3 0 45 0 " + std::to_string(placement) + " 0.5 7\n";
+				++added;
+				break;
+			}
+		}
+		return edited;
+	}
+
+	bool Compile(const std::string& text, std::vector<std::uint8_t>& compiled, SceneFile& scene)
+	{
+		std::string error;
+		if (!SceneFile::Compile(text.data(), text.size(), compiled, error) || !scene.Load(compiled.data(), compiled.size()))
+		{
+			std::fprintf(stderr, "%s\n", error.empty() ? scene.Error().c_str() : error.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	// Every old placement is continued once or removed, and every continued one that is
+	// not reported changed is equal to its source.
+	bool CheckDiff(const SceneFile& before, const SceneFile& after, const SceneListDiff& diff)
+	{
+		std::vector<int> uses(before.PlacementCount(), 0);
+		for (std::uint32_t removed : diff.Removed)
+			++uses[removed];
+		std::vector<bool> changed(after.PlacementCount(), false);
+		for (std::uint32_t i : diff.Changed)
+			changed[i] = true;
+
+		for (std::uint32_t i = 0; i < after.PlacementCount(); ++i)
+		{
+			const std::uint32_t source = diff.Sources[i];
+			if (source == SceneDiff::NoSource)
+				continue;
+			++uses[source];
+
+			const ScenePlacement& p = before.Placements()[source];
+			const ScenePlacement& q = after.Placements()[i];
+			const bool equal = std::string(before.Name(p.Mesh)) == after.Name(q.Mesh) &&
+				std::string(before.Name(p.Material)) == after.Name(q.Material) && p.Flags == q.Flags &&
+				std::memcmp(p.Scale, q.Scale, sizeof(float) * 9) == 0;
+			if (equal == changed[i])
+			{
+				std::fprintf(stderr, "placement %u is %s but reported %s\n", i, equal ? "unchanged" : "changed",
+					changed[i] ? "changed" : "unchanged");
+				return false;
+			}
+		}
+		for (std::uint32_t i = 0; i < before.PlacementCount(); ++i)
+		{
+			if (uses[i] != 1)
+			{
+				std::fprintf(stderr, "old placement %u is used %d times\n", i, uses[i]);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Diffs a scene against an edited copy; false unless the diff finds exactly the edits.
+	bool BenchDiff(const std::string& text, std::uint32_t stride, double& diffMs, std::uint32_t& edits)
+	{
+		std::uint32_t changed, removed, added;
+		const std::string edited = EditScene(text, stride, changed, removed, added);
+
+		std::vector<std::uint8_t> beforeBytes, afterBytes;
+		SceneFile before, after;
+		if (!Compile(text, beforeBytes, before) || !Compile(edited, afterBytes, after))
+			return false;
+
+		SceneDiff diff;
+		diffMs = 1e9;
+		for (int i = 0; i < 5; ++i)
+		{
+			auto start = std::chrono::steady_clock::now();
+			diff.Compare(before, after);
+			diffMs = std::min(diffMs, Milliseconds(start));
+		}
+
+		const SceneListDiff& placements = diff.Placements();
+		if (placements.Changed.size() != changed || placements.Removed.size() != removed ||
+			placements.Added.size() != added || !diff.Materials().Empty() || !diff.Lights().Empty() ||
+			diff.SpritesChanged())
+		{
+			std::fprintf(stderr, "expected %u changed, %u removed, %u added; found %zu, %zu, %zu\n",
+				changed, removed, added, placements.Changed.size(), placements.Removed.size(), placements.Added.size());
+			return false;
+		}
+		edits = changed + removed + added;
+		return CheckDiff(before, after, placements);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1)
+	{
+		std::ifstream fin(argv[1], std::ios::binary);
+		std::string text((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+
+		std::vector<std::uint8_t> compiled;
+		std::string error;
+		SceneFile scene;
+		if (!SceneFile::Compile(text.data(), text.size(), compiled, error) || !scene.Load(compiled.data(), compiled.size()))
+		{
+			std::fprintf(stderr, "%s: %s\n", argv[1], error.empty() ? scene.Error().c_str() : error.c_str());
+			return 1;
+		}
+
+		std::uint32_t colliders = 0;
+		for (std::uint32_t i = 0; i < scene.PlacementCount(); ++i)
+			colliders += (scene.Placements()[i].Flags & ScenePlacementCollide) != 0;
+		std::printf("%s: %u placements (%u colliders), %u sprites, %u materials, %u lights, %u nodes, %u names, %u bytes compiled\n\n",
+			argv[1], scene.PlacementCount(), colliders, scene.SpriteCount(), scene.MaterialCount(), scene.LightCount(),
+			scene.NodeCount(), scene.NameCount(), (unsigned)compiled.size());
+	}
+
+	std::printf("%10s %12s %12s %12s\n", "placements", "compile ms", "open ms", "MB");
+
+	const std::uint32_t counts[] = { 1000, 10000, 100000 };
+	for (std::uint32_t count : counts)
+	{
+		const std::string text = RandomScene(count, count);
+
+		std::vector<std::uint8_t> compiled;
+		std::string error;
+		auto start = std::chrono::steady_clock::now();
+		if (!SceneFile::Compile(text.data(), text.size(), compiled, error))
+		{
+			std::fprintf(stderr, "%s\n", error.c_str());
+			return 1;
+		}
+		const double compileMs = Milliseconds(start);
+
+		if (!WriteFile(TempFile, compiled) || !Verify(text))
+			return 1;
+
+		// Best of a few opens; the first warms the page cache.
+		double openMs = 1e9;
+		double checksum = 0.0;
+		for (int i = 0; i < 5; ++i)
+		{
+			start = std::chrono::steady_clock::now();
+			if (!OpenAndWalk(checksum))
+				return 1;
+			openMs = std::min(openMs, Milliseconds(start));
+		}
+
+		std::printf("%10u %12.3f %12.3f %12.2f\n", count, compileMs, openMs, compiled.size() / (1024.0 * 1024.0));
+	}
+
+	std::remove(TempFile);
+
+	std::printf("\n%10s %12s %12s\n", "placements", "edits", "diff ms");
+	for (std::uint32_t count : counts)
+	{
+		const std::string text = RandomScene(count, count);
+		for (std::uint32_t stride : { count / 4, count / 100 })
+		{
+			double diffMs;
+			std::uint32_t edits;
+			if (!BenchDiff(text, stride, diffMs, edits))
+				return 1;
+			std::printf("%10u %12u %12.3f\n", count, edits, diffMs);
+		}
+	}
+	return 0;
+}
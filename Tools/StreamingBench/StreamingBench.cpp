@@ -0,0 +1,431 @@
+//***************************************************************************************
+// StreamingBench.cpp
+//
+// Flies a camera down a row of 16 to 16384 streamed textures and back, then holds it
+// still, driving TextureStreamer as CastleApp::UpdateTextureStreaming does: each frame
+// every texture in view is requested at the size its bounds project to, and the
+// changes Update returns land two frames later, or are cancelled, as a load that
+// could not start is.  Textures are BC1, 512 to 2048 texels square with full mip
+// chains, and start with their 64x64 tail resident.  The budget is 8 MB, so flying
+// past them keeps evicting, and from a few thousand textures on the tails alone do
+// not fit: the camera then waits at the start until the streamer has evicted enough.
+//
+// Every frame is checked against a copy of the streamer's state kept here:
+//
+//   - each texture wants the mip its projected size calls for, or its coarsest when
+//     unseen
+//   - a load, or an eviction of a texture in view, only starts when it fits the
+//     budget, and the accounted bytes are exactly the resident chains plus those of
+//     the changes in flight
+//   - an eviction takes a texture down to its coarsest mip, or to what it is drawn
+//     with this frame, and no texture it could have taken was drawn less recently
+//   - once under the budget, the accounted bytes never exceed it by more than every
+//     texture's coarsest chain
+//
+// and once the camera has held still and the streamer has nothing left to change, every
+// texture in view must have the mip it wants, or a finer one the budget had no need to
+// take back.
+//
+//   settle    frames until the tails fit the budget
+//   frames    frames flown and held
+//   loads     changes to finer mips
+//   evicted   changes to coarser mips
+//   peak MB   most memory accounted at once after settling
+//   us/frame  BeginFrame, the requests and Update
+//
+// Usage: StreamingBench [frames]
+//
+// Build (from the repository root):
+//   g++ -std=c++14 -O2 -ICommon Tools/StreamingBench/StreamingBench.cpp Common/TextureStreamer.cpp -o StreamingBench
+//   cl /O2 /EHsc /ICommon Tools\StreamingBench\StreamingBench.cpp Common\TextureStreamer.cpp
+//***************************************************************************************
+
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+	// The app's default window and camera.
+	const float ProjectionScale = 0.5f * 600.0f / std::tan(0.5f * 0.25f * 3.1415926535f);
+	const float NearZ = 1.0f;
+
+	// Textures sit along x, Spacing apart; the camera flies Offset to the side of them.
+	const float Spacing = 30.0f;
+	const float Radius = 8.0f;
+	const float Offset = 20.0f;
+	const float ViewDistance = 300.0f;
+
+	const std::uint32_t TailTexels = 64;
+	const std::uint64_t Budget = 8ull << 20;
+	const int ResidentDelay = 2;
+	const int HoldFrames = 30;
+
+	// A copy of what the streamer should know about each texture.
+	struct Texture
+	{
+		std::uint32_t Size = 0;
+		std::uint32_t Levels = 0;
+		std::uint32_t Tail = 0;
+		std::uint32_t Coarsest = 0;
+		std::vector<std::uint64_t> ChainBytes;
+
+		std::uint32_t Resident = 0;
+		bool Pending = false;
+		std::uint32_t PendingMip = 0;
+		int LastUsed = -1;
+	};
+
+	struct Arrival
+	{
+		int Texture;
+		std::uint32_t Mip;
+		int Frame;
+	};
+
+	struct Result
+	{
+		int SettleFrames = 0;
+		int Frames = 0;
+		std::uint64_t Loads = 0;
+		std::uint64_t Evictions = 0;
+		std::uint64_t PeakBytes = 0;
+		double UsPerFrame = 0.0;
+	};
+
+	std::uint64_t Bc1Bytes(std::uint32_t size)
+	{
+		const std::uint64_t blocks = std::max<std::uint32_t>(1, (size + 3) / 4);
+		return blocks * blocks * 8;
+	}
+
+	// The finest mip whose texels still cover the screen pixels, counted up from the
+	// top rather than with log2 as MipForScreenSize does.
+	std::uint32_t ExpectedMip(const Texture& tex, float screenPixels)
+	{
+		std::uint32_t mip = 0;
+		while (mip + 1 < tex.Levels && (float)(tex.Size >> (mip + 1)) >= screenPixels)
+			++mip;
+		return mip;
+	}
+
+	bool Fly(int textureCount, int frames, bool verify, Result& result)
+	{
+		result = Result();
+		std::vector<Texture> textures(textureCount);
+		std::uint64_t coarsestBytes = 0;
+		for (int i = 0; i < textureCount; ++i)
+		{
+			Texture& tex = textures[i];
+			tex.Size = 512u << (i % 3);
+			tex.Levels = 1;
+			while ((tex.Size >> (tex.Levels - 1)) > 1)
+				++tex.Levels;
+			tex.Tail = 0;
+			while ((tex.Size >> tex.Tail) > TailTexels)
+				++tex.Tail;
+			tex.Coarsest = tex.Levels - 1;
+			tex.Resident = tex.Tail;
+
+			tex.ChainBytes.assign(tex.Levels + 1, 0);
+			for (std::uint32_t m = tex.Levels; m-- > 0;)
+				tex.ChainBytes[m] = tex.ChainBytes[m + 1] + Bc1Bytes(tex.Size >> m);
+			coarsestBytes += tex.ChainBytes[tex.Coarsest];
+		}
+
+		TextureStreamer streamer(Budget);
+		for (const Texture& tex : textures)
+		{
+			std::vector<std::uint64_t> mipBytes;
+			for (std::uint32_t m = 0; m < tex.Levels; ++m)
+				mipBytes.push_back(Bc1Bytes(tex.Size >> m));
+			streamer.AddTexture(tex.Size, tex.Size, mipBytes, tex.Tail, tex.Coarsest);
+		}
+
+		// At the start until the tails fit, down the row and back, then still, facing
+		// along it, halfway, until nothing changes.  Every eviction frees at least a
+		// tail, so neither wait outlasts a frame per texture.
+		const float start = -50.0f;
+		const float end = Spacing * textureCount + 50.0f;
+		const float speed = 2.0f * (end - start) / frames;
+		const int maxSettleFrames = textureCount;
+		const int maxHoldFrames = textureCount + HoldFrames;
+		bool settled = false;
+
+		std::vector<Arrival> arrivals;
+		std::vector<float> screenPixels(textureCount);
+		std::vector<int> drawn;
+		int changeCount = 0;
+		double updateSeconds = 0.0;
+		for (int frame = 0;; ++frame)
+		{
+			if (!settled)
+			{
+				settled = streamer.AccountedBytes() <= streamer.Budget();
+				if (!settled && frame == maxSettleFrames)
+				{
+					std::fprintf(stderr, "%d textures: still %llu bytes accounted of %llu after %d frames\n", textureCount,
+						(unsigned long long)streamer.AccountedBytes(), (unsigned long long)streamer.Budget(), frame);
+					return false;
+				}
+				if (!settled)
+					++result.SettleFrames;
+			}
+
+			const int flown = frame - result.SettleFrames;
+			float x;
+			float direction;
+			if (!settled || flown < frames / 2)
+				x = start + speed * (std::max)(flown, 0), direction = 1.0f;
+			else if (flown < frames)
+				x = end - speed * (flown - frames / 2), direction = -1.0f;
+			else
+				x = 0.5f * (start + end), direction = 1.0f;
+
+			// Loads that land this frame, as the texture loader reports them.
+			for (size_t a = 0; a < arrivals.size();)
+			{
+				if (arrivals[a].Frame > frame)
+				{
+					++a;
+					continue;
+				}
+				Texture& tex = textures[arrivals[a].Texture];
+				tex.Resident = arrivals[a].Mip;
+				tex.Pending = false;
+				streamer.OnResident(arrivals[a].Texture, arrivals[a].Mip);
+				arrivals[a] = arrivals.back();
+				arrivals.pop_back();
+			}
+
+			// The textures ahead, nearest first.
+			drawn.clear();
+			const int first = (std::max)(0, (int)std::floor((x - ViewDistance) / Spacing));
+			const int last = (std::min)(textureCount - 1, (int)std::ceil((x + ViewDistance) / Spacing));
+			for (int i = first; i <= last; ++i)
+			{
+				const float along = (Spacing * i - x) * direction;
+				if (along < -Radius || along > ViewDistance)
+					continue;
+				const float distance = (std::max)(std::sqrt(along * along + Offset * Offset) - Radius, NearZ);
+				screenPixels[i] = 2.0f * Radius * ProjectionScale / distance;
+				drawn.push_back(i);
+			}
+
+			auto timeStart = std::chrono::steady_clock::now();
+			streamer.BeginFrame();
+			for (int i : drawn)
+				streamer.RequestScreenSize(i, screenPixels[i]);
+			const std::vector<TextureStreamer::Change>& changes = streamer.Update();
+			updateSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - timeStart).count();
+
+			if (settled)
+				result.PeakBytes = (std::max)(result.PeakBytes, streamer.AccountedBytes());
+
+			if (verify)
+			{
+				std::vector<std::uint32_t> wanted(textureCount);
+				for (int i = 0; i < textureCount; ++i)
+					wanted[i] = textures[i].Coarsest;
+				for (int i : drawn)
+				{
+					wanted[i] = ExpectedMip(textures[i], screenPixels[i]);
+					textures[i].LastUsed = frame;
+				}
+
+				for (int i = 0; i < textureCount; ++i)
+				{
+					if (streamer.WantedMip(i) != wanted[i] || streamer.ResidentMip(i) != textures[i].Resident)
+					{
+						std::fprintf(stderr, "%d textures, frame %d: texture %d wants mip %u with %u resident, expected %u with %u\n",
+							textureCount, frame, i, streamer.WantedMip(i), streamer.ResidentMip(i), wanted[i], textures[i].Resident);
+						return false;
+					}
+				}
+
+				// Loads and evictions of textures in view must fit when they start;
+				// evictions to the coarsest mip need not.
+				std::uint64_t accounted = 0;
+				for (const Texture& tex : textures)
+					accounted += tex.ChainBytes[tex.Resident] + (tex.Pending ? tex.ChainBytes[tex.PendingMip] : 0);
+
+				int newestEvicted = -1;
+				for (const TextureStreamer::Change& change : changes)
+				{
+					const Texture& tex = textures[change.Texture];
+					if (tex.Pending || change.MostDetailedMip == tex.Resident)
+					{
+						std::fprintf(stderr, "%d textures, frame %d: texture %d changed to mip %u while %s\n",
+							textureCount, frame, change.Texture, change.MostDetailedMip, tex.Pending ? "in flight" : "already there");
+						return false;
+					}
+
+					const std::uint64_t bytes = tex.ChainBytes[change.MostDetailedMip];
+					if (change.MostDetailedMip != tex.Coarsest && accounted + bytes > streamer.Budget())
+					{
+						std::fprintf(stderr, "%d textures, frame %d: changing texture %d to mip %u takes %llu of %llu bytes\n",
+							textureCount, frame, change.Texture, change.MostDetailedMip,
+							(unsigned long long)(accounted + bytes), (unsigned long long)streamer.Budget());
+						return false;
+					}
+					accounted += bytes;
+
+					if (change.MostDetailedMip > tex.Resident)
+					{
+						if (change.MostDetailedMip != wanted[change.Texture] || tex.LastUsed < newestEvicted)
+						{
+							std::fprintf(stderr, "%d textures, frame %d: evicted texture %d, last drawn in frame %d, to mip %u; expected mip %u, drawn no earlier than frame %d\n",
+								textureCount, frame, change.Texture, tex.LastUsed, change.MostDetailedMip, wanted[change.Texture], newestEvicted);
+							return false;
+						}
+						newestEvicted = tex.LastUsed;
+					}
+				}
+				if (accounted != streamer.AccountedBytes())
+				{
+					std::fprintf(stderr, "%d textures, frame %d: %llu bytes accounted, expected %llu\n",
+						textureCount, frame, (unsigned long long)streamer.AccountedBytes(), (unsigned long long)accounted);
+					return false;
+				}
+
+				// Least recently used first: nothing that could have been evicted was
+				// drawn before the newest texture that was.
+				if (newestEvicted >= 0)
+				{
+					std::vector<bool> changed(textureCount, false);
+					for (const TextureStreamer::Change& change : changes)
+						changed[change.Texture] = true;
+					for (int i = 0; i < textureCount; ++i)
+					{
+						const Texture& tex = textures[i];
+						if (!changed[i] && !tex.Pending && tex.Resident < wanted[i] && tex.LastUsed < newestEvicted)
+						{
+							std::fprintf(stderr, "%d textures, frame %d: kept texture %d, last drawn in frame %d, but evicted one drawn in frame %d\n",
+								textureCount, frame, i, tex.LastUsed, newestEvicted);
+							return false;
+						}
+					}
+				}
+
+				if (settled && accounted > streamer.Budget() + coarsestBytes)
+				{
+					std::fprintf(stderr, "%d textures, frame %d: %llu bytes accounted, more than the budget of %llu and %llu bytes of coarsest mips\n",
+						textureCount, frame, (unsigned long long)accounted, (unsigned long long)streamer.Budget(),
+						(unsigned long long)coarsestBytes);
+					return false;
+				}
+			}
+
+			// Start the changes.  Now and then one cannot be, as when the loader's
+			// queue is full.
+			for (const TextureStreamer::Change& change : changes)
+			{
+				Texture& tex = textures[change.Texture];
+				if (change.MostDetailedMip < tex.Resident)
+					++result.Loads;
+				else
+					++result.Evictions;
+
+				if (++changeCount % 13 == 0)
+				{
+					streamer.Cancel(change.Texture);
+					continue;
+				}
+				tex.Pending = true;
+				tex.PendingMip = change.MostDetailedMip;
+				arrivals.push_back({ change.Texture, change.MostDetailedMip, frame + ResidentDelay });
+			}
+
+			if (flown < frames + HoldFrames || !changes.empty() || !arrivals.empty())
+			{
+				if (flown == frames + maxHoldFrames)
+				{
+					std::fprintf(stderr, "%d textures: still changing after holding still for %d frames\n", textureCount, maxHoldFrames);
+					return false;
+				}
+				continue;
+			}
+			result.Frames = flown + 1;
+
+			// Held still long enough, the textures in view have what they want, or more.
+			if (verify)
+			{
+				for (int i : drawn)
+				{
+					if (streamer.ResidentMip(i) > streamer.WantedMip(i))
+					{
+						std::fprintf(stderr, "%d textures: after holding still, texture %d has mip %u resident but wants %u\n",
+							textureCount, i, streamer.ResidentMip(i), streamer.WantedMip(i));
+						return false;
+					}
+				}
+			}
+			break;
+		}
+
+		result.UsPerFrame = updateSeconds * 1e6 / (result.SettleFrames + result.Frames);
+		return true;
+	}
+
+	bool VerifyMipForScreenSize()
+	{
+		struct Case
+		{
+			std::uint32_t Width, Height, Levels;
+			float ScreenPixels;
+			std::uint32_t Mip;
+		};
+		const Case cases[] =
+		{
+			{ 1024, 1024, 11, 2048.0f, 0 },
+			{ 1024, 1024, 11, 1024.0f, 0 },
+			{ 1024, 1024, 11, 1023.0f, 0 },
+			{ 1024, 1024, 11, 512.0f, 1 },
+			{ 1024, 1024, 11, 100.0f, 3 },
+			{ 1024, 256, 11, 100.0f, 3 },
+			{ 1024, 1024, 11, 0.5f, 10 },
+			{ 1024, 1024, 5, 1.0f, 4 },
+			{ 1024, 1024, 11, 0.0f, 10 },
+		};
+		for (const Case& c : cases)
+		{
+			const std::uint32_t mip = TextureStreamer::MipForScreenSize(c.Width, c.Height, c.Levels, c.ScreenPixels);
+			if (mip != c.Mip)
+			{
+				std::fprintf(stderr, "%ux%u with %u mips drawn %g pixels across: mip %u, expected %u\n",
+					c.Width, c.Height, c.Levels, c.ScreenPixels, mip, c.Mip);
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	const int frames = (argc > 1) ? (std::max)(100, std::atoi(argv[1])) : 2000;
+
+	if (!VerifyMipForScreenSize())
+		return 1;
+
+	std::printf("%8s %8s %8s %8s %8s %8s %9s\n", "textures", "settle", "frames", "loads", "evicted", "peak MB", "us/frame");
+
+	const int counts[] = { 16, 256, 4096, 16384 };
+	for (int count : counts)
+	{
+		Result result;
+		if (!Fly(count, frames, true, result))
+			return 1;
+
+		Fly(count, frames, false, result);
+		std::printf("%8d %8d %8d %8llu %8llu %8.2f %9.2f\n", count, result.SettleFrames, result.Frames, (unsigned long long)result.Loads,
+			(unsigned long long)result.Evictions, result.PeakBytes / (1024.0 * 1024.0), result.UsPerFrame);
+	}
+
+	return 0;
+}
@@ -0,0 +1,402 @@
+//***************************************************************************************
+// BlockCompress.cpp
+//***************************************************************************************
+
+#include "BlockCompress.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	// Endpoints of the line through the block's texels along their principal axis,
+	// over the first `channels` channels.  Power iteration on the covariance matrix
+	// finds the axis; the extreme projections are then inset slightly, which lowers
+	// the error of the interpolated palette entries.
+	void FitEndpoints(const std::uint8_t* block, int channels, float lo[4], float hi[4])
+	{
+		float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; ++i)
+		{
+			for (int c = 0; c < channels; ++c)
+				mean[c] += block[i * 4 + c];
+		}
+		for (int c = 0; c < channels; ++c)
+			mean[c] /= 16.0f;
+
+		float cov[4][4] = {};
+		for (int i = 0; i < 16; ++i)
+		{
+			float d[4];
+			for (int c = 0; c < channels; ++c)
+				d[c] = block[i * 4 + c] - mean[c];
+
+			for (int a = 0; a < channels; ++a)
+			{
+				for (int b = 0; b < channels; ++b)
+					cov[a][b] += d[a] * d[b];
+			}
+		}
+
+		// Start from the row of the channel with the most variance so the first guess
+		// is never orthogonal to the answer.
+		int start = 0;
+		for (int c = 1; c < channels; ++c)
+		{
+			if (cov[c][c] > cov[start][start])
+				start = c;
+		}
+
+		float axis[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for (int c = 0; c < channels; ++c)
+			axis[c] = cov[start][c];
+
+		for (int iteration = 0; iteration < 8; ++iteration)
+		{
+			float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			float largest = 0.0f;
+			for (int a = 0; a < channels; ++a)
+			{
+				for (int b = 0; b < channels; ++b)
+					next[a] += cov[a][b] * axis[b];
+				largest = std::max(largest, std::fabs(next[a]));
+			}
+
+			if (largest == 0.0f)
+				break;
+
+			for (int c = 0; c < channels; ++c)
+				axis[c] = next[c] / largest;
+		}
+
+		float length = 0.0f;
+		for (int c = 0; c < channels; ++c)
+			length += axis[c] * axis[c];
+		length = std::sqrt(length);
+
+		// A flat block: both endpoints are the mean.
+		if (length == 0.0f)
+		{
+			for (int c = 0; c < channels; ++c)
+				lo[c] = hi[c] = mean[c];
+			return;
+		}
+
+		for (int c = 0; c < channels; ++c)
+			axis[c] /= length;
+
+		float tmin = 0.0f;
+		float tmax = 0.0f;
+		for (int i = 0; i < 16; ++i)
+		{
+			float t = 0.0f;
+			for (int c = 0; c < channels; ++c)
+				t += (block[i * 4 + c] - mean[c]) * axis[c];
+			tmin = std::min(tmin, t);
+			tmax = std::max(tmax, t);
+		}
+
+		const float inset = (tmax - tmin) / 32.0f;
+		tmin += inset;
+		tmax -= inset;
+
+		for (int c = 0; c < channels; ++c)
+		{
+			lo[c] = std::min(255.0f, std::max(0.0f, mean[c] + tmin * axis[c]));
+			hi[c] = std::min(255.0f, std::max(0.0f, mean[c] + tmax * axis[c]));
+		}
+	}
+
+	int SquaredDistance(const std::uint8_t* texel, const int* color, int channels)
+	{
+		int sum = 0;
+		for (int c = 0; c < channels; ++c)
+		{
+			int d = texel[c] - color[c];
+			sum += d * d;
+		}
+		return sum;
+	}
+
+	std::uint16_t To565(const float c[3])
+	{
+		int r = (int)std::lround(c[0] * 31.0f / 255.0f);
+		int g = (int)std::lround(c[1] * 63.0f / 255.0f);
+		int b = (int)std::lround(c[2] * 31.0f / 255.0f);
+		return (std::uint16_t)((r << 11) | (g << 5) | b);
+	}
+
+	void From565(std::uint16_t v, int out[3])
+	{
+		int r = (v >> 11) & 31;
+		int g = (v >> 5) & 63;
+		int b = v & 31;
+		out[0] = (r << 3) | (r >> 2);
+		out[1] = (g << 2) | (g >> 4);
+		out[2] = (b << 3) | (b >> 2);
+	}
+
+	void WriteU16(std::uint8_t* out, std::uint16_t v)
+	{
+		out[0] = (std::uint8_t)(v & 0xff);
+		out[1] = (std::uint8_t)(v >> 8);
+	}
+
+	// The 8-byte colour half shared by BC1 and BC3.  Always uses four-colour mode, which
+	// BC3 requires and BC1 selects by storing the larger endpoint first.
+	void EncodeColorBlock(const std::uint8_t* block, std::uint8_t* out)
+	{
+		float lo[4];
+		float hi[4];
+		FitEndpoints(block, 3, lo, hi);
+
+		std::uint16_t c0 = To565(hi);
+		std::uint16_t c1 = To565(lo);
+		if (c0 < c1)
+			std::swap(c0, c1);
+
+		WriteU16(out, c0);
+		WriteU16(out + 2, c1);
+		std::memset(out + 4, 0, 4);
+
+		// Equal endpoints would select three-colour mode, but index 0 is c0 either way.
+		if (c0 == c1)
+			return;
+
+		int palette[4][3];
+		From565(c0, palette[0]);
+		From565(c1, palette[1]);
+		for (int c = 0; c < 3; ++c)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		std::uint32_t indices = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			int best = 0;
+			int bestError = SquaredDistance(block + i * 4, palette[0], 3);
+			for (int p = 1; p < 4; ++p)
+			{
+				int error = SquaredDistance(block + i * 4, palette[p], 3);
+				if (error < bestError)
+				{
+					best = p;
+					bestError = error;
+				}
+			}
+			indices |= (std::uint32_t)best << (2 * i);
+		}
+
+		for (int b = 0; b < 4; ++b)
+			out[4 + b] = (std::uint8_t)(indices >> (8 * b));
+	}
+
+	// The 8-byte interpolated alpha half of BC3, in eight-value mode.
+	void EncodeAlphaBlock(const std::uint8_t* block, std::uint8_t* out)
+	{
+		int amin = 255;
+		int amax = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			amin = std::min<int>(amin, block[i * 4 + 3]);
+			amax = std::max<int>(amax, block[i * 4 + 3]);
+		}
+
+		out[0] = (std::uint8_t)amax;
+		out[1] = (std::uint8_t)amin;
+		std::memset(out + 2, 0, 6);
+
+		if (amax == amin)
+			return;
+
+		int palette[8];
+		palette[0] = amax;
+		palette[1] = amin;
+		for (int k = 1; k < 7; ++k)
+			palette[k + 1] = ((7 - k) * amax + k * amin) / 7;
+
+		std::uint64_t indices = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			int a = block[i * 4 + 3];
+			int best = 0;
+			for (int p = 1; p < 8; ++p)
+			{
+				if (std::abs(a - palette[p]) < std::abs(a - palette[best]))
+					best = p;
+			}
+			indices |= (std::uint64_t)best << (3 * i);
+		}
+
+		for (int b = 0; b < 6; ++b)
+			out[2 + b] = (std::uint8_t)(indices >> (8 * b));
+	}
+
+	// Packs fields least significant bit first, as BC7 blocks are laid out.
+	class BitWriter
+	{
+	public:
+		explicit BitWriter(std::uint8_t* out) : mOut(out) { std::memset(mOut, 0, 16); }
+
+		void Write(std::uint32_t value, int bits)
+		{
+			for (int i = 0; i < bits; ++i, ++mPosition)
+			{
+				if (value & (1u << i))
+					mOut[mPosition >> 3] |= (std::uint8_t)(1u << (mPosition & 7));
+			}
+		}
+
+	private:
+		std::uint8_t* mOut;
+		int mPosition = 0;
+	};
+
+	// Mode 6 stores each endpoint as 7 bits per channel plus a shared low bit.  Try
+	// both low bits and keep whichever reproduces the endpoint more closely.
+	void QuantizeMode6Endpoint(const float e[4], int q[4], int& pbit)
+	{
+		float bestError = 0.0f;
+		for (int p = 0; p < 2; ++p)
+		{
+			int candidate[4];
+			float error = 0.0f;
+			for (int c = 0; c < 4; ++c)
+			{
+				candidate[c] = std::min(127, std::max(0, (int)std::lround((e[c] - p) / 2.0f)));
+				float d = (float)((candidate[c] << 1) | p) - e[c];
+				error += d * d;
+			}
+
+			if (p == 0 || error < bestError)
+			{
+				bestError = error;
+				pbit = p;
+				std::copy(candidate, candidate + 4, q);
+			}
+		}
+	}
+}
+
+std::uint32_t BlockBytes(BlockFormat format)
+{
+	return (format == BlockFormat::BC1) ? 8 : 16;
+}
+
+void EncodeBC1Block(const std::uint8_t* block, std::uint8_t* out)
+{
+	EncodeColorBlock(block, out);
+}
+
+void EncodeBC3Block(const std::uint8_t* block, std::uint8_t* out)
+{
+	EncodeAlphaBlock(block, out);
+	EncodeColorBlock(block, out + 8);
+}
+
+void EncodeBC7Block(const std::uint8_t* block, std::uint8_t* out)
+{
+	static const int Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	float lo[4];
+	float hi[4];
+	FitEndpoints(block, 4, lo, hi);
+
+	int q[2][4];
+	int pbit[2];
+	QuantizeMode6Endpoint(lo, q[0], pbit[0]);
+	QuantizeMode6Endpoint(hi, q[1], pbit[1]);
+
+	int e[2][4];
+	for (int c = 0; c < 4; ++c)
+	{
+		e[0][c] = (q[0][c] << 1) | pbit[0];
+		e[1][c] = (q[1][c] << 1) | pbit[1];
+	}
+
+	int palette[16][4];
+	for (int i = 0; i < 16; ++i)
+	{
+		for (int c = 0; c < 4; ++c)
+			palette[i][c] = ((64 - Weights[i]) * e[0][c] + Weights[i] * e[1][c] + 32) >> 6;
+	}
+
+	int indices[16];
+	for (int i = 0; i < 16; ++i)
+	{
+		int best = 0;
+		int bestError = SquaredDistance(block + i * 4, palette[0], 4);
+		for (int p = 1; p < 16; ++p)
+		{
+			int error = SquaredDistance(block + i * 4, palette[p], 4);
+			if (error < bestError)
+			{
+				best = p;
+				bestError = error;
+			}
+		}
+		indices[i] = best;
+	}
+
+	// The first index is stored in 3 bits, so its top bit must be clear.  Swapping
+	// the endpoints mirrors every index.
+	if (indices[0] & 8)
+	{
+		std::swap(q[0], q[1]);
+		std::swap(pbit[0], pbit[1]);
+		for (int i = 0; i < 16; ++i)
+			indices[i] = 15 - indices[i];
+	}
+
+	BitWriter bits(out);
+	bits.Write(1u << 6, 7); // mode 6
+	for (int c = 0; c < 4; ++c)
+	{
+		bits.Write(q[0][c], 7);
+		bits.Write(q[1][c], 7);
+	}
+	bits.Write(pbit[0], 1);
+	bits.Write(pbit[1], 1);
+	bits.Write(indices[0], 3);
+	for (int i = 1; i < 16; ++i)
+		bits.Write(indices[i], 4);
+}
+
+std::vector<std::uint8_t> CompressSurface(const std::uint8_t* rgba, std::uint32_t width,
+	std::uint32_t height, BlockFormat format)
+{
+	const std::uint32_t blocksWide = std::max(1u, (width + 3) / 4);
+	const std::uint32_t blocksHigh = std::max(1u, (height + 3) / 4);
+	const std::uint32_t blockBytes = BlockBytes(format);
+
+	std::vector<std::uint8_t> blocks((std::size_t)blocksWide * blocksHigh * blockBytes);
+	std::uint8_t* out = blocks.data();
+
+	for (std::uint32_t by = 0; by < blocksHigh; ++by)
+	{
+		for (std::uint32_t bx = 0; bx < blocksWide; ++bx, out += blockBytes)
+		{
+			std::uint8_t block[64];
+			for (std::uint32_t y = 0; y < 4; ++y)
+			{
+				std::uint32_t sy = std::min(by * 4 + y, height - 1);
+				for (std::uint32_t x = 0; x < 4; ++x)
+				{
+					std::uint32_t sx = std::min(bx * 4 + x, width - 1);
+					std::memcpy(block + (y * 4 + x) * 4, rgba + ((std::size_t)sy * width + sx) * 4, 4);
+				}
+			}
+
+			switch (format)
+			{
+			case BlockFormat::BC1: EncodeBC1Block(block, out); break;
+			case BlockFormat::BC3: EncodeBC3Block(block, out); break;
+			case BlockFormat::BC7: EncodeBC7Block(block, out); break;
+			}
+		}
+	}
+
+	return blocks;
+}
@@ -0,0 +1,33 @@
+//***************************************************************************************
+// BlockCompress.h
+//
+// BC1, BC3 and BC7 block encoders for the texture cooker.  Each encoder takes a 4x4
+// block of RGBA8 texels and fits endpoints along the block's principal axis, which is
+// fast and close to what offline compressors achieve on photographic sources.  BC7 uses
+// mode 6 only (one subset, RGBA endpoints, 4-bit indices).
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+enum class BlockFormat
+{
+	BC1, // RGB, 4 bpp
+	BC3, // RGBA with interpolated alpha, 8 bpp
+	BC7  // RGBA, 8 bpp, best quality
+};
+
+// Bytes per 4x4 block.
+std::uint32_t BlockBytes(BlockFormat format);
+
+// block is 16 RGBA8 texels in row-major order.
+void EncodeBC1Block(const std::uint8_t* block, std::uint8_t* out);
+void EncodeBC3Block(const std::uint8_t* block, std::uint8_t* out);
+void EncodeBC7Block(const std::uint8_t* block, std::uint8_t* out);
+
+// Compresses a width x height RGBA8 surface into rows of blocks.  Partial blocks at
+// the right and bottom edges repeat the last texel.
+std::vector<std::uint8_t> CompressSurface(const std::uint8_t* rgba, std::uint32_t width,
+	std::uint32_t height, BlockFormat format);
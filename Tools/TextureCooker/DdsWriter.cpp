@@ -0,0 +1,84 @@
+//***************************************************************************************
+// DdsWriter.cpp
+//***************************************************************************************
+
+#include "DdsWriter.h"
+#include "DdsImage.h"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	const std::uint32_t DdsMagic = 0x20534444; // "DDS "
+
+	const std::uint32_t DdsdCaps = 0x1;
+	const std::uint32_t DdsdHeight = 0x2;
+	const std::uint32_t DdsdWidth = 0x4;
+	const std::uint32_t DdsdPixelFormat = 0x1000;
+	const std::uint32_t DdsdMipMapCount = 0x20000;
+	const std::uint32_t DdsdLinearSize = 0x80000;
+
+	const std::uint32_t DdpfFourCC = 0x4;
+
+	const std::uint32_t DdsCapsComplex = 0x8;
+	const std::uint32_t DdsCapsTexture = 0x1000;
+	const std::uint32_t DdsCapsMipMap = 0x400000;
+
+	constexpr std::uint32_t MakeFourCC(char ch0, char ch1, char ch2, char ch3)
+	{
+		return (std::uint32_t)(std::uint8_t)ch0 | ((std::uint32_t)(std::uint8_t)ch1 << 8) |
+			((std::uint32_t)(std::uint8_t)ch2 << 16) | ((std::uint32_t)(std::uint8_t)ch3 << 24);
+	}
+
+	template<typename T>
+	void Append(std::vector<std::uint8_t>& file, const T& value)
+	{
+		const std::uint8_t* bytes = reinterpret_cast<const std::uint8_t*>(&value);
+		file.insert(file.end(), bytes, bytes + sizeof(T));
+	}
+}
+
+std::vector<std::uint8_t> BuildDds(const std::vector<Image>& mips, BlockFormat format)
+{
+	const Image& top = mips.front();
+
+	DdsHeader header;
+	std::memset(&header, 0, sizeof(header));
+	header.size = sizeof(DdsHeader);
+	header.flags = DdsdCaps | DdsdHeight | DdsdWidth | DdsdPixelFormat | DdsdMipMapCount | DdsdLinearSize;
+	header.height = top.Height;
+	header.width = top.Width;
+	header.pitchOrLinearSize = std::max(1u, (top.Width + 3) / 4) * std::max(1u, (top.Height + 3) / 4) * BlockBytes(format);
+	header.mipMapCount = (std::uint32_t)mips.size();
+	header.ddspf.size = sizeof(DdsPixelFormat);
+	header.ddspf.flags = DdpfFourCC;
+	header.caps = DdsCapsTexture | (mips.size() > 1 ? DdsCapsComplex | DdsCapsMipMap : 0);
+
+	switch (format)
+	{
+	case BlockFormat::BC1: header.ddspf.fourCC = MakeFourCC('D', 'X', 'T', '1'); break;
+	case BlockFormat::BC3: header.ddspf.fourCC = MakeFourCC('D', 'X', 'T', '5'); break;
+	case BlockFormat::BC7: header.ddspf.fourCC = MakeFourCC('D', 'X', '1', '0'); break;
+	}
+
+	std::vector<std::uint8_t> file;
+	Append(file, DdsMagic);
+	Append(file, header);
+
+	if (format == BlockFormat::BC7)
+	{
+		DdsHeaderDxt10 ext = {};
+		ext.dxgiFormat = (std::uint32_t)DdsFormat::BC7_UNORM;
+		ext.resourceDimension = (std::uint32_t)DdsDimension::Texture2D;
+		ext.arraySize = 1;
+		Append(file, ext);
+	}
+
+	for (const Image& mip : mips)
+	{
+		std::vector<std::uint8_t> blocks = CompressSurface(mip.Pixels.data(), mip.Width, mip.Height, format);
+		file.insert(file.end(), blocks.begin(), blocks.end());
+	}
+
+	return file;
+}
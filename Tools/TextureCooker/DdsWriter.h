@@ -0,0 +1,14 @@
+//***************************************************************************************
+// DdsWriter.h
+//
+// Serialises a compressed mip chain as a DDS file.  BC1 and BC3 use the legacy DXT1 and
+// DXT5 FourCCs so any DDS reader accepts them; BC7 needs the DX10 extended header.
+//***************************************************************************************
+
+#pragma once
+
+#include "BlockCompress.h"
+#include "MipChain.h"
+
+// Compresses every level of mips and returns the complete file.
+std::vector<std::uint8_t> BuildDds(const std::vector<Image>& mips, BlockFormat format);
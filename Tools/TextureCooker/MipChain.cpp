@@ -0,0 +1,100 @@
+//***************************************************************************************
+// MipChain.cpp
+//***************************************************************************************
+
+#include "MipChain.h"
+#include <algorithm>
+#include <utility>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MIPCHAIN_SSE2 1
+#else
+#define MIPCHAIN_SSE2 0
+#endif
+
+bool Image::HasAlpha()const
+{
+	for (std::size_t i = 3; i < Pixels.size(); i += 4)
+	{
+		if (Pixels[i] != 255)
+			return true;
+	}
+	return false;
+}
+
+Image Downsample(const Image& src)
+{
+	Image dst;
+	dst.Width = std::max(1u, src.Width / 2);
+	dst.Height = std::max(1u, src.Height / 2);
+	dst.Pixels.resize((std::size_t)dst.Width * dst.Height * 4);
+
+	const std::size_t srcPitch = (std::size_t)src.Width * 4;
+
+	for (std::uint32_t y = 0; y < dst.Height; ++y)
+	{
+		const std::uint8_t* row0 = src.Pixels.data() + std::min(2 * y, src.Height - 1) * srcPitch;
+		const std::uint8_t* row1 = src.Pixels.data() + std::min(2 * y + 1, src.Height - 1) * srcPitch;
+		std::uint8_t* out = dst.Pixels.data() + (std::size_t)y * dst.Width * 4;
+
+		std::uint32_t x = 0;
+
+#if MIPCHAIN_SSE2
+		// Four output texels from eight input texels per row.  Only valid while the
+		// right-hand column of each 2x2 footprint exists.
+		if (src.Width >= 2)
+		{
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i two = _mm_set1_epi16(2);
+			const std::uint32_t fullPairs = src.Width / 2;
+
+			for (; x + 4 <= std::min(dst.Width, fullPairs); x += 4)
+			{
+				__m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8));
+				__m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8 + 16));
+				__m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+				__m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8 + 16));
+
+				// Vertical sums in 16 bits, two input texels per register.
+				__m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+				__m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+				__m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+				__m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+				// Horizontal sums: add each register's high texel to its low texel.
+				s0 = _mm_add_epi16(s0, _mm_srli_si128(s0, 8));
+				s1 = _mm_add_epi16(s1, _mm_srli_si128(s1, 8));
+				s2 = _mm_add_epi16(s2, _mm_srli_si128(s2, 8));
+				s3 = _mm_add_epi16(s3, _mm_srli_si128(s3, 8));
+
+				__m128i d01 = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(s0, s1), two), 2);
+				__m128i d23 = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(s2, s3), two), 2);
+
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), _mm_packus_epi16(d01, d23));
+			}
+		}
+#endif
+
+		for (; x < dst.Width; ++x)
+		{
+			const std::size_t x0 = (std::size_t)std::min(2 * x, src.Width - 1) * 4;
+			const std::size_t x1 = (std::size_t)std::min(2 * x + 1, src.Width - 1) * 4;
+			for (int c = 0; c < 4; ++c)
+				out[x * 4 + c] = (std::uint8_t)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+		}
+	}
+
+	return dst;
+}
+
+std::vector<Image> GenerateMipChain(Image base)
+{
+	std::vector<Image> mips;
+	mips.push_back(std::move(base));
+
+	while (mips.back().Width > 1 || mips.back().Height > 1)
+		mips.push_back(Downsample(mips.back()));
+
+	return mips;
+}
@@ -0,0 +1,26 @@
+//***************************************************************************************
+// MipChain.h
+//
+// RGBA8 images and mip chain generation for the texture cooker.  Each level is a 2x2
+// box filter of the one above, with SSE2 doing four output texels at a time.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+struct Image
+{
+	std::uint32_t Width = 0;
+	std::uint32_t Height = 0;
+	std::vector<std::uint8_t> Pixels; // RGBA8, rows tightly packed
+
+	bool HasAlpha()const;
+};
+
+// Halves both dimensions (never below 1).  Odd edges repeat their last row/column.
+Image Downsample(const Image& src);
+
+// Returns base followed by every smaller level down to 1x1.
+std::vector<Image> GenerateMipChain(Image base);
@@ -0,0 +1,348 @@
+//***************************************************************************************
+// TextureCooker.cpp
+//
+// Offline converter from JPG/PNG sources to block-compressed DDS files with full mip
+// chains, ready for CreateDDSTextureFromFile12 and TextureLoader.
+//
+// Usage: TextureCooker <source dir> <output dir> [-format auto|bc1|bc3|bc7] [-force]
+//
+// Every .jpg, .jpeg and .png under the source directory is decoded with WIC, mipped,
+// compressed and written to the same relative path under the output directory with a
+// .dds extension.  "auto" picks BC1 for opaque images and BC3 for images with alpha.
+// Direct3D requires the top mip of a block-compressed texture to be a whole number of
+// 4x4 blocks, so sources whose sides are not multiples of 4 are scaled up to the next
+// ones (750x750 is cooked at 752x752).
+// Files are cooked in parallel.  The output directory keeps a manifest of source
+// content hashes, so a rerun only cooks sources whose bytes or settings changed.
+//***************************************************************************************
+
+#include "DdsWriter.h"
+#include "DdsImage.h"
+#include "MappedFile.h"
+
+#include <windows.h>
+#include <wincodec.h>
+#include <wrl.h>
+#include <ppl.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cwctype>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#pragma comment(lib, "windowscodecs.lib")
+
+using Microsoft::WRL::ComPtr;
+namespace fs = std::filesystem;
+
+// Bump when the encoders or filters change so every output is cooked again.
+static const int CookerVersion = 2;
+
+static const wchar_t* ManifestName = L"cook.manifest";
+
+enum class FormatChoice
+{
+	Auto,
+	BC1,
+	BC3,
+	BC7
+};
+
+struct CookJob
+{
+	fs::path Source;
+	fs::path Output;
+	std::wstring Key;        // output path relative to the output directory
+	std::uint64_t Hash = 0;  // source bytes and settings
+	bool Skipped = false;
+	std::string Error;
+	std::uint64_t SourceBytes = 0;
+	std::uint64_t OutputBytes = 0;
+};
+
+static void Check(HRESULT hr, const char* what)
+{
+	if (FAILED(hr))
+	{
+		char text[128];
+		std::snprintf(text, sizeof(text), "%s failed (hr 0x%08lx)", what, (unsigned long)hr);
+		throw std::runtime_error(text);
+	}
+}
+
+static std::uint64_t HashBytes(const std::uint8_t* data, std::uint64_t size, std::uint64_t hash = 14695981039346656037ull)
+{
+	for (std::uint64_t i = 0; i < size; ++i)
+	{
+		hash ^= data[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static Image DecodeImage(IWICImagingFactory* factory, const MappedFile& file)
+{
+	ComPtr<IWICStream> stream;
+	Check(factory->CreateStream(&stream), "CreateStream");
+	Check(stream->InitializeFromMemory(const_cast<BYTE*>(file.Data()), (DWORD)file.Size()), "InitializeFromMemory");
+
+	ComPtr<IWICBitmapDecoder> decoder;
+	Check(factory->CreateDecoderFromStream(stream.Get(), nullptr, WICDecodeMetadataCacheOnDemand, &decoder),
+		"CreateDecoderFromStream");
+
+	ComPtr<IWICBitmapFrameDecode> frame;
+	Check(decoder->GetFrame(0, &frame), "GetFrame");
+
+	ComPtr<IWICBitmapSource> rgba;
+	Check(WICConvertBitmapSource(GUID_WICPixelFormat32bppRGBA, frame.Get(), &rgba), "WICConvertBitmapSource");
+
+	UINT width = 0;
+	UINT height = 0;
+	Check(rgba->GetSize(&width, &height), "GetSize");
+
+	// D3D12_REQ_TEXTURE2D_U_OR_V_DIMENSION.
+	if (width > 16384 || height > 16384)
+		throw std::runtime_error("image is larger than 16384 texels");
+
+	// Whole 4x4 blocks in the top mip; the smaller mips may end in partial blocks.
+	Image image;
+	image.Width = (width + 3) & ~3u;
+	image.Height = (height + 3) & ~3u;
+
+	ComPtr<IWICBitmapSource> source = rgba;
+	if (image.Width != width || image.Height != height)
+	{
+		ComPtr<IWICBitmapScaler> scaler;
+		Check(factory->CreateBitmapScaler(&scaler), "CreateBitmapScaler");
+		Check(scaler->Initialize(rgba.Get(), image.Width, image.Height, WICBitmapInterpolationModeFant), "IWICBitmapScaler::Initialize");
+		source = scaler;
+	}
+
+	image.Pixels.resize((std::size_t)image.Width * image.Height * 4);
+	Check(source->CopyPixels(nullptr, image.Width * 4, (UINT)image.Pixels.size(), image.Pixels.data()), "CopyPixels");
+
+	return image;
+}
+
+static void Cook(IWICImagingFactory* factory, const MappedFile& file, CookJob& job, FormatChoice choice)
+{
+	Image base = DecodeImage(factory, file);
+
+	BlockFormat format = BlockFormat::BC7;
+	switch (choice)
+	{
+	case FormatChoice::Auto: format = base.HasAlpha() ? BlockFormat::BC3 : BlockFormat::BC1; break;
+	case FormatChoice::BC1:  format = BlockFormat::BC1; break;
+	case FormatChoice::BC3:  format = BlockFormat::BC3; break;
+	case FormatChoice::BC7:  format = BlockFormat::BC7; break;
+	}
+
+	std::vector<std::uint8_t> dds = BuildDds(GenerateMipChain(std::move(base)), format);
+
+	// Check the file with the same parser the runtime uses before writing it.
+	DdsImage check;
+	DdsResult result = check.Parse(dds.data(), dds.size());
+	if (result != DdsResult::Ok)
+		throw std::runtime_error(std::string("cooked file does not parse: ") + DdsResultName(result));
+
+	fs::create_directories(job.Output.parent_path());
+	std::ofstream fout(job.Output, std::ios::binary | std::ios::trunc);
+	fout.write(reinterpret_cast<const char*>(dds.data()), (std::streamsize)dds.size());
+	if (!fout)
+		throw std::runtime_error("cannot write output");
+
+	job.OutputBytes = dds.size();
+}
+
+static std::map<std::wstring, std::uint64_t> ReadManifest(const fs::path& path)
+{
+	std::map<std::wstring, std::uint64_t> manifest;
+
+	std::wifstream fin(path);
+	std::wstring line;
+	while (std::getline(fin, line))
+	{
+		// <16 hex digits> <relative output path>
+		if (line.size() < 18)
+			continue;
+		manifest[line.substr(17)] = std::wcstoull(line.substr(0, 16).c_str(), nullptr, 16);
+	}
+
+	return manifest;
+}
+
+static void WriteManifest(const fs::path& path, const std::map<std::wstring, std::uint64_t>& manifest)
+{
+	std::wofstream fout(path, std::ios::trunc);
+	for (const auto& entry : manifest)
+	{
+		wchar_t hash[17];
+		swprintf_s(hash, L"%016llx", (unsigned long long)entry.second);
+		fout << hash << L' ' << entry.first << L'\n';
+	}
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+	if (argc < 3)
+	{
+		std::fwprintf(stderr, L"usage: %s <source dir> <output dir> [-format auto|bc1|bc3|bc7] [-force]\n", argv[0]);
+		return 1;
+	}
+
+	const fs::path sourceDir = argv[1];
+	const fs::path outputDir = argv[2];
+	FormatChoice choice = FormatChoice::Auto;
+	bool force = false;
+
+	for (int i = 3; i < argc; ++i)
+	{
+		std::wstring arg = argv[i];
+		if (arg == L"-force")
+		{
+			force = true;
+		}
+		else if (arg == L"-format" && i + 1 < argc)
+		{
+			std::wstring value = argv[++i];
+			if (value == L"auto")     choice = FormatChoice::Auto;
+			else if (value == L"bc1") choice = FormatChoice::BC1;
+			else if (value == L"bc3") choice = FormatChoice::BC3;
+			else if (value == L"bc7") choice = FormatChoice::BC7;
+			else
+			{
+				std::fwprintf(stderr, L"unknown format %s\n", value.c_str());
+				return 1;
+			}
+		}
+		else
+		{
+			std::fwprintf(stderr, L"unknown option %s\n", arg.c_str());
+			return 1;
+		}
+	}
+
+	std::vector<CookJob> jobs;
+	std::error_code ec;
+	for (const auto& entry : fs::recursive_directory_iterator(sourceDir, ec))
+	{
+		std::wstring ext = entry.path().extension().wstring();
+		std::transform(ext.begin(), ext.end(), ext.begin(), [](wchar_t c) { return (wchar_t)std::towlower(c); });
+		if (!entry.is_regular_file() || (ext != L".jpg" && ext != L".jpeg" && ext != L".png"))
+			continue;
+
+		CookJob job;
+		job.Source = entry.path();
+		job.Output = outputDir / fs::relative(entry.path(), sourceDir).replace_extension(L".dds");
+		job.Key = fs::relative(job.Output, outputDir).generic_wstring();
+		jobs.push_back(std::move(job));
+	}
+
+	if (ec)
+	{
+		std::fwprintf(stderr, L"cannot read %s\n", sourceDir.c_str());
+		return 1;
+	}
+
+	const fs::path manifestPath = outputDir / ManifestName;
+	std::map<std::wstring, std::uint64_t> manifest = ReadManifest(manifestPath);
+
+	// The settings are part of the hash, so changing them re-cooks everything.
+	const std::uint64_t settings[] = { (std::uint64_t)CookerVersion, (std::uint64_t)choice };
+	const std::uint64_t settingsHash = HashBytes(reinterpret_cast<const std::uint8_t*>(settings), sizeof(settings));
+
+	concurrency::parallel_for(size_t(0), jobs.size(), [&](size_t i)
+	{
+		CookJob& job = jobs[i];
+
+		// WIC is COM; PPL worker threads are not initialised for it.
+		HRESULT coInit = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+		try
+		{
+			MappedFile source;
+			if (!source.Open(job.Source.c_str()))
+				throw std::runtime_error("cannot open source (error " + std::to_string(source.Error()) + ")");
+			job.Hash = HashBytes(source.Data(), source.Size(), settingsHash);
+			job.SourceBytes = source.Size();
+
+			auto previous = manifest.find(job.Key);
+			if (!force && previous != manifest.end() && previous->second == job.Hash && fs::exists(job.Output))
+			{
+				job.Skipped = true;
+			}
+			else
+			{
+				ComPtr<IWICImagingFactory> factory;
+				Check(CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory)),
+					"CoCreateInstance(WICImagingFactory)");
+				Cook(factory.Get(), source, job, choice);
+			}
+		}
+		catch (const std::exception& e)
+		{
+			job.Error = e.what();
+		}
+
+		if (SUCCEEDED(coInit))
+			CoUninitialize();
+	});
+
+	int cooked = 0;
+	int skipped = 0;
+	int failed = 0;
+	std::uint64_t sourceBytes = 0;
+	std::uint64_t outputBytes = 0;
+	std::uint64_t uncompressedBytes = 0;
+
+	for (const CookJob& job : jobs)
+	{
+		if (!job.Error.empty())
+		{
+			std::fwprintf(stderr, L"%s: %S\n", job.Source.c_str(), job.Error.c_str());
+			manifest.erase(job.Key);
+			++failed;
+			continue;
+		}
+
+		manifest[job.Key] = job.Hash;
+		if (job.Skipped)
+		{
+			++skipped;
+			continue;
+		}
+
+		++cooked;
+		sourceBytes += job.SourceBytes;
+		outputBytes += job.OutputBytes;
+
+		DdsImage check;
+		MappedFile output;
+		if (output.Open(job.Output.c_str()) && check.Parse(output.Data(), output.Size()) == DdsResult::Ok)
+		{
+			// What the same mip chain would occupy as RGBA8.
+			for (const DdsSubresource& sub : check.Subresources())
+				uncompressedBytes += (std::uint64_t)sub.Width * sub.Height * 4;
+		}
+
+		std::wprintf(L"cooked %s\n", job.Key.c_str());
+	}
+
+	WriteManifest(manifestPath, manifest);
+
+	std::wprintf(L"%d cooked, %d up to date, %d failed\n", cooked, skipped, failed);
+	if (cooked > 0 && outputBytes > 0)
+	{
+		std::wprintf(L"%llu bytes of sources -> %llu bytes of DDS (%.1fx smaller than RGBA8 with mips)\n",
+			(unsigned long long)sourceBytes, (unsigned long long)outputBytes,
+			(double)uncompressedBytes / (double)outputBytes);
+	}
+
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,226 @@
+//***************************************************************************************
+// TexturePacker.cpp
+//
+// Build-time packer that merges small 2D textures into texture arrays.
+//
+// Usage: TexturePacker <output dir> <texture.dds>...
+//
+// Inputs with the same format, size, mip count and alpha mode are grouped. Each group
+// of two or more is written to the output directory as one Texture2DArray DDS, with
+// one slice per input in command-line order. Inputs that match nothing are left
+// alone.
+//
+// The output directory also gets textures.pack, a tab-separated manifest with one
+// line per packed input:
+//
+//     <input file name>	<array file name>	<slice>
+//
+// The app reads the manifest at startup and draws each packed texture from its array
+// slice, so those materials share one resource and one descriptor.
+//***************************************************************************************
+
+#include "DdsImage.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+	const std::uint32_t DdsMagic = 0x20534444; // "DDS "
+
+	const std::uint32_t DdsdCaps = 0x1;
+	const std::uint32_t DdsdHeight = 0x2;
+	const std::uint32_t DdsdWidth = 0x4;
+	const std::uint32_t DdsdPixelFormat = 0x1000;
+	const std::uint32_t DdsdMipMapCount = 0x20000;
+
+	const std::uint32_t DdpfFourCC = 0x4;
+
+	const std::uint32_t DdsCapsComplex = 0x8;
+	const std::uint32_t DdsCapsTexture = 0x1000;
+	const std::uint32_t DdsCapsMipMap = 0x400000;
+
+	const std::uint32_t FourCCDX10 = 0x30315844; // "DX10"
+
+	const char* ManifestName = "textures.pack";
+
+	struct Input
+	{
+		fs::path Path;
+		MappedFile File;
+		DdsImage Image;
+	};
+
+	// Textures can share an array only if every one of these matches.
+	using GroupKey = std::tuple<DdsFormat, std::uint32_t, std::uint32_t, std::uint32_t, DdsAlphaMode>;
+
+	template<typename T>
+	void Append(std::vector<std::uint8_t>& file, const T& value)
+	{
+		const std::uint8_t* bytes = reinterpret_cast<const std::uint8_t*>(&value);
+		file.insert(file.end(), bytes, bytes + sizeof(T));
+	}
+
+	// A DDS with a DX10 header holding every slice of members, mip chains in order.
+	std::vector<std::uint8_t> BuildArray(const std::vector<const Input*>& members)
+	{
+		const DdsImage& first = members.front()->Image;
+
+		DdsHeader header;
+		std::memset(&header, 0, sizeof(header));
+		header.size = sizeof(DdsHeader);
+		header.flags = DdsdCaps | DdsdHeight | DdsdWidth | DdsdPixelFormat | DdsdMipMapCount;
+		header.height = first.Height();
+		header.width = first.Width();
+		header.mipMapCount = first.MipLevels();
+		header.ddspf.size = sizeof(DdsPixelFormat);
+		header.ddspf.flags = DdpfFourCC;
+		header.ddspf.fourCC = FourCCDX10;
+		header.caps = DdsCapsTexture | DdsCapsComplex | (first.MipLevels() > 1 ? DdsCapsMipMap : 0);
+
+		DdsHeaderDxt10 ext = {};
+		ext.dxgiFormat = (std::uint32_t)first.Format();
+		ext.resourceDimension = (std::uint32_t)DdsDimension::Texture2D;
+		ext.arraySize = (std::uint32_t)members.size();
+		ext.miscFlags2 = (std::uint32_t)first.AlphaMode();
+
+		std::vector<std::uint8_t> file;
+		Append(file, DdsMagic);
+		Append(file, header);
+		Append(file, ext);
+
+		for (const Input* member : members)
+		{
+			const DdsImage& image = member->Image;
+			for (std::size_t i = 0; i < image.Subresources().size(); ++i)
+			{
+				const std::uint8_t* data = image.SubresourceData(i);
+				file.insert(file.end(), data, data + image.Subresources()[i].SlicePitch);
+			}
+		}
+
+		return file;
+	}
+
+	std::string Lower(std::string text)
+	{
+		std::transform(text.begin(), text.end(), text.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+		return text;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		std::fprintf(stderr, "usage: %s <output dir> <texture.dds>...\n", argv[0]);
+		return 1;
+	}
+
+	const fs::path outputDir = argv[1];
+
+	std::vector<Input> inputs(argc - 2);
+	std::map<GroupKey, std::vector<const Input*>> groups;
+	int failed = 0;
+
+	for (int i = 2; i < argc; ++i)
+	{
+		Input& input = inputs[i - 2];
+		input.Path = argv[i];
+
+		if (!input.File.Open(argv[i]))
+		{
+			std::fprintf(stderr, "%s: cannot open (error %lu)\n", argv[i], (unsigned long)input.File.Error());
+			++failed;
+			continue;
+		}
+
+		DdsResult result = input.Image.Parse(input.File.Data(), input.File.Size());
+		if (result != DdsResult::Ok)
+		{
+			std::fprintf(stderr, "%s: %s\n", argv[i], DdsResultName(result));
+			++failed;
+			continue;
+		}
+
+		const DdsImage& image = input.Image;
+		if (image.Dimension() != DdsDimension::Texture2D || image.ArraySize() != 1 || image.IsCubeMap())
+		{
+			std::printf("skipped %s (not a single 2D texture)\n", argv[i]);
+			continue;
+		}
+
+		groups[GroupKey(image.Format(), image.Width(), image.Height(), image.MipLevels(), image.AlphaMode())].push_back(&input);
+	}
+
+	if (failed > 0)
+		return 1;
+
+	std::error_code ec;
+	fs::create_directories(outputDir, ec);
+
+	std::ofstream manifest(outputDir / ManifestName, std::ios::trunc);
+	manifest << "# TexturePacker output: <input file>\t<array file>\t<slice>\n";
+
+	int arrays = 0;
+	int packed = 0;
+	for (const auto& group : groups)
+	{
+		const std::vector<const Input*>& members = group.second;
+		if (members.size() < 2)
+			continue;
+
+		const DdsImage& first = members.front()->Image;
+		char name[96];
+		std::snprintf(name, sizeof(name), "array_%ux%u_f%u_m%u_a%u.dds", first.Width(), first.Height(),
+			(unsigned)first.Format(), first.MipLevels(), (unsigned)first.AlphaMode());
+
+		std::vector<std::uint8_t> dds = BuildArray(members);
+
+		// Check the file with the same parser the runtime uses before writing it.
+		DdsImage check;
+		DdsResult result = check.Parse(dds.data(), dds.size());
+		if (result != DdsResult::Ok || check.ArraySize() != members.size())
+		{
+			std::fprintf(stderr, "%s: packed array does not parse: %s\n", name, DdsResultName(result));
+			return 1;
+		}
+
+		std::ofstream fout(outputDir / name, std::ios::binary | std::ios::trunc);
+		fout.write(reinterpret_cast<const char*>(dds.data()), (std::streamsize)dds.size());
+		if (!fout)
+		{
+			std::fprintf(stderr, "%s: cannot write output\n", name);
+			return 1;
+		}
+
+		for (std::size_t slice = 0; slice < members.size(); ++slice)
+		{
+			manifest << Lower(members[slice]->Path.filename().string()) << '\t' << name << '\t' << slice << '\n';
+			std::printf("packed %s -> %s[%zu]\n", members[slice]->Path.string().c_str(), name, slice);
+		}
+
+		++arrays;
+		packed += (int)members.size();
+	}
+
+	if (!manifest)
+	{
+		std::fprintf(stderr, "cannot write %s\n", ManifestName);
+		return 1;
+	}
+
+	std::printf("%d textures packed into %d arrays\n", packed, arrays);
+	return 0;
+}